@@ -36,6 +36,7 @@
 #include <gflags/gflags.h>
 #include <time.h>
 #include <theia/theia.h>
+#include <algorithm>
 #include <chrono>  // NOLINT
 #include <string>
 #include <vector>
@@ -53,6 +54,11 @@ DEFINE_string(
     "File to write the two-view matches to. This file can be used in "
     "future iterations as input to the reconstruction builder. Leave empty if "
     "you do not want to output matches.");
+DEFINE_bool(resume_matching, false,
+            "If true, the matched image pairs are recorded in a journal next "
+            "to --output_matches_file. If matching is interrupted, running "
+            "again with the same images skips the pairs that were already "
+            "matched and appends the new matches to the matches file.");
 DEFINE_string(
     output_reconstruction, "",
     "Filename to write reconstruction to. The filename will be appended with "
@@ -66,24 +72,122 @@ DEFINE_int32(num_threads, 1,
 DEFINE_string(
     descriptor, "SIFT",
     "Type of feature descriptor to use. Must be one of the following: "
-    "SIFT");
+    "SIFT, AKAZE, or AKAZE_MLDB (binary AKAZE descriptors).");
 DEFINE_string(feature_density, "NORMAL",
               "Set to SPARSE, NORMAL, or DENSE to extract fewer or more "
               "features from each image.");
+DEFINE_int32(num_decoding_threads, 0,
+             "Number of threads that read and decode the images. The decoded "
+             "images are queued for the num_threads feature extraction "
+             "threads. If 0, each image is decoded by the thread that "
+             "extracts its features.");
+DEFINE_int32(max_num_queued_images, 4,
+             "Maximum number of decoded images that wait for a feature "
+             "extraction thread.");
+DEFINE_int32(max_image_dimension, 0,
+             "If positive, images whose width or height is larger are decoded "
+             "at a reduced resolution so that neither is larger. The keypoints "
+             "are written in the pixel coordinates of the full resolution "
+             "images.");
+DEFINE_int32(max_decoded_image_memory_mb, 0,
+             "Maximum number of megabytes of decoded images that are queued or "
+             "used by feature extraction. Set to 0 to only limit the number of "
+             "queued images.");
+DEFINE_bool(parallelize_large_images, false,
+            "If true, the SIFT features of each large image are extracted "
+            "with --num_threads additional threads so that a few very large "
+            "images use all threads. The features are the same.");
 DEFINE_string(matching_strategy, "CASCADE_HASHING",
-              "Strategy used to match features. Must be BRUTE_FORCE "
-              " or CASCADE_HASHING");
+              "Strategy used to match features. Must be BRUTE_FORCE,"
+              " CASCADE_HASHING, KD_TREE, BRUTE_FORCE_HAMMING, or"
+              " MULTI_INDEX_HASHING. The last two are for binary descriptors.");
 DEFINE_bool(match_out_of_core, true,
             "Perform matching out of core by saving features to disk and "
             "reading them as needed. Set to false to perform matching all in "
             "memory.");
+DEFINE_bool(overlap_extraction_and_matching, false,
+            "If true, the features of the images are extracted while other "
+            "images are matched instead of before matching. Ignored if image "
+            "retrieval is used.");
 DEFINE_string(matching_working_directory, "",
               "Directory used during matching to store features for "
               "out-of-core matching.");
+DEFINE_string(packed_features_file, "",
+              "Packed feature store written by extract_features "
+              "--packed_features_file. The features of the images in the store "
+              "are read from it (without copying the descriptors) instead of "
+              "being extracted.");
 DEFINE_int32(matching_max_num_images_in_cache, 128,
              "Maximum number of images to store in the LRU cache during "
              "feature matching. The higher this number is the more memory is "
              "consumed during matching.");
+DEFINE_int32(matching_max_cache_size_mb, 0,
+             "Maximum number of megabytes of features to store in the LRU "
+             "cache during feature matching. Set to 0 to only limit the cache "
+             "by the number of images.");
+DEFINE_string(matching_descriptor_precision, "FLOAT32",
+              "Precision used to store the descriptors in the LRU cache and on "
+              "disk during feature matching. Set to FLOAT32, FLOAT16, UINT8, "
+              "or BINARY. Lower precision allows more images to fit in the "
+              "cache. UINT8 is intended for SIFT descriptors and BINARY for "
+              "AKAZE_MLDB descriptors, which must be matched with the "
+              "BRUTE_FORCE_HAMMING or MULTI_INDEX_HASHING strategies.");
+DEFINE_int32(matching_num_retrieved_images, 0,
+             "If positive, each image is only matched with this many of its "
+             "most similar images according to a vocabulary tree instead of "
+             "being matched with all other images.");
+DEFINE_string(vocabulary_tree_file, "",
+              "File of the vocabulary tree used to find similar images. If the "
+              "file does not exist, a vocabulary tree is trained on the "
+              "features of the images and written to it.");
+DEFINE_int32(vocabulary_tree_branching_factor, 10,
+             "Number of children of each node of the vocabulary tree.");
+DEFINE_int32(vocabulary_tree_depth, 5,
+             "Number of levels of the vocabulary tree.");
+DEFINE_int32(matching_num_nearest_neighbors_by_gps, 0,
+             "If positive, each image with GPS coordinates in its EXIF data is "
+             "matched with this many of the images that are closest to it.");
+DEFINE_double(matching_max_gps_distance_meters, 0.0,
+              "If positive, each image with GPS coordinates in its EXIF data "
+              "is matched with all images within this distance of it.");
+DEFINE_int32(matching_sequential_window_size, 0,
+             "If positive, each image is matched with this many of the images "
+             "that follow it in capture order (i.e., the sorted order of the "
+             "image filenames). Useful for video sequences.");
+DEFINE_int32(matching_loop_closure_interval, 0,
+             "If positive, every n-th image in capture order is matched with "
+             "all other n-th images to find loop closures.");
+DEFINE_int32(num_matching_shards, 1,
+             "If greater than 1, matching is distributed over this many "
+             "processes. Each process matches only the image pairs of shard "
+             "--matching_shard_index, writes the matches to "
+             "--output_matches_file, and exits without building a "
+             "reconstruction. The shard files are combined with "
+             "merge_matches. All processes must be given the same images and "
+             "matching options. The features must be extracted beforehand "
+             "with extract_features into a shared "
+             "--matching_working_directory or --packed_features_file. With "
+             "image retrieval, shard 0 trains the --vocabulary_tree_file and "
+             "must be run before the other shards.");
+DEFINE_int32(matching_shard_index, 0,
+             "Index of the shard of image pairs matched by this process, in "
+             "[0, --num_matching_shards).");
+DEFINE_string(matching_shard_strategy, "IMAGE_BLOCKS",
+              "How image pairs are split into shards. Set to PAIRS to split "
+              "the list of image pairs into consecutive ranges, or to "
+              "IMAGE_BLOCKS to give each shard the pairs between a few groups "
+              "of images so that it reads the features of fewer images.");
+DEFINE_bool(preemptive_matching, false,
+            "If true, each image pair is first matched with only the "
+            "--preemptive_matching_num_features largest features of each "
+            "image, and pairs with fewer than "
+            "--preemptive_matching_min_num_matches matches are rejected "
+            "without matching all features.");
+DEFINE_int32(preemptive_matching_num_features, 100,
+             "Number of features per image used for preemptive matching.");
+DEFINE_int32(preemptive_matching_min_num_matches, 4,
+             "Minimum number of preemptive matches for an image pair to be "
+             "matched with all features.");
 DEFINE_double(lowes_ratio, 0.8, "Lowes ratio used for feature matching.");
 DEFINE_double(max_sampson_error_for_verified_match, 4.0,
               "Maximum sampson error for a match to be considered "
@@ -227,16 +331,60 @@ ReconstructionBuilderOptions SetReconstructionBuilderOptions() {
   ReconstructionBuilderOptions options;
   options.num_threads = FLAGS_num_threads;
   options.output_matches_file = FLAGS_output_matches_file;
+  options.resume_matching = FLAGS_resume_matching;
 
   options.descriptor_type = StringToDescriptorExtractorType(FLAGS_descriptor);
   options.feature_density = StringToFeatureDensity(FLAGS_feature_density);
+  options.image_decoding_options.num_decoding_threads =
+      FLAGS_num_decoding_threads;
+  options.image_decoding_options.max_num_queued_images =
+      FLAGS_max_num_queued_images;
+  options.image_decoding_options.max_image_memory_bytes =
+      static_cast<size_t>(FLAGS_max_decoded_image_memory_mb) * 1024 * 1024;
+  options.image_decoding_options.max_image_dimension =
+      FLAGS_max_image_dimension;
+  options.parallelize_large_images = FLAGS_parallelize_large_images;
   options.matching_options.match_out_of_core = FLAGS_match_out_of_core;
+  options.overlap_extraction_and_matching =
+      FLAGS_overlap_extraction_and_matching;
   options.matching_options.keypoints_and_descriptors_output_dir =
       FLAGS_matching_working_directory;
+  options.matching_options.packed_features_file = FLAGS_packed_features_file;
   options.matching_options.cache_capacity =
       FLAGS_matching_max_num_images_in_cache;
+  if (FLAGS_matching_max_cache_size_mb > 0) {
+    options.matching_options.cache_capacity_in_bytes =
+        static_cast<size_t>(FLAGS_matching_max_cache_size_mb) * 1024 * 1024;
+  }
+  options.matching_options.descriptor_precision =
+      StringToDescriptorPrecision(FLAGS_matching_descriptor_precision);
   options.matching_strategy =
       StringToMatchingStrategyType(FLAGS_matching_strategy);
+  options.matching_options.image_retrieval_num_neighbors =
+      FLAGS_matching_num_retrieved_images;
+  options.matching_options.vocabulary_tree_file = FLAGS_vocabulary_tree_file;
+  options.matching_options.vocabulary_tree_options.branching_factor =
+      FLAGS_vocabulary_tree_branching_factor;
+  options.matching_options.vocabulary_tree_options.depth =
+      FLAGS_vocabulary_tree_depth;
+  options.matching_options.perform_preemptive_matching =
+      FLAGS_preemptive_matching;
+  options.matching_options.preemptive_matching_num_features =
+      FLAGS_preemptive_matching_num_features;
+  options.matching_options.preemptive_matching_min_num_matches =
+      FLAGS_preemptive_matching_min_num_matches;
+  options.matching_options.num_shards = FLAGS_num_matching_shards;
+  options.matching_options.shard_index = FLAGS_matching_shard_index;
+  options.matching_options.shard_strategy =
+      StringToMatchingShardStrategy(FLAGS_matching_shard_strategy);
+  options.image_pair_selection_options.num_nearest_neighbors_by_position =
+      FLAGS_matching_num_nearest_neighbors_by_gps;
+  options.image_pair_selection_options.max_distance_between_positions =
+      FLAGS_matching_max_gps_distance_meters;
+  options.image_pair_selection_options.sequential_window_size =
+      FLAGS_matching_sequential_window_size;
+  options.image_pair_selection_options.loop_closure_interval =
+      FLAGS_matching_loop_closure_interval;
   options.matching_options.lowes_ratio = FLAGS_lowes_ratio;
   options.matching_options.keep_only_symmetric_matches =
       FLAGS_keep_only_symmetric_matches;
@@ -342,16 +490,14 @@ ReconstructionBuilderOptions SetReconstructionBuilderOptions() {
 
 void AddMatchesToReconstructionBuilder(
     ReconstructionBuilder* reconstruction_builder) {
-  // Load matches from file.
-  std::vector<std::string> image_files;
-  std::vector<theia::CameraIntrinsicsPrior> camera_intrinsics_prior;
-  std::vector<theia::ImagePairMatch> image_matches;
-
-  // Read in match file.
-  theia::ReadMatchesAndGeometry(FLAGS_matches_file,
-                                &image_files,
-                                &camera_intrinsics_prior,
-                                &image_matches);
+  // Open the match file. The matches are read chunk by chunk so that they do
+  // not have to be held in memory all at once.
+  theia::MatchesReader matches_reader;
+  CHECK(matches_reader.Open(FLAGS_matches_file))
+      << "Could not read the matches file " << FLAGS_matches_file;
+  const std::vector<std::string>& image_files = matches_reader.view_names();
+  const std::vector<theia::CameraIntrinsicsPrior>& camera_intrinsics_prior =
+      matches_reader.camera_intrinsics_prior();
 
   // Add all the views. When the intrinsics group id is invalid, the
   // reconstruction builder will assume that the view does not share its
@@ -368,10 +514,13 @@ void AddMatchesToReconstructionBuilder(
   }
 
   // Add the matches.
-  for (const auto& match : image_matches) {
-    CHECK(reconstruction_builder->AddTwoViewMatch(match.image1,
-                                                  match.image2,
-                                                  match));
+  std::vector<theia::ImagePairMatch> image_matches;
+  while (matches_reader.ReadNextChunk(&image_matches)) {
+    for (const auto& match : image_matches) {
+      CHECK(reconstruction_builder->AddTwoViewMatch(match.image1,
+                                                    match.image2,
+                                                    match));
+    }
   }
 }
 
@@ -383,6 +532,8 @@ void AddImagesToReconstructionBuilder(
       << ". NOTE that the ~ filepath is not supported.";
 
   CHECK_GT(image_files.size(), 0) << "No images found in: " << FLAGS_images;
+  // Add the images in capture order for sequential image pair selection.
+  std::sort(image_files.begin(), image_files.end());
 
   // Load calibration file if it is provided.
   std::unordered_map<std::string, theia::CameraIntrinsicsPrior>
@@ -456,7 +607,7 @@ int main(int argc, char *argv[]) {
   THEIA_GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
   google::InitGoogleLogging(argv[0]);
 
-  CHECK_GT(FLAGS_output_reconstruction.size(), 0)
+  CHECK(FLAGS_output_reconstruction.size() > 0 || FLAGS_num_matching_shards > 1)
       << "Must specify a filepath to output the reconstruction.";
 
   const ReconstructionBuilderOptions options =
@@ -467,7 +618,22 @@ int main(int argc, char *argv[]) {
   if (FLAGS_matches_file.size() != 0) {
     AddMatchesToReconstructionBuilder(&reconstruction_builder);
   } else if (FLAGS_images.size() != 0) {
+    // A shard of the matches is not enough to build a reconstruction, so only
+    // the matches of the shard are written.
+    if (FLAGS_num_matching_shards > 1) {
+      CHECK_GT(FLAGS_output_matches_file.size(), 0)
+          << "Must specify --output_matches_file to match a shard of the "
+             "image pairs.";
+    }
     AddImagesToReconstructionBuilder(&reconstruction_builder);
+    if (FLAGS_num_matching_shards > 1) {
+      LOG(INFO) << "Wrote the matches of shard " << FLAGS_matching_shard_index
+                << " to " << FLAGS_output_matches_file
+                << ". Combine the matches of all shards with merge_matches "
+                   "and pass them to build_reconstruction with "
+                   "--matches_file.";
+      return 0;
+    }
   } else {
     LOG(FATAL)
         << "You must specifiy either images to reconstruct or a match file.";
@@ -69,8 +69,8 @@ DEFINE_string(feature_density, "NORMAL",
               "Set to SPARSE, NORMAL, or DENSE to extract fewer or more "
               "features from each image.");
 DEFINE_string(matching_strategy, "CASCADE_HASHING",
-              "Strategy used to match features. Must be BRUTE_FORCE "
-              " or CASCADE_HASHING");
+              "Strategy used to match features. Must be BRUTE_FORCE,"
+              " CASCADE_HASHING, or KD_TREE");
 DEFINE_bool(match_out_of_core, true,
             "Perform matching out of core by saving features to disk and "
             "reading them as needed. Set to false to perform matching all in "
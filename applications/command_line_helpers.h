@@ -43,10 +43,12 @@
 #include <sstream>
 
 using theia::DescriptorExtractorType;
+using theia::DescriptorPrecision;
 using theia::FeatureDensity;
 using theia::GlobalPositionEstimatorType;
 using theia::GlobalRotationEstimatorType;
 using theia::LossFunctionType;
+using theia::MatchingShardStrategy;
 using theia::MatchingStrategy;
 using theia::OptimizeIntrinsicsType;
 using theia::ReconstructionEstimatorType;
@@ -57,12 +59,44 @@ inline DescriptorExtractorType StringToDescriptorExtractorType(
     return DescriptorExtractorType::SIFT;
   } else if (descriptor == "AKAZE") {
     return DescriptorExtractorType::AKAZE;
+  } else if (descriptor == "AKAZE_MLDB") {
+    return DescriptorExtractorType::AKAZE_MLDB;
   } else {
     LOG(FATAL) << "Invalid DescriptorExtractor specified. Using SIFT instead.";
     return DescriptorExtractorType::SIFT;
   }
 }
 
+inline DescriptorPrecision StringToDescriptorPrecision(
+    const std::string& descriptor_precision) {
+  if (descriptor_precision == "FLOAT32") {
+    return DescriptorPrecision::FLOAT32;
+  } else if (descriptor_precision == "FLOAT16") {
+    return DescriptorPrecision::FLOAT16;
+  } else if (descriptor_precision == "UINT8") {
+    return DescriptorPrecision::UINT8;
+  } else if (descriptor_precision == "BINARY") {
+    return DescriptorPrecision::BINARY;
+  } else {
+    LOG(FATAL) << "Invalid descriptor precision requested. Please use FLOAT32, "
+                  "FLOAT16, UINT8, or BINARY.";
+    return DescriptorPrecision::FLOAT32;
+  }
+}
+
+inline MatchingShardStrategy StringToMatchingShardStrategy(
+    const std::string& shard_strategy) {
+  if (shard_strategy == "PAIRS") {
+    return MatchingShardStrategy::PAIRS;
+  } else if (shard_strategy == "IMAGE_BLOCKS") {
+    return MatchingShardStrategy::IMAGE_BLOCKS;
+  } else {
+    LOG(FATAL) << "Invalid matching shard strategy requested. Please use PAIRS "
+                  "or IMAGE_BLOCKS.";
+    return MatchingShardStrategy::IMAGE_BLOCKS;
+  }
+}
+
 inline FeatureDensity StringToFeatureDensity(
     const std::string& feature_density) {
   if (feature_density == "SPARSE") {
@@ -84,6 +118,12 @@ inline MatchingStrategy StringToMatchingStrategyType(
     return MatchingStrategy::BRUTE_FORCE;
   } else if (matching_strategy == "CASCADE_HASHING") {
     return MatchingStrategy::CASCADE_HASHING;
+  } else if (matching_strategy == "KD_TREE") {
+    return MatchingStrategy::KD_TREE;
+  } else if (matching_strategy == "BRUTE_FORCE_HAMMING") {
+    return MatchingStrategy::BRUTE_FORCE_HAMMING;
+  } else if (matching_strategy == "MULTI_INDEX_HASHING") {
+    return MatchingStrategy::MULTI_INDEX_HASHING;
   } else {
     LOG(FATAL)
         << "Invalid matching strategy specified. Using BRUTE_FORCE instead.";
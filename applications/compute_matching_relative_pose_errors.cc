@@ -136,10 +136,10 @@ int main(int argc, char* argv[]) {
   std::vector<std::string> view_names;
   std::vector<theia::CameraIntrinsicsPrior> camera_intrinsics_prior;
   std::vector<theia::ImagePairMatch> matches;
-  CHECK(theia::ReadMatchesAndGeometry(FLAGS_matches,
-                                      &view_names,
-                                      &camera_intrinsics_prior,
-                                      &matches))
+  CHECK(theia::ReadMatchesWithoutCorrespondences(FLAGS_matches,
+                                                 &view_names,
+                                                 &camera_intrinsics_prior,
+                                                 &matches))
       << "Could not read matches from " << FLAGS_matches;
 
   std::unique_ptr<theia::Reconstruction> reconstruction(
@@ -64,7 +64,7 @@ DEFINE_string(feature_density, "NORMAL",
               "features from each image.");
 DEFINE_string(matching_strategy, "CASCADE_HASHING",
               "Strategy used to match features. Must be BRUTE_FORCE, "
-              "or CASCADE_HASHING");
+              "CASCADE_HASHING, or KD_TREE");
 DEFINE_double(lowes_ratio, 0.75, "Lowes ratio used for feature matching.");
 DEFINE_double(
     max_sampson_error_for_verified_match, 4.0,
@@ -111,10 +111,10 @@ void EvaluateTranslationOptimization(
   std::vector<std::string> view_names;
   std::vector<theia::CameraIntrinsicsPrior> camera_intrinsics_prior;
   std::vector<theia::ImagePairMatch> matches;
-  CHECK(theia::ReadMatchesAndGeometry(matches_file,
-                                      &view_names,
-                                      &camera_intrinsics_prior,
-                                      &matches))
+  CHECK(theia::ReadMatchesWithoutCorrespondences(matches_file,
+                                                 &view_names,
+                                                 &camera_intrinsics_prior,
+                                                 &matches))
       << "Could not read matches from " << FLAGS_matches;
 
   // Collect relative translations.
@@ -47,15 +47,45 @@ DEFINE_string(
     "images.");
 DEFINE_string(features_output_directory, ".",
               "Name of output directory to write the features files.");
+DEFINE_string(packed_features_file, "",
+              "If set, the features of all images are written to this single "
+              "packed feature store (along with an index file with the same "
+              "name and a .index extension) instead of one features file per "
+              "image in features_output_directory.");
 DEFINE_int32(num_threads, 1,
              "Number of threads to use for feature extraction and matching.");
+DEFINE_int32(num_decoding_threads, 0,
+             "Number of threads that read and decode the images. The decoded "
+             "images are queued for the num_threads feature extraction "
+             "threads. If 0, each image is decoded by the thread that "
+             "extracts its features.");
+DEFINE_int32(max_num_queued_images, 4,
+             "Maximum number of decoded images that wait for a feature "
+             "extraction thread.");
+DEFINE_int32(max_image_dimension, 0,
+             "If positive, images whose width or height is larger are decoded "
+             "at a reduced resolution so that neither is larger. The keypoints "
+             "are written in the pixel coordinates of the full resolution "
+             "images.");
+DEFINE_int32(max_decoded_image_memory_mb, 0,
+             "Maximum number of megabytes of decoded images that are queued or "
+             "used by feature extraction. Set to 0 to only limit the number of "
+             "queued images.");
+DEFINE_bool(parallelize_large_images, false,
+            "If true, the SIFT features of each large image are extracted "
+            "with --num_threads additional threads so that a few very large "
+            "images use all threads. The features are the same.");
 DEFINE_string(
     descriptor, "SIFT",
     "Type of feature descriptor to use. Must be one of the following: "
-    "SIFT");
+    "SIFT, AKAZE, or AKAZE_MLDB (binary AKAZE descriptors).");
 DEFINE_string(feature_density, "NORMAL",
               "Set to SPARSE, NORMAL, or DENSE to extract fewer or more "
               "features from each image.");
+DEFINE_string(descriptor_precision, "FLOAT32",
+              "Precision used to store the descriptors in the features files. "
+              "Set to FLOAT32, FLOAT16, UINT8, or BINARY. UINT8 is intended "
+              "for SIFT descriptors and BINARY for AKAZE_MLDB descriptors.");
 
 int main(int argc, char *argv[]) {
   THEIA_GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
@@ -73,7 +103,19 @@ int main(int argc, char *argv[]) {
       StringToDescriptorExtractorType(FLAGS_descriptor);
   options.feature_density = StringToFeatureDensity(FLAGS_feature_density);
   options.num_threads = FLAGS_num_threads;
+  options.image_decoding_options.num_decoding_threads =
+      FLAGS_num_decoding_threads;
+  options.image_decoding_options.max_num_queued_images =
+      FLAGS_max_num_queued_images;
+  options.image_decoding_options.max_image_memory_bytes =
+      static_cast<size_t>(FLAGS_max_decoded_image_memory_mb) * 1024 * 1024;
+  options.image_decoding_options.max_image_dimension =
+      FLAGS_max_image_dimension;
+  options.parallelize_large_images = FLAGS_parallelize_large_images;
   options.output_directory = FLAGS_features_output_directory;
+  options.packed_features_file = FLAGS_packed_features_file;
+  options.descriptor_precision =
+      StringToDescriptorPrecision(FLAGS_descriptor_precision);
 
   theia::FeatureExtractor feature_extractor(options);
 
@@ -0,0 +1,72 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include <theia/theia.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+DEFINE_string(input_matches_files, "",
+              "Wildcard of the matches files of the matching shards to merge, "
+              "e.g. /path/to/matches-shard-*.bin");
+DEFINE_string(output_matches_file, "",
+              "Filename of the merged matches file.");
+
+// Combines the matches files that were written by several processes that each
+// matched one shard of the image pairs (see --num_matching_shards of
+// build_reconstruction) into a single matches file that can be passed to
+// build_reconstruction with --matches_file.
+int main(int argc, char* argv[]) {
+  THEIA_GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  CHECK_GT(FLAGS_output_matches_file.size(), 0)
+      << "Must specify a filepath to output the merged matches.";
+  std::vector<std::string> input_matches_files;
+  CHECK(theia::GetFilepathsFromWildcard(FLAGS_input_matches_files,
+                                        &input_matches_files))
+      << "Could not find matches files that matched the filepath: "
+      << FLAGS_input_matches_files
+      << ". NOTE that the ~ filepath is not supported.";
+  std::sort(input_matches_files.begin(), input_matches_files.end());
+
+  LOG(INFO) << "Merging " << input_matches_files.size()
+            << " matches files into " << FLAGS_output_matches_file;
+  CHECK(theia::MergeMatchesFiles(input_matches_files,
+                                 FLAGS_output_matches_file))
+      << "Could not merge the matches files.";
+  return 0;
+}
@@ -39,31 +39,47 @@
 #include "theia/image/descriptor/akaze_descriptor.h"
 #include "theia/image/descriptor/create_descriptor_extractor.h"
 #include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
 #include "theia/image/descriptor/sift_descriptor.h"
 #include "theia/image/image.h"
 #include "theia/image/image_cache.h"
+#include "theia/image/image_decoding_pipeline.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 #include "theia/image/keypoint_detector/keypoint_detector.h"
 #include "theia/image/keypoint_detector/sift_detector.h"
 #include "theia/image/keypoint_detector/sift_parameters.h"
 #include "theia/io/eigen_serializable.h"
+#include "theia/io/hashed_image_format.h"
 #include "theia/io/import_nvm_file.h"
+#include "theia/io/keypoints_and_descriptors_format.h"
+#include "theia/io/matches_file.h"
+#include "theia/io/matches_format.h"
+#include "theia/io/packed_feature_store.h"
+#include "theia/io/packed_features_format.h"
 #include "theia/io/populate_image_sizes.h"
 #include "theia/io/read_1dsfm.h"
 #include "theia/io/read_bundler_files.h"
 #include "theia/io/read_calibration.h"
+#include "theia/io/read_hashed_image.h"
 #include "theia/io/read_keypoints_and_descriptors.h"
 #include "theia/io/read_matches.h"
+#include "theia/io/read_vocabulary_tree.h"
 #include "theia/io/reconstruction_reader.h"
 #include "theia/io/reconstruction_writer.h"
 #include "theia/io/sift_binary_file.h"
 #include "theia/io/sift_text_file.h"
+#include "theia/io/vocabulary_tree_format.h"
 #include "theia/io/write_bundler_files.h"
+#include "theia/io/write_hashed_image.h"
 #include "theia/io/write_keypoints_and_descriptors.h"
 #include "theia/io/write_matches.h"
 #include "theia/io/write_nvm_file.h"
 #include "theia/io/write_ply_file.h"
+#include "theia/io/write_vocabulary_tree.h"
 #include "theia/matching/brute_force_feature_matcher.h"
+#include "theia/matching/brute_force_hamming_feature_matcher.h"
 #include "theia/matching/cascade_hasher.h"
 #include "theia/matching/cascade_hashing_feature_matcher.h"
 #include "theia/matching/create_feature_matcher.h"
@@ -72,10 +88,17 @@
 #include "theia/matching/feature_matcher.h"
 #include "theia/matching/feature_matcher_options.h"
 #include "theia/matching/feature_matcher_utils.h"
+#include "theia/matching/feature_prefetcher.h"
 #include "theia/matching/guided_epipolar_matcher.h"
 #include "theia/matching/image_pair_match.h"
+#include "theia/matching/image_pair_selection.h"
 #include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/inverted_file.h"
+#include "theia/matching/kd_tree_feature_matcher.h"
 #include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/matching/matching_journal.h"
+#include "theia/matching/multi_index_hashing_feature_matcher.h"
+#include "theia/matching/vocabulary_tree.h"
 #include "theia/math/closed_form_polynomial_solver.h"
 #include "theia/math/constrained_l1_solver.h"
 #include "theia/math/distribution.h"
@@ -202,6 +225,7 @@
 #include "theia/sfm/types.h"
 #include "theia/sfm/undistort_image.h"
 #include "theia/sfm/view.h"
+#include "theia/sfm/view_graph/guided_match_view_graph.h"
 #include "theia/sfm/view_graph/orientations_from_maximum_spanning_tree.h"
 #include "theia/sfm/view_graph/remove_disconnected_view_pairs.h"
 #include "theia/sfm/view_graph/view_graph.h"
@@ -222,11 +246,13 @@
 #include "theia/solvers/ransac.h"
 #include "theia/solvers/sample_consensus_estimator.h"
 #include "theia/solvers/sampler.h"
+#include "theia/util/concurrent_lru_cache.h"
 #include "theia/util/enable_enum_bitmask_operators.h"
 #include "theia/util/filesystem.h"
 #include "theia/util/hash.h"
 #include "theia/util/lru_cache.h"
 #include "theia/util/map_util.h"
+#include "theia/util/memory_mapped_file.h"
 #include "theia/util/mutable_priority_queue.h"
 #include "theia/util/random.h"
 #include "theia/util/string.h"
@@ -234,5 +260,6 @@
 #include "theia/util/threadpool.h"
 #include "theia/util/timer.h"
 #include "theia/util/util.h"
+#include "theia/util/work_stealing_thread_pool.h"
 
 #endif  // THEIA_THEIA_H_
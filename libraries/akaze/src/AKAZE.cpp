@@ -462,8 +462,10 @@ void AKAZE::Compute_Descriptors(std::vector<AKAZEKeypoint>& kpts,
       t = options_.descriptor_size;
     }
 
+    // The comparisons are OR'd into the descriptor bits, so they must start
+    // out as zero.
     for (int i = 0; i < desc.binary_descriptor.size(); i++) {
-      desc.binary_descriptor[i].resize(t);
+      desc.binary_descriptor[i].setZero(t);
     }
   }
 
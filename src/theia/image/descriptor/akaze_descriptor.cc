@@ -35,16 +35,42 @@
 #include "theia/image/descriptor/akaze_descriptor.h"
 
 #include <Eigen/Core>
+#include <stdint.h>
 #include <algorithm>
 #include <vector>
 
 #include "akaze/src/AKAZE.h"
 #include "glog/logging.h"
 
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 
 namespace theia {
+
+namespace {
+
+// Converts the full length MLDB descriptors, whose bits are packed starting
+// with the least significant bit of the first byte, to descriptors with one 0
+// or 1 entry per bit.
+void BinaryDescriptorsToMatrix(
+    const std::vector<libAKAZE::BinaryVectorX>& binary_descriptors,
+    const int num_channels,
+    DescriptorMatrix* descriptors) {
+  // The full length descriptor compares 2x2, 3x3, and 4x4 grids of samples in
+  // each channel.
+  const int num_bits = (6 + 36 + 120) * num_channels;
+  descriptors->resize(binary_descriptors.size(), num_bits);
+  for (int i = 0; i < binary_descriptors.size(); i++) {
+    const uint8_t* bits = binary_descriptors[i].data();
+    for (int j = 0; j < num_bits; j++) {
+      (*descriptors)(i, j) = (bits[j >> 3] >> (j & 7)) & 1;
+    }
+  }
+}
+
+}  // namespace
+
 bool AkazeDescriptorExtractor::ComputeDescriptor(const FloatImage& image,
                                                  const Keypoint& keypoint,
                                                  Eigen::VectorXf* descriptor) {
@@ -58,7 +84,7 @@ bool AkazeDescriptorExtractor::ComputeDescriptor(const FloatImage& image,
 bool AkazeDescriptorExtractor::DetectAndExtractDescriptors(
     const FloatImage& image,
     std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
+    DescriptorMatrix* descriptors) {
   // Try to convert the image to grayscale and eigen type.
   const FloatImage& gray_image = image.AsGrayscaleImage();
   libAKAZE::RowMatrixXf img_32 =
@@ -79,7 +105,8 @@ bool AkazeDescriptorExtractor::DetectAndExtractDescriptors(
   options.min_dthreshold = 0.00001f;
 
   options.diffusivity = libAKAZE::PM_G2;
-  options.descriptor = libAKAZE::MSURF;
+  options.descriptor = akaze_params_.use_binary_descriptors ? libAKAZE::MLDB
+                                                            : libAKAZE::MSURF;
   options.descriptor_size = 0;
   options.descriptor_channels = 3;
   options.descriptor_pattern_size = 10;
@@ -113,7 +140,13 @@ bool AkazeDescriptorExtractor::DetectAndExtractDescriptors(
   }
 
   // Set the output descriptors.
-  std::swap(*descriptors, akaze_descriptors.float_descriptor);
+  if (akaze_params_.use_binary_descriptors) {
+    BinaryDescriptorsToMatrix(akaze_descriptors.binary_descriptor,
+                              options.descriptor_channels,
+                              descriptors);
+  } else {
+    DescriptorsToMatrix(akaze_descriptors.float_descriptor, descriptors);
+  }
   return true;
 }
 
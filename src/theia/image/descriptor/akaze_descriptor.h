@@ -51,6 +51,12 @@ struct AkazeParameters {
   int num_sublevels = 4;
   // Lowering this threshold will increase the number of features.
   float hessian_threshold = 0.001f;
+  // If true, binary MLDB descriptors are extracted instead of the float MSURF
+  // descriptors. The 486 bits of each descriptor are returned as a descriptor
+  // with 0 or 1 entries, which should be stored with
+  // DescriptorPrecision::BINARY (61 bytes per descriptor) and matched with the
+  // Hamming distance.
+  bool use_binary_descriptors = false;
 };
 
 class AkazeDescriptorExtractor : public DescriptorExtractor {
@@ -69,7 +75,9 @@ class AkazeDescriptorExtractor : public DescriptorExtractor {
   // same time.
   bool DetectAndExtractDescriptors(const FloatImage& image,
                                    std::vector<Keypoint>* keypoints,
-                                   std::vector<Eigen::VectorXf>* descriptors);
+                                   DescriptorMatrix* descriptors);
+
+  using DescriptorExtractor::DetectAndExtractDescriptors;
 
  private:
   const AkazeParameters akaze_params_;
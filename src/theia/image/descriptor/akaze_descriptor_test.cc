@@ -39,6 +39,7 @@
 
 #include "theia/image/image.h"
 #include "theia/image/descriptor/akaze_descriptor.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 
 DEFINE_string(test_img, "image/descriptor/img1.png",
@@ -62,4 +63,23 @@ TEST(AkazeDescriptor, Sanity) {
                                                           &descriptors));
 }
 
+TEST(AkazeDescriptor, BinaryDescriptors) {
+  FloatImage input_img(img_filename);
+
+  AkazeParameters options;
+  options.use_binary_descriptors = true;
+  AkazeDescriptorExtractor akaze_extractor(options);
+
+  std::vector<Keypoint> keypoints;
+  DescriptorMatrix descriptors;
+  EXPECT_TRUE(akaze_extractor.DetectAndExtractDescriptors(input_img, &keypoints,
+                                                          &descriptors));
+  EXPECT_EQ(descriptors.rows(), keypoints.size());
+  EXPECT_EQ(descriptors.cols(), 486);
+
+  // Each entry is one bit of the descriptor.
+  EXPECT_TRUE(
+      (descriptors.array() == 0.0f || descriptors.array() == 1.0f).all());
+}
+
 }  // namespace theia
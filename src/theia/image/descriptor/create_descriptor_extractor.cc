@@ -84,17 +84,25 @@ inline AkazeParameters FeatureDensityToAkazeParameters(
 
 std::unique_ptr<DescriptorExtractor> CreateDescriptorExtractor(
     const DescriptorExtractorType& descriptor_type,
-    const FeatureDensity& feature_density) {
+    const FeatureDensity& feature_density,
+    ThreadPool* thread_pool) {
   std::unique_ptr<DescriptorExtractor> descriptor_extractor;
   switch (descriptor_type) {
     case DescriptorExtractorType::SIFT:
       descriptor_extractor.reset(new SiftDescriptorExtractor(
-          FeatureDensityToSiftParameters(feature_density)));
+          FeatureDensityToSiftParameters(feature_density), thread_pool));
       break;
     case DescriptorExtractorType::AKAZE:
       descriptor_extractor.reset(new AkazeDescriptorExtractor(
           FeatureDensityToAkazeParameters(feature_density)));
       break;
+    case DescriptorExtractorType::AKAZE_MLDB: {
+      AkazeParameters akaze_params =
+          FeatureDensityToAkazeParameters(feature_density);
+      akaze_params.use_binary_descriptors = true;
+      descriptor_extractor.reset(new AkazeDescriptorExtractor(akaze_params));
+      break;
+    }
     default:
       LOG(ERROR) << "Invalid Descriptor Extractor specified.";
   }
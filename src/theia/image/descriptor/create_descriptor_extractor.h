@@ -39,14 +39,19 @@
 
 namespace theia {
 class DescriptorExtractor;
+class ThreadPool;
 
 // The various types of feature descriptors you can choose. We use the default
 // keypoint extractor for each feature type. Since this is a convenience class
 // anyways, this functionality is acceptable. If more flexibility (custom
 // features and custom descriptors) is needed then a new class may be developed.
+//
+// AKAZE_MLDB extracts binary AKAZE descriptors. These should be stored with
+// DescriptorPrecision::BINARY and matched with a Hamming distance matcher.
 enum class DescriptorExtractorType {
   SIFT = 0,
   AKAZE = 1,
+  AKAZE_MLDB = 2,
 };
 
 // Users may specify feature density to target their specific
@@ -60,10 +65,14 @@ enum class FeatureDensity {
   DENSE = 2
 };
 
-// Factory method to create the keypoint detector and descriptor extractor.
+// Factory method to create the keypoint detector and descriptor extractor. If a
+// thread pool is given, SIFT descriptor extractors use it to extract the
+// features of large images in parallel (see SiftDescriptorExtractor). The
+// thread pool must outlive the descriptor extractor.
 std::unique_ptr<DescriptorExtractor> CreateDescriptorExtractor(
     const DescriptorExtractorType& descriptor_type,
-    const FeatureDensity& feature_density);
+    const FeatureDensity& feature_density,
+    ThreadPool* thread_pool = nullptr);
 
 }  // namespace theia
 
@@ -35,32 +35,60 @@
 #include "theia/image/descriptor/descriptor_extractor.h"
 
 #include <Eigen/Core>
+#include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 
 namespace theia {
 
 // Compute the descriptor for multiple keypoints in a given image.
-bool DescriptorExtractor::ComputeDescriptors(
-    const FloatImage& image,
-    std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
+bool DescriptorExtractor::ComputeDescriptors(const FloatImage& image,
+                                             std::vector<Keypoint>* keypoints,
+                                             DescriptorMatrix* descriptors) {
   const FloatImage& gray_image = image.AsGrayscaleImage();
-  descriptors->reserve(keypoints->size());
 
-  auto keypoint_it = keypoints->begin();
-  while (keypoint_it != keypoints->end()) {
+  std::vector<Keypoint> valid_keypoints;
+  valid_keypoints.reserve(keypoints->size());
+  std::vector<Eigen::VectorXf> valid_descriptors;
+  valid_descriptors.reserve(keypoints->size());
+  for (const Keypoint& keypoint : *keypoints) {
     Eigen::VectorXf descriptor;
-    if (!ComputeDescriptor(gray_image,
-                           *keypoint_it,
-                           &descriptor)) {
-      keypoint_it = keypoints->erase(keypoint_it);
+    if (!ComputeDescriptor(gray_image, keypoint, &descriptor)) {
       continue;
     }
 
-    descriptors->push_back(descriptor);
+    valid_keypoints.emplace_back(keypoint);
+    valid_descriptors.emplace_back(descriptor);
+  }
+
+  keypoints->swap(valid_keypoints);
+  DescriptorsToMatrix(valid_descriptors, descriptors);
+  return true;
+}
+
+bool DescriptorExtractor::ComputeDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    std::vector<Eigen::VectorXf>* descriptors) {
+  DescriptorMatrix descriptor_matrix;
+  if (!ComputeDescriptors(image, keypoints, &descriptor_matrix)) {
+    return false;
+  }
+  MatrixToDescriptors(descriptor_matrix, descriptors);
+  return true;
+}
+
+bool DescriptorExtractor::DetectAndExtractDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    std::vector<Eigen::VectorXf>* descriptors) {
+  DescriptorMatrix descriptor_matrix;
+  if (!DetectAndExtractDescriptors(image, keypoints, &descriptor_matrix)) {
+    return false;
   }
+  MatrixToDescriptors(descriptor_matrix, descriptors);
   return true;
 }
 
@@ -38,6 +38,7 @@
 #include <Eigen/Core>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/util/util.h"
 
 namespace theia {
@@ -65,20 +66,28 @@ class DescriptorExtractor {
   // Compute the descriptors for multiple keypoints in a given image. This
   // method will return all descriptors that could be extracted. If any
   // descriptors could not be extracted at a given keypoint, that keypoint will
-  // be removed from the container. Returns true on success and false on
+  // be removed from the container. The i-th row of the descriptor matrix is the
+  // descriptor of the i-th keypoint. Returns true on success and false on
   // failure.
-  virtual bool ComputeDescriptors(
-      const FloatImage& image,
-      std::vector<Keypoint>* keypoints,
-      std::vector<Eigen::VectorXf>* descriptors);
+  virtual bool ComputeDescriptors(const FloatImage& image,
+                                  std::vector<Keypoint>* keypoints,
+                                  DescriptorMatrix* descriptors);
 
   // Detects keypoints using the default method for the given descriptor. This
   // can be more efficient (e.g., with SIFT) because there is some overhead
   // required for creating the keypoint and descriptor objects.
-  virtual bool DetectAndExtractDescriptors(
-      const FloatImage& image,
-      std::vector<Keypoint>* keypoints,
-      std::vector<Eigen::VectorXf>* descriptors) = 0;
+  virtual bool DetectAndExtractDescriptors(const FloatImage& image,
+                                           std::vector<Keypoint>* keypoints,
+                                           DescriptorMatrix* descriptors) = 0;
+
+  // Same as the methods above, but the descriptors are returned as a vector of
+  // descriptors instead of a descriptor matrix.
+  bool ComputeDescriptors(const FloatImage& image,
+                          std::vector<Keypoint>* keypoints,
+                          std::vector<Eigen::VectorXf>* descriptors);
+  bool DetectAndExtractDescriptors(const FloatImage& image,
+                                   std::vector<Keypoint>* keypoints,
+                                   std::vector<Eigen::VectorXf>* descriptors);
 
  private:
   DISALLOW_COPY_AND_ASSIGN(DescriptorExtractor);
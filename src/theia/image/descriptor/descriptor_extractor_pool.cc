@@ -0,0 +1,117 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+
+#include <glog/logging.h>
+
+#include <memory>
+#include <mutex>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+
+namespace theia {
+
+DescriptorExtractorPool::DescriptorExtractorPool(
+    const DescriptorExtractorType& descriptor_type,
+    const FeatureDensity& feature_density,
+    ThreadPool* thread_pool)
+    : DescriptorExtractorPool([descriptor_type, feature_density,
+                               thread_pool]() {
+        return CreateDescriptorExtractor(descriptor_type, feature_density,
+                                         thread_pool);
+      }) {}
+
+DescriptorExtractorPool::DescriptorExtractorPool(
+    const CreateDescriptorExtractorFunction& create_descriptor_extractor)
+    : create_descriptor_extractor_(create_descriptor_extractor),
+      num_extractors_(0) {
+  CHECK(create_descriptor_extractor_);
+}
+
+DescriptorExtractorPool::~DescriptorExtractorPool() {
+  CHECK_EQ(available_extractors_.size(), num_extractors_)
+      << "The descriptor extractor pool was destroyed while it was in use.";
+}
+
+bool DescriptorExtractorPool::DetectAndExtractDescriptors(
+    const FloatImage& image,
+    std::vector<Keypoint>* keypoints,
+    DescriptorMatrix* descriptors) {
+  std::unique_ptr<DescriptorExtractor> descriptor_extractor =
+      AcquireDescriptorExtractor();
+  const bool success = descriptor_extractor->DetectAndExtractDescriptors(
+      image, keypoints, descriptors);
+  ReleaseDescriptorExtractor(std::move(descriptor_extractor));
+  return success;
+}
+
+int DescriptorExtractorPool::NumDescriptorExtractors() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_extractors_;
+}
+
+std::unique_ptr<DescriptorExtractor>
+DescriptorExtractorPool::AcquireDescriptorExtractor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!available_extractors_.empty()) {
+      std::unique_ptr<DescriptorExtractor> descriptor_extractor =
+          std::move(available_extractors_.back());
+      available_extractors_.pop_back();
+      return descriptor_extractor;
+    }
+    ++num_extractors_;
+  }
+
+  // Create the extractor without holding the lock since creating it may be
+  // expensive.
+  std::unique_ptr<DescriptorExtractor> descriptor_extractor =
+      create_descriptor_extractor_();
+  CHECK(descriptor_extractor != nullptr)
+      << "Could not create a descriptor extractor.";
+  return descriptor_extractor;
+}
+
+void DescriptorExtractorPool::ReleaseDescriptorExtractor(
+    std::unique_ptr<DescriptorExtractor> descriptor_extractor) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  available_extractors_.emplace_back(std::move(descriptor_extractor));
+}
+
+}  // namespace theia
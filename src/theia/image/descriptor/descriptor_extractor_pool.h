@@ -0,0 +1,107 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_EXTRACTOR_POOL_H_
+#define THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_EXTRACTOR_POOL_H_
+
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+#include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/util/util.h"
+
+namespace theia {
+class DescriptorExtractor;
+class FloatImage;
+class Keypoint;
+class ThreadPool;
+
+// A thread-safe pool of descriptor extractors that are reused across images.
+// Creating a descriptor extractor (and e.g. the SIFT filters that it holds for
+// each image size) can cost as much as extracting the features of a small
+// image, so instead of creating an extractor for each image, each thread takes
+// an extractor from the pool while it extracts the features of an image and
+// returns it afterwards. At most one extractor is created for each thread that
+// extracts features at the same time.
+class DescriptorExtractorPool {
+ public:
+  typedef std::function<std::unique_ptr<DescriptorExtractor>()>
+      CreateDescriptorExtractorFunction;
+
+  // The descriptor extractors are created with CreateDescriptorExtractor, which
+  // is given the thread pool (if any) to extract features of large images in
+  // parallel.
+  DescriptorExtractorPool(const DescriptorExtractorType& descriptor_type,
+                          const FeatureDensity& feature_density,
+                          ThreadPool* thread_pool = nullptr);
+
+  // The descriptor extractors are created with the given function, e.g. for
+  // custom descriptor extractors.
+  explicit DescriptorExtractorPool(
+      const CreateDescriptorExtractorFunction& create_descriptor_extractor);
+
+  ~DescriptorExtractorPool();
+
+  // Detects the keypoints and extracts the descriptors of the image with one of
+  // the descriptor extractors of the pool. This may be called from several
+  // threads at once. Returns false if the extraction fails.
+  bool DetectAndExtractDescriptors(const FloatImage& image,
+                                   std::vector<Keypoint>* keypoints,
+                                   DescriptorMatrix* descriptors);
+
+  // Returns the number of descriptor extractors that have been created.
+  int NumDescriptorExtractors();
+
+ private:
+  // Takes a descriptor extractor from the pool, or creates one if all
+  // extractors are in use, and returns it to the pool.
+  std::unique_ptr<DescriptorExtractor> AcquireDescriptorExtractor();
+  void ReleaseDescriptorExtractor(
+      std::unique_ptr<DescriptorExtractor> descriptor_extractor);
+
+  const CreateDescriptorExtractorFunction create_descriptor_extractor_;
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<DescriptorExtractor> > available_extractors_;
+  int num_extractors_;
+
+  DISALLOW_COPY_AND_ASSIGN(DescriptorExtractorPool);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_EXTRACTOR_POOL_H_
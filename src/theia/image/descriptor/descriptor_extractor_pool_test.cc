@@ -0,0 +1,112 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/image.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/util/threadpool.h"
+
+namespace theia {
+
+namespace {
+
+// A descriptor extractor that fails the test if it is used by more than one
+// thread at a time and returns one keypoint.
+class TestDescriptorExtractor : public DescriptorExtractor {
+ public:
+  TestDescriptorExtractor() : in_use_(false) {}
+
+  bool ComputeDescriptor(const FloatImage& image,
+                         const Keypoint& keypoint,
+                         Eigen::VectorXf* descriptor) {
+    return false;
+  }
+
+  bool DetectAndExtractDescriptors(const FloatImage& image,
+                                   std::vector<Keypoint>* keypoints,
+                                   DescriptorMatrix* descriptors) {
+    EXPECT_FALSE(in_use_.exchange(true));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    keypoints->assign(1, Keypoint(0, 0, Keypoint::OTHER));
+    descriptors->setZero(1, 4);
+    in_use_ = false;
+    return true;
+  }
+
+ private:
+  std::atomic<bool> in_use_;
+};
+
+}  // namespace
+
+TEST(DescriptorExtractorPool, ReusesDescriptorExtractors) {
+  static const int kNumThreads = 4;
+  static const int kNumImages = 50;
+
+  DescriptorExtractorPool descriptor_extractor_pool([]() {
+    return std::unique_ptr<DescriptorExtractor>(new TestDescriptorExtractor);
+  });
+  const FloatImage image;
+  std::atomic<int> num_extracted(0);
+  {
+    ThreadPool pool(kNumThreads);
+    for (int i = 0; i < kNumImages; i++) {
+      pool.Add([&]() {
+        std::vector<Keypoint> keypoints;
+        DescriptorMatrix descriptors;
+        if (descriptor_extractor_pool.DetectAndExtractDescriptors(
+                image, &keypoints, &descriptors) &&
+            keypoints.size() == 1) {
+          ++num_extracted;
+        }
+      });
+    }
+  }
+
+  EXPECT_EQ(num_extracted, kNumImages);
+  EXPECT_GE(descriptor_extractor_pool.NumDescriptorExtractors(), 1);
+  EXPECT_LE(descriptor_extractor_pool.NumDescriptorExtractors(), kNumThreads);
+}
+
+}  // namespace theia
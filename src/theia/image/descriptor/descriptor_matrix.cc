@@ -0,0 +1,78 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+#include <vector>
+
+namespace theia {
+
+void DescriptorsToMatrix(const std::vector<Eigen::VectorXf>& descriptors,
+                         DescriptorMatrix* descriptor_matrix) {
+  CHECK_NOTNULL(descriptor_matrix);
+  if (descriptors.empty()) {
+    descriptor_matrix->resize(0, 0);
+    return;
+  }
+
+  descriptor_matrix->resize(descriptors.size(), descriptors[0].size());
+  for (int i = 0; i < descriptors.size(); i++) {
+    CHECK_EQ(descriptors[i].size(), descriptor_matrix->cols())
+        << "All descriptors must have the same dimension.";
+    descriptor_matrix->row(i) = descriptors[i].transpose();
+  }
+}
+
+void MatrixToDescriptors(const DescriptorMatrix& descriptor_matrix,
+                         std::vector<Eigen::VectorXf>* descriptors) {
+  CHECK_NOTNULL(descriptors)->resize(descriptor_matrix.rows());
+  for (int i = 0; i < descriptor_matrix.rows(); i++) {
+    (*descriptors)[i] = descriptor_matrix.row(i).transpose();
+  }
+}
+
+void SelectDescriptors(const std::vector<int>& indices,
+                       DescriptorMatrix* descriptor_matrix) {
+  CHECK_NOTNULL(descriptor_matrix);
+  DescriptorMatrix selected_descriptors(indices.size(),
+                                        descriptor_matrix->cols());
+  for (int i = 0; i < indices.size(); i++) {
+    selected_descriptors.row(i) = descriptor_matrix->row(indices[i]);
+  }
+  descriptor_matrix->swap(selected_descriptors);
+}
+
+}  // namespace theia
@@ -0,0 +1,65 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_MATRIX_H_
+#define THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_MATRIX_H_
+
+#include <Eigen/Core>
+#include <vector>
+
+namespace theia {
+
+// Descriptors for an image are stored as the rows of a single row-major
+// matrix. Compared to a std::vector<Eigen::VectorXf> this needs one allocation
+// per image instead of one per descriptor, and keeps all descriptors in
+// contiguous memory so that matching can operate directly on the matrix.
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    DescriptorMatrix;
+
+// Adapters between the descriptor matrix and the std::vector<Eigen::VectorXf>
+// layout. All descriptors must have the same dimension.
+void DescriptorsToMatrix(const std::vector<Eigen::VectorXf>& descriptors,
+                         DescriptorMatrix* descriptor_matrix);
+void MatrixToDescriptors(const DescriptorMatrix& descriptor_matrix,
+                         std::vector<Eigen::VectorXf>* descriptors);
+
+// Keeps only the descriptors (i.e. rows) at the given indices, in the order
+// that they are given. This is the matrix equivalent of removing entries from a
+// std::vector of descriptors.
+void SelectDescriptors(const std::vector<int>& indices,
+                       DescriptorMatrix* descriptor_matrix);
+
+}  // namespace theia
+
+#endif  // THEIA_IMAGE_DESCRIPTOR_DESCRIPTOR_MATRIX_H_
@@ -0,0 +1,348 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+
+namespace theia {
+namespace {
+
+void ConvertFloatsToHalfs(const float* values,
+                          const int num_values,
+                          uint16_t* halfs) {
+  int i = 0;
+#ifdef __F16C__
+  for (; i + 8 <= num_values; i += 8) {
+    const __m256 float_values = _mm256_loadu_ps(values + i);
+    const __m128i half_values =
+        _mm256_cvtps_ph(float_values, _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(halfs + i), half_values);
+  }
+#endif
+  for (; i < num_values; i++) {
+    halfs[i] = FloatToHalf(values[i]);
+  }
+}
+
+void ConvertHalfsToFloats(const uint16_t* halfs,
+                          const int num_values,
+                          float* values) {
+  int i = 0;
+#ifdef __F16C__
+  for (; i + 8 <= num_values; i += 8) {
+    const __m128i half_values =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(halfs + i));
+    _mm256_storeu_ps(values + i, _mm256_cvtph_ps(half_values));
+  }
+#endif
+  for (; i < num_values; i++) {
+    values[i] = HalfToFloat(halfs[i]);
+  }
+}
+
+// Packs the bits of num_descriptors descriptors with num_dimensions entries
+// each into num_bytes bytes per descriptor.
+void PackBinaryDescriptors(const float* values,
+                           const int num_descriptors,
+                           const int num_dimensions,
+                           const int num_bytes,
+                           uint8_t* bits) {
+  std::fill(bits, bits + num_descriptors * num_bytes, 0);
+  for (int i = 0; i < num_descriptors; i++) {
+    const float* descriptor = values + i * num_dimensions;
+    uint8_t* descriptor_bits = bits + i * num_bytes;
+    for (int j = 0; j < num_dimensions; j++) {
+      if (descriptor[j] > 0.5f) {
+        descriptor_bits[j >> 3] |= 1 << (j & 7);
+      }
+    }
+  }
+}
+
+void UnpackBinaryDescriptors(const uint8_t* bits,
+                             const int num_descriptors,
+                             const int num_dimensions,
+                             const int num_bytes,
+                             float* values) {
+  for (int i = 0; i < num_descriptors; i++) {
+    const uint8_t* descriptor_bits = bits + i * num_bytes;
+    float* descriptor = values + i * num_dimensions;
+    for (int j = 0; j < num_dimensions; j++) {
+      descriptor[j] = (descriptor_bits[j >> 3] >> (j & 7)) & 1;
+    }
+  }
+}
+
+}  // namespace
+
+uint16_t FloatToHalf(const float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const uint32_t abs_bits = bits & 0x7fffffff;
+  const uint32_t exponent = abs_bits >> 23;
+
+  // NaN and infinity.
+  if (abs_bits >= 0x7f800000) {
+    return sign | 0x7c00 | (abs_bits > 0x7f800000 ? 0x0200 : 0);
+  }
+  // Values that are too large to be represented become infinity.
+  if (abs_bits >= 0x47800000) {
+    return sign | 0x7c00;
+  }
+  // Values that are too small to be represented become zero.
+  if (exponent < 102) {
+    return sign;
+  }
+
+  // Values that have a subnormal half precision representation. The rounding
+  // is to the nearest value, with ties going to the even value.
+  if (exponent < 113) {
+    const uint32_t mantissa = (abs_bits & 0x007fffff) | 0x00800000;
+    const uint32_t shift = 126 - exponent;
+    uint32_t half = mantissa >> shift;
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1))) {
+      ++half;
+    }
+    return sign | half;
+  }
+
+  // Normal values. Rounding up may carry into the exponent, which correctly
+  // rounds the largest values to infinity.
+  uint32_t half = ((exponent - 112) << 10) | ((abs_bits >> 13) & 0x03ff);
+  const uint32_t remainder = abs_bits & 0x1fff;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+    ++half;
+  }
+  return sign | half;
+}
+
+float HalfToFloat(const uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1f;
+  const uint32_t mantissa = value & 0x03ff;
+
+  uint32_t bits;
+  if (exponent == 0x1f) {
+    // NaN and infinity.
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent == 0) {
+    // Zero and subnormal values.
+    const float abs_value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -abs_value : abs_value;
+  } else {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+
+  float float_value;
+  std::memcpy(&float_value, &bits, sizeof(float_value));
+  return float_value;
+}
+
+void QuantizedDescriptorMatrix::Quantize(const DescriptorMatrix& descriptors,
+                                         const DescriptorPrecision precision) {
+  precision_ = precision;
+  float32_descriptors_.resize(0, 0);
+  float16_descriptors_.resize(0, 0);
+  uint8_descriptors_.resize(0, 0);
+  binary_descriptors_.resize(0, 0);
+  binary_descriptor_dimension_ = 0;
+
+  switch (precision_) {
+    case DescriptorPrecision::FLOAT32:
+      float32_descriptors_ = descriptors;
+      break;
+    case DescriptorPrecision::FLOAT16:
+      float16_descriptors_.resize(descriptors.rows(), descriptors.cols());
+      ConvertFloatsToHalfs(descriptors.data(),
+                           descriptors.size(),
+                           float16_descriptors_.data());
+      break;
+    case DescriptorPrecision::UINT8:
+      uint8_descriptors_ = (descriptors.array() * kUint8DescriptorScale)
+                               .round()
+                               .max(0.0f)
+                               .min(255.0f)
+                               .cast<uint8_t>()
+                               .matrix();
+      break;
+    case DescriptorPrecision::BINARY:
+      binary_descriptor_dimension_ = descriptors.cols();
+      binary_descriptors_.resize(
+          descriptors.rows(),
+          DescriptorSizeInBytes(precision_, descriptors.cols()));
+      PackBinaryDescriptors(descriptors.data(),
+                            descriptors.rows(),
+                            descriptors.cols(),
+                            binary_descriptors_.cols(),
+                            binary_descriptors_.data());
+      break;
+    default:
+      LOG(FATAL) << "Invalid descriptor precision.";
+  }
+}
+
+void QuantizedDescriptorMatrix::Dequantize(
+    DescriptorMatrix* descriptors) const {
+  switch (precision_) {
+    case DescriptorPrecision::FLOAT16:
+      DequantizeDescriptors(precision_,
+                            float16_descriptors_.data(),
+                            float16_descriptors_.rows(),
+                            float16_descriptors_.cols(),
+                            descriptors);
+      break;
+    case DescriptorPrecision::UINT8:
+      DequantizeDescriptors(precision_,
+                            uint8_descriptors_.data(),
+                            uint8_descriptors_.rows(),
+                            uint8_descriptors_.cols(),
+                            descriptors);
+      break;
+    case DescriptorPrecision::BINARY:
+      DequantizeDescriptors(precision_,
+                            binary_descriptors_.data(),
+                            binary_descriptors_.rows(),
+                            binary_descriptor_dimension_,
+                            descriptors);
+      break;
+    default:
+      *CHECK_NOTNULL(descriptors) = float32_descriptors_;
+  }
+}
+
+size_t DescriptorEntrySize(const DescriptorPrecision precision) {
+  switch (precision) {
+    case DescriptorPrecision::FLOAT32:
+      return sizeof(float);
+    case DescriptorPrecision::FLOAT16:
+      return sizeof(uint16_t);
+    case DescriptorPrecision::UINT8:
+      return sizeof(uint8_t);
+    default:
+      LOG(FATAL) << "Invalid descriptor precision.";
+      return 0;
+  }
+}
+
+size_t DescriptorSizeInBytes(const DescriptorPrecision precision,
+                             const int num_dimensions) {
+  if (precision == DescriptorPrecision::BINARY) {
+    return (num_dimensions + 7) / 8;
+  }
+  return num_dimensions * DescriptorEntrySize(precision);
+}
+
+void DequantizeDescriptors(const DescriptorPrecision precision,
+                           const void* data,
+                           const int rows,
+                           const int cols,
+                           DescriptorMatrix* descriptors) {
+  CHECK_NOTNULL(descriptors)->resize(rows, cols);
+  switch (precision) {
+    case DescriptorPrecision::FLOAT32:
+      *descriptors = Eigen::Map<const DescriptorMatrix>(
+          static_cast<const float*>(data), rows, cols);
+      break;
+    case DescriptorPrecision::FLOAT16:
+      ConvertHalfsToFloats(static_cast<const uint16_t*>(data),
+                           descriptors->size(),
+                           descriptors->data());
+      break;
+    case DescriptorPrecision::UINT8:
+      *descriptors = Eigen::Map<const Uint8DescriptorMatrix>(
+                         static_cast<const uint8_t*>(data), rows, cols)
+                         .cast<float>() *
+                     (1.0f / kUint8DescriptorScale);
+      break;
+    case DescriptorPrecision::BINARY:
+      UnpackBinaryDescriptors(static_cast<const uint8_t*>(data),
+                              rows,
+                              cols,
+                              DescriptorSizeInBytes(precision, cols),
+                              descriptors->data());
+      break;
+    default:
+      LOG(FATAL) << "Invalid descriptor precision.";
+  }
+}
+
+int QuantizedDescriptorMatrix::rows() const {
+  switch (precision_) {
+    case DescriptorPrecision::FLOAT16:
+      return float16_descriptors_.rows();
+    case DescriptorPrecision::UINT8:
+      return uint8_descriptors_.rows();
+    case DescriptorPrecision::BINARY:
+      return binary_descriptors_.rows();
+    default:
+      return float32_descriptors_.rows();
+  }
+}
+
+int QuantizedDescriptorMatrix::cols() const {
+  switch (precision_) {
+    case DescriptorPrecision::FLOAT16:
+      return float16_descriptors_.cols();
+    case DescriptorPrecision::UINT8:
+      return uint8_descriptors_.cols();
+    case DescriptorPrecision::BINARY:
+      return binary_descriptor_dimension_;
+    default:
+      return float32_descriptors_.cols();
+  }
+}
+
+size_t QuantizedDescriptorMatrix::NumBytes() const {
+  return float32_descriptors_.size() * sizeof(float) +
+         float16_descriptors_.size() * sizeof(uint16_t) +
+         uint8_descriptors_.size() * sizeof(uint8_t) +
+         binary_descriptors_.size() * sizeof(uint8_t);
+}
+
+}  // namespace theia
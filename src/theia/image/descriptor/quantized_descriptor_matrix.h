@@ -0,0 +1,176 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IMAGE_DESCRIPTOR_QUANTIZED_DESCRIPTOR_MATRIX_H_
+#define THEIA_IMAGE_DESCRIPTOR_QUANTIZED_DESCRIPTOR_MATRIX_H_
+
+#include <cereal/access.hpp>
+#include <cereal/types/common.hpp>
+#include <Eigen/Core>
+#include <stdint.h>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/io/eigen_serializable.h"
+
+namespace theia {
+
+// The precision used to store descriptors. Reduced precision descriptors need
+// 2x (FLOAT16) or 4x (UINT8) less memory and disk space than FLOAT32.
+//
+// FLOAT16: IEEE half precision floats. Suitable for any float descriptor.
+//
+// UINT8: Each entry is scaled by kUint8DescriptorScale, rounded, and clamped to
+//   [0, 255]. This is the native range of the VLFeat SIFT descriptor, so SIFT
+//   and RootSIFT descriptors are stored with a negligible loss of accuracy.
+//   Descriptors with negative entries (e.g. AKAZE) should use FLOAT16 instead.
+//
+// BINARY: Each entry is stored as a single bit that is set if the entry is
+//   greater than 0.5. This is meant for binary descriptors (e.g. AKAZE MLDB),
+//   which are represented by float descriptors with 0 or 1 entries. The bits of
+//   each descriptor are packed into ceil(cols / 8) bytes, starting with the
+//   least significant bit of the first byte, so that they may be compared with
+//   the Hamming distance. For 0/1 descriptors the squared L2 distance equals
+//   the Hamming distance, so the float matchers remain valid as well.
+enum class DescriptorPrecision {
+  FLOAT32 = 0,
+  FLOAT16 = 1,
+  UINT8 = 2,
+  BINARY = 3,
+};
+
+// The scale applied to descriptor entries when quantizing them to UINT8.
+static const float kUint8DescriptorScale = 512.0f;
+
+// Conversions between single and (IEEE) half precision floats. Values are
+// rounded to the nearest half precision float.
+uint16_t FloatToHalf(const float value);
+float HalfToFloat(const uint16_t value);
+
+// The number of bytes used to store a single descriptor entry with the given
+// precision. This may not be called for BINARY descriptors, which use a single
+// bit per entry.
+size_t DescriptorEntrySize(const DescriptorPrecision precision);
+
+// The number of bytes used to store a single descriptor with the given
+// precision and number of dimensions.
+size_t DescriptorSizeInBytes(const DescriptorPrecision precision,
+                             const int num_dimensions);
+
+// Converts rows x cols descriptor entries that are stored in row-major order
+// with the given precision to floats. This allows descriptors to be converted
+// directly from a buffer that is not owned by a QuantizedDescriptorMatrix, e.g.
+// a memory mapped file.
+void DequantizeDescriptors(const DescriptorPrecision precision,
+                           const void* data,
+                           const int rows,
+                           const int cols,
+                           DescriptorMatrix* descriptors);
+
+typedef Eigen::Matrix<uint16_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    Float16DescriptorMatrix;
+typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    Uint8DescriptorMatrix;
+// Binary descriptors with the bits of each descriptor packed into the bytes of
+// one row (see DescriptorPrecision::BINARY).
+typedef Eigen::Matrix<uint8_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    BinaryDescriptorMatrix;
+
+// A descriptor matrix stored with a given precision. Like the DescriptorMatrix,
+// the descriptors are stored contiguously with one descriptor per row.
+class QuantizedDescriptorMatrix {
+ public:
+  QuantizedDescriptorMatrix()
+      : precision_(DescriptorPrecision::FLOAT32),
+        binary_descriptor_dimension_(0) {}
+
+  // Stores the descriptors with the given precision.
+  void Quantize(const DescriptorMatrix& descriptors,
+                const DescriptorPrecision precision);
+
+  // Converts the stored descriptors back to single precision floats.
+  void Dequantize(DescriptorMatrix* descriptors) const;
+
+  DescriptorPrecision precision() const { return precision_; }
+  int rows() const;
+  int cols() const;
+
+  // The number of bytes used to store the descriptors.
+  size_t NumBytes() const;
+
+  // The stored descriptors. Only the matrix corresponding to the precision is
+  // non-empty.
+  const DescriptorMatrix& float32_descriptors() const {
+    return float32_descriptors_;
+  }
+  const Float16DescriptorMatrix& float16_descriptors() const {
+    return float16_descriptors_;
+  }
+  const Uint8DescriptorMatrix& uint8_descriptors() const {
+    return uint8_descriptors_;
+  }
+  const BinaryDescriptorMatrix& binary_descriptors() const {
+    return binary_descriptors_;
+  }
+
+ private:
+  // Templated method for disk I/O with cereal. This method tells cereal which
+  // data members should be used when reading/writing to/from disk.
+  friend class cereal::access;
+  template <class Archive>
+  void serialize(Archive& ar, const std::uint32_t version) {  // NOLINT
+    ar(precision_,
+       float32_descriptors_,
+       float16_descriptors_,
+       uint8_descriptors_);
+    // Binary descriptors were added in version 1.
+    if (version > 0) {
+      ar(binary_descriptors_, binary_descriptor_dimension_);
+    }
+  }
+
+  DescriptorPrecision precision_;
+  DescriptorMatrix float32_descriptors_;
+  Float16DescriptorMatrix float16_descriptors_;
+  Uint8DescriptorMatrix uint8_descriptors_;
+  BinaryDescriptorMatrix binary_descriptors_;
+  // The number of bits of each binary descriptor. The last byte of each row of
+  // the binary descriptors may be partially used.
+  int binary_descriptor_dimension_;
+};
+
+}  // namespace theia
+
+CEREAL_CLASS_VERSION(theia::QuantizedDescriptorMatrix, 1);
+
+#endif  // THEIA_IMAGE_DESCRIPTOR_QUANTIZED_DESCRIPTOR_MATRIX_H_
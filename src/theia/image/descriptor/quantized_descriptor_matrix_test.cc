@@ -0,0 +1,175 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <stdint.h>
+#include <cmath>
+#include <limits>
+
+#include "gtest/gtest.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/util/random.h"
+
+namespace theia {
+
+namespace {
+
+RandomNumberGenerator rng(57);
+
+static const int kNumDescriptors = 100;
+static const int kNumDimensions = 128;
+
+DescriptorMatrix RandomDescriptors(const float lower, const float upper) {
+  DescriptorMatrix descriptors(kNumDescriptors, kNumDimensions);
+  for (int i = 0; i < descriptors.rows(); i++) {
+    for (int j = 0; j < descriptors.cols(); j++) {
+      descriptors(i, j) = rng.RandFloat(lower, upper);
+    }
+  }
+  return descriptors;
+}
+
+}  // namespace
+
+TEST(QuantizedDescriptorMatrix, HalfConversionRoundTrip) {
+  // Every finite half precision value is exactly representable as a float.
+  for (int i = 0; i < (1 << 16); i++) {
+    const uint16_t half = static_cast<uint16_t>(i);
+    const float value = HalfToFloat(half);
+    if (std::isnan(value)) {
+      continue;
+    }
+    EXPECT_EQ(FloatToHalf(value), half);
+  }
+
+  EXPECT_EQ(HalfToFloat(FloatToHalf(0.0f)), 0.0f);
+  EXPECT_EQ(HalfToFloat(FloatToHalf(1.0f)), 1.0f);
+  EXPECT_EQ(HalfToFloat(FloatToHalf(-0.5f)), -0.5f);
+  EXPECT_EQ(HalfToFloat(FloatToHalf(1e6f)),
+            std::numeric_limits<float>::infinity());
+}
+
+TEST(QuantizedDescriptorMatrix, Float32IsExact) {
+  const DescriptorMatrix descriptors = RandomDescriptors(-1.0f, 1.0f);
+  QuantizedDescriptorMatrix quantized;
+  quantized.Quantize(descriptors, DescriptorPrecision::FLOAT32);
+  EXPECT_EQ(quantized.rows(), kNumDescriptors);
+  EXPECT_EQ(quantized.cols(), kNumDimensions);
+  EXPECT_EQ(quantized.NumBytes(),
+            kNumDescriptors * kNumDimensions * sizeof(float));
+
+  DescriptorMatrix dequantized;
+  quantized.Dequantize(&dequantized);
+  EXPECT_EQ((dequantized - descriptors).cwiseAbs().maxCoeff(), 0.0f);
+}
+
+TEST(QuantizedDescriptorMatrix, Float16RoundTrip) {
+  const DescriptorMatrix descriptors = RandomDescriptors(-1.0f, 1.0f);
+  QuantizedDescriptorMatrix quantized;
+  quantized.Quantize(descriptors, DescriptorPrecision::FLOAT16);
+  EXPECT_EQ(quantized.rows(), kNumDescriptors);
+  EXPECT_EQ(quantized.cols(), kNumDimensions);
+  EXPECT_EQ(quantized.NumBytes(),
+            kNumDescriptors * kNumDimensions * sizeof(uint16_t));
+
+  // Half precision floats have an 11 bit significand, so values in [-1, 1] are
+  // accurate to within 2^-11.
+  DescriptorMatrix dequantized;
+  quantized.Dequantize(&dequantized);
+  EXPECT_EQ(dequantized.rows(), kNumDescriptors);
+  EXPECT_EQ(dequantized.cols(), kNumDimensions);
+  EXPECT_LE((dequantized - descriptors).cwiseAbs().maxCoeff(),
+            std::ldexp(1.0f, -11));
+}
+
+TEST(QuantizedDescriptorMatrix, Uint8RoundTrip) {
+  const float kMaxValue = 255.0f / kUint8DescriptorScale;
+  const DescriptorMatrix descriptors = RandomDescriptors(0.0f, kMaxValue);
+  QuantizedDescriptorMatrix quantized;
+  quantized.Quantize(descriptors, DescriptorPrecision::UINT8);
+  EXPECT_EQ(quantized.rows(), kNumDescriptors);
+  EXPECT_EQ(quantized.cols(), kNumDimensions);
+  EXPECT_EQ(quantized.NumBytes(), kNumDescriptors * kNumDimensions);
+
+  // Rounding introduces an error of at most half of a quantization step.
+  DescriptorMatrix dequantized;
+  quantized.Dequantize(&dequantized);
+  EXPECT_LE((dequantized - descriptors).cwiseAbs().maxCoeff(),
+            0.5f / kUint8DescriptorScale + 1e-6f);
+}
+
+TEST(QuantizedDescriptorMatrix, Uint8Clamps) {
+  DescriptorMatrix descriptors(1, 3);
+  descriptors << -1.0f, 0.1f, 1.0f;
+  QuantizedDescriptorMatrix quantized;
+  quantized.Quantize(descriptors, DescriptorPrecision::UINT8);
+  EXPECT_EQ(quantized.uint8_descriptors()(0, 0), 0);
+  EXPECT_EQ(quantized.uint8_descriptors()(0, 1),
+            static_cast<uint8_t>(std::round(0.1f * kUint8DescriptorScale)));
+  EXPECT_EQ(quantized.uint8_descriptors()(0, 2), 255);
+}
+
+TEST(QuantizedDescriptorMatrix, BinaryRoundTrip) {
+  // 486 bits is the size of an AKAZE MLDB descriptor, which does not fill the
+  // last byte.
+  static const int kNumBits = 486;
+  DescriptorMatrix descriptors(kNumDescriptors, kNumBits);
+  for (int i = 0; i < descriptors.rows(); i++) {
+    for (int j = 0; j < descriptors.cols(); j++) {
+      descriptors(i, j) = rng.RandInt(0, 1);
+    }
+  }
+
+  QuantizedDescriptorMatrix quantized;
+  quantized.Quantize(descriptors, DescriptorPrecision::BINARY);
+  EXPECT_EQ(quantized.rows(), kNumDescriptors);
+  EXPECT_EQ(quantized.cols(), kNumBits);
+  EXPECT_EQ(quantized.binary_descriptors().cols(), 61);
+  EXPECT_EQ(quantized.NumBytes(), kNumDescriptors * 61);
+  EXPECT_EQ(DescriptorSizeInBytes(DescriptorPrecision::BINARY, kNumBits), 61);
+
+  // The bits are packed starting with the least significant bit.
+  EXPECT_EQ(quantized.binary_descriptors()(0, 0) & 1,
+            static_cast<int>(descriptors(0, 0)));
+  EXPECT_EQ((quantized.binary_descriptors()(0, 1) >> 2) & 1,
+            static_cast<int>(descriptors(0, 10)));
+
+  DescriptorMatrix dequantized;
+  quantized.Dequantize(&dequantized);
+  EXPECT_EQ(dequantized.rows(), kNumDescriptors);
+  EXPECT_EQ(dequantized.cols(), kNumBits);
+  EXPECT_EQ((dequantized - descriptors).cwiseAbs().maxCoeff(), 0.0f);
+}
+
+}  // namespace theia
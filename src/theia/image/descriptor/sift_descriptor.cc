@@ -35,6 +35,10 @@
 #include "theia/image/descriptor/sift_descriptor.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <future>  // NOLINT
 extern "C" {
 #include "vl/sift.h"
 }
@@ -44,7 +48,9 @@ extern "C" {
 #include "glog/logging.h"
 #include "theia/image/image.h"
 #include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/util/threadpool.h"
 
 namespace theia {
 namespace {
@@ -53,6 +59,24 @@ namespace {
 // than this then we begin to have memory and speed issues.
 static const int kMaxScaledDim = 3600;
 
+// The dimension of a SIFT descriptor.
+static const int kSiftDescriptorDim = 128;
+
+// The maximum number of SIFT filters (one per image size) that are kept, and
+// the maximum total number of image pixels of the kept filters. The memory of
+// a filter grows with the image size, so only the filter of the most recently
+// used image size is kept for large images.
+static const int kMaxNumSiftFilters = 4;
+static const int64_t kMaxNumSiftFilterPixels = 8 * 1024 * 1024;
+
+// The number of keypoints whose orientations and descriptors are computed by
+// each task when the keypoints of an octave are described in parallel.
+static const int kNumKeypointsPerTask = 256;
+
+// VLFeat only vectorizes the Gaussian filter of images whose width and height
+// are multiples of 16, so the tiles of an octave start at multiples of 16.
+static const int kTileAlignment = 16;
+
 double GetValidFirstOctave(const int first_octave,
                            const int width,
                            const int height) {
@@ -66,10 +90,497 @@ double GetValidFirstOctave(const int first_octave,
   return valid_first_octave;
 }
 
+// Returns the pixels of the image as a grayscale image. Color images are
+// converted into the grayscale image.
+const float* GrayscalePixels(const FloatImage& image,
+                             FloatImage* grayscale_image) {
+  if (image.Channels() == 1) {
+    return image.Data();
+  }
+  *grayscale_image = image.AsGrayscaleImage();
+  return grayscale_image->Data();
+}
+
+// Copies num_rows rows of row_length values between two images with the given
+// number of values per row.
+void CopyRows(const float* source,
+              const int source_row_stride,
+              const int num_rows,
+              const int row_length,
+              const int destination_row_stride,
+              float* destination) {
+  for (int i = 0; i < num_rows; i++) {
+    std::memcpy(destination + i * destination_row_stride,
+                source + i * source_row_stride,
+                row_length * sizeof(*source));
+  }
+}
+
+// Returns true if the two strings are equal. This may be evaluated at compile
+// time.
+constexpr bool StringsAreEqual(const char* a, const char* b) {
+  return *a == *b && (*a == '\0' || StringsAreEqual(a + 1, b + 1));
+}
+
+// VLFeat has no API to store an octave that was computed outside of the SIFT
+// filter, so the octaves that are computed in tiles are stored by writing the
+// private fields of the filter that vl_sift_process_first_octave,
+// vl_sift_process_next_octave, and the gradient computation of
+// vl_sift_calc_keypoint_orientations write. SetSiftFilterState is the only
+// function that writes private fields of VlSiftFilt. Other functions only read
+// them, and write the levels of the scale space through vl_sift_get_octave and
+// the gradient through the pointer returned by SetSiftFilterState. The fields
+// and their meaning must be checked again whenever VLFeat is updated.
+static_assert(StringsAreEqual(VL_VERSION_STRING, "0.9.20"),
+              "The private fields of VlSiftFilt that are written by "
+              "SetSiftFilterState must be checked for this VLFeat version.");
+
+// Sets the current octave of the filter without computing it, which sets the
+// size of the octave and clears its keypoints as vl_sift_process_first_octave
+// and vl_sift_process_next_octave do, and sets whether the gradient of the
+// filter is the gradient of the octave. The nominal smoothing is the smoothing
+// of the images that the filter processes. Returns the gradient of the filter,
+// which has two values (the magnitude and the angle) for each pixel of the
+// levels s_min + 1 to s_max - 2 of the octave.
+float* SetSiftFilterState(const int octave,
+                          const bool gradient_is_computed,
+                          const double nominal_smoothing,
+                          VlSiftFilt* sift_filter) {
+  sift_filter->o_cur = octave;
+  sift_filter->nkeys = 0;
+  sift_filter->octave_width = VL_SHIFT_LEFT(sift_filter->width, -octave);
+  sift_filter->octave_height = VL_SHIFT_LEFT(sift_filter->height, -octave);
+  // VLFeat recomputes the gradient whenever its octave is not the current one.
+  sift_filter->grad_o = gradient_is_computed ? octave : octave - 1;
+  sift_filter->sigman = nominal_smoothing;
+  return sift_filter->grad;
+}
+
+// Computes the gradient of the current octave of the filter if it is not up to
+// date. VLFeat computes the gradient when the orientations of the first
+// keypoint of an octave are computed, so we compute the orientations of a
+// keypoint at the origin.
+void UpdateGradient(VlSiftFilt* sift_filter) {
+  if (sift_filter->grad_o == sift_filter->o_cur) {
+    return;
+  }
+  VlSiftKeypoint keypoint;
+  const double sigma = sift_filter->sigma0 * std::pow(2.0, sift_filter->o_cur);
+  vl_sift_keypoint_init(sift_filter, &keypoint, 0.0, 0.0, sigma);
+  double angles[4];
+  vl_sift_calc_keypoint_orientations(sift_filter, angles, &keypoint);
+  CHECK_EQ(sift_filter->grad_o, sift_filter->o_cur);
+}
+
+// Returns the width of VLFeat's Gaussian filter (on each side of the center).
+int GaussianFilterWidth(const double sigma) {
+  return std::max(static_cast<int>(std::ceil(4.0 * sigma)), 1);
+}
+
+// Returns the number of pixels at the edges of a tile of an octave in which the
+// scale space or the gradient of the tile may differ from the scale space of
+// the whole octave. The scale space of the tile is computed as if the image
+// ended at the edges of the tile, so each smoothing spreads the difference by
+// the width of its Gaussian filter. The first level is computed from the image
+// without any difference unless the image is upsampled.
+int NumTileMarginPixels(const VlSiftFilt& sift_filter,
+                        const int first_octave,
+                        const bool smooth_first_level) {
+  int num_margin_pixels = first_octave < 0 ? (1 << -first_octave) + 1 : 0;
+  if (smooth_first_level) {
+    const double sa =
+        sift_filter.sigma0 * std::pow(sift_filter.sigmak, sift_filter.s_min);
+    const double sb = sift_filter.sigman * std::pow(2.0, -first_octave);
+    if (sa > sb) {
+      num_margin_pixels += GaussianFilterWidth(std::sqrt(sa * sa - sb * sb));
+    }
+  }
+  for (int s = sift_filter.s_min + 1; s <= sift_filter.s_max; ++s) {
+    num_margin_pixels += GaussianFilterWidth(
+        sift_filter.dsigma0 * std::pow(sift_filter.sigmak, s));
+  }
+  // The gradient uses the neighboring pixels.
+  return num_margin_pixels + 1;
+}
+
+// Computes the scale space and the gradient of a tile of the current octave of
+// the filter and copies the part of the tile within [x0, x1) x [y0, y1) into
+// the filter. The tile includes the margins around this part, in which the
+// scale space of the tile differs from the scale space of the whole octave.
+void ComputeOctaveTile(const float* image,
+                       const int image_width,
+                       const int image_height,
+                       const int first_octave,
+                       const bool smooth_first_level,
+                       const int num_margin_pixels,
+                       const int x0,
+                       const int x1,
+                       const int y0,
+                       const int y1,
+                       VlSiftFilt* sift_filter,
+                       float* gradient) {
+  const int octave_width = vl_sift_get_octave_width(sift_filter);
+  const int octave_height = vl_sift_get_octave_height(sift_filter);
+
+  // The tile starts and ends at multiples of the alignment, which is also a
+  // pixel of the image if the image is upsampled. The tile extends to the end
+  // of the image if it reaches the end of the octave so that the edges of the
+  // octave are handled as for the whole octave.
+  const int alignment =
+      first_octave < 0 ? std::max(kTileAlignment, 1 << -first_octave)
+                       : kTileAlignment;
+  const int tile_x0 =
+      std::max(x0 - num_margin_pixels, 0) / alignment * alignment;
+  const int tile_y0 =
+      std::max(y0 - num_margin_pixels, 0) / alignment * alignment;
+  const int tile_x1 =
+      (x1 + num_margin_pixels + alignment - 1) / alignment * alignment;
+  const int tile_y1 =
+      (y1 + num_margin_pixels + alignment - 1) / alignment * alignment;
+  const int image_x0 = VL_SHIFT_LEFT(tile_x0, first_octave);
+  const int image_y0 = VL_SHIFT_LEFT(tile_y0, first_octave);
+  const int image_x1 = tile_x1 >= octave_width
+                           ? image_width
+                           : VL_SHIFT_LEFT(tile_x1, first_octave);
+  const int image_y1 = tile_y1 >= octave_height
+                           ? image_height
+                           : VL_SHIFT_LEFT(tile_y1, first_octave);
+
+  std::vector<float> tile_image((image_x1 - image_x0) *
+                                (image_y1 - image_y0));
+  CopyRows(image + image_y0 * image_width + image_x0,
+           image_width,
+           image_y1 - image_y0,
+           image_x1 - image_x0,
+           image_x1 - image_x0,
+           tile_image.data());
+
+  VlSiftFilt* tile_filter = vl_sift_new(image_x1 - image_x0,
+                                        image_y1 - image_y0,
+                                        1,
+                                        sift_filter->S,
+                                        first_octave);
+  // The nominal smoothing of the image is set to the smoothing of the first
+  // level if the image is the downsampled level of the previous octave, which
+  // is already smoothed as much.
+  if (!smooth_first_level) {
+    SetSiftFilterState(first_octave, false, tile_filter->sigma0, tile_filter);
+  }
+  vl_sift_process_first_octave(tile_filter, tile_image.data());
+  UpdateGradient(tile_filter);
+
+  const int tile_width = vl_sift_get_octave_width(tile_filter);
+  const int tile_height = vl_sift_get_octave_height(tile_filter);
+  CHECK_GE(tile_x0 + tile_width, x1);
+  CHECK_GE(tile_y0 + tile_height, y1);
+  const int tile_offset = (y0 - tile_y0) * tile_width + x0 - tile_x0;
+  const int octave_offset = y0 * octave_width + x0;
+  for (int s = sift_filter->s_min; s <= sift_filter->s_max; ++s) {
+    CopyRows(vl_sift_get_octave(tile_filter, s) + tile_offset,
+             tile_width,
+             y1 - y0,
+             x1 - x0,
+             octave_width,
+             vl_sift_get_octave(sift_filter, s) + octave_offset);
+  }
+
+  // The gradient has two values (the magnitude and the angle) for each pixel
+  // of the levels s_min + 1 to s_max - 2.
+  for (int s = sift_filter->s_min + 1; s <= sift_filter->s_max - 2; ++s) {
+    const int level = s - sift_filter->s_min - 1;
+    CopyRows(tile_filter->grad + 2 * (level * tile_width * tile_height +
+                                      tile_offset),
+             2 * tile_width,
+             y1 - y0,
+             2 * (x1 - x0),
+             2 * octave_width,
+             gradient + 2 * (level * octave_width * octave_height +
+                             octave_offset));
+  }
+  vl_sift_delete(tile_filter);
+}
+
+// Computes the scale space and the gradient of the octave in tiles of about
+// tile_size x tile_size pixels on the thread pool and makes it the current
+// octave of the filter. Since the scale space is computed with local filters,
+// each tile is computed with a margin that is large enough for the tile to be
+// the same as the whole octave apart from the margin, so the filter is the same
+// as if it had computed the whole octave itself. The octave is computed from
+// the image, which is upsampled or downsampled by the first octave, and the
+// first level is smoothed to the smoothing of the octave if smooth_first_level
+// is true.
+void ComputeOctaveInTiles(const float* image,
+                          const int image_width,
+                          const int image_height,
+                          const int octave,
+                          const int first_octave,
+                          const bool smooth_first_level,
+                          const int tile_size,
+                          ThreadPool* thread_pool,
+                          VlSiftFilt* sift_filter) {
+  const double nominal_smoothing = sift_filter->sigman;
+  float* gradient =
+      SetSiftFilterState(octave, false, nominal_smoothing, sift_filter);
+  const int octave_width = vl_sift_get_octave_width(sift_filter);
+  const int octave_height = vl_sift_get_octave_height(sift_filter);
+  const int num_margin_pixels =
+      NumTileMarginPixels(*sift_filter, first_octave, smooth_first_level);
+  const int num_tiles_x = (octave_width + tile_size - 1) / tile_size;
+  const int num_tiles_y = (octave_height + tile_size - 1) / tile_size;
+
+  // The octave is divided into tiles that start at multiples of the tile
+  // alignment.
+  const auto tile_start = [](const int i, const int num_tiles, const int size) {
+    return i == num_tiles
+               ? size
+               : i * size / num_tiles / kTileAlignment * kTileAlignment;
+  };
+
+  std::vector<std::future<void> > tiles;
+  for (int i = 0; i < num_tiles_y; i++) {
+    const int y0 = tile_start(i, num_tiles_y, octave_height);
+    const int y1 = tile_start(i + 1, num_tiles_y, octave_height);
+    for (int j = 0; j < num_tiles_x; j++) {
+      const int x0 = tile_start(j, num_tiles_x, octave_width);
+      const int x1 = tile_start(j + 1, num_tiles_x, octave_width);
+      if (x0 == x1 || y0 == y1) {
+        continue;
+      }
+      tiles.emplace_back(thread_pool->Add(ComputeOctaveTile,
+                                          image,
+                                          image_width,
+                                          image_height,
+                                          first_octave,
+                                          smooth_first_level,
+                                          num_margin_pixels,
+                                          x0,
+                                          x1,
+                                          y0,
+                                          y1,
+                                          sift_filter,
+                                          gradient));
+    }
+  }
+  for (std::future<void>& tile : tiles) {
+    tile.get();
+  }
+  SetSiftFilterState(octave, true, nominal_smoothing, sift_filter);
+}
+
+// Computes the orientations and descriptors of the keypoints [begin, end) of
+// the current octave of the filter, and appends the keypoints (once for each
+// orientation) and their descriptors.
+void ComputeOrientationsAndDescriptors(const bool upright_sift,
+                                       const int begin,
+                                       const int end,
+                                       VlSiftFilt* sift_filter,
+                                       std::vector<Keypoint>* keypoints,
+                                       std::vector<float>* descriptor_data) {
+  const VlSiftKeypoint* vl_keypoints = vl_sift_get_keypoints(sift_filter);
+  for (int i = begin; i < end; ++i) {
+    // Calculate (up to 4) orientations of the keypoint.
+    double angles[4];
+    int num_angles = vl_sift_calc_keypoint_orientations(sift_filter,
+                                                        angles,
+                                                        &vl_keypoints[i]);
+    // If upright sift is enabled, only use the first keypoint at a given
+    // pixel location.
+    if (upright_sift && num_angles > 1) {
+      num_angles = 1;
+    }
+
+    for (int j = 0; j < num_angles; ++j) {
+      descriptor_data->resize(descriptor_data->size() + kSiftDescriptorDim);
+      vl_sift_calc_keypoint_descriptor(
+          sift_filter,
+          descriptor_data->data() + descriptor_data->size() -
+              kSiftDescriptorDim,
+          &vl_keypoints[i],
+          angles[j]);
+
+      Keypoint keypoint(vl_keypoints[i].x, vl_keypoints[i].y, Keypoint::SIFT);
+      keypoint.set_scale(vl_keypoints[i].sigma);
+      keypoint.set_orientation(angles[j]);
+      keypoints->push_back(keypoint);
+    }
+  }
+}
+
+// Applies the RootSIFT conversion to each row of the descriptor matrix.
+void ConvertRowsToRootSift(DescriptorMatrix* descriptors) {
+  static const double kTolerance = 1e-8;
+  for (int i = 0; i < descriptors->rows(); i++) {
+    const double l1_norm = descriptors->row(i).lpNorm<1>();
+    if (l1_norm > kTolerance) {
+      descriptors->row(i) = (descriptors->row(i) / l1_norm).array().sqrt();
+    }
+  }
+}
+
 }  // namespace
 
 SiftDescriptorExtractor::~SiftDescriptorExtractor() {
-  if (sift_filter_ != nullptr) vl_sift_delete(sift_filter_);
+  for (VlSiftFilt* sift_filter : sift_filters_) {
+    vl_sift_delete(sift_filter);
+  }
+}
+
+VlSiftFilt* SiftDescriptorExtractor::GetSiftFilter(const int width,
+                                                   const int height) {
+  for (int i = 0; i < sift_filters_.size(); i++) {
+    if (sift_filters_[i]->width == width &&
+        sift_filters_[i]->height == height) {
+      // Move the filter to the front since it is the most recently used one.
+      std::rotate(sift_filters_.begin(),
+                  sift_filters_.begin() + i,
+                  sift_filters_.begin() + i + 1);
+      // VLFeat does not mark the gradient of the filter as out of date when the
+      // filter processes another image, so the gradient of the previous image
+      // would be used if it was computed for the first octave.
+      VlSiftFilt* sift_filter = sift_filters_.front();
+      SetSiftFilterState(vl_sift_get_octave_first(sift_filter),
+                         false,
+                         sift_filter->sigman,
+                         sift_filter);
+      return sift_filter;
+    }
+  }
+
+  const int first_octave =
+      GetValidFirstOctave(sift_params_.first_octave, width, height);
+  VlSiftFilt* sift_filter = vl_sift_new(width,
+                                        height,
+                                        sift_params_.num_octaves,
+                                        sift_params_.num_levels,
+                                        first_octave);
+  vl_sift_set_edge_thresh(sift_filter, sift_params_.edge_threshold);
+  vl_sift_set_peak_thresh(sift_filter, sift_params_.peak_threshold);
+  sift_filters_.insert(sift_filters_.begin(), sift_filter);
+
+  // Delete the least recently used filters if too many are kept. The most
+  // recently used filter is always kept.
+  int64_t num_pixels = 0;
+  for (int i = 0; i < sift_filters_.size(); i++) {
+    num_pixels += static_cast<int64_t>(sift_filters_[i]->width) *
+                  sift_filters_[i]->height;
+    if (i > 0 &&
+        (i >= kMaxNumSiftFilters || num_pixels > kMaxNumSiftFilterPixels)) {
+      for (int j = i; j < sift_filters_.size(); j++) {
+        vl_sift_delete(sift_filters_[j]);
+      }
+      sift_filters_.resize(i);
+      break;
+    }
+  }
+  return sift_filter;
+}
+
+bool SiftDescriptorExtractor::UseTiles(const int octave_width,
+                                       const int octave_height) const {
+  return thread_pool_ != nullptr && sift_params_.tile_size > 0 &&
+         (octave_width > sift_params_.tile_size ||
+          octave_height > sift_params_.tile_size);
+}
+
+int SiftDescriptorExtractor::ProcessFirstOctave(const float* pixels,
+                                                VlSiftFilt* sift_filter) {
+  if (!UseTiles(VL_SHIFT_LEFT(sift_filter->width, -sift_filter->o_min),
+                VL_SHIFT_LEFT(sift_filter->height, -sift_filter->o_min))) {
+    return vl_sift_process_first_octave(sift_filter, pixels);
+  }
+
+  if (vl_sift_get_noctaves(sift_filter) == 0) {
+    return VL_ERR_EOF;
+  }
+  ComputeOctaveInTiles(pixels,
+                       sift_filter->width,
+                       sift_filter->height,
+                       vl_sift_get_octave_first(sift_filter),
+                       vl_sift_get_octave_first(sift_filter),
+                       true,
+                       sift_params_.tile_size,
+                       thread_pool_,
+                       sift_filter);
+  return VL_ERR_OK;
+}
+
+int SiftDescriptorExtractor::ProcessNextOctave(VlSiftFilt* sift_filter) {
+  const int next_octave = sift_filter->o_cur + 1;
+  if (sift_filter->o_cur == sift_filter->o_min + sift_filter->O - 1 ||
+      !UseTiles(VL_SHIFT_LEFT(sift_filter->width, -next_octave),
+                VL_SHIFT_LEFT(sift_filter->height, -next_octave))) {
+    return vl_sift_process_next_octave(sift_filter);
+  }
+
+  // As in VLFeat, the first level of the next octave is the level of the
+  // current octave with twice the smoothing of the first level, downsampled by
+  // two. It is not smoothed any further.
+  const int width = vl_sift_get_octave_width(sift_filter);
+  const float* level = vl_sift_get_octave(
+      sift_filter,
+      std::min(sift_filter->s_min + sift_filter->S, sift_filter->s_max));
+  const int next_width = VL_SHIFT_LEFT(sift_filter->width, -next_octave);
+  const int next_height = VL_SHIFT_LEFT(sift_filter->height, -next_octave);
+  std::vector<float> next_level(next_width * next_height);
+  for (int y = 0; y < next_height; y++) {
+    for (int x = 0; x < next_width; x++) {
+      next_level[y * next_width + x] = level[2 * (y * width + x)];
+    }
+  }
+
+  ComputeOctaveInTiles(next_level.data(),
+                       next_width,
+                       next_height,
+                       next_octave,
+                       0,
+                       false,
+                       sift_params_.tile_size,
+                       thread_pool_,
+                       sift_filter);
+  return VL_ERR_OK;
+}
+
+void SiftDescriptorExtractor::ExtractOctaveDescriptors(
+    VlSiftFilt* sift_filter, std::vector<Keypoint>* keypoints) {
+  const int num_keypoints = vl_sift_get_nkeypoints(sift_filter);
+  if (thread_pool_ == nullptr || num_keypoints <= kNumKeypointsPerTask) {
+    ComputeOrientationsAndDescriptors(sift_params_.upright_sift,
+                                      0,
+                                      num_keypoints,
+                                      sift_filter,
+                                      keypoints,
+                                      &descriptor_data_);
+    return;
+  }
+
+  // The tasks only read the filter once its gradient is up to date. The
+  // keypoints and descriptors of each task are appended in the order of the
+  // tasks so that they are in the same order as without the thread pool.
+  UpdateGradient(sift_filter);
+  const int num_tasks =
+      (num_keypoints + kNumKeypointsPerTask - 1) / kNumKeypointsPerTask;
+  std::vector<std::vector<Keypoint> > task_keypoints(num_tasks);
+  std::vector<std::vector<float> > task_descriptor_data(num_tasks);
+  std::vector<std::future<void> > tasks;
+  for (int i = 0; i < num_tasks; i++) {
+    tasks.emplace_back(thread_pool_->Add(
+        ComputeOrientationsAndDescriptors,
+        sift_params_.upright_sift,
+        i * kNumKeypointsPerTask,
+        std::min((i + 1) * kNumKeypointsPerTask, num_keypoints),
+        sift_filter,
+        &task_keypoints[i],
+        &task_descriptor_data[i]));
+  }
+  for (int i = 0; i < num_tasks; i++) {
+    tasks[i].get();
+    keypoints->insert(keypoints->end(),
+                      task_keypoints[i].begin(),
+                      task_keypoints[i].end());
+    descriptor_data_.insert(descriptor_data_.end(),
+                            task_descriptor_data[i].begin(),
+                            task_descriptor_data[i].end());
+  }
 }
 
 bool SiftDescriptorExtractor::ComputeDescriptor(
@@ -79,37 +590,23 @@ bool SiftDescriptorExtractor::ComputeDescriptor(
   CHECK(keypoint.has_scale() && keypoint.has_orientation())
       << "Keypoint must have scale and orientation to compute a SIFT "
       << "descriptor.";
-  // If the filter has been set, but is not usable for the input image (i.e. the
-  // width and height are different) then we must make a new filter. Adding this
-  // statement will save the function from regenerating the filter for
-  // successive calls with images of the same size (e.g. a video sequence).
-  if (sift_filter_ == nullptr || (sift_filter_->width != image.Cols() ||
-                                  sift_filter_->height != image.Rows())) {
-    vl_sift_delete(sift_filter_);
-    const int first_octave =
-        GetValidFirstOctave(sift_params_.first_octave,
-                            image.Rows(), image.Cols());
-    sift_filter_ = vl_sift_new(image.Cols(), image.Rows(),
-                               sift_params_.num_octaves,
-                               sift_params_.num_levels, first_octave);
-  }
+  VlSiftFilt* sift_filter = GetSiftFilter(image.Cols(), image.Rows());
 
   // Create the vl sift keypoint from the one passed in.
   VlSiftKeypoint sift_keypoint;
-  vl_sift_keypoint_init(sift_filter_, &sift_keypoint, keypoint.x(),
+  vl_sift_keypoint_init(sift_filter, &sift_keypoint, keypoint.x(),
                         keypoint.y(), keypoint.scale());
 
-  // The VLFeat functions take in a non-const image pointer so that it can
-  // calculate gaussian pyramids. Obviously, we do not want to break our const
-  // input, so the best solution (for now) is to copy the image.
-  FloatImage mutable_image = image.AsGrayscaleImage();
+  // VLFeat only reads the image, so grayscale images are used without copying.
+  FloatImage grayscale_image;
+  const float* pixels = GrayscalePixels(image, &grayscale_image);
 
   // Calculate the first octave to process.
   int vl_status =
-      vl_sift_process_first_octave(sift_filter_, mutable_image.Data());
+      vl_sift_process_first_octave(sift_filter, pixels);
   // Proceed through the octaves we reach the same one as the keypoint.
-  while (sift_keypoint.o != sift_filter_->o_cur) {
-    vl_sift_process_next_octave(sift_filter_);
+  while (sift_keypoint.o != sift_filter->o_cur) {
+    vl_sift_process_next_octave(sift_filter);
   }
 
   if (vl_status == VL_ERR_EOF) {
@@ -118,8 +615,8 @@ bool SiftDescriptorExtractor::ComputeDescriptor(
 
   // Calculate the sift feature. Note that we are passing in a direct pointer to
   // the descriptor's underlying data.
-  CHECK_NOTNULL(descriptor)->resize(128);
-  vl_sift_calc_keypoint_descriptor(sift_filter_, descriptor->data(),
+  CHECK_NOTNULL(descriptor)->resize(kSiftDescriptorDim);
+  vl_sift_calc_keypoint_descriptor(sift_filter, descriptor->data(),
                                    &sift_keypoint, keypoint.orientation());
   if (sift_params_.root_sift) {
     ConvertToRootSift(descriptor);
@@ -130,21 +627,8 @@ bool SiftDescriptorExtractor::ComputeDescriptor(
 bool SiftDescriptorExtractor::ComputeDescriptors(
     const FloatImage& image,
     std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
-  // If the filter has been set, but is not usable for the input image (i.e. the
-  // width and height are different) then we must make a new filter. Adding this
-  // statement will save the function from regenerating the filter for
-  // successive calls with images of the same size (e.g. a video sequence).
-  if (sift_filter_ == nullptr || (sift_filter_->width != image.Cols() ||
-                                  sift_filter_->height != image.Rows())) {
-    vl_sift_delete(sift_filter_);
-    const int first_octave =
-        GetValidFirstOctave(sift_params_.first_octave,
-                            image.Rows(), image.Cols());
-    sift_filter_ = vl_sift_new(image.Cols(), image.Rows(),
-                               sift_params_.num_octaves,
-                               sift_params_.num_levels, first_octave);
-  }
+    DescriptorMatrix* descriptors) {
+  VlSiftFilt* sift_filter = GetSiftFilter(image.Cols(), image.Rows());
 
   // Create the vl sift keypoint from the one passed in.
   std::vector<VlSiftKeypoint> sift_keypoints(keypoints->size());
@@ -152,41 +636,38 @@ bool SiftDescriptorExtractor::ComputeDescriptors(
     CHECK((*keypoints)[i].has_scale() && (*keypoints)[i].has_orientation())
         << "Keypoint must have scale and orientation to compute a SIFT "
         << "descriptor.";
-    vl_sift_keypoint_init(sift_filter_,
+    vl_sift_keypoint_init(sift_filter,
                           &sift_keypoints[i],
                           (*keypoints)[i].x(),
                           (*keypoints)[i].y(),
                           (*keypoints)[i].scale());
   }
-  // The VLFeat functions take in a non-const image pointer so that it can
-  // calculate gaussian pyramids. Obviously, we do not want to break our const
-  // input, so the best solution (for now) is to copy the image.
-  FloatImage mutable_image = image.AsGrayscaleImage();
+  // VLFeat only reads the image, so grayscale images are used without copying.
+  FloatImage grayscale_image;
+  const float* pixels = GrayscalePixels(image, &grayscale_image);
 
   // Calculate the first octave to process.
   int vl_status =
-      vl_sift_process_first_octave(sift_filter_, mutable_image.Data());
+      vl_sift_process_first_octave(sift_filter, pixels);
 
   // Proceed through the octaves we reach the same one as the keypoint.  We
-  // first resize the descriptors vector so that the keypoint indicies will be
-  // properly matched to the descriptors.
-  descriptors->resize(keypoints->size(), Eigen::VectorXf(128));
+  // first resize the descriptor matrix so that the keypoint indicies will be
+  // properly matched to the descriptor rows.
+  descriptors->resize(keypoints->size(), kSiftDescriptorDim);
   while (vl_status != VL_ERR_EOF) {
     // Go through each keypoint to see if it came from this octave.
     for (int i = 0; i < sift_keypoints.size(); i++) {
-      if (sift_keypoints[i].o != sift_filter_->o_cur) continue;
+      if (sift_keypoints[i].o != sift_filter->o_cur) continue;
 
       vl_sift_calc_keypoint_descriptor(
-          sift_filter_, (*descriptors)[i].data(), &sift_keypoints[i],
+          sift_filter, descriptors->row(i).data(), &sift_keypoints[i],
           (*keypoints)[i].orientation());
     }
-    vl_status = vl_sift_process_next_octave(sift_filter_);
+    vl_status = vl_sift_process_next_octave(sift_filter);
   }
 
   if (sift_params_.root_sift) {
-    for (int i = 0; i < descriptors->size(); i++) {
-      ConvertToRootSift(&(*descriptors)[i]);
-    }
+    ConvertRowsToRootSift(descriptors);
   }
 
   return true;
@@ -195,73 +676,43 @@ bool SiftDescriptorExtractor::ComputeDescriptors(
 bool SiftDescriptorExtractor::DetectAndExtractDescriptors(
     const FloatImage& image,
     std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
-  // If the filter has been set, but is not usable for the input image (i.e. the
-  // width and height are different) then we must make a new filter. Adding this
-  // statement will save the function from regenerating the filter for
-  // successive calls with images of the same size (e.g. a video sequence).
-  if (sift_filter_ == nullptr || (sift_filter_->width != image.Cols() ||
-                                  sift_filter_->height != image.Rows())) {
-    vl_sift_delete(sift_filter_);
-    const int first_octave =
-        GetValidFirstOctave(sift_params_.first_octave,
-                            image.Rows(), image.Cols());
-    sift_filter_ = vl_sift_new(image.Cols(), image.Rows(),
-                               sift_params_.num_octaves,
-                               sift_params_.num_levels, first_octave);
-    vl_sift_set_edge_thresh(sift_filter_, sift_params_.edge_threshold);
-    vl_sift_set_peak_thresh(sift_filter_, sift_params_.peak_threshold);
-  }
-
-  // The VLFeat functions take in a non-const image pointer so that it can
-  // calculate gaussian pyramids. Obviously, we do not want to break our const
-  // input, so the best solution (for now) is to copy the image.
-  FloatImage mutable_image = image.AsGrayscaleImage();
+    DescriptorMatrix* descriptors) {
+  VlSiftFilt* sift_filter = GetSiftFilter(image.Cols(), image.Rows());
 
-  // Calculate the first octave to process.
-  int vl_status =
-      vl_sift_process_first_octave(sift_filter_, mutable_image.Data());
+  // VLFeat only reads the image, so grayscale images are used without copying.
+  FloatImage grayscale_image;
+  const float* pixels = GrayscalePixels(image, &grayscale_image);
+
+  // The descriptors are accumulated in a flat buffer since the number of
+  // keypoints is not known in advance, and copied into the matrix at the end.
+  descriptor_data_.clear();
+
+  // Calculate the first octave to process. The keypoints are detected in the
+  // whole octave even if the octave is computed in tiles so that they are the
+  // same as without tiles.
+  int vl_status = ProcessFirstOctave(pixels, sift_filter);
   // Process octaves until you can't anymore.
   while (vl_status != VL_ERR_EOF) {
     // Detect the keypoints.
-    vl_sift_detect(sift_filter_);
-
-    // Get the keypoints.
-    const VlSiftKeypoint* vl_keypoints = vl_sift_get_keypoints(sift_filter_);
-    const int num_keypoints = vl_sift_get_nkeypoints(sift_filter_);
-
-    for (int i = 0; i < num_keypoints; ++i) {
-      // Calculate (up to 4) orientations of the keypoint.
-      double angles[4];
-      int num_angles = vl_sift_calc_keypoint_orientations(sift_filter_,
-                                                          angles,
-                                                          &vl_keypoints[i]);
-      // If upright sift is enabled, only use the first keypoint at a given
-      // pixel location.
-      if (sift_params_.upright_sift && num_angles > 1) {
-        num_angles = 1;
-      }
+    vl_sift_detect(sift_filter);
 
-      for (int j = 0; j < num_angles; ++j) {
-        descriptors->emplace_back(128);
-        vl_sift_calc_keypoint_descriptor(
-            sift_filter_, descriptors->back().data(), &vl_keypoints[i],
-            angles[j]);
+    // Compute the orientations and descriptors of the keypoints.
+    ExtractOctaveDescriptors(sift_filter, keypoints);
 
-        Keypoint keypoint(vl_keypoints[i].x, vl_keypoints[i].y, Keypoint::SIFT);
-        keypoint.set_scale(vl_keypoints[i].sigma);
-        keypoint.set_orientation(angles[j]);
-        keypoints->push_back(keypoint);
-      }
-    }
     // Attempt to process the next octave.
-    vl_status = vl_sift_process_next_octave(sift_filter_);
+    vl_status = ProcessNextOctave(sift_filter);
+  }
+
+  descriptors->resize(descriptor_data_.size() / kSiftDescriptorDim,
+                      kSiftDescriptorDim);
+  if (!descriptor_data_.empty()) {
+    std::memcpy(descriptors->data(),
+                descriptor_data_.data(),
+                descriptor_data_.size() * sizeof(descriptor_data_[0]));
   }
 
   if (sift_params_.root_sift) {
-    for (int i = 0; i < descriptors->size(); i++) {
-      ConvertToRootSift(&(*descriptors)[i]);
-    }
+    ConvertRowsToRootSift(descriptors);
   }
 
   return true;
@@ -48,6 +48,7 @@ namespace theia {
 
 class FloatImage;
 class Keypoint;
+class ThreadPool;
 
 class SiftDescriptorExtractor : public DescriptorExtractor {
  public:
@@ -55,11 +56,22 @@ class SiftDescriptorExtractor : public DescriptorExtractor {
   //  number of image octaves, number of scale levels per octave, and where the
   //  first octave should start.
   explicit SiftDescriptorExtractor(const SiftParameters& detector_params) :
-      sift_params_(detector_params), sift_filter_(nullptr) {}
+      sift_params_(detector_params), thread_pool_(nullptr) {}
   SiftDescriptorExtractor(int num_octaves, int num_levels, int first_octave)
       : sift_params_(num_octaves, num_levels, first_octave, 10.0f,
-                     255.0 * 0.02 / num_levels),
-        sift_filter_(nullptr) {}
+                     255.0 * 0.02 / num_levels), thread_pool_(nullptr) {}
+
+  // DetectAndExtractDescriptors uses the thread pool to extract the features
+  // of a single image with several threads: the octaves of the scale space that
+  // are larger than the tile size of the parameters are computed in tiles in
+  // parallel, and the orientations and descriptors of the keypoints of each
+  // octave are computed in parallel. The thread pool may be shared by several
+  // extractors and must outlive the extractor. DetectAndExtractDescriptors
+  // waits for the tasks that it adds to the thread pool, so it must not be
+  // called from the threads of the thread pool.
+  SiftDescriptorExtractor(const SiftParameters& detector_params,
+                          ThreadPool* thread_pool)
+      : sift_params_(detector_params), thread_pool_(thread_pool) {}
   SiftDescriptorExtractor() : SiftDescriptorExtractor(-1, 3, -1) {}
   ~SiftDescriptorExtractor();
 
@@ -71,20 +83,48 @@ class SiftDescriptorExtractor : public DescriptorExtractor {
   // Compute multiple descriptors for keypoints from a single image.
   bool ComputeDescriptors(const FloatImage& image,
                           std::vector<Keypoint>* keypoints,
-                          std::vector<Eigen::VectorXf>* descriptors);
+                          DescriptorMatrix* descriptors);
 
   // Detect keypoints using the Sift keypoint detector and extracts them at the
   // same time.
-  bool DetectAndExtractDescriptors(
-      const FloatImage& image,
-      std::vector<Keypoint>* keypoints,
-      std::vector<Eigen::VectorXf>* descriptors);
+  bool DetectAndExtractDescriptors(const FloatImage& image,
+                                   std::vector<Keypoint>* keypoints,
+                                   DescriptorMatrix* descriptors);
+
+  using DescriptorExtractor::ComputeDescriptors;
+  using DescriptorExtractor::DetectAndExtractDescriptors;
 
   // This method is only public so that we can easily test it.
   static void ConvertToRootSift(Eigen::VectorXf* descriptor);
  private:
+  // Returns a SIFT filter for images of the given size. The filters of the most
+  // recently used image sizes are kept (up to a bounded number of pixels) so
+  // that the filters are not recreated when the extractor is used for many
+  // images, e.g. image collections with both portrait and landscape images.
+  VlSiftFilt* GetSiftFilter(const int width, const int height);
+
+  // Computes the first or the next octave of the scale space of the filter like
+  // vl_sift_process_first_octave and vl_sift_process_next_octave, and returns
+  // VL_ERR_EOF if there are no more octaves. Octaves that are larger than the
+  // tile size are computed in tiles on the thread pool.
+  int ProcessFirstOctave(const float* pixels, VlSiftFilt* sift_filter);
+  int ProcessNextOctave(VlSiftFilt* sift_filter);
+
+  // Returns true if an octave of the given size is computed in tiles.
+  bool UseTiles(const int octave_width, const int octave_height) const;
+
+  // Computes the orientations and descriptors of the keypoints of the current
+  // octave of the filter, in parallel on the thread pool if there is one.
+  void ExtractOctaveDescriptors(VlSiftFilt* sift_filter,
+                                std::vector<Keypoint>* keypoints);
+
   const SiftParameters sift_params_;
-  VlSiftFilt* sift_filter_;
+  ThreadPool* thread_pool_;
+  // The SIFT filters ordered from the most to the least recently used.
+  std::vector<VlSiftFilt*> sift_filters_;
+  // Buffer for the descriptors found by DetectAndExtractDescriptors, which is
+  // reused across images.
+  std::vector<float> descriptor_data_;
 
   DISALLOW_COPY_AND_ASSIGN(SiftDescriptorExtractor);
 };
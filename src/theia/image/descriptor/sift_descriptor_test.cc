@@ -34,12 +34,18 @@
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
 #include <string>
+#include <vector>
 #include "gtest/gtest.h"
 
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/sift_detector.h"
 #include "theia/image/descriptor/sift_descriptor.h"
+#include "theia/image/keypoint_detector/sift_parameters.h"
+#include "theia/util/random.h"
+#include "theia/util/threadpool.h"
 
 DEFINE_string(test_img, "image/descriptor/img1.png",
               "Name of test image file.");
@@ -48,6 +54,87 @@ namespace theia {
 
 namespace {
 std::string img_filename = THEIA_DATA_DIR + std::string("/") + FLAGS_test_img;
+
+// Returns a grayscale image of random Gaussian blobs, which have SIFT features
+// at many scales.
+FloatImage RandomBlobImage(const int width, const int height) {
+  RandomNumberGenerator rng(width + height);
+  FloatImage image(width, height, 1);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      image.SetXY(x, y, 0, 0.5f);
+    }
+  }
+  for (int i = 0; i < width * height / 400; i++) {
+    const float center_x = rng.RandFloat(0.0f, width);
+    const float center_y = rng.RandFloat(0.0f, height);
+    const float radius = rng.RandFloat(2.0f, 12.0f);
+    const float amplitude = rng.RandFloat(-0.5f, 0.5f);
+    const int x0 = std::max(0, static_cast<int>(center_x - 3 * radius));
+    const int x1 = std::min(width, static_cast<int>(center_x + 3 * radius));
+    const int y0 = std::max(0, static_cast<int>(center_y - 3 * radius));
+    const int y1 = std::min(height, static_cast<int>(center_y + 3 * radius));
+    for (int y = y0; y < y1; y++) {
+      for (int x = x0; x < x1; x++) {
+        const float squared_distance = (x - center_x) * (x - center_x) +
+                                       (y - center_y) * (y - center_y);
+        image.SetXY(x,
+                    y,
+                    0,
+                    image.GetXY(x, y, 0) +
+                        amplitude * std::exp(-squared_distance /
+                                             (2.0f * radius * radius)));
+      }
+    }
+  }
+  return image;
+}
+
+// Returns a grayscale image with a grid of bright dots, which only have SIFT
+// features in the first octave.
+FloatImage DotImage(const int width, const int height, const float amplitude) {
+  static const int kDotSpacing = 5;
+  FloatImage image(width, height, 1);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const bool is_dot = x % kDotSpacing == kDotSpacing / 2 &&
+                          y % kDotSpacing == kDotSpacing / 2;
+      image.SetXY(x, y, 0, is_dot ? 0.5f + amplitude : 0.5f);
+    }
+  }
+  return image;
+}
+
+// Extracts the features of the image with and without tiles of the given size
+// and checks that they are the same.
+void ExpectTiledExtractionMatchesUntiledExtraction(
+    const FloatImage& image, SiftParameters sift_params, const int tile_size) {
+  SiftDescriptorExtractor sift_extractor(sift_params);
+  std::vector<Keypoint> keypoints;
+  DescriptorMatrix descriptors;
+  EXPECT_TRUE(sift_extractor.DetectAndExtractDescriptors(image,
+                                                         &keypoints,
+                                                         &descriptors));
+  EXPECT_GT(keypoints.size(), 0);
+
+  sift_params.tile_size = tile_size;
+  ThreadPool thread_pool(4);
+  SiftDescriptorExtractor tiled_sift_extractor(sift_params, &thread_pool);
+  std::vector<Keypoint> tiled_keypoints;
+  DescriptorMatrix tiled_descriptors;
+  EXPECT_TRUE(tiled_sift_extractor.DetectAndExtractDescriptors(
+      image, &tiled_keypoints, &tiled_descriptors));
+
+  ASSERT_EQ(keypoints.size(), tiled_keypoints.size());
+  for (int i = 0; i < keypoints.size(); i++) {
+    EXPECT_EQ(keypoints[i].x(), tiled_keypoints[i].x());
+    EXPECT_EQ(keypoints[i].y(), tiled_keypoints[i].y());
+    EXPECT_EQ(keypoints[i].scale(), tiled_keypoints[i].scale());
+    EXPECT_EQ(keypoints[i].orientation(), tiled_keypoints[i].orientation());
+  }
+  EXPECT_TRUE(descriptors == tiled_descriptors);
+}
+
 }  // namespace
 
 TEST(SiftDescriptor, Sanity) {
@@ -72,6 +159,29 @@ TEST(SiftDescriptor, Sanity) {
                                                 &sift_descriptors));
 }
 
+TEST(SiftDescriptor, DescriptorMatrixMatchesDescriptorVector) {
+  FloatImage input_img(img_filename);
+  SiftDescriptorExtractor sift_extractor;
+
+  std::vector<Keypoint> keypoints;
+  DescriptorMatrix descriptor_matrix;
+  EXPECT_TRUE(sift_extractor.DetectAndExtractDescriptors(input_img,
+                                                         &keypoints,
+                                                         &descriptor_matrix));
+  EXPECT_EQ(descriptor_matrix.rows(), keypoints.size());
+  EXPECT_EQ(descriptor_matrix.cols(), 128);
+
+  keypoints.clear();
+  std::vector<Eigen::VectorXf> descriptors;
+  EXPECT_TRUE(sift_extractor.DetectAndExtractDescriptors(input_img,
+                                                         &keypoints,
+                                                         &descriptors));
+  ASSERT_EQ(descriptors.size(), descriptor_matrix.rows());
+  for (int i = 0; i < descriptors.size(); i++) {
+    EXPECT_EQ(descriptors[i], descriptor_matrix.row(i).transpose());
+  }
+}
+
 TEST(SiftDescriptor, ZeroDescriptorRootSiftTest) {
   Eigen::VectorXf descriptor(128);
   descriptor.setZero();
@@ -103,4 +213,58 @@ TEST(SiftDescriptor, DifferentImageSizes) {
                                                          &descriptors));
 }
 
+TEST(SiftDescriptor, ReusedFilterMatchesNewFilter) {
+  // The gradient of the first image is only computed for the first octave,
+  // which must not be reused for the second image of the same size.
+  const FloatImage image1 = DotImage(64, 64, 0.5f);
+  const FloatImage image2 = DotImage(64, 64, 0.3f);
+  const SiftParameters sift_params;
+  SiftDescriptorExtractor sift_extractor(sift_params);
+  std::vector<Keypoint> keypoints1;
+  DescriptorMatrix descriptors1;
+  EXPECT_TRUE(sift_extractor.DetectAndExtractDescriptors(image1,
+                                                         &keypoints1,
+                                                         &descriptors1));
+  EXPECT_GT(keypoints1.size(), 0);
+  std::vector<Keypoint> keypoints;
+  DescriptorMatrix descriptors;
+  EXPECT_TRUE(sift_extractor.DetectAndExtractDescriptors(image2,
+                                                         &keypoints,
+                                                         &descriptors));
+
+  SiftDescriptorExtractor new_sift_extractor(sift_params);
+  std::vector<Keypoint> new_keypoints;
+  DescriptorMatrix new_descriptors;
+  EXPECT_TRUE(new_sift_extractor.DetectAndExtractDescriptors(
+      image2, &new_keypoints, &new_descriptors));
+  ASSERT_EQ(keypoints.size(), new_keypoints.size());
+  EXPECT_GT(keypoints.size(), 0);
+  EXPECT_TRUE(descriptors == new_descriptors);
+}
+
+TEST(SiftDescriptor, TiledExtractionMatchesUntiledExtraction) {
+  FloatImage input_img(img_filename);
+  // Use small tiles so that the image is split into several tiles.
+  ExpectTiledExtractionMatchesUntiledExtraction(
+      input_img, SiftParameters(), 128);
+}
+
+TEST(SiftDescriptor, TiledExtractionOfUpsampledFirstOctave) {
+  // The first octave is upsampled from the image, so the tiles of the first
+  // octave start at pixels of the image.
+  SiftParameters sift_params;
+  sift_params.first_octave = -1;
+  ExpectTiledExtractionMatchesUntiledExtraction(
+      RandomBlobImage(301, 203), sift_params, 64);
+}
+
+TEST(SiftDescriptor, TiledExtractionOfOctavesThatAreNotMultiplesOf16) {
+  // None of the octaves are multiples of the tile alignment, and the tiles do
+  // not evenly divide the octaves.
+  SiftParameters sift_params;
+  sift_params.first_octave = 0;
+  ExpectTiledExtractionMatchesUntiledExtraction(
+      RandomBlobImage(333, 517), sift_params, 37);
+}
+
 }  // namespace theia
@@ -38,14 +38,25 @@
 #include <string>
 
 #include "theia/image/image.h"
+#include "theia/util/concurrent_lru_cache.h"
 #include "theia/util/filesystem.h"
-#include "theia/util/lru_cache.h"
 #include "theia/util/string.h"
 
 namespace theia {
 
+namespace {
+
+// Returns the number of bytes used by the pixels of the image.
+size_t NumBytesOfImage(const std::shared_ptr<const FloatImage>& image) {
+  return static_cast<size_t>(image->Rows()) * image->Cols() *
+         image->Channels() * sizeof(float);
+}
+
+}  // namespace
+
 ImageCache::ImageCache(const std::string& image_directory,
-                       const int max_num_images_in_cache)
+                       const int max_num_images_in_cache,
+                       const size_t max_num_bytes_in_cache)
     : image_directory_(image_directory) {
   AppendTrailingSlashIfNeeded(&image_directory_);
 
@@ -54,7 +65,11 @@ ImageCache::ImageCache(const std::string& image_directory,
       fetch_images = std::bind(&ImageCache::FetchImagesFromDisk,
                                this,
                                std::placeholders::_1);
-  images_.reset(new ImageLRUCache(fetch_images, max_num_images_in_cache));
+  ConcurrentLRUCacheOptions cache_options;
+  cache_options.max_cache_entries = max_num_images_in_cache;
+  cache_options.max_cache_size = max_num_bytes_in_cache;
+  images_.reset(
+      new ImageLRUCache(fetch_images, NumBytesOfImage, cache_options));
 }
 
 ImageCache::~ImageCache() {}
@@ -35,10 +35,11 @@
 #ifndef THEIA_IMAGE_IMAGE_CACHE_H_
 #define THEIA_IMAGE_IMAGE_CACHE_H_
 
+#include <limits>
 #include <memory>
 #include <string>
 
-#include "theia/util/lru_cache.h"
+#include "theia/util/concurrent_lru_cache.h"
 
 namespace theia {
 class FloatImage;
@@ -54,9 +55,15 @@ public:
  // Images are held in an LRU cache so as to remain memory efficient for
  // out-of-core operations. This specifies the maximum number of images that
  // may be in the cache at any given time. This value may need to be adjusted
- // depending on how much memory is available.
+ // depending on how much memory is available. The memory used by the cached
+ // images may additionally be limited to max_num_bytes_in_cache bytes.
+ //
+ // Images may be fetched by several threads at once. Images are read from disk
+ // without blocking threads that fetch other images.
  ImageCache(const std::string& image_directory,
-            const int max_num_images_in_cache);
+            const int max_num_images_in_cache,
+            const size_t max_num_bytes_in_cache =
+                std::numeric_limits<size_t>::max());
  ~ImageCache();
 
  // Returns the image corresponding to the view id, or a nullptr if the view
@@ -68,7 +75,8 @@ public:
      const std::string& image_filename) const;
 
  private:
-  typedef LRUCache<std::string, std::shared_ptr<const theia::FloatImage> >
+  typedef ConcurrentLRUCache<std::string,
+                             std::shared_ptr<const theia::FloatImage> >
       ImageLRUCache;
 
   // Method to fetch images from disk.
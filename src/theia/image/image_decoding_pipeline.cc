@@ -0,0 +1,346 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/image/image_decoding_pipeline.h"
+
+#include <glog/logging.h>
+#include <OpenImageIO/imagebuf.h>
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "theia/image/image.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/util/threadpool.h"
+#include "theia/util/timer.h"
+
+namespace theia {
+
+void LogImageDecodingStatistics(const ImageDecodingStatistics& statistics) {
+  const double elapsed_time = std::max(statistics.elapsed_time, 1e-9);
+  LOG(INFO) << "Decoded and processed " << statistics.num_images
+            << " images in " << statistics.elapsed_time << " seconds ("
+            << statistics.num_images / elapsed_time << " images per second)."
+            << "\n\tDecoding time: " << statistics.decoding_time
+            << " seconds, waiting for the queue: "
+            << statistics.decoding_wait_time << " seconds."
+            << "\n\tProcessing time: " << statistics.processing_time
+            << " seconds, waiting for images: "
+            << statistics.processing_wait_time << " seconds."
+            << "\n\tAverage queue depth: " << statistics.average_queue_depth
+            << ", max queue depth: " << statistics.max_queue_depth
+            << ", max image memory: "
+            << statistics.max_image_memory_bytes / (1024 * 1024) << " MB.";
+  LOG_IF(WARNING, statistics.num_failed_images > 0)
+      << statistics.num_failed_images << " images could not be read.";
+}
+
+bool ReadGrayscaleImage(const std::string& filename, FloatImage* image) {
+  double scale;
+  return ReadGrayscaleImage(filename, 0, image, &scale);
+}
+
+bool ReadGrayscaleImage(const std::string& filename,
+                        const int max_image_dimension,
+                        FloatImage* image,
+                        double* scale) {
+  OpenImageIO::ImageBuf& image_buf = image->GetOpenImageIOImageBuf();
+  image_buf.reset(filename);
+  if (!image_buf.init_spec(filename, 0, 0)) {
+    LOG(ERROR) << "Could not read the image " << filename << ": "
+               << image_buf.geterror();
+    return false;
+  }
+  const int original_dimension =
+      std::max(image_buf.spec().width, image_buf.spec().height);
+  const bool reduce_image =
+      max_image_dimension > 0 && original_dimension > max_image_dimension;
+
+  // Find the smallest MIP level that is not smaller than the requested size so
+  // that the full resolution image does not have to be decoded.
+  int miplevel = 0;
+  if (reduce_image) {
+    for (int level = 1; level < image_buf.nmiplevels(); level++) {
+      OpenImageIO::ImageBuf mip_buf;
+      if (!mip_buf.init_spec(filename, 0, level) ||
+          std::max(mip_buf.spec().width, mip_buf.spec().height) <
+              max_image_dimension) {
+        break;
+      }
+      miplevel = level;
+    }
+  }
+  if (miplevel > 0) {
+    image_buf.reset(filename, 0, miplevel);
+  }
+  if (!image_buf.read(0, miplevel, true, OpenImageIO::TypeDesc::FLOAT)) {
+    LOG(ERROR) << "Could not read the image " << filename << ": "
+               << image_buf.geterror();
+    return false;
+  }
+  image->ConvertToGrayscaleImage();
+
+  // Resample the image to the final size. The image is converted to grayscale
+  // first so that only one channel is resampled.
+  const int decoded_dimension = std::max(image->Width(), image->Height());
+  if (reduce_image && decoded_dimension > max_image_dimension) {
+    const double reduction =
+        static_cast<double>(max_image_dimension) / decoded_dimension;
+    image->Resize(
+        std::max(static_cast<int>(std::round(reduction * image->Width())), 1),
+        std::max(static_cast<int>(std::round(reduction * image->Height())),
+                 1));
+  }
+  *scale = static_cast<double>(original_dimension) /
+           std::max(image->Width(), image->Height());
+  VLOG_IF(2, reduce_image) << "Decoded image " << filename << " at "
+                           << image->Width() << "x" << image->Height()
+                           << " pixels (MIP level " << miplevel
+                           << ", scale " << *scale << ").";
+  return true;
+}
+
+void RescaleKeypoints(const double scale, std::vector<Keypoint>* keypoints) {
+  if (scale == 1.0) {
+    return;
+  }
+  // The keypoint coordinates refer to pixel centers, so the pixel centers of
+  // the reduced image are mapped to the corresponding positions in the
+  // original image.
+  for (Keypoint& keypoint : *keypoints) {
+    keypoint.set_x((keypoint.x() + 0.5) * scale - 0.5);
+    keypoint.set_y((keypoint.y() + 0.5) * scale - 0.5);
+    if (keypoint.has_scale()) {
+      keypoint.set_scale(keypoint.scale() * scale);
+    }
+  }
+}
+
+ImageDecodingPipeline::ImageDecodingPipeline(
+    const ImageDecodingOptions& options, const int num_processing_threads)
+    : options_(options),
+      num_processing_threads_(num_processing_threads),
+      read_image_([this](const std::string& filename,
+                         FloatImage* image,
+                         double* scale) {
+        return ReadGrayscaleImage(
+            filename, options_.max_image_dimension, image, scale);
+      }),
+      filenames_(nullptr),
+      process_image_(nullptr),
+      next_image_index_(0),
+      num_held_bytes_(0),
+      num_running_decoding_threads_(0),
+      total_queue_depth_(0.0) {
+  CHECK_GT(num_processing_threads_, 0);
+  CHECK_GE(options_.num_decoding_threads, 0);
+  CHECK_GT(options_.max_num_queued_images, 0);
+}
+
+void ImageDecodingPipeline::SetReadImageFunction(
+    const ReadImageFunction& read_image) {
+  CHECK(read_image);
+  read_image_ = read_image;
+}
+
+void ImageDecodingPipeline::Run(const std::vector<std::string>& filenames,
+                                const ProcessImageFunction& process_image,
+                                ImageDecodingStatistics* statistics) {
+  Timer timer;
+  filenames_ = &filenames;
+  process_image_ = &process_image;
+  next_image_index_ = 0;
+  num_held_bytes_ = 0;
+  total_queue_depth_ = 0.0;
+  statistics_ = ImageDecodingStatistics();
+
+  // There is no need for more threads than images.
+  const int num_images = filenames.size();
+  const int num_processing_threads =
+      std::min(num_processing_threads_, num_images);
+  const int num_decoding_threads =
+      std::min(options_.num_decoding_threads, num_images);
+  if (num_images > 0) {
+    // The thread pool waits for all threads to finish when it goes out of
+    // scope.
+    ThreadPool pool(num_processing_threads + num_decoding_threads);
+    if (num_decoding_threads == 0) {
+      for (int i = 0; i < num_processing_threads; i++) {
+        pool.Add(&ImageDecodingPipeline::DecodeAndProcessImages, this);
+      }
+    } else {
+      num_running_decoding_threads_ = num_decoding_threads;
+      for (int i = 0; i < num_decoding_threads; i++) {
+        pool.Add(&ImageDecodingPipeline::DecodeImages, this);
+      }
+      for (int i = 0; i < num_processing_threads; i++) {
+        pool.Add(&ImageDecodingPipeline::ProcessQueuedImages, this);
+      }
+    }
+  }
+
+  if (statistics_.num_images > 0) {
+    statistics_.average_queue_depth =
+        total_queue_depth_ / statistics_.num_images;
+  }
+  statistics_.elapsed_time = timer.ElapsedTimeInSeconds();
+  if (statistics != nullptr) {
+    *statistics = statistics_;
+  }
+  filenames_ = nullptr;
+  process_image_ = nullptr;
+}
+
+bool ImageDecodingPipeline::DecodeNextImage(DecodedImage* decoded_image) {
+  while (true) {
+    const int index = next_image_index_++;
+    if (index >= filenames_->size()) {
+      return false;
+    }
+
+    Timer timer;
+    std::unique_ptr<FloatImage> image(new FloatImage);
+    double scale = 1.0;
+    const bool success =
+        read_image_((*filenames_)[index], image.get(), &scale);
+    const double decoding_time = timer.ElapsedTimeInSeconds();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.decoding_time += decoding_time;
+    if (!success) {
+      ++statistics_.num_failed_images;
+      continue;
+    }
+    decoded_image->index = index;
+    decoded_image->scale = scale;
+    decoded_image->num_bytes = sizeof(float) * image->Width() *
+                               image->Height() * image->Channels();
+    decoded_image->image = std::move(image);
+    return true;
+  }
+}
+
+void ImageDecodingPipeline::DecodeImages() {
+  DecodedImage decoded_image;
+  while (DecodeNextImage(&decoded_image)) {
+    Timer timer;
+    std::unique_lock<std::mutex> lock(mutex_);
+    room_available_.wait(lock, [this, &decoded_image]() {
+      if (queue_.size() >= options_.max_num_queued_images) {
+        return false;
+      }
+      // An image is always queued if no other image is held so that images
+      // larger than the memory budget are still processed.
+      return options_.max_image_memory_bytes == 0 || num_held_bytes_ == 0 ||
+             num_held_bytes_ + decoded_image.num_bytes <=
+                 options_.max_image_memory_bytes;
+    });
+    statistics_.decoding_wait_time += timer.ElapsedTimeInSeconds();
+
+    num_held_bytes_ += decoded_image.num_bytes;
+    statistics_.max_image_memory_bytes =
+        std::max(statistics_.max_image_memory_bytes, num_held_bytes_);
+    queue_.emplace_back(std::move(decoded_image));
+    statistics_.max_queue_depth = std::max(
+        statistics_.max_queue_depth, static_cast<int>(queue_.size()));
+    image_queued_.notify_one();
+  }
+
+  // Wake up the processing threads once all images are decoded so that they
+  // stop waiting for more images.
+  std::lock_guard<std::mutex> lock(mutex_);
+  --num_running_decoding_threads_;
+  if (num_running_decoding_threads_ == 0) {
+    image_queued_.notify_all();
+  }
+}
+
+void ImageDecodingPipeline::ProcessQueuedImages() {
+  while (true) {
+    DecodedImage decoded_image;
+    {
+      Timer timer;
+      std::unique_lock<std::mutex> lock(mutex_);
+      image_queued_.wait(lock, [this]() {
+        return !queue_.empty() || num_running_decoding_threads_ == 0;
+      });
+      statistics_.processing_wait_time += timer.ElapsedTimeInSeconds();
+      if (queue_.empty()) {
+        return;
+      }
+      total_queue_depth_ += queue_.size();
+      decoded_image = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    room_available_.notify_all();
+
+    Timer timer;
+    (*process_image_)(
+        decoded_image.index, *decoded_image.image, decoded_image.scale);
+    const double processing_time = timer.ElapsedTimeInSeconds();
+    decoded_image.image.reset();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      statistics_.processing_time += processing_time;
+      ++statistics_.num_images;
+      num_held_bytes_ -= decoded_image.num_bytes;
+    }
+    room_available_.notify_all();
+  }
+}
+
+void ImageDecodingPipeline::DecodeAndProcessImages() {
+  DecodedImage decoded_image;
+  while (DecodeNextImage(&decoded_image)) {
+    Timer timer;
+    (*process_image_)(
+        decoded_image.index, *decoded_image.image, decoded_image.scale);
+    const double processing_time = timer.ElapsedTimeInSeconds();
+    decoded_image.image.reset();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    statistics_.processing_time += processing_time;
+    ++statistics_.num_images;
+  }
+}
+
+}  // namespace theia
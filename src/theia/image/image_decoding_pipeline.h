@@ -0,0 +1,214 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IMAGE_IMAGE_DECODING_PIPELINE_H_
+#define THEIA_IMAGE_IMAGE_DECODING_PIPELINE_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "theia/util/util.h"
+
+namespace theia {
+class FloatImage;
+class Keypoint;
+
+// Options for reading and decoding images in separate threads from the threads
+// that process them (e.g. extract features).
+struct ImageDecodingOptions {
+  // The number of threads that read and decode images. The decoded images are
+  // queued for the processing threads. If this is 0, each image is read and
+  // decoded by the thread that processes it.
+  int num_decoding_threads = 0;
+
+  // The maximum number of decoded images waiting in the queue. The decoding
+  // threads wait when the queue is full.
+  int max_num_queued_images = 4;
+
+  // The maximum number of bytes of decoded images that are queued or being
+  // processed. The decoding threads wait until enough memory is available, and
+  // each decoding thread holds at most one more image while it waits. If 0,
+  // the memory is only bounded by the size of the queue. An image that is
+  // larger than the budget is queued once no other image is held.
+  size_t max_image_memory_bytes = 0;
+
+  // If positive, images whose width or height is larger than this are decoded
+  // at a reduced resolution so that neither is larger (see
+  // ReadGrayscaleImage). This reduces the decoding and processing cost and the
+  // memory of large images.
+  int max_image_dimension = 0;
+};
+
+// Throughput and queue depth counters of an ImageDecodingPipeline, which can be
+// used to choose the number of decoding and processing threads.
+struct ImageDecodingStatistics {
+  // The number of images that were processed and that could not be read.
+  int num_images = 0;
+  int num_failed_images = 0;
+
+  // The time the pipeline ran, and the total time the threads spent reading
+  // and decoding images and processing them, in seconds.
+  double elapsed_time = 0.0;
+  double decoding_time = 0.0;
+  double processing_time = 0.0;
+
+  // The total time the decoding threads waited for room in the queue and the
+  // processing threads waited for decoded images, in seconds. A large decoding
+  // wait time means that there are more decoding threads than needed, and a
+  // large processing wait time means that there are too few.
+  double decoding_wait_time = 0.0;
+  double processing_wait_time = 0.0;
+
+  // The average number of queued images when a processing thread took an image
+  // from the queue, and the maximum number of queued images.
+  double average_queue_depth = 0.0;
+  int max_queue_depth = 0;
+
+  // The maximum number of bytes of decoded images held at once.
+  size_t max_image_memory_bytes = 0;
+};
+
+// Logs the statistics of the pipeline, e.g. after extracting features.
+void LogImageDecodingStatistics(const ImageDecodingStatistics& statistics);
+
+// Reads the image and converts it to a grayscale image. Returns false if the
+// image could not be read.
+bool ReadGrayscaleImage(const std::string& filename, FloatImage* image);
+
+// Same as above, but if the width or height of the image is larger than
+// max_image_dimension (and max_image_dimension is positive), the image is
+// reduced so that neither is larger. If the file contains MIP levels (e.g. a
+// tiled TIFF pyramid), the smallest level that is at least as large is read
+// instead of the full resolution image, and the image is resampled to the
+// final size otherwise. scale is set to the ratio of the original image size
+// to the size of the returned image.
+bool ReadGrayscaleImage(const std::string& filename,
+                        const int max_image_dimension,
+                        FloatImage* image,
+                        double* scale);
+
+// Rescales the keypoints that were detected in an image that was reduced by
+// the scale (see ReadGrayscaleImage) to the pixel coordinates of the original
+// image.
+void RescaleKeypoints(const double scale, std::vector<Keypoint>* keypoints);
+
+// A two-stage pipeline that reads and decodes images in decoding threads and
+// processes the decoded images in processing threads, so that reading images
+// from disk and decoding them does not stall the (typically compute bound)
+// processing. The decoded images are passed between the stages in a bounded
+// queue that is also bounded by a memory budget.
+class ImageDecodingPipeline {
+ public:
+  // Reads and decodes the image from the file and sets the ratio of the
+  // original image size to the size of the decoded image. Returns false if
+  // the image could not be read.
+  typedef std::function<bool(const std::string&, FloatImage*, double*)>
+      ReadImageFunction;
+
+  // Processes the decoded image with the given index in the filenames. The
+  // last argument is the ratio of the original image size to the size of the
+  // decoded image, e.g. to rescale keypoints with RescaleKeypoints.
+  typedef std::function<void(const int, const FloatImage&, const double)>
+      ProcessImageFunction;
+
+  ImageDecodingPipeline(const ImageDecodingOptions& options,
+                        const int num_processing_threads);
+
+  // Sets the function that reads the images. By default, the images are read
+  // with ReadGrayscaleImage and the max_image_dimension of the options.
+  void SetReadImageFunction(const ReadImageFunction& read_image);
+
+  // Reads and processes the images, and returns once all images have been
+  // processed. process_image is called from the processing threads, so it may
+  // be called from several threads at once. Images that cannot be read are
+  // skipped. The statistics may be nullptr.
+  void Run(const std::vector<std::string>& filenames,
+           const ProcessImageFunction& process_image,
+           ImageDecodingStatistics* statistics);
+
+ private:
+  struct DecodedImage {
+    int index;
+    std::unique_ptr<FloatImage> image;
+    double scale;
+    size_t num_bytes;
+  };
+
+  // Reads and decodes the images and queues them. This is run in each decoding
+  // thread.
+  void DecodeImages();
+
+  // Processes the queued images until all images have been decoded. This is
+  // run in each processing thread.
+  void ProcessQueuedImages();
+
+  // Reads and processes the images without a queue. This is run in each
+  // processing thread if there are no decoding threads.
+  void DecodeAndProcessImages();
+
+  // Reads the next image that has not been read yet. Returns false if all
+  // images have been read.
+  bool DecodeNextImage(DecodedImage* decoded_image);
+
+  const ImageDecodingOptions options_;
+  const int num_processing_threads_;
+  ReadImageFunction read_image_;
+
+  // The images and the processing function of the current run.
+  const std::vector<std::string>* filenames_;
+  const ProcessImageFunction* process_image_;
+  std::atomic<int> next_image_index_;
+
+  std::mutex mutex_;
+  std::condition_variable image_queued_, room_available_;
+  std::deque<DecodedImage> queue_;
+  // The number of bytes of the images that are queued or being processed.
+  size_t num_held_bytes_;
+  int num_running_decoding_threads_;
+  double total_queue_depth_;
+  ImageDecodingStatistics statistics_;
+
+  DISALLOW_COPY_AND_ASSIGN(ImageDecodingPipeline);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_IMAGE_IMAGE_DECODING_PIPELINE_H_
@@ -0,0 +1,252 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/image/image_decoding_pipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "theia/image/image.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+
+namespace theia {
+
+namespace {
+
+static const int kNumImages = 20;
+static const int kImageSize = 10;
+static const size_t kImageBytes = sizeof(float) * kImageSize * kImageSize;
+
+// Creates a grayscale image for each filename, which is the index of the
+// image. Images whose index is a multiple of failure_interval cannot be read.
+// The scale is set to the index plus one.
+bool ReadFakeImage(const int failure_interval,
+                   const std::string& filename,
+                   FloatImage* image,
+                   double* scale) {
+  const int index = std::stoi(filename);
+  if (failure_interval > 0 && index % failure_interval == 0) {
+    return false;
+  }
+  *image = FloatImage(kImageSize, kImageSize, 1);
+  image->SetXY(0, 0, 0, index);
+  *scale = index + 1.0;
+  return true;
+}
+
+std::vector<std::string> ImageFilenames() {
+  std::vector<std::string> filenames;
+  for (int i = 0; i < kNumImages; i++) {
+    filenames.emplace_back(std::to_string(i));
+  }
+  return filenames;
+}
+
+// Runs the pipeline and checks that each image that can be read is processed
+// exactly once with the correct index.
+void TestAllImagesAreProcessed(const ImageDecodingOptions& options,
+                               const int num_processing_threads) {
+  static const int kFailureInterval = 7;
+  ImageDecodingPipeline pipeline(options, num_processing_threads);
+  pipeline.SetReadImageFunction(
+      [](const std::string& filename, FloatImage* image, double* scale) {
+        return ReadFakeImage(kFailureInterval, filename, image, scale);
+      });
+
+  std::mutex mutex;
+  std::vector<int> num_times_processed(kNumImages, 0);
+  ImageDecodingStatistics statistics;
+  pipeline.Run(ImageFilenames(),
+               [&](const int index, const FloatImage& image,
+                   const double scale) {
+                 EXPECT_EQ(image.GetXY(0, 0, 0), index);
+                 EXPECT_EQ(scale, index + 1.0);
+                 std::lock_guard<std::mutex> lock(mutex);
+                 ++num_times_processed[index];
+               },
+               &statistics);
+
+  int num_expected_images = 0;
+  for (int i = 0; i < kNumImages; i++) {
+    if (i % kFailureInterval == 0) {
+      EXPECT_EQ(num_times_processed[i], 0);
+    } else {
+      EXPECT_EQ(num_times_processed[i], 1);
+      ++num_expected_images;
+    }
+  }
+  EXPECT_EQ(statistics.num_images, num_expected_images);
+  EXPECT_EQ(statistics.num_failed_images, kNumImages - num_expected_images);
+}
+
+}  // namespace
+
+TEST(ImageDecodingPipeline, DecodeInProcessingThreads) {
+  ImageDecodingOptions options;
+  options.num_decoding_threads = 0;
+  TestAllImagesAreProcessed(options, 1);
+  TestAllImagesAreProcessed(options, 4);
+}
+
+TEST(ImageDecodingPipeline, DecodeInDecodingThreads) {
+  ImageDecodingOptions options;
+  for (const int num_decoding_threads : {1, 3}) {
+    options.num_decoding_threads = num_decoding_threads;
+    TestAllImagesAreProcessed(options, 1);
+    TestAllImagesAreProcessed(options, 4);
+  }
+}
+
+TEST(ImageDecodingPipeline, QueueAndMemoryAreBounded) {
+  static const int kMaxNumHeldImages = 2;
+  ImageDecodingOptions options;
+  options.num_decoding_threads = 4;
+  options.max_num_queued_images = 3;
+  options.max_image_memory_bytes = kMaxNumHeldImages * kImageBytes;
+  ImageDecodingPipeline pipeline(options, 4);
+  pipeline.SetReadImageFunction(
+      [](const std::string& filename, FloatImage* image, double* scale) {
+        return ReadFakeImage(0, filename, image, scale);
+      });
+
+  // The images that are processed count against the memory budget, so at most
+  // two images are processed at once.
+  std::atomic<int> num_processing_images(0);
+  std::atomic<int> max_num_processing_images(0);
+  ImageDecodingStatistics statistics;
+  pipeline.Run(ImageFilenames(),
+               [&](const int index, const FloatImage& image,
+                   const double scale) {
+                 const int num_processing = ++num_processing_images;
+                 int max_num_processing = max_num_processing_images;
+                 while (num_processing > max_num_processing &&
+                        !max_num_processing_images.compare_exchange_weak(
+                            max_num_processing, num_processing)) {
+                 }
+                 std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                 --num_processing_images;
+               },
+               &statistics);
+
+  EXPECT_EQ(statistics.num_images, kNumImages);
+  EXPECT_LE(max_num_processing_images, kMaxNumHeldImages);
+  EXPECT_LE(statistics.max_queue_depth, kMaxNumHeldImages);
+  EXPECT_GT(statistics.max_queue_depth, 0);
+  EXPECT_LE(statistics.max_image_memory_bytes,
+            options.max_image_memory_bytes);
+  EXPECT_GT(statistics.average_queue_depth, 0.0);
+}
+
+TEST(ImageDecodingPipeline, ImagesLargerThanMemoryBudgetAreProcessed) {
+  ImageDecodingOptions options;
+  options.num_decoding_threads = 2;
+  options.max_image_memory_bytes = kImageBytes / 2;
+  ImageDecodingPipeline pipeline(options, 2);
+  pipeline.SetReadImageFunction(
+      [](const std::string& filename, FloatImage* image, double* scale) {
+        return ReadFakeImage(0, filename, image, scale);
+      });
+
+  std::atomic<int> num_processed_images(0);
+  ImageDecodingStatistics statistics;
+  pipeline.Run(
+      ImageFilenames(),
+      [&](const int index, const FloatImage& image, const double scale) {
+        ++num_processed_images;
+      },
+      &statistics);
+
+  EXPECT_EQ(num_processed_images, kNumImages);
+  EXPECT_EQ(statistics.num_images, kNumImages);
+  EXPECT_EQ(statistics.max_image_memory_bytes, kImageBytes);
+}
+
+TEST(ImageDecodingPipeline, ReadReducedResolutionImage) {
+  const std::string filename =
+      THEIA_DATA_DIR + std::string("/image/test1.jpg");
+  FloatImage image;
+  double scale;
+  ASSERT_TRUE(ReadGrayscaleImage(filename, 0, &image, &scale));
+  EXPECT_EQ(image.Channels(), 1);
+  EXPECT_EQ(scale, 1.0);
+  const int width = image.Width();
+  const int height = image.Height();
+  const int max_dimension = std::max(width, height);
+
+  // Images that are not larger than the maximum dimension are not reduced.
+  FloatImage full_image;
+  ASSERT_TRUE(ReadGrayscaleImage(filename, max_dimension, &full_image, &scale));
+  EXPECT_EQ(full_image.Width(), width);
+  EXPECT_EQ(full_image.Height(), height);
+  EXPECT_EQ(scale, 1.0);
+
+  FloatImage reduced_image;
+  ASSERT_TRUE(
+      ReadGrayscaleImage(filename, max_dimension / 4, &reduced_image, &scale));
+  EXPECT_EQ(reduced_image.Channels(), 1);
+  EXPECT_EQ(std::max(reduced_image.Width(), reduced_image.Height()),
+            max_dimension / 4);
+  EXPECT_DOUBLE_EQ(scale, static_cast<double>(max_dimension) /
+                              (max_dimension / 4));
+  EXPECT_NEAR(reduced_image.Width() * scale, width, scale);
+  EXPECT_NEAR(reduced_image.Height() * scale, height, scale);
+}
+
+TEST(ImageDecodingPipeline, RescaleKeypoints) {
+  static const double kScale = 4.0;
+  std::vector<Keypoint> keypoints(2);
+  keypoints[0] = Keypoint(0.0, 0.0, Keypoint::SIFT);
+  keypoints[0].set_scale(1.5);
+  keypoints[0].set_orientation(0.3);
+  keypoints[1] = Keypoint(10.0, 20.0, Keypoint::OTHER);
+
+  RescaleKeypoints(kScale, &keypoints);
+  // The center of the first pixel of the reduced image is the center of the
+  // first 4x4 pixels of the original image.
+  EXPECT_DOUBLE_EQ(keypoints[0].x(), 1.5);
+  EXPECT_DOUBLE_EQ(keypoints[0].y(), 1.5);
+  EXPECT_DOUBLE_EQ(keypoints[0].scale(), 6.0);
+  EXPECT_DOUBLE_EQ(keypoints[0].orientation(), 0.3);
+  EXPECT_DOUBLE_EQ(keypoints[1].x(), 41.5);
+  EXPECT_DOUBLE_EQ(keypoints[1].y(), 81.5);
+  EXPECT_FALSE(keypoints[1].has_scale());
+}
+
+}  // namespace theia
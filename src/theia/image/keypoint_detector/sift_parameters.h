@@ -69,6 +69,11 @@ struct SiftParameters {
   // location. This is useful for SfM for a number of reasons, especially during
   // geometric verification.
   bool upright_sift = true;
+  // If the SIFT descriptor extractor is given a thread pool, the octaves that
+  // are larger than this (in pixels of the octave) are computed in overlapping
+  // tiles of about this size in parallel. The features are the same as without
+  // tiles since VLFeat is compiled without floating point contraction.
+  int tile_size = 512;
 };
 
 #endif  // THEIA_IMAGE_KEYPOINT_DETECTOR_SIFT_PARAMETERS_H_
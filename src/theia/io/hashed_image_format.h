@@ -0,0 +1,74 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IO_HASHED_IMAGE_FORMAT_H_
+#define THEIA_IO_HASHED_IMAGE_FORMAT_H_
+
+#include <stdint.h>
+
+namespace theia {
+
+// Hashed image files begin with this magic number followed by the format
+// version, the HashedImageHeader, and the hashed image. The header comes before
+// the (much larger) hashed image so that it can be checked without reading the
+// entire file.
+static const uint64_t kHashedImageMagic = 0x5448454941485348ULL;
+static const uint32_t kHashedImageVersion = 2;
+
+// A hashed image is only valid for the hashing projections and the descriptors
+// that it was created from. The header identifies the projections by the
+// fingerprint of the CascadeHasher (see CascadeHasher::Fingerprint) and the
+// descriptors by their number, dimension, and checksum (see
+// ComputeDescriptorChecksum), so that a hashed image file of features that were
+// extracted again is not reused.
+struct HashedImageHeader {
+  uint64_t hasher_fingerprint = 0;
+  uint32_t num_descriptors = 0;
+  uint32_t descriptor_dimension = 0;
+  uint64_t descriptor_checksum = 0;
+
+  bool operator==(const HashedImageHeader& other) const {
+    return hasher_fingerprint == other.hasher_fingerprint &&
+           num_descriptors == other.num_descriptors &&
+           descriptor_dimension == other.descriptor_dimension &&
+           descriptor_checksum == other.descriptor_checksum;
+  }
+  bool operator!=(const HashedImageHeader& other) const {
+    return !(*this == other);
+  }
+};
+
+}  // namespace theia
+
+#endif  // THEIA_IO_HASHED_IMAGE_FORMAT_H_
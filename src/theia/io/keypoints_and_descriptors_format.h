@@ -0,0 +1,54 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IO_KEYPOINTS_AND_DESCRIPTORS_FORMAT_H_
+#define THEIA_IO_KEYPOINTS_AND_DESCRIPTORS_FORMAT_H_
+
+#include <stdint.h>
+
+namespace theia {
+
+// Feature files begin with this magic number followed by the format version,
+// the keypoints, and the descriptors. Version 1 stores the descriptors as a
+// DescriptorMatrix and version 2 stores them as a QuantizedDescriptorMatrix.
+// Feature files written before the descriptor matrix was introduced contain
+// only the keypoints and a vector of descriptors, so they begin with the (much
+// smaller) number of keypoints instead. This allows the legacy files to be
+// detected and read.
+static const uint64_t kKeypointsAndDescriptorsMagic = 0x5448454941464554ULL;
+static const uint32_t kKeypointsAndDescriptorsVersion = 2;
+
+}  // namespace theia
+
+#endif  // THEIA_IO_KEYPOINTS_AND_DESCRIPTORS_FORMAT_H_
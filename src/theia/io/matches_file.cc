@@ -0,0 +1,761 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/io/matches_file.h"
+
+#include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+#include <glog/logging.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>  // NOLINT
+#include <functional>
+#include <mutex>  // NOLINT
+#include <sstream>  // NOLINT
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "theia/io/matches_format.h"
+#include "theia/matching/feature_correspondence.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/sfm/camera_intrinsics_prior.h"
+#include "theia/util/hash.h"
+#include "theia/util/map_util.h"
+
+namespace theia {
+
+namespace {
+
+// The FNV-1a hash of the payload, which is used to detect records that were
+// only partially written.
+uint64_t PayloadChecksum(const std::string& payload) {
+  return Fnv1aHash(payload.data(), payload.size());
+}
+
+// Returns the approximate number of bytes that the match occupies in memory and
+// on disk.
+size_t NumBytesOfMatch(const ImagePairMatch& match) {
+  return sizeof(match) + match.image1.size() + match.image2.size() +
+         match.correspondences.size() * sizeof(FeatureCorrespondence);
+}
+
+// Returns the index entry of a match that was serialized at the offset.
+MatchesIndexEntry IndexEntryOfMatch(const ImagePairMatch& match,
+                                    const uint64_t offset,
+                                    const uint64_t size) {
+  MatchesIndexEntry entry;
+  entry.image1 = match.image1;
+  entry.image2 = match.image2;
+  entry.twoview_info = match.twoview_info;
+  entry.num_correspondences = match.correspondences.size();
+  entry.offset = offset;
+  entry.size = size;
+  return entry;
+}
+
+// Reads the next record of the matches file. Returns false if the file ends
+// before the record is complete or if the payload does not match its checksum.
+bool ReadRecord(std::ifstream* reader,
+                uint32_t* record_type,
+                uint32_t* num_items,
+                std::string* payload) {
+  char record_header[kMatchesRecordHeaderSize];
+  if (!reader->read(record_header, kMatchesRecordHeaderSize)) {
+    return false;
+  }
+  uint64_t payload_size, checksum;
+  std::memcpy(record_type, record_header, sizeof(uint32_t));
+  std::memcpy(num_items, record_header + 4, sizeof(uint32_t));
+  std::memcpy(&payload_size, record_header + 8, sizeof(uint64_t));
+  std::memcpy(&checksum, record_header + 16, sizeof(uint64_t));
+
+  // Make sure the payload size is sane before allocating memory for it.
+  const std::streampos payload_start = reader->tellg();
+  reader->seekg(0, std::ios::end);
+  const uint64_t num_remaining_bytes = reader->tellg() - payload_start;
+  reader->seekg(payload_start);
+  if (payload_size > num_remaining_bytes) {
+    return false;
+  }
+
+  payload->resize(payload_size);
+  if (!reader->read(&(*payload)[0], payload_size)) {
+    return false;
+  }
+  return PayloadChecksum(*payload) == checksum;
+}
+
+// Seeks to the position that was returned by tellg. The position is invalid if
+// the reader had already failed, e.g. because it reached the end of the file.
+void RestorePosition(const std::streampos position, std::ifstream* reader) {
+  reader->clear();
+  if (position == std::streampos(-1)) {
+    reader->seekg(0, std::ios::end);
+  } else {
+    reader->seekg(position);
+  }
+}
+
+}  // namespace
+
+MatchesWriter::MatchesWriter(const size_t max_chunk_size_bytes)
+    : max_chunk_size_bytes_(max_chunk_size_bytes),
+      file_size_(0),
+      stale_file_size_(0),
+      chunk_size_bytes_(0),
+      num_matches_(0) {}
+
+MatchesWriter::~MatchesWriter() {
+  if (matches_writer_.is_open()) {
+    Close();
+  }
+}
+
+bool MatchesWriter::Open(
+    const std::string& matches_file,
+    const std::vector<std::string>& view_names,
+    const std::vector<CameraIntrinsicsPrior>& camera_intrinsics_prior) {
+  CHECK_EQ(view_names.size(), camera_intrinsics_prior.size());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(!matches_writer_.is_open()) << "The matches file is already open.";
+  matches_writer_.open(matches_file, std::ios::out | std::ios::binary);
+  if (!matches_writer_.is_open()) {
+    LOG(ERROR) << "Could not open the matches file: " << matches_file
+               << " for writing.";
+    return false;
+  }
+  matches_file_ = matches_file;
+  chunk_.clear();
+  chunk_size_bytes_ = 0;
+  num_matches_ = 0;
+  index_.clear();
+  stale_file_size_ = 0;
+
+  // The offset of the index is written to the header when the file is closed.
+  char header[kMatchesHeaderSize] = {0};
+  std::memcpy(header, &kMatchesMagic, sizeof(kMatchesMagic));
+  std::memcpy(header + 8, &kMatchesVersion, sizeof(uint32_t));
+  std::memcpy(header + 12, &kMatchesByteOrderMark, sizeof(uint32_t));
+  matches_writer_.write(header, kMatchesHeaderSize);
+  file_size_ = kMatchesHeaderSize;
+
+  std::ostringstream payload_stream;
+  // Make sure that Cereal is able to finish executing before returning.
+  {
+    cereal::PortableBinaryOutputArchive output_archive(payload_stream);
+    output_archive(view_names, camera_intrinsics_prior);
+  }
+  return WriteRecord(
+      kMatchesViewsRecord, view_names.size(), payload_stream.str());
+}
+
+bool MatchesWriter::Reopen(const std::string& matches_file) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(!matches_writer_.is_open()) << "The matches file is already open.";
+  std::ifstream matches_reader(matches_file, std::ios::in | std::ios::binary);
+  if (!matches_reader.is_open()) {
+    LOG(ERROR) << "Could not open the matches file: " << matches_file
+               << " for reading.";
+    return false;
+  }
+
+  // Only files of the current version can be appended to.
+  char header[kMatchesHeaderSize];
+  uint64_t magic = 0;
+  uint32_t version = 0, byte_order_mark = 0;
+  if (matches_reader.read(header, kMatchesHeaderSize)) {
+    std::memcpy(&magic, header, sizeof(magic));
+    std::memcpy(&version, header + 8, sizeof(uint32_t));
+    std::memcpy(&byte_order_mark, header + 12, sizeof(uint32_t));
+  }
+  uint32_t record_type, num_items;
+  std::string payload;
+  if (magic != kMatchesMagic || version != kMatchesVersion ||
+      byte_order_mark != kMatchesByteOrderMark ||
+      !ReadRecord(&matches_reader, &record_type, &num_items, &payload) ||
+      record_type != kMatchesViewsRecord) {
+    LOG(ERROR) << "Cannot append to the matches file " << matches_file
+               << " because it was not written by this version of Theia.";
+    return false;
+  }
+
+  // Keep all complete chunks and rebuild their index. The index record, the
+  // end record, and any incomplete chunk are overwritten by new records.
+  chunk_.clear();
+  chunk_size_bytes_ = 0;
+  num_matches_ = 0;
+  index_.clear();
+  uint64_t end_of_chunks = matches_reader.tellg();
+  while (ReadRecord(&matches_reader, &record_type, &num_items, &payload) &&
+         record_type == kMatchesChunkRecord) {
+    const uint64_t payload_offset = end_of_chunks + kMatchesRecordHeaderSize;
+    std::istringstream payload_stream(payload);
+    for (int i = 0; i < num_items; i++) {
+      const uint64_t match_start = payload_stream.tellg();
+      ImagePairMatch match;
+      // Make sure that Cereal is able to finish executing before continuing.
+      {
+        cereal::PortableBinaryInputArchive input_archive(payload_stream);
+        input_archive(match);
+      }
+      const uint64_t match_end = payload_stream.tellg();
+      index_.emplace_back(IndexEntryOfMatch(
+          match, payload_offset + match_start, match_end - match_start));
+    }
+    num_matches_ += num_items;
+    end_of_chunks = payload_offset + payload.size();
+  }
+  matches_reader.clear();
+  matches_reader.seekg(0, std::ios::end);
+  stale_file_size_ = matches_reader.tellg();
+  matches_reader.close();
+
+  matches_writer_.open(matches_file,
+                       std::ios::in | std::ios::out | std::ios::binary);
+  if (!matches_writer_.is_open()) {
+    LOG(ERROR) << "Could not open the matches file: " << matches_file
+               << " for writing.";
+    return false;
+  }
+  matches_file_ = matches_file;
+
+  // The file has no index until it is closed again.
+  const uint64_t index_offset = 0;
+  matches_writer_.seekp(kMatchesIndexOffsetPosition);
+  matches_writer_.write(reinterpret_cast<const char*>(&index_offset),
+                        sizeof(index_offset));
+  matches_writer_.seekp(end_of_chunks);
+  file_size_ = end_of_chunks;
+  InvalidateStaleRecord();
+  matches_writer_.flush();
+  return static_cast<bool>(matches_writer_);
+}
+
+void MatchesWriter::InvalidateStaleRecord() {
+  if (file_size_ >= stale_file_size_) {
+    return;
+  }
+  // A zeroed record header never matches the checksum of its payload.
+  static const char kZeros[kMatchesRecordHeaderSize] = {0};
+  const uint64_t num_zeros =
+      std::min(kMatchesRecordHeaderSize, stale_file_size_ - file_size_);
+  matches_writer_.write(kZeros, num_zeros);
+  matches_writer_.seekp(file_size_);
+}
+
+bool MatchesWriter::WriteRecord(const uint32_t record_type,
+                                const uint32_t num_items,
+                                const std::string& payload) {
+  const uint64_t payload_size = payload.size();
+  const uint64_t checksum = PayloadChecksum(payload);
+  char record_header[kMatchesRecordHeaderSize] = {0};
+  std::memcpy(record_header, &record_type, sizeof(uint32_t));
+  std::memcpy(record_header + 4, &num_items, sizeof(uint32_t));
+  std::memcpy(record_header + 8, &payload_size, sizeof(uint64_t));
+  std::memcpy(record_header + 16, &checksum, sizeof(uint64_t));
+  matches_writer_.write(record_header, kMatchesRecordHeaderSize);
+  matches_writer_.write(payload.data(), payload_size);
+  file_size_ += kMatchesRecordHeaderSize + payload_size;
+  InvalidateStaleRecord();
+
+  // Flush the record so that it is on disk even if the writer is never closed.
+  matches_writer_.flush();
+  if (!matches_writer_) {
+    LOG(ERROR) << "Could not write to the matches file " << matches_file_;
+    return false;
+  }
+  return true;
+}
+
+bool MatchesWriter::AddMatch(const ImagePairMatch& match) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(matches_writer_.is_open()) << "The matches file is not open.";
+  chunk_.emplace_back(match);
+  chunk_size_bytes_ += NumBytesOfMatch(match);
+  ++num_matches_;
+  if (chunk_size_bytes_ < max_chunk_size_bytes_) {
+    return true;
+  }
+  return FlushLocked();
+}
+
+bool MatchesWriter::Flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(matches_writer_.is_open()) << "The matches file is not open.";
+  return FlushLocked();
+}
+
+bool MatchesWriter::FlushLocked() {
+  if (chunk_.empty()) {
+    return true;
+  }
+
+  // Serialize each match on its own and add it to the index.
+  const uint64_t payload_offset = file_size_ + kMatchesRecordHeaderSize;
+  std::ostringstream payload_stream;
+  for (const ImagePairMatch& match : chunk_) {
+    const uint64_t match_start = payload_stream.tellp();
+    // Make sure that Cereal is able to finish executing before continuing.
+    {
+      cereal::PortableBinaryOutputArchive output_archive(payload_stream);
+      output_archive(match);
+    }
+    const uint64_t match_end = payload_stream.tellp();
+    index_.emplace_back(IndexEntryOfMatch(
+        match, payload_offset + match_start, match_end - match_start));
+  }
+  const uint32_t num_matches_in_chunk = chunk_.size();
+  chunk_.clear();
+  chunk_.shrink_to_fit();
+  chunk_size_bytes_ = 0;
+  return WriteRecord(
+      kMatchesChunkRecord, num_matches_in_chunk, payload_stream.str());
+}
+
+bool MatchesWriter::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(matches_writer_.is_open()) << "The matches file is not open.";
+  if (!FlushLocked()) {
+    matches_writer_.close();
+    return false;
+  }
+
+  // Append the index and the end record, then point the header to the index.
+  const uint64_t index_offset = file_size_;
+  std::ostringstream payload_stream;
+  // Make sure that Cereal is able to finish executing before continuing.
+  {
+    cereal::PortableBinaryOutputArchive output_archive(payload_stream);
+    output_archive(index_);
+  }
+  bool success =
+      WriteRecord(kMatchesIndexRecord, index_.size(), payload_stream.str()) &&
+      WriteRecord(kMatchesEndRecord, 0, std::string());
+  if (success) {
+    matches_writer_.seekp(kMatchesIndexOffsetPosition);
+    matches_writer_.write(reinterpret_cast<const char*>(&index_offset),
+                          sizeof(index_offset));
+    matches_writer_.flush();
+    success = static_cast<bool>(matches_writer_);
+  }
+  matches_writer_.close();
+  index_.clear();
+  index_.shrink_to_fit();
+  return success;
+}
+
+MatchesReader::MatchesReader()
+    : version_(0),
+      first_chunk_offset_(0),
+      has_index_(false),
+      is_legacy_file_(false),
+      is_complete_(false) {}
+
+bool MatchesReader::Open(const std::string& matches_file) {
+  matches_reader_.open(matches_file, std::ios::in | std::ios::binary);
+  if (!matches_reader_.is_open()) {
+    LOG(ERROR) << "Could not open the matches file: " << matches_file
+               << " for reading.";
+    return false;
+  }
+  matches_file_ = matches_file;
+  view_names_.clear();
+  camera_intrinsics_prior_.clear();
+  index_.clear();
+  index_of_pair_.clear();
+  legacy_matches_.clear();
+  has_index_ = false;
+  is_legacy_file_ = false;
+  is_complete_ = false;
+
+  uint64_t magic = 0;
+  char header[kMatchesHeaderSize] = {0};
+  if (matches_reader_.read(header, kMatchesVersion1HeaderSize)) {
+    std::memcpy(&magic, header, sizeof(magic));
+  }
+
+  // Files written by older versions hold a single archive with all matches.
+  if (magic != kMatchesMagic) {
+    matches_reader_.clear();
+    matches_reader_.seekg(0);
+    is_legacy_file_ = true;
+    // Make sure that Cereal is able to finish executing before returning.
+    {
+      cereal::PortableBinaryInputArchive input_archive(matches_reader_);
+      input_archive(view_names_, camera_intrinsics_prior_, legacy_matches_);
+    }
+    return true;
+  }
+
+  uint32_t byte_order_mark;
+  std::memcpy(&version_, header + 8, sizeof(uint32_t));
+  std::memcpy(&byte_order_mark, header + 12, sizeof(uint32_t));
+  if (version_ > kMatchesVersion) {
+    LOG(ERROR) << "The matches file " << matches_file << " has version "
+               << version_ << " but only versions up to " << kMatchesVersion
+               << " are supported.";
+    return false;
+  }
+  if (byte_order_mark != kMatchesByteOrderMark) {
+    LOG(ERROR) << "The matches file " << matches_file
+               << " was written on a machine with a different byte order.";
+    return false;
+  }
+  uint64_t index_offset = 0;
+  if (version_ > 1) {
+    if (!matches_reader_.read(
+            header + kMatchesVersion1HeaderSize,
+            kMatchesHeaderSize - kMatchesVersion1HeaderSize)) {
+      LOG(ERROR) << "Could not read the header of the matches file "
+                 << matches_file;
+      return false;
+    }
+    std::memcpy(&index_offset,
+                header + kMatchesIndexOffsetPosition,
+                sizeof(index_offset));
+  }
+
+  uint32_t record_type, num_items;
+  std::string payload;
+  if (!ReadRecord(&matches_reader_, &record_type, &num_items, &payload) ||
+      record_type != kMatchesViewsRecord) {
+    LOG(ERROR) << "Could not read the views of the matches file "
+               << matches_file;
+    return false;
+  }
+  // Make sure that Cereal is able to finish executing before continuing.
+  {
+    std::istringstream payload_stream(payload);
+    cereal::PortableBinaryInputArchive input_archive(payload_stream);
+    input_archive(view_names_, camera_intrinsics_prior_);
+  }
+  if (view_names_.size() != num_items) {
+    LOG(ERROR) << "Could not read the views of the matches file "
+               << matches_file;
+    return false;
+  }
+  first_chunk_offset_ = matches_reader_.tellg();
+
+  // Read the index if the file was closed properly. If the index cannot be
+  // read (e.g. because the file was truncated), the file is scanned instead.
+  if (index_offset == 0) {
+    return true;
+  }
+  matches_reader_.seekg(index_offset);
+  if (!ReadRecord(&matches_reader_, &record_type, &num_items, &payload) ||
+      record_type != kMatchesIndexRecord) {
+    LOG(WARNING) << "Could not read the index of the matches file "
+                 << matches_file << ". The file is scanned instead.";
+    matches_reader_.clear();
+    matches_reader_.seekg(first_chunk_offset_);
+    return true;
+  }
+  // Make sure that Cereal is able to finish executing before continuing.
+  {
+    std::istringstream payload_stream(payload);
+    cereal::PortableBinaryInputArchive input_archive(payload_stream);
+    input_archive(index_);
+  }
+  if (index_.size() != num_items) {
+    LOG(ERROR) << "Could not read the index of the matches file "
+               << matches_file;
+    return false;
+  }
+  for (int i = 0; i < index_.size(); i++) {
+    index_of_pair_[std::make_pair(index_[i].image1, index_[i].image2)] = i;
+  }
+  has_index_ = true;
+  matches_reader_.seekg(first_chunk_offset_);
+  return true;
+}
+
+bool MatchesReader::ReadNextChunk(std::vector<ImagePairMatch>* matches) {
+  CHECK_NOTNULL(matches)->clear();
+  CHECK(matches_reader_.is_open()) << "The matches file is not open.";
+  if (is_complete_) {
+    return false;
+  }
+
+  if (is_legacy_file_) {
+    std::swap(*matches, legacy_matches_);
+    is_complete_ = true;
+    return true;
+  }
+
+  uint32_t record_type, num_matches;
+  std::string payload;
+  while (ReadRecord(&matches_reader_, &record_type, &num_matches, &payload)) {
+    if (record_type == kMatchesEndRecord) {
+      is_complete_ = true;
+      return false;
+    }
+
+    // Skip the index and the records that are not known to this version.
+    if (record_type != kMatchesChunkRecord) {
+      continue;
+    }
+
+    std::istringstream payload_stream(payload);
+    if (version_ == 1) {
+      cereal::PortableBinaryInputArchive input_archive(payload_stream);
+      input_archive(*matches);
+    } else {
+      matches->resize(num_matches);
+      for (ImagePairMatch& match : *matches) {
+        cereal::PortableBinaryInputArchive input_archive(payload_stream);
+        input_archive(match);
+      }
+    }
+    if (matches->size() != num_matches) {
+      LOG(ERROR) << "A chunk of the matches file " << matches_file_
+                 << " holds " << matches->size() << " matches but "
+                 << num_matches << " matches were expected.";
+      return false;
+    }
+    return true;
+  }
+
+  LOG(WARNING) << "The matches file " << matches_file_
+               << " was not closed properly. Only the matches that were "
+                  "completely written before are read.";
+  return false;
+}
+
+bool MatchesReader::ReadIndexedMatch(const MatchesIndexEntry& entry,
+                                     ImagePairMatch* match) {
+  // Keep the position of the chunks that are read with ReadNextChunk.
+  const std::streampos position = matches_reader_.tellg();
+  std::string serialized_match(entry.size, 0);
+  matches_reader_.clear();
+  matches_reader_.seekg(entry.offset);
+  const bool success = static_cast<bool>(
+      matches_reader_.read(&serialized_match[0], entry.size));
+  RestorePosition(position, &matches_reader_);
+  if (!success) {
+    LOG(ERROR) << "Could not read the match between " << entry.image1
+               << " and " << entry.image2 << " from the matches file "
+               << matches_file_;
+    return false;
+  }
+
+  std::istringstream match_stream(serialized_match);
+  // Make sure that Cereal is able to finish executing before returning.
+  {
+    cereal::PortableBinaryInputArchive input_archive(match_stream);
+    input_archive(*match);
+  }
+  return true;
+}
+
+bool MatchesReader::ScanMatches(
+    const std::function<void(ImagePairMatch*)>& callback) {
+  std::vector<ImagePairMatch> matches;
+  if (is_legacy_file_) {
+    // The matches may have been handed out with ReadNextChunk already.
+    std::ifstream legacy_reader(matches_file_, std::ios::in | std::ios::binary);
+    std::vector<std::string> view_names;
+    std::vector<CameraIntrinsicsPrior> camera_intrinsics_prior;
+    // Make sure that Cereal is able to finish executing before continuing.
+    {
+      cereal::PortableBinaryInputArchive input_archive(legacy_reader);
+      input_archive(view_names, camera_intrinsics_prior, matches);
+    }
+    for (ImagePairMatch& match : matches) {
+      callback(&match);
+    }
+    return true;
+  }
+
+  // Read all chunks from the start and restore the state of ReadNextChunk.
+  const std::streampos position = matches_reader_.tellg();
+  const bool is_complete = is_complete_;
+  matches_reader_.clear();
+  matches_reader_.seekg(first_chunk_offset_);
+  is_complete_ = false;
+  while (ReadNextChunk(&matches)) {
+    for (ImagePairMatch& match : matches) {
+      callback(&match);
+    }
+  }
+  RestorePosition(position, &matches_reader_);
+  is_complete_ = is_complete;
+  return true;
+}
+
+bool MatchesReader::ReadMatch(const std::string& image1,
+                              const std::string& image2,
+                              ImagePairMatch* match) {
+  CHECK_NOTNULL(match);
+  CHECK(matches_reader_.is_open()) << "The matches file is not open.";
+  if (!has_index_) {
+    bool found = false;
+    ScanMatches([&](ImagePairMatch* scanned_match) {
+      if ((scanned_match->image1 == image1 &&
+           scanned_match->image2 == image2) ||
+          (scanned_match->image1 == image2 &&
+           scanned_match->image2 == image1)) {
+        std::swap(*match, *scanned_match);
+        found = true;
+      }
+    });
+    return found;
+  }
+
+  const int* entry_index =
+      FindOrNull(index_of_pair_, std::make_pair(image1, image2));
+  if (entry_index == nullptr) {
+    entry_index = FindOrNull(index_of_pair_, std::make_pair(image2, image1));
+  }
+  if (entry_index == nullptr) {
+    return false;
+  }
+  return ReadIndexedMatch(index_[*entry_index], match);
+}
+
+bool MatchesReader::ReadMatchesOfViews(
+    const std::unordered_set<std::string>& view_names,
+    std::vector<ImagePairMatch>* matches) {
+  CHECK_NOTNULL(matches)->clear();
+  CHECK(matches_reader_.is_open()) << "The matches file is not open.";
+  if (!has_index_) {
+    return ScanMatches([&](ImagePairMatch* match) {
+      if (ContainsKey(view_names, match->image1) ||
+          ContainsKey(view_names, match->image2)) {
+        matches->emplace_back(std::move(*match));
+      }
+    });
+  }
+
+  // The index is in the order of the file, so the matches are read in order.
+  for (const MatchesIndexEntry& entry : index_) {
+    if (!ContainsKey(view_names, entry.image1) &&
+        !ContainsKey(view_names, entry.image2)) {
+      continue;
+    }
+    matches->emplace_back();
+    if (!ReadIndexedMatch(entry, &matches->back())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MatchesReader::ReadMatchesWithoutCorrespondences(
+    std::vector<ImagePairMatch>* matches) {
+  CHECK_NOTNULL(matches)->clear();
+  CHECK(matches_reader_.is_open()) << "The matches file is not open.";
+  if (!has_index_) {
+    return ScanMatches([&](ImagePairMatch* match) {
+      match->correspondences.clear();
+      match->correspondences.shrink_to_fit();
+      matches->emplace_back(std::move(*match));
+    });
+  }
+
+  matches->resize(index_.size());
+  for (int i = 0; i < index_.size(); i++) {
+    (*matches)[i].image1 = index_[i].image1;
+    (*matches)[i].image2 = index_[i].image2;
+    (*matches)[i].twoview_info = index_[i].twoview_info;
+  }
+  return true;
+}
+
+bool MergeMatchesFiles(const std::vector<std::string>& input_matches_files,
+                       const std::string& output_matches_file) {
+  if (input_matches_files.empty()) {
+    LOG(ERROR) << "No matches files were given to merge.";
+    return false;
+  }
+  if (std::find(input_matches_files.begin(),
+                input_matches_files.end(),
+                output_matches_file) != input_matches_files.end()) {
+    LOG(ERROR) << "The merged matches file " << output_matches_file
+               << " must not be one of the files that are merged.";
+    return false;
+  }
+
+  MatchesWriter matches_writer;
+  std::vector<std::string> view_names;
+  std::unordered_set<std::pair<std::string, std::string> > merged_pairs;
+  std::vector<ImagePairMatch> matches;
+  for (int i = 0; i < input_matches_files.size(); i++) {
+    MatchesReader matches_reader;
+    if (!matches_reader.Open(input_matches_files[i])) {
+      return false;
+    }
+    if (i == 0) {
+      view_names = matches_reader.view_names();
+      if (!matches_writer.Open(output_matches_file,
+                               view_names,
+                               matches_reader.camera_intrinsics_prior())) {
+        return false;
+      }
+    } else if (matches_reader.view_names() != view_names) {
+      LOG(ERROR) << "The matches file " << input_matches_files[i]
+                 << " holds other views than " << input_matches_files[0]
+                 << " and cannot be merged with it.";
+      return false;
+    }
+
+    int num_merged_matches = 0;
+    while (matches_reader.ReadNextChunk(&matches)) {
+      for (const ImagePairMatch& match : matches) {
+        const auto pair = std::minmax(match.image1, match.image2);
+        if (!merged_pairs.emplace(pair.first, pair.second).second) {
+          continue;
+        }
+        if (!matches_writer.AddMatch(match)) {
+          return false;
+        }
+        ++num_merged_matches;
+      }
+    }
+    if (!matches_reader.is_complete()) {
+      LOG(WARNING) << "The matches file " << input_matches_files[i]
+                   << " is incomplete. Only its complete chunks were merged.";
+    }
+    VLOG(1) << "Merged " << num_merged_matches << " matches from "
+            << input_matches_files[i];
+  }
+  return matches_writer.Close();
+}
+
+}  // namespace theia
@@ -0,0 +1,236 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IO_MATCHES_FILE_H_
+#define THEIA_IO_MATCHES_FILE_H_
+
+#include <cereal/access.hpp>
+#include <cereal/types/string.hpp>
+#include <stdint.h>
+
+#include <fstream>  // NOLINT
+#include <functional>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "theia/matching/image_pair_match.h"
+#include "theia/sfm/camera_intrinsics_prior.h"
+#include "theia/sfm/twoview_info.h"
+#include "theia/util/hash.h"
+#include "theia/util/util.h"
+
+namespace theia {
+
+// The entry of a match in the index of a matches file. The index holds
+// everything about the match except for the correspondences, along with the
+// location of the serialized match in the file.
+struct MatchesIndexEntry {
+  std::string image1;
+  std::string image2;
+  TwoViewInfo twoview_info;
+  uint32_t num_correspondences = 0;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+
+ private:
+  friend class cereal::access;
+  template <class Archive>
+  void serialize(Archive& ar, const std::uint32_t version) {  // NOLINT
+    ar(image1, image2, twoview_info, num_correspondences, offset, size);
+  }
+};
+
+// Writes image pair matches to a matches file as they are found so that the
+// matches of large image collections never have to be held in memory at once.
+// The matches are buffered and appended to the file in chunks of roughly
+// max_chunk_size_bytes. Each chunk is written completely and flushed before
+// the next one is started, so if the writer is not closed (e.g. because the
+// process crashed) the file still holds all chunks that were written. See
+// matches_format.h for the file format. Matches may be added from several
+// threads at once.
+class MatchesWriter {
+ public:
+  explicit MatchesWriter(const size_t max_chunk_size_bytes = 16 << 20);
+  // Closes the file if it is still open.
+  ~MatchesWriter();
+
+  // Creates the matches file and writes the view names and camera intrinsics
+  // priors. Any existing file is overwritten.
+  bool Open(const std::string& matches_file,
+            const std::vector<std::string>& view_names,
+            const std::vector<CameraIntrinsicsPrior>& camera_intrinsics_prior);
+
+  // Reopens a matches file to append matches to it, e.g. to resume matching
+  // after it was interrupted. All complete chunks of the file are kept along
+  // with the view names and camera intrinsics priors of the file, and the rest
+  // of the file is overwritten. Only files that were written with the current
+  // format version can be reopened.
+  bool Reopen(const std::string& matches_file);
+
+  // Adds the match to the current chunk and appends the chunk to the file once
+  // it exceeds the maximum chunk size.
+  bool AddMatch(const ImagePairMatch& match);
+
+  // Appends the buffered matches to the file as a chunk.
+  bool Flush();
+
+  // Writes the remaining matches and the index of all matches, and marks the
+  // end of the file.
+  bool Close();
+
+  // The number of matches that have been added.
+  int NumMatches() const { return num_matches_; }
+
+ private:
+  // Appends a record to the file. The mutex must be held by the caller.
+  bool WriteRecord(const uint32_t record_type,
+                   const uint32_t num_items,
+                   const std::string& payload);
+  bool FlushLocked();
+
+  // Reopened files may hold stale records past the records that have been
+  // written. The record header that follows the written records is zeroed so
+  // that readers do not mistake stale records for new ones.
+  void InvalidateStaleRecord();
+
+  const size_t max_chunk_size_bytes_;
+
+  std::mutex mutex_;
+  std::string matches_file_;
+  std::ofstream matches_writer_;
+  uint64_t file_size_;
+  uint64_t stale_file_size_;
+  std::vector<ImagePairMatch> chunk_;
+  size_t chunk_size_bytes_;
+  int num_matches_;
+  std::vector<MatchesIndexEntry> index_;
+
+  DISALLOW_COPY_AND_ASSIGN(MatchesWriter);
+};
+
+// Reads a matches file. The matches may be read lazily chunk by chunk so that
+// they can be processed without loading all of them into memory. If the file
+// was closed properly by the writer, its index allows reading only the matches
+// of some image pairs or views, or only the TwoViewInfo of all matches without
+// reading the correspondences at all. Files without an index (e.g. because the
+// writer was not closed) are scanned instead, and the incomplete chunk at the
+// end of the file is skipped. Matches files that were written by older versions
+// are read entirely as a single chunk.
+class MatchesReader {
+ public:
+  MatchesReader();
+
+  // Opens the matches file and reads the view names, the camera intrinsics
+  // priors, and the index.
+  bool Open(const std::string& matches_file);
+
+  const std::vector<std::string>& view_names() const { return view_names_; }
+  const std::vector<CameraIntrinsicsPrior>& camera_intrinsics_prior() const {
+    return camera_intrinsics_prior_;
+  }
+
+  // Reads the next chunk of matches. Returns false once all chunks have been
+  // read, or if the rest of the file is truncated or corrupted.
+  bool ReadNextChunk(std::vector<ImagePairMatch>* matches);
+
+  // Returns true if all chunks have been read and the file was closed properly
+  // by the writer, i.e. no matches are missing.
+  bool is_complete() const { return is_complete_; }
+
+  // Returns true if the file has an index. The index holds the image names and
+  // the TwoViewInfo of all matches.
+  bool has_index() const { return has_index_; }
+  const std::vector<MatchesIndexEntry>& index() const { return index_; }
+
+  // The methods below do not affect the chunks read with ReadNextChunk.
+
+  // Reads the match between the two images (in either order). Returns false if
+  // the images were not matched.
+  bool ReadMatch(const std::string& image1,
+                 const std::string& image2,
+                 ImagePairMatch* match);
+
+  // Reads all matches that contain at least one of the views.
+  bool ReadMatchesOfViews(const std::unordered_set<std::string>& view_names,
+                          std::vector<ImagePairMatch>* matches);
+
+  // Reads the image names and TwoViewInfo of all matches, which is all that is
+  // needed to build a view graph. The correspondences of the matches are left
+  // empty. If the file has an index, only the index is read.
+  bool ReadMatchesWithoutCorrespondences(std::vector<ImagePairMatch>* matches);
+
+ private:
+  // Reads the match at the location given by the index entry.
+  bool ReadIndexedMatch(const MatchesIndexEntry& entry, ImagePairMatch* match);
+
+  // Passes each match in the file to the callback by reading the file from the
+  // first chunk on. This is used if the file has no index.
+  bool ScanMatches(const std::function<void(ImagePairMatch*)>& callback);
+
+  std::string matches_file_;
+  std::ifstream matches_reader_;
+  uint32_t version_;
+  uint64_t first_chunk_offset_;
+  std::vector<std::string> view_names_;
+  std::vector<CameraIntrinsicsPrior> camera_intrinsics_prior_;
+
+  // The index of the matches, and the position of each image pair in it.
+  bool has_index_;
+  std::vector<MatchesIndexEntry> index_;
+  std::unordered_map<std::pair<std::string, std::string>, int> index_of_pair_;
+
+  // The matches of a file that was written by an older version.
+  std::vector<ImagePairMatch> legacy_matches_;
+  bool is_legacy_file_;
+  bool is_complete_;
+
+  DISALLOW_COPY_AND_ASSIGN(MatchesReader);
+};
+
+// Combines the matches files of several matching shards (see
+// FeatureMatcherOptions::num_shards) into a single matches file. All input
+// files must hold the same views, and the camera intrinsics priors of the first
+// file are used. Image pairs that appear in more than one file are only kept
+// once. Only the complete chunks of input files that were not closed properly
+// are merged.
+bool MergeMatchesFiles(const std::vector<std::string>& input_matches_files,
+                       const std::string& output_matches_file);
+
+}  // namespace theia
+
+#endif  // THEIA_IO_MATCHES_FILE_H_
@@ -0,0 +1,369 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <fstream>  // NOLINT
+#include <iterator>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "theia/io/matches_file.h"
+#include "theia/io/read_matches.h"
+#include "theia/matching/feature_correspondence.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/sfm/camera_intrinsics_prior.h"
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+namespace {
+
+static const int kNumViews = 4;
+static const int kNumCorrespondences = 20;
+
+std::vector<std::string> ViewNames() {
+  std::vector<std::string> view_names;
+  for (int i = 0; i < kNumViews; i++) {
+    view_names.emplace_back(std::to_string(i));
+  }
+  return view_names;
+}
+
+// Returns the matches of all pairs of the views. The correspondences and the
+// two view info of each match identify its image pair.
+std::vector<ImagePairMatch> AllMatches() {
+  std::vector<ImagePairMatch> matches;
+  for (int i = 0; i < kNumViews; i++) {
+    for (int j = i + 1; j < kNumViews; j++) {
+      ImagePairMatch match;
+      match.image1 = std::to_string(i);
+      match.image2 = std::to_string(j);
+      match.twoview_info.num_verified_matches = kNumCorrespondences;
+      match.twoview_info.focal_length_1 = i;
+      match.twoview_info.focal_length_2 = j;
+      for (int k = 0; k < kNumCorrespondences; k++) {
+        match.correspondences.emplace_back(Feature(i, k), Feature(j, k));
+      }
+      matches.emplace_back(match);
+    }
+  }
+  return matches;
+}
+
+void ExpectMatchIsValid(const ImagePairMatch& match) {
+  EXPECT_EQ(match.twoview_info.focal_length_1, std::stoi(match.image1));
+  EXPECT_EQ(match.twoview_info.focal_length_2, std::stoi(match.image2));
+  ASSERT_EQ(match.correspondences.size(), kNumCorrespondences);
+  for (int k = 0; k < kNumCorrespondences; k++) {
+    EXPECT_EQ(match.correspondences[k].feature1,
+              Feature(std::stoi(match.image1), k));
+    EXPECT_EQ(match.correspondences[k].feature2,
+              Feature(std::stoi(match.image2), k));
+  }
+}
+
+// Writes the matches to the file in chunks of one match each.
+void WriteMatchesFile(const std::string& matches_file,
+                      const std::vector<ImagePairMatch>& matches) {
+  MatchesWriter writer(1);
+  ASSERT_TRUE(writer.Open(matches_file,
+                          ViewNames(),
+                          std::vector<CameraIntrinsicsPrior>(kNumViews)));
+  for (const ImagePairMatch& match : matches) {
+    EXPECT_TRUE(writer.AddMatch(match));
+  }
+  EXPECT_TRUE(writer.Close());
+}
+
+}  // namespace
+
+TEST(MatchesFile, StreamMatchesChunkByChunk) {
+  const std::string matches_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/streamed_matches.bin";
+  const std::vector<std::string> view_names = ViewNames();
+  const std::vector<ImagePairMatch> matches = AllMatches();
+  std::vector<CameraIntrinsicsPrior> priors(kNumViews);
+  priors[2].focal_length.is_set = true;
+  priors[2].focal_length.value[0] = 800.0;
+
+  // Write each match to the file as it is added. The chunks are small enough
+  // that each match is written in its own chunk.
+  {
+    MatchesWriter writer(1);
+    ASSERT_TRUE(writer.Open(matches_file, view_names, priors));
+    for (const ImagePairMatch& match : matches) {
+      EXPECT_TRUE(writer.AddMatch(match));
+    }
+    EXPECT_EQ(writer.NumMatches(), matches.size());
+    EXPECT_TRUE(writer.Close());
+  }
+
+  // The matches are read back chunk by chunk.
+  MatchesReader reader;
+  ASSERT_TRUE(reader.Open(matches_file));
+  EXPECT_EQ(reader.view_names(), view_names);
+  ASSERT_EQ(reader.camera_intrinsics_prior().size(), kNumViews);
+  EXPECT_TRUE(reader.camera_intrinsics_prior()[2].focal_length.is_set);
+  EXPECT_EQ(reader.camera_intrinsics_prior()[2].focal_length.value[0], 800.0);
+  EXPECT_FALSE(reader.camera_intrinsics_prior()[1].focal_length.is_set);
+
+  int num_read_matches = 0;
+  std::vector<ImagePairMatch> chunk;
+  while (reader.ReadNextChunk(&chunk)) {
+    ASSERT_EQ(chunk.size(), 1);
+    EXPECT_EQ(chunk[0].image1, matches[num_read_matches].image1);
+    EXPECT_EQ(chunk[0].image2, matches[num_read_matches].image2);
+    ExpectMatchIsValid(chunk[0]);
+    ++num_read_matches;
+  }
+  EXPECT_TRUE(reader.is_complete());
+  EXPECT_EQ(num_read_matches, matches.size());
+}
+
+TEST(MatchesFile, FlushWritesBufferedMatches) {
+  const std::string matches_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/flushed_matches.bin";
+  const std::vector<ImagePairMatch> matches = AllMatches();
+
+  // With the default chunk size all matches fit in one chunk, which is only
+  // written once the writer is flushed.
+  MatchesWriter writer;
+  ASSERT_TRUE(writer.Open(matches_file,
+                          ViewNames(),
+                          std::vector<CameraIntrinsicsPrior>(kNumViews)));
+  for (const ImagePairMatch& match : matches) {
+    EXPECT_TRUE(writer.AddMatch(match));
+  }
+  {
+    MatchesReader reader;
+    ASSERT_TRUE(reader.Open(matches_file));
+    std::vector<ImagePairMatch> chunk;
+    EXPECT_FALSE(reader.ReadNextChunk(&chunk));
+    EXPECT_FALSE(reader.is_complete());
+  }
+
+  ASSERT_TRUE(writer.Flush());
+  {
+    MatchesReader reader;
+    ASSERT_TRUE(reader.Open(matches_file));
+    std::vector<ImagePairMatch> chunk;
+    ASSERT_TRUE(reader.ReadNextChunk(&chunk));
+    EXPECT_EQ(chunk.size(), matches.size());
+    EXPECT_FALSE(reader.ReadNextChunk(&chunk));
+    EXPECT_FALSE(reader.is_complete());
+  }
+  EXPECT_TRUE(writer.Close());
+}
+
+TEST(MatchesFile, ReadMatchesWithIndex) {
+  const std::string matches_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/indexed_matches.bin";
+  const std::vector<ImagePairMatch> matches = AllMatches();
+  WriteMatchesFile(matches_file, matches);
+
+  MatchesReader reader;
+  ASSERT_TRUE(reader.Open(matches_file));
+  ASSERT_TRUE(reader.has_index());
+  ASSERT_EQ(reader.index().size(), matches.size());
+  for (int i = 0; i < matches.size(); i++) {
+    EXPECT_EQ(reader.index()[i].image1, matches[i].image1);
+    EXPECT_EQ(reader.index()[i].image2, matches[i].image2);
+    EXPECT_EQ(reader.index()[i].num_correspondences, kNumCorrespondences);
+  }
+
+  // Single matches are read in either order of the images.
+  ImagePairMatch match;
+  ASSERT_TRUE(reader.ReadMatch("1", "2", &match));
+  EXPECT_EQ(match.image1, "1");
+  EXPECT_EQ(match.image2, "2");
+  ExpectMatchIsValid(match);
+  ASSERT_TRUE(reader.ReadMatch("3", "0", &match));
+  EXPECT_EQ(match.image1, "0");
+  EXPECT_EQ(match.image2, "3");
+  ExpectMatchIsValid(match);
+  EXPECT_FALSE(reader.ReadMatch("0", "4", &match));
+
+  // Reading single matches does not affect the chunks read in order.
+  std::vector<ImagePairMatch> chunk;
+  ASSERT_TRUE(reader.ReadNextChunk(&chunk));
+  ASSERT_EQ(chunk.size(), 1);
+  EXPECT_EQ(chunk[0].image1, matches[0].image1);
+  EXPECT_EQ(chunk[0].image2, matches[0].image2);
+
+  std::vector<ImagePairMatch> read_matches;
+  ASSERT_TRUE(reader.ReadMatchesOfViews({"3"}, &read_matches));
+  ASSERT_EQ(read_matches.size(), kNumViews - 1);
+  for (const ImagePairMatch& read_match : read_matches) {
+    EXPECT_TRUE(read_match.image1 == "3" || read_match.image2 == "3");
+    ExpectMatchIsValid(read_match);
+  }
+
+  ASSERT_TRUE(reader.ReadMatchesWithoutCorrespondences(&read_matches));
+  ASSERT_EQ(read_matches.size(), matches.size());
+  for (int i = 0; i < matches.size(); i++) {
+    EXPECT_EQ(read_matches[i].image1, matches[i].image1);
+    EXPECT_EQ(read_matches[i].image2, matches[i].image2);
+    EXPECT_EQ(read_matches[i].twoview_info.focal_length_1,
+              matches[i].twoview_info.focal_length_1);
+    EXPECT_TRUE(read_matches[i].correspondences.empty());
+  }
+}
+
+TEST(MatchesFile, ReadAndReopenTruncatedFile) {
+  const std::string matches_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/truncated_matches.bin";
+  const std::vector<ImagePairMatch> matches = AllMatches();
+  WriteMatchesFile(matches_file, matches);
+
+  MatchesIndexEntry last_entry;
+  {
+    MatchesReader reader;
+    ASSERT_TRUE(reader.Open(matches_file));
+    ASSERT_TRUE(reader.has_index());
+    last_entry = reader.index().back();
+  }
+
+  // Drop the index, the end record, and part of the last chunk as if the
+  // writer had been interrupted.
+  std::string file_contents;
+  {
+    std::ifstream reader(matches_file, std::ios::in | std::ios::binary);
+    file_contents.assign(std::istreambuf_iterator<char>(reader),
+                         std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream writer(matches_file, std::ios::out | std::ios::binary);
+    writer.write(file_contents.data(), last_entry.offset + last_entry.size / 2);
+  }
+
+  // All complete chunks are read.
+  std::vector<std::string> read_view_names;
+  std::vector<CameraIntrinsicsPrior> read_priors;
+  std::vector<ImagePairMatch> read_matches;
+  EXPECT_TRUE(ReadMatchesAndGeometry(
+      matches_file, &read_view_names, &read_priors, &read_matches));
+  EXPECT_EQ(read_view_names, ViewNames());
+  EXPECT_EQ(read_matches.size(), matches.size() - 1);
+
+  // Without the index, the complete chunks of the file are scanned instead.
+  {
+    MatchesReader reader;
+    ASSERT_TRUE(reader.Open(matches_file));
+    EXPECT_FALSE(reader.has_index());
+    std::vector<ImagePairMatch> chunk;
+    while (reader.ReadNextChunk(&chunk)) {
+    }
+    EXPECT_FALSE(reader.is_complete());
+
+    ASSERT_TRUE(reader.ReadMatchesOfViews({"0", "1", "2", "3"}, &read_matches));
+    EXPECT_EQ(read_matches.size(), matches.size() - 1);
+    ImagePairMatch match;
+    ASSERT_TRUE(reader.ReadMatch("1", "0", &match));
+    ExpectMatchIsValid(match);
+    EXPECT_FALSE(
+        reader.ReadMatch(last_entry.image1, last_entry.image2, &match));
+  }
+
+  // Reopening the file keeps the complete chunks and overwrites the rest.
+  {
+    MatchesWriter writer(1);
+    ASSERT_TRUE(writer.Reopen(matches_file));
+    EXPECT_EQ(writer.NumMatches(), matches.size() - 1);
+    EXPECT_TRUE(writer.AddMatch(matches.back()));
+    EXPECT_TRUE(writer.Close());
+  }
+  MatchesReader reader;
+  ASSERT_TRUE(reader.Open(matches_file));
+  EXPECT_EQ(reader.view_names(), ViewNames());
+  ASSERT_TRUE(reader.has_index());
+  EXPECT_EQ(reader.index().size(), matches.size());
+  ImagePairMatch match;
+  ASSERT_TRUE(reader.ReadMatch(last_entry.image2, last_entry.image1, &match));
+  ExpectMatchIsValid(match);
+  EXPECT_TRUE(ReadMatchesAndGeometry(
+      matches_file, &read_view_names, &read_priors, &read_matches));
+  EXPECT_EQ(read_matches.size(), matches.size());
+}
+
+TEST(MatchesFile, MergeMatchesFiles) {
+  static const int kNumShards = 3;
+  const std::vector<ImagePairMatch> matches = AllMatches();
+
+  // Each shard file holds every third match. The last match is written to two
+  // shards, e.g. because a shard was matched again after it was interrupted.
+  std::vector<std::string> shard_matches_files;
+  for (int i = 0; i < kNumShards; i++) {
+    std::vector<ImagePairMatch> shard_matches;
+    for (int j = i; j < matches.size(); j += kNumShards) {
+      shard_matches.emplace_back(matches[j]);
+    }
+    if (i == 0) {
+      shard_matches.emplace_back(matches.back());
+    }
+    shard_matches_files.emplace_back(
+        std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/shard_matches" +
+        std::to_string(i) + ".bin");
+    WriteMatchesFile(shard_matches_files.back(), shard_matches);
+  }
+
+  // The merged file holds every image pair once.
+  const std::string merged_matches_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/merged_matches.bin";
+  ASSERT_TRUE(MergeMatchesFiles(shard_matches_files, merged_matches_file));
+  std::vector<std::string> read_view_names;
+  std::vector<CameraIntrinsicsPrior> read_priors;
+  std::vector<ImagePairMatch> read_matches;
+  ASSERT_TRUE(ReadMatchesAndGeometry(
+      merged_matches_file, &read_view_names, &read_priors, &read_matches));
+  EXPECT_EQ(read_view_names, ViewNames());
+  EXPECT_EQ(read_matches.size(), matches.size());
+  std::set<std::pair<std::string, std::string> > read_pairs;
+  for (const ImagePairMatch& match : read_matches) {
+    read_pairs.emplace(match.image1, match.image2);
+    ExpectMatchIsValid(match);
+  }
+  EXPECT_EQ(read_pairs.size(), matches.size());
+
+  // Files of other views cannot be merged.
+  MatchesWriter writer;
+  ASSERT_TRUE(writer.Open(shard_matches_files[0],
+                          {"a", "b"},
+                          std::vector<CameraIntrinsicsPrior>(2)));
+  EXPECT_TRUE(writer.Close());
+  EXPECT_FALSE(MergeMatchesFiles(shard_matches_files, merged_matches_file));
+}
+
+}  // namespace theia
@@ -0,0 +1,83 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IO_MATCHES_FORMAT_H_
+#define THEIA_IO_MATCHES_FORMAT_H_
+
+#include <stdint.h>
+
+namespace theia {
+
+// Matches files begin with a header of kMatchesHeaderSize bytes that holds the
+// magic number, the format version, the byte order mark, and the offset of the
+// index record (or zero if the file has no index). The header is followed by a
+// sequence of records. Each record consists of a record header of
+// kMatchesRecordHeaderSize bytes (the record type, the number of items in the
+// record, the size of the payload in bytes, and the checksum of the payload)
+// followed by the payload, which is serialized with cereal. The first record
+// holds the view names and camera intrinsics priors and the following records
+// hold chunks of image pair matches. Each match in a chunk is serialized on its
+// own so that it can be read without reading the rest of the chunk. When the
+// file is closed, the index record and the end record are appended and the
+// offset of the index is written to the header. The index holds the image
+// names, the TwoViewInfo, and the location of each match, so that the view
+// graph can be built and single matches can be read without reading all
+// correspondences. Records are only ever appended to the file, so a file that
+// was not closed (e.g. because matching was interrupted) still holds all chunks
+// that were completely written before, but it has no index.
+//
+// In version 1, the header did not hold the offset of the index (and was
+// kMatchesVersion1HeaderSize bytes long), the matches of a chunk were
+// serialized together, and there was no index.
+//
+// Files that do not begin with the magic number were written by older versions
+// and hold a single cereal archive of the view names, camera intrinsics priors,
+// and all matches.
+static const uint64_t kMatchesMagic = 0x54484549414d4154ULL;
+static const uint32_t kMatchesVersion = 2;
+static const uint32_t kMatchesByteOrderMark = 0x01020304;
+static const uint64_t kMatchesHeaderSize = 32;
+static const uint64_t kMatchesVersion1HeaderSize = 16;
+static const uint64_t kMatchesIndexOffsetPosition = 16;
+static const uint64_t kMatchesRecordHeaderSize = 24;
+
+// The types of the records in a matches file.
+static const uint32_t kMatchesViewsRecord = 1;
+static const uint32_t kMatchesChunkRecord = 2;
+static const uint32_t kMatchesEndRecord = 3;
+static const uint32_t kMatchesIndexRecord = 4;
+
+}  // namespace theia
+
+#endif  // THEIA_IO_MATCHES_FORMAT_H_
@@ -0,0 +1,425 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/io/packed_feature_store.h"
+
+#include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+#include <Eigen/Core>
+#include <glog/logging.h>
+#include <stdint.h>
+
+#include <cstring>
+#include <fstream>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/io/packed_features_format.h"
+#include "theia/util/memory_mapped_file.h"
+
+namespace theia {
+
+static_assert(sizeof(PackedKeypoint) == 48,
+              "The packed keypoint must not contain any padding.");
+
+namespace {
+
+PackedKeypoint PackKeypoint(const Keypoint& keypoint) {
+  PackedKeypoint packed_keypoint;
+  packed_keypoint.x = keypoint.x();
+  packed_keypoint.y = keypoint.y();
+  packed_keypoint.strength = keypoint.strength();
+  packed_keypoint.scale = keypoint.scale();
+  packed_keypoint.orientation = keypoint.orientation();
+  packed_keypoint.keypoint_type = keypoint.keypoint_type();
+  packed_keypoint.reserved = 0;
+  return packed_keypoint;
+}
+
+Keypoint UnpackKeypoint(const PackedKeypoint& packed_keypoint) {
+  Keypoint keypoint(
+      packed_keypoint.x,
+      packed_keypoint.y,
+      static_cast<Keypoint::KeypointType>(packed_keypoint.keypoint_type));
+  keypoint.set_strength(packed_keypoint.strength);
+  keypoint.set_scale(packed_keypoint.scale);
+  keypoint.set_orientation(packed_keypoint.orientation);
+  return keypoint;
+}
+
+// Returns a pointer to the descriptor data with the given precision.
+const char* DescriptorData(const QuantizedDescriptorMatrix& descriptors) {
+  switch (descriptors.precision()) {
+    case DescriptorPrecision::FLOAT16:
+      return reinterpret_cast<const char*>(
+          descriptors.float16_descriptors().data());
+    case DescriptorPrecision::UINT8:
+      return reinterpret_cast<const char*>(
+          descriptors.uint8_descriptors().data());
+    case DescriptorPrecision::BINARY:
+      return reinterpret_cast<const char*>(
+          descriptors.binary_descriptors().data());
+    default:
+      return reinterpret_cast<const char*>(
+          descriptors.float32_descriptors().data());
+  }
+}
+
+}  // namespace
+
+std::string PackedFeatureStoreIndexFilename(const std::string& store_file) {
+  return store_file + ".index";
+}
+
+PackedFeatureStoreWriter::PackedFeatureStoreWriter() : data_size_(0) {}
+
+PackedFeatureStoreWriter::~PackedFeatureStoreWriter() {
+  if (data_writer_.is_open()) {
+    Close();
+  }
+}
+
+bool PackedFeatureStoreWriter::Open(const std::string& store_file) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(!data_writer_.is_open()) << "The packed feature store is already open.";
+  data_writer_.open(store_file, std::ios::out | std::ios::binary);
+  if (!data_writer_.is_open()) {
+    LOG(ERROR) << "Could not open the packed feature store: " << store_file
+               << " for writing.";
+    return false;
+  }
+  store_file_ = store_file;
+  entries_.clear();
+  entry_index_.clear();
+
+  char header[kPackedFeaturesHeaderSize] = {0};
+  std::memcpy(header, &kPackedFeaturesMagic, sizeof(kPackedFeaturesMagic));
+  std::memcpy(header + 8, &kPackedFeaturesVersion, sizeof(uint32_t));
+  std::memcpy(header + 12, &kPackedFeaturesByteOrderMark, sizeof(uint32_t));
+  data_writer_.write(header, kPackedFeaturesHeaderSize);
+  data_size_ = kPackedFeaturesHeaderSize;
+  return static_cast<bool>(data_writer_);
+}
+
+void PackedFeatureStoreWriter::AlignDataFile() {
+  static const char kZeros[kPackedFeaturesAlignment] = {0};
+  const uint64_t padding =
+      (kPackedFeaturesAlignment - data_size_ % kPackedFeaturesAlignment) %
+      kPackedFeaturesAlignment;
+  data_writer_.write(kZeros, padding);
+  data_size_ += padding;
+}
+
+bool PackedFeatureStoreWriter::AddImage(
+    const std::string& image_name,
+    const std::vector<Keypoint>& keypoints,
+    const QuantizedDescriptorMatrix& descriptors) {
+  CHECK_EQ(keypoints.size(), descriptors.rows())
+      << "The number of keypoints and descriptors must be the same.";
+
+  std::vector<PackedKeypoint> packed_keypoints;
+  packed_keypoints.reserve(keypoints.size());
+  for (const Keypoint& keypoint : keypoints) {
+    packed_keypoints.emplace_back(PackKeypoint(keypoint));
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(data_writer_.is_open()) << "The packed feature store is not open.";
+  if (entry_index_.count(image_name) > 0) {
+    LOG(ERROR) << "The features of image " << image_name
+               << " were already added to the packed feature store "
+               << store_file_;
+    return false;
+  }
+
+  PackedFeaturesIndexEntry entry;
+  entry.image_name = image_name;
+  entry.num_features = keypoints.size();
+  entry.descriptor_dimension = descriptors.cols();
+  entry.precision = descriptors.precision();
+
+  AlignDataFile();
+  entry.keypoints_offset = data_size_;
+  const uint64_t keypoints_size =
+      packed_keypoints.size() * sizeof(PackedKeypoint);
+  data_writer_.write(reinterpret_cast<const char*>(packed_keypoints.data()),
+                     keypoints_size);
+  data_size_ += keypoints_size;
+
+  AlignDataFile();
+  entry.descriptors_offset = data_size_;
+  data_writer_.write(DescriptorData(descriptors), descriptors.NumBytes());
+  data_size_ += descriptors.NumBytes();
+
+  if (!data_writer_) {
+    LOG(ERROR) << "Could not write the features of image " << image_name
+               << " to the packed feature store " << store_file_;
+    return false;
+  }
+
+  entry_index_[image_name] = entries_.size();
+  entries_.emplace_back(entry);
+  return true;
+}
+
+bool PackedFeatureStoreWriter::AddImage(const std::string& image_name,
+                                        const std::vector<Keypoint>& keypoints,
+                                        const DescriptorMatrix& descriptors,
+                                        const DescriptorPrecision precision) {
+  QuantizedDescriptorMatrix quantized_descriptors;
+  quantized_descriptors.Quantize(descriptors, precision);
+  return AddImage(image_name, keypoints, quantized_descriptors);
+}
+
+bool PackedFeatureStoreWriter::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(data_writer_.is_open()) << "The packed feature store is not open.";
+  data_writer_.close();
+  if (!data_writer_) {
+    LOG(ERROR) << "Could not write the packed feature store " << store_file_;
+    return false;
+  }
+
+  const std::string index_file = PackedFeatureStoreIndexFilename(store_file_);
+  std::ofstream index_writer(index_file, std::ios::out | std::ios::binary);
+  if (!index_writer.is_open()) {
+    LOG(ERROR) << "Could not open the packed feature store index: "
+               << index_file << " for writing.";
+    return false;
+  }
+
+  // Make sure that Cereal is able to finish executing before returning.
+  {
+    cereal::PortableBinaryOutputArchive output_archive(index_writer);
+    output_archive(kPackedFeaturesMagic, kPackedFeaturesVersion, entries_);
+  }
+  return static_cast<bool>(index_writer);
+}
+
+PackedFeaturesView::PackedFeaturesView()
+    : keypoints_(nullptr),
+      descriptors_(nullptr),
+      num_features_(0),
+      descriptor_dimension_(0),
+      precision_(DescriptorPrecision::FLOAT32) {}
+
+Eigen::Map<const DescriptorMatrix> PackedFeaturesView::float32_descriptors()
+    const {
+  CHECK(precision_ == DescriptorPrecision::FLOAT32);
+  return Eigen::Map<const DescriptorMatrix>(
+      static_cast<const float*>(descriptors_),
+      num_features_,
+      descriptor_dimension_);
+}
+
+Eigen::Map<const Float16DescriptorMatrix>
+PackedFeaturesView::float16_descriptors() const {
+  CHECK(precision_ == DescriptorPrecision::FLOAT16);
+  return Eigen::Map<const Float16DescriptorMatrix>(
+      static_cast<const uint16_t*>(descriptors_),
+      num_features_,
+      descriptor_dimension_);
+}
+
+Eigen::Map<const Uint8DescriptorMatrix> PackedFeaturesView::uint8_descriptors()
+    const {
+  CHECK(precision_ == DescriptorPrecision::UINT8);
+  return Eigen::Map<const Uint8DescriptorMatrix>(
+      static_cast<const uint8_t*>(descriptors_),
+      num_features_,
+      descriptor_dimension_);
+}
+
+Eigen::Map<const BinaryDescriptorMatrix>
+PackedFeaturesView::binary_descriptors() const {
+  CHECK(precision_ == DescriptorPrecision::BINARY);
+  return Eigen::Map<const BinaryDescriptorMatrix>(
+      static_cast<const uint8_t*>(descriptors_),
+      num_features_,
+      DescriptorSizeInBytes(precision_, descriptor_dimension_));
+}
+
+size_t PackedFeaturesView::NumDescriptorBytes() const {
+  return static_cast<size_t>(num_features_) *
+         DescriptorSizeInBytes(precision_, descriptor_dimension_);
+}
+
+void PackedFeaturesView::GetKeypoints(std::vector<Keypoint>* keypoints) const {
+  CHECK_NOTNULL(keypoints)->clear();
+  keypoints->reserve(num_features_);
+  for (int i = 0; i < num_features_; i++) {
+    keypoints->emplace_back(UnpackKeypoint(keypoints_[i]));
+  }
+}
+
+void PackedFeaturesView::GetDescriptors(DescriptorMatrix* descriptors) const {
+  DequantizeDescriptors(precision_,
+                        descriptors_,
+                        num_features_,
+                        descriptor_dimension_,
+                        descriptors);
+}
+
+PackedFeatureStore::PackedFeatureStore() {}
+
+PackedFeatureStore::~PackedFeatureStore() {}
+
+bool PackedFeatureStore::Open(const std::string& store_file) {
+  CHECK(mapped_file_ == nullptr) << "The packed feature store is already open.";
+
+  // Read the index.
+  const std::string index_file = PackedFeatureStoreIndexFilename(store_file);
+  std::ifstream index_reader(index_file, std::ios::in | std::ios::binary);
+  if (!index_reader.is_open()) {
+    LOG(ERROR) << "Could not open the packed feature store index: "
+               << index_file << " for reading.";
+    return false;
+  }
+  uint64_t magic;
+  uint32_t version;
+  std::vector<PackedFeaturesIndexEntry> entries;
+  {
+    cereal::PortableBinaryInputArchive input_archive(index_reader);
+    input_archive(magic, version);
+    if (magic != kPackedFeaturesMagic || version != kPackedFeaturesVersion) {
+      LOG(ERROR) << "The packed feature store index " << index_file
+                 << " is invalid or has an unsupported version.";
+      return false;
+    }
+    input_archive(entries);
+  }
+
+  // Map the data file and validate the header.
+  std::shared_ptr<MemoryMappedFile> mapped_file(new MemoryMappedFile);
+  if (!mapped_file->Open(store_file)) {
+    return false;
+  }
+  const char* data = mapped_file->data();
+  const uint64_t data_size = mapped_file->size();
+  uint32_t byte_order_mark = 0;
+  if (data_size >= kPackedFeaturesHeaderSize) {
+    std::memcpy(&magic, data, sizeof(magic));
+    std::memcpy(&version, data + 8, sizeof(version));
+    std::memcpy(&byte_order_mark, data + 12, sizeof(byte_order_mark));
+  }
+  if (data_size < kPackedFeaturesHeaderSize || magic != kPackedFeaturesMagic ||
+      version != kPackedFeaturesVersion) {
+    LOG(ERROR) << "The packed feature store " << store_file
+               << " is invalid or has an unsupported version.";
+    return false;
+  }
+  if (byte_order_mark != kPackedFeaturesByteOrderMark) {
+    LOG(ERROR) << "The packed feature store " << store_file
+               << " was written on a machine with a different byte order.";
+    return false;
+  }
+
+  // Make sure that the features of all images are within the data file.
+  for (PackedFeaturesIndexEntry& entry : entries) {
+    const uint64_t keypoints_size =
+        static_cast<uint64_t>(entry.num_features) * sizeof(PackedKeypoint);
+    const uint64_t descriptors_size =
+        static_cast<uint64_t>(entry.num_features) *
+        DescriptorSizeInBytes(entry.precision, entry.descriptor_dimension);
+    if (entry.keypoints_offset % kPackedFeaturesAlignment != 0 ||
+        entry.descriptors_offset % kPackedFeaturesAlignment != 0 ||
+        entry.keypoints_offset + keypoints_size > data_size ||
+        entry.descriptors_offset + descriptors_size > data_size) {
+      LOG(ERROR) << "The features of image " << entry.image_name
+                 << " are not within the packed feature store " << store_file;
+      return false;
+    }
+    const std::string image_name = entry.image_name;
+    index_[image_name] = std::move(entry);
+  }
+
+  mapped_file_ = mapped_file;
+  return true;
+}
+
+std::vector<std::string> PackedFeatureStore::ImageNames() const {
+  std::vector<std::string> image_names;
+  image_names.reserve(index_.size());
+  for (const auto& entry : index_) {
+    image_names.emplace_back(entry.first);
+  }
+  return image_names;
+}
+
+bool PackedFeatureStore::HasImage(const std::string& image_name) const {
+  return index_.count(image_name) > 0;
+}
+
+bool PackedFeatureStore::GetFeaturesView(const std::string& image_name,
+                                         PackedFeaturesView* features) const {
+  CHECK_NOTNULL(features);
+  const auto it = index_.find(image_name);
+  if (it == index_.end()) {
+    return false;
+  }
+
+  const PackedFeaturesIndexEntry& entry = it->second;
+  features->mapped_file_ = mapped_file_;
+  features->keypoints_ = reinterpret_cast<const PackedKeypoint*>(
+      mapped_file_->data() + entry.keypoints_offset);
+  features->descriptors_ = mapped_file_->data() + entry.descriptors_offset;
+  features->num_features_ = entry.num_features;
+  features->descriptor_dimension_ = entry.descriptor_dimension;
+  features->precision_ = entry.precision;
+  return true;
+}
+
+bool PackedFeatureStore::ReadKeypointsAndDescriptors(
+    const std::string& image_name,
+    std::vector<Keypoint>* keypoints,
+    DescriptorMatrix* descriptors) const {
+  PackedFeaturesView features;
+  if (!GetFeaturesView(image_name, &features)) {
+    LOG(ERROR) << "The packed feature store does not contain image "
+               << image_name;
+    return false;
+  }
+  features.GetKeypoints(keypoints);
+  features.GetDescriptors(descriptors);
+  return true;
+}
+
+}  // namespace theia
@@ -0,0 +1,225 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IO_PACKED_FEATURE_STORE_H_
+#define THEIA_IO_PACKED_FEATURE_STORE_H_
+
+#include <cereal/access.hpp>
+#include <cereal/types/common.hpp>
+#include <cereal/types/string.hpp>
+#include <Eigen/Core>
+#include <stdint.h>
+
+#include <fstream>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/util/util.h"
+
+namespace theia {
+class Keypoint;
+class MemoryMappedFile;
+
+// Writing features to one file per image results in a very large number of
+// small files for large image collections, and each file must be deserialized
+// entirely when it is read. A packed feature store instead holds the features
+// of all images in a single data file along with an index file that holds the
+// location of the features of each image. The keypoints and descriptors are
+// stored as raw arrays so that the data file can be memory mapped and the
+// descriptors can be used without reading or copying them. See
+// packed_features_format.h for the file format.
+
+// The layout of a keypoint in the data file.
+struct PackedKeypoint {
+  double x;
+  double y;
+  double strength;
+  double scale;
+  double orientation;
+  int32_t keypoint_type;
+  int32_t reserved;
+};
+
+// The location of the features of an image in the data file.
+struct PackedFeaturesIndexEntry {
+  std::string image_name;
+  uint64_t keypoints_offset = 0;
+  uint64_t descriptors_offset = 0;
+  uint32_t num_features = 0;
+  uint32_t descriptor_dimension = 0;
+  DescriptorPrecision precision = DescriptorPrecision::FLOAT32;
+
+ private:
+  friend class cereal::access;
+  template <class Archive>
+  void serialize(Archive& ar, const std::uint32_t version) {  // NOLINT
+    ar(image_name,
+       keypoints_offset,
+       descriptors_offset,
+       num_features,
+       descriptor_dimension,
+       precision);
+  }
+};
+
+// Returns the filepath of the index file of a packed feature store.
+std::string PackedFeatureStoreIndexFilename(const std::string& store_file);
+
+// Writes the features of many images to a packed feature store. Images may be
+// added from several threads at once.
+class PackedFeatureStoreWriter {
+ public:
+  PackedFeatureStoreWriter();
+  // Closes the store if it is still open.
+  ~PackedFeatureStoreWriter();
+
+  // Creates the data file of the store. Any existing store is overwritten.
+  bool Open(const std::string& store_file);
+
+  // Appends the features of an image to the store. The i-th row of the
+  // descriptor matrix is the descriptor of the i-th keypoint. Returns false if
+  // the features could not be written or if the image was already added.
+  bool AddImage(const std::string& image_name,
+                const std::vector<Keypoint>& keypoints,
+                const QuantizedDescriptorMatrix& descriptors);
+
+  // Same as above, but the descriptors are written with the given precision.
+  bool AddImage(const std::string& image_name,
+                const std::vector<Keypoint>& keypoints,
+                const DescriptorMatrix& descriptors,
+                const DescriptorPrecision precision);
+
+  // Writes the index file. The store may only be read once it is closed.
+  bool Close();
+
+ private:
+  // Pads the data file with zeros up to the next multiple of the alignment.
+  void AlignDataFile();
+
+  std::mutex mutex_;
+  std::string store_file_;
+  std::ofstream data_writer_;
+  uint64_t data_size_;
+  std::vector<PackedFeaturesIndexEntry> entries_;
+  std::unordered_map<std::string, int> entry_index_;
+
+  DISALLOW_COPY_AND_ASSIGN(PackedFeatureStoreWriter);
+};
+
+// A view of the features of one image in a packed feature store. The keypoints
+// and descriptors are not copied, they are accessed directly in the memory
+// mapped data file. The view keeps the mapping alive, so it remains valid even
+// if the store it was obtained from is destroyed.
+class PackedFeaturesView {
+ public:
+  PackedFeaturesView();
+
+  // Returns true if the view does not reference any features.
+  bool empty() const { return mapped_file_ == nullptr; }
+
+  int num_features() const { return num_features_; }
+  int descriptor_dimension() const { return descriptor_dimension_; }
+  DescriptorPrecision precision() const { return precision_; }
+
+  const PackedKeypoint* keypoints() const { return keypoints_; }
+
+  // The descriptors with the precision they are stored with. Only the method
+  // corresponding to the precision of the descriptors may be called.
+  Eigen::Map<const DescriptorMatrix> float32_descriptors() const;
+  Eigen::Map<const Float16DescriptorMatrix> float16_descriptors() const;
+  Eigen::Map<const Uint8DescriptorMatrix> uint8_descriptors() const;
+  // Each row holds the packed bits of one binary descriptor.
+  Eigen::Map<const BinaryDescriptorMatrix> binary_descriptors() const;
+
+  // The number of bytes that the descriptors occupy in the data file.
+  size_t NumDescriptorBytes() const;
+
+  // Copies the keypoints and the descriptors (converted to floats).
+  void GetKeypoints(std::vector<Keypoint>* keypoints) const;
+  void GetDescriptors(DescriptorMatrix* descriptors) const;
+
+ private:
+  friend class PackedFeatureStore;
+
+  std::shared_ptr<const MemoryMappedFile> mapped_file_;
+  const PackedKeypoint* keypoints_;
+  const void* descriptors_;
+  int num_features_;
+  int descriptor_dimension_;
+  DescriptorPrecision precision_;
+};
+
+// Reads features from a packed feature store. The data file is memory mapped,
+// so features are only read from disk when they are accessed. All methods may
+// be called from several threads at once.
+class PackedFeatureStore {
+ public:
+  PackedFeatureStore();
+  ~PackedFeatureStore();
+
+  // Reads the index file and maps the data file into memory. Returns false if
+  // the store could not be opened or if it is invalid.
+  bool Open(const std::string& store_file);
+
+  int NumImages() const { return index_.size(); }
+  std::vector<std::string> ImageNames() const;
+  bool HasImage(const std::string& image_name) const;
+
+  // Returns a view of the features of the image without copying them. Returns
+  // false if the image is not in the store.
+  bool GetFeaturesView(const std::string& image_name,
+                       PackedFeaturesView* features) const;
+
+  // Copies the features of the image. The descriptors are converted to floats.
+  bool ReadKeypointsAndDescriptors(const std::string& image_name,
+                                   std::vector<Keypoint>* keypoints,
+                                   DescriptorMatrix* descriptors) const;
+
+ private:
+  std::shared_ptr<const MemoryMappedFile> mapped_file_;
+  std::unordered_map<std::string, PackedFeaturesIndexEntry> index_;
+
+  DISALLOW_COPY_AND_ASSIGN(PackedFeatureStore);
+};
+
+}  // namespace theia
+
+CEREAL_CLASS_VERSION(theia::PackedFeaturesIndexEntry, 0);
+
+#endif  // THEIA_IO_PACKED_FEATURE_STORE_H_
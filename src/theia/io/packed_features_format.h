@@ -0,0 +1,62 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IO_PACKED_FEATURES_FORMAT_H_
+#define THEIA_IO_PACKED_FEATURES_FORMAT_H_
+
+#include <stdint.h>
+
+namespace theia {
+
+// A packed feature store consists of a data file and an index file. The data
+// file begins with a header that holds the magic number, the format version,
+// and a byte order mark, followed by the keypoints and descriptors of all
+// images as raw arrays. Each array starts at a multiple of
+// kPackedFeaturesAlignment bytes so that it can be used directly from a memory
+// mapping of the file. The arrays are stored in the byte order of the machine
+// that wrote them, which is checked with the byte order mark when the store is
+// opened.
+//
+// The index file is a cereal PortableBinary archive that begins with the magic
+// number and the format version, followed by the location of the features of
+// each image in the data file.
+static const uint64_t kPackedFeaturesMagic = 0x5448454941504b46ULL;
+static const uint32_t kPackedFeaturesVersion = 1;
+static const uint32_t kPackedFeaturesByteOrderMark = 0x01020304;
+static const uint64_t kPackedFeaturesAlignment = 64;
+static const uint64_t kPackedFeaturesHeaderSize = 64;
+
+}  // namespace theia
+
+#endif  // THEIA_IO_PACKED_FEATURES_FORMAT_H_
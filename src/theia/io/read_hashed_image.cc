@@ -0,0 +1,121 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/io/read_hashed_image.h"
+
+#include <cereal/archives/portable_binary.hpp>
+#include <glog/logging.h>
+#include <stdint.h>
+
+#include <fstream>  // NOLINT
+#include <string>
+
+#include "theia/io/hashed_image_format.h"
+#include "theia/matching/cascade_hasher.h"
+
+namespace theia {
+
+namespace {
+
+// Reads the file header that identifies the hasher and the descriptors that the
+// hashed image was created from.
+bool ReadHeader(const std::string& hashed_image_file,
+                cereal::PortableBinaryInputArchive* input_archive,
+                HashedImageHeader* header) {
+  uint64_t magic;
+  uint32_t version;
+  (*input_archive)(magic, version);
+  if (magic != kHashedImageMagic || version != kHashedImageVersion) {
+    LOG(ERROR) << "The file " << hashed_image_file
+               << " is not a hashed image file of version "
+               << kHashedImageVersion;
+    return false;
+  }
+  (*input_archive)(header->hasher_fingerprint,
+                   header->num_descriptors,
+                   header->descriptor_dimension,
+                   header->descriptor_checksum);
+  return true;
+}
+
+}  // namespace
+
+bool ReadHashedImage(const std::string& hashed_image_file,
+                     const HashedImageHeader& expected_header,
+                     HashedImage* hashed_image) {
+  CHECK_NOTNULL(hashed_image);
+
+  std::ifstream hashed_image_reader(hashed_image_file,
+                                    std::ios::in | std::ios::binary);
+  if (!hashed_image_reader.is_open()) {
+    VLOG(2) << "Could not open the hashed image file: " << hashed_image_file
+            << " for reading.";
+    return false;
+  }
+
+  cereal::PortableBinaryInputArchive input_archive(hashed_image_reader);
+  HashedImageHeader header;
+  if (!ReadHeader(hashed_image_file, &input_archive, &header)) {
+    return false;
+  }
+  if (header.hasher_fingerprint != expected_header.hasher_fingerprint) {
+    VLOG(2) << "The hashed image file " << hashed_image_file
+            << " was created with different hashing projections.";
+    return false;
+  }
+  if (header != expected_header) {
+    VLOG(2) << "The hashed image file " << hashed_image_file
+            << " was created from different descriptors.";
+    return false;
+  }
+
+  input_archive(*hashed_image);
+  return true;
+}
+
+bool ReadHashedImageHeader(const std::string& hashed_image_file,
+                           HashedImageHeader* header) {
+  CHECK_NOTNULL(header);
+
+  std::ifstream hashed_image_reader(hashed_image_file,
+                                    std::ios::in | std::ios::binary);
+  if (!hashed_image_reader.is_open()) {
+    return false;
+  }
+
+  cereal::PortableBinaryInputArchive input_archive(hashed_image_reader);
+  return ReadHeader(hashed_image_file, &input_archive, header);
+}
+
+}  // namespace theia
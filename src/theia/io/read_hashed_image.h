@@ -0,0 +1,60 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_IO_READ_HASHED_IMAGE_H_
+#define THEIA_IO_READ_HASHED_IMAGE_H_
+
+#include <string>
+
+namespace theia {
+struct HashedImage;
+struct HashedImageHeader;
+
+// Reads the cascade hashing information of an image that was written with
+// WriteHashedImage. Returns false if the file cannot be read or if its header
+// differs from the expected header (i.e. it was created by another
+// CascadeHasher or from other descriptors), in which case the hashed image must
+// be recreated.
+bool ReadHashedImage(const std::string& hashed_image_file,
+                     const HashedImageHeader& expected_header,
+                     HashedImage* hashed_image);
+
+// Reads only the header of the hashed image file. This is useful to check if an
+// existing file can be reused.
+bool ReadHashedImageHeader(const std::string& hashed_image_file,
+                           HashedImageHeader* header);
+
+}  // namespace theia
+
+#endif  // THEIA_IO_READ_HASHED_IMAGE_H_
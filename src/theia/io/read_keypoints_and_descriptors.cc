@@ -40,6 +40,7 @@
 #include <Eigen/Core>
 
 #include <glog/logging.h>
+#include <stdint.h>
 #include <cstdlib>
 #include <fstream>   // NOLINT
 #include <iostream>  // NOLINT
@@ -47,17 +48,20 @@
 #include <vector>
 
 #include "theia/alignment/alignment.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 #include "theia/io/eigen_serializable.h"
+#include "theia/io/keypoints_and_descriptors_format.h"
 
 namespace theia {
 
 // Reads the features from a file.
 bool ReadKeypointsAndDescriptors(const std::string& features_file,
                                  std::vector<Keypoint>* keypoints,
-                                 std::vector<Eigen::VectorXf>* descriptors) {
+                                 QuantizedDescriptorMatrix* descriptors) {
   CHECK_NOTNULL(keypoints)->clear();
-  CHECK_NOTNULL(descriptors)->clear();
+  CHECK_NOTNULL(descriptors);
 
   // Return false if the file cannot be opened.
   std::ifstream features_reader(features_file, std::ios::in | std::ios::binary);
@@ -68,8 +72,65 @@ bool ReadKeypointsAndDescriptors(const std::string& features_file,
   }
 
   cereal::PortableBinaryInputArchive input_archive(features_reader);
-  input_archive(*keypoints, *descriptors);
 
+  // Files in the current format begin with a magic number. Legacy files begin
+  // with the size of the keypoints vector instead.
+  uint64_t header;
+  input_archive(header);
+  if (header != kKeypointsAndDescriptorsMagic) {
+    // This mirrors the way that cereal reads the std::vector<Keypoint> after
+    // the size has been read.
+    keypoints->resize(header);
+    for (Keypoint& keypoint : *keypoints) {
+      input_archive(keypoint);
+    }
+    std::vector<Eigen::VectorXf> legacy_descriptors;
+    input_archive(legacy_descriptors);
+    DescriptorMatrix descriptor_matrix;
+    DescriptorsToMatrix(legacy_descriptors, &descriptor_matrix);
+    descriptors->Quantize(descriptor_matrix, DescriptorPrecision::FLOAT32);
+    return true;
+  }
+
+  uint32_t version;
+  input_archive(version);
+  if (version == 1) {
+    DescriptorMatrix descriptor_matrix;
+    input_archive(*keypoints, descriptor_matrix);
+    descriptors->Quantize(descriptor_matrix, DescriptorPrecision::FLOAT32);
+  } else if (version == kKeypointsAndDescriptorsVersion) {
+    input_archive(*keypoints, *descriptors);
+  } else {
+    LOG(ERROR) << "Feature file " << features_file << " has version "
+               << version << " but only versions up to "
+               << kKeypointsAndDescriptorsVersion << " are supported.";
+    return false;
+  }
+
+  return true;
+}
+
+bool ReadKeypointsAndDescriptors(const std::string& features_file,
+                                 std::vector<Keypoint>* keypoints,
+                                 DescriptorMatrix* descriptors) {
+  QuantizedDescriptorMatrix quantized_descriptors;
+  if (!ReadKeypointsAndDescriptors(
+          features_file, keypoints, &quantized_descriptors)) {
+    return false;
+  }
+  quantized_descriptors.Dequantize(CHECK_NOTNULL(descriptors));
+  return true;
+}
+
+bool ReadKeypointsAndDescriptors(const std::string& features_file,
+                                 std::vector<Keypoint>* keypoints,
+                                 std::vector<Eigen::VectorXf>* descriptors) {
+  DescriptorMatrix descriptor_matrix;
+  if (!ReadKeypointsAndDescriptors(
+          features_file, keypoints, &descriptor_matrix)) {
+    return false;
+  }
+  MatrixToDescriptors(descriptor_matrix, CHECK_NOTNULL(descriptors));
   return true;
 }
 
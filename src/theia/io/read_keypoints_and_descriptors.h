@@ -39,10 +39,26 @@
 #include <string>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+
 namespace theia {
 class Keypoint;
 
-// Reads the features from a single file.
+// Reads the features from a single file. The i-th row of the descriptor matrix
+// is the descriptor of the i-th keypoint. Feature files written in the legacy
+// format (a vector of descriptors) may also be read.
+bool ReadKeypointsAndDescriptors(const std::string& features_file,
+                                 std::vector<Keypoint>* keypoints,
+                                 DescriptorMatrix* descriptors);
+
+// Same as above, but the descriptors are returned with the precision that they
+// were written with, i.e. they are not converted to floats.
+bool ReadKeypointsAndDescriptors(const std::string& features_file,
+                                 std::vector<Keypoint>* keypoints,
+                                 QuantizedDescriptorMatrix* descriptors);
+
+// Same as above, but the descriptors are returned as a vector of descriptors.
 bool ReadKeypointsAndDescriptors(const std::string& features_file,
                                  std::vector<Keypoint>* keypoints,
                                  std::vector<Eigen::VectorXf>* descriptors);
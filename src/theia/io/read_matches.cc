@@ -34,16 +34,12 @@
 
 #include "theia/io/read_matches.h"
 
-#include <cereal/archives/portable_binary.hpp>
-#include <cereal/types/string.hpp>
-#include <cereal/types/vector.hpp>
-
 #include <glog/logging.h>
-#include <cstdlib>
-#include <fstream>   // NOLINT
-#include <iostream>  // NOLINT
+#include <iterator>
 #include <string>
+#include <vector>
 
+#include "theia/io/matches_file.h"
 #include "theia/matching/image_pair_match.h"
 #include "theia/sfm/camera_intrinsics_prior.h"
 
@@ -58,21 +54,38 @@ bool ReadMatchesAndGeometry(
   CHECK_NOTNULL(camera_intrinsics_prior)->clear();
   CHECK_NOTNULL(matches)->clear();
 
-  // Return false if the file cannot be opened.
-  std::ifstream matches_reader(matches_file, std::ios::in | std::ios::binary);
-  if (!matches_reader.is_open()) {
-    LOG(ERROR) << "Could not open the matches file: " << matches_file
-               << " for reading.";
+  MatchesReader matches_reader;
+  if (!matches_reader.Open(matches_file)) {
     return false;
   }
+  *view_names = matches_reader.view_names();
+  *camera_intrinsics_prior = matches_reader.camera_intrinsics_prior();
 
-  // Make sure that Cereal is able to finish executing before returning.
-  {
-    cereal::PortableBinaryInputArchive input_archive(matches_reader);
-    input_archive(*view_names, *camera_intrinsics_prior, *matches);
+  std::vector<ImagePairMatch> chunk;
+  while (matches_reader.ReadNextChunk(&chunk)) {
+    matches->insert(matches->end(),
+                    std::make_move_iterator(chunk.begin()),
+                    std::make_move_iterator(chunk.end()));
   }
-
   return true;
 }
 
+bool ReadMatchesWithoutCorrespondences(
+    const std::string& matches_file,
+    std::vector<std::string>* view_names,
+    std::vector<CameraIntrinsicsPrior>* camera_intrinsics_prior,
+    std::vector<ImagePairMatch>* matches) {
+  CHECK_NOTNULL(view_names)->clear();
+  CHECK_NOTNULL(camera_intrinsics_prior)->clear();
+  CHECK_NOTNULL(matches)->clear();
+
+  MatchesReader matches_reader;
+  if (!matches_reader.Open(matches_file)) {
+    return false;
+  }
+  *view_names = matches_reader.view_names();
+  *camera_intrinsics_prior = matches_reader.camera_intrinsics_prior();
+  return matches_reader.ReadMatchesWithoutCorrespondences(matches);
+}
+
 }  // namespace theia
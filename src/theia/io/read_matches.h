@@ -46,13 +46,25 @@ struct ImagePairMatch;
 // Reads the feature matches between view pairs as well as the two view geometry
 // (i.e., TwoViewInfo) that describes the relative pose between the two
 // views. The names of all views are returned and the image indices in the
-// matches objects corresponds to the index of view_names.
+// matches objects corresponds to the index of view_names. If the file was not
+// closed properly when it was written, all matches that were completely written
+// are read. Use MatchesReader to process the matches chunk by chunk instead.
 bool ReadMatchesAndGeometry(
     const std::string& matches_file,
     std::vector<std::string>* view_names,
     std::vector<CameraIntrinsicsPrior>* camera_intrinsics_prior,
     std::vector<ImagePairMatch>* matches);
 
+// Same as above, but only the image names and the TwoViewInfo of the matches
+// are read and the correspondences are left empty. If the matches file has an
+// index, only the index is read, which is much faster than reading all matches
+// (e.g. when only the view graph is needed).
+bool ReadMatchesWithoutCorrespondences(
+    const std::string& matches_file,
+    std::vector<std::string>* view_names,
+    std::vector<CameraIntrinsicsPrior>* camera_intrinsics_prior,
+    std::vector<ImagePairMatch>* matches);
+
 }  // namespace theia
 
 #endif  // THEIA_IO_READ_MATCHES_H_
@@ -0,0 +1,75 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/io/write_hashed_image.h"
+
+#include <cereal/archives/portable_binary.hpp>
+#include <glog/logging.h>
+#include <stdint.h>
+
+#include <fstream>  // NOLINT
+#include <string>
+
+#include "theia/io/hashed_image_format.h"
+#include "theia/matching/cascade_hasher.h"
+
+namespace theia {
+
+bool WriteHashedImage(const std::string& hashed_image_file,
+                      const HashedImageHeader& header,
+                      const HashedImage& hashed_image) {
+  std::ofstream hashed_image_writer(hashed_image_file,
+                                    std::ios::out | std::ios::binary);
+  if (!hashed_image_writer.is_open()) {
+    LOG(ERROR) << "Could not open the hashed image file: " << hashed_image_file
+               << " for writing.";
+    return false;
+  }
+
+  // Make sure that Cereal is able to finish executing before returning.
+  {
+    cereal::PortableBinaryOutputArchive output_archive(hashed_image_writer);
+    output_archive(kHashedImageMagic,
+                   kHashedImageVersion,
+                   header.hasher_fingerprint,
+                   header.num_descriptors,
+                   header.descriptor_dimension,
+                   header.descriptor_checksum,
+                   hashed_image);
+  }
+
+  return true;
+}
+
+}  // namespace theia
@@ -47,8 +47,12 @@
 #include <vector>
 
 #include "theia/alignment/alignment.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 #include "theia/io/eigen_serializable.h"
+#include "theia/io/keypoints_and_descriptors_format.h"
+#include "theia/util/filesystem.h"
 
 namespace theia {
 
@@ -56,20 +60,75 @@ namespace theia {
 bool WriteKeypointsAndDescriptors(
     const std::string& features_file,
     const std::vector<Keypoint>& keypoints,
-    const std::vector<Eigen::VectorXf>& descriptors) {
-  // Return false if the file cannot be opened.
-  std::ofstream features_writer(features_file, std::ios::out | std::ios::binary);
-  if (!features_writer.is_open()) {
-    LOG(ERROR) << "Could not open the feature file: " << features_file
-               << " for writing.";
+    const QuantizedDescriptorMatrix& descriptors) {
+  // The features are written to a temporary file that is renamed once it is
+  // complete, so that an interrupted write never leaves a partial feature file
+  // that would be reused by later runs.
+  const std::string temporary_features_file = features_file + ".tmp";
+  {
+    // Return false if the file cannot be opened.
+    std::ofstream features_writer(temporary_features_file,
+                                  std::ios::out | std::ios::binary);
+    if (!features_writer.is_open()) {
+      LOG(ERROR) << "Could not open the feature file: "
+                 << temporary_features_file << " for writing.";
+      return false;
+    }
+
+    // Make sure that Cereal is able to finish executing before the file is
+    // closed.
+    {
+      cereal::PortableBinaryOutputArchive output_archive(features_writer);
+      output_archive(kKeypointsAndDescriptorsMagic,
+                     kKeypointsAndDescriptorsVersion,
+                     keypoints,
+                     descriptors);
+    }
+    features_writer.close();
+    if (features_writer.fail()) {
+      LOG(ERROR) << "Could not write the feature file: "
+                 << temporary_features_file;
+      return false;
+    }
+  }
+
+  if (!RenameFile(temporary_features_file, features_file)) {
+    LOG(ERROR) << "Could not rename the feature file "
+               << temporary_features_file << " to " << features_file;
     return false;
   }
+  return true;
+}
 
-  cereal::PortableBinaryOutputArchive output_archive(features_writer);
-  output_archive(keypoints, descriptors);
+bool WriteKeypointsAndDescriptors(const std::string& features_file,
+                                  const std::vector<Keypoint>& keypoints,
+                                  const DescriptorMatrix& descriptors,
+                                  const DescriptorPrecision precision) {
+  QuantizedDescriptorMatrix quantized_descriptors;
+  quantized_descriptors.Quantize(descriptors, precision);
+  return WriteKeypointsAndDescriptors(features_file,
+                                      keypoints,
+                                      quantized_descriptors);
+}
 
-  return true;
+bool WriteKeypointsAndDescriptors(const std::string& features_file,
+                                  const std::vector<Keypoint>& keypoints,
+                                  const DescriptorMatrix& descriptors) {
+  return WriteKeypointsAndDescriptors(features_file,
+                                      keypoints,
+                                      descriptors,
+                                      DescriptorPrecision::FLOAT32);
+}
 
+bool WriteKeypointsAndDescriptors(
+    const std::string& features_file,
+    const std::vector<Keypoint>& keypoints,
+    const std::vector<Eigen::VectorXf>& descriptors) {
+  DescriptorMatrix descriptor_matrix;
+  DescriptorsToMatrix(descriptors, &descriptor_matrix);
+  return WriteKeypointsAndDescriptors(features_file,
+                                      keypoints,
+                                      descriptor_matrix);
 }
 
 }  // namespace theia
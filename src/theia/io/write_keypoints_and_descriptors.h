@@ -39,10 +39,31 @@
 #include <string>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+
 namespace theia {
 class Keypoint;
 
-// Writes the features to a single file.
+// Writes the features to a single file. The i-th row of the descriptor matrix
+// is the descriptor of the i-th keypoint. The descriptors are written with the
+// precision of the quantized descriptor matrix.
+bool WriteKeypointsAndDescriptors(const std::string& features_file,
+                                  const std::vector<Keypoint>& keypoints,
+                                  const QuantizedDescriptorMatrix& descriptors);
+
+// Same as above, but the descriptors are written with the given precision.
+bool WriteKeypointsAndDescriptors(const std::string& features_file,
+                                  const std::vector<Keypoint>& keypoints,
+                                  const DescriptorMatrix& descriptors,
+                                  const DescriptorPrecision precision);
+
+// Same as above, but the descriptors are written with full precision.
+bool WriteKeypointsAndDescriptors(const std::string& features_file,
+                                  const std::vector<Keypoint>& keypoints,
+                                  const DescriptorMatrix& descriptors);
+
+// Same as above, but the descriptors are given as a vector of descriptors.
 bool WriteKeypointsAndDescriptors(
     const std::string& features_file,
     const std::vector<Keypoint>& keypoints,
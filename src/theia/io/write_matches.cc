@@ -34,15 +34,11 @@
 
 #include "theia/io/write_matches.h"
 
-#include <cereal/archives/portable_binary.hpp>
-#include <cereal/types/string.hpp>
-#include <cereal/types/vector.hpp>
 #include <glog/logging.h>
-#include <cstdlib>
-#include <fstream>   // NOLINT
-#include <iostream>  // NOLINT
 #include <string>
+#include <vector>
 
+#include "theia/io/matches_file.h"
 #include "theia/matching/image_pair_match.h"
 #include "theia/sfm/camera_intrinsics_prior.h"
 
@@ -55,21 +51,17 @@ bool WriteMatchesAndGeometry(
     const std::vector<ImagePairMatch>& matches) {
   CHECK_EQ(view_names.size(), camera_intrinsics_prior.size());
 
-  // Return false if the file cannot be opened for writing.
-  std::ofstream matches_writer(matches_file, std::ios::out | std::ios::binary);
-  if (!matches_writer.is_open()) {
-    LOG(ERROR) << "Could not open the matches file: " << matches_file
-               << " for writing.";
+  MatchesWriter matches_writer;
+  if (!matches_writer.Open(
+          matches_file, view_names, camera_intrinsics_prior)) {
     return false;
   }
-
-  // Make sure that Cereal is able to finish executing before returning.
-  {
-    cereal::PortableBinaryOutputArchive output_archive(matches_writer);
-    output_archive(view_names, camera_intrinsics_prior, matches);
+  for (const ImagePairMatch& match : matches) {
+    if (!matches_writer.AddMatch(match)) {
+      return false;
+    }
   }
-
-  return true;
+  return matches_writer.Close();
 }
 
 }  // namespace theia
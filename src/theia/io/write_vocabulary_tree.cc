@@ -0,0 +1,89 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/io/write_vocabulary_tree.h"
+
+#include <cereal/archives/portable_binary.hpp>
+#include <glog/logging.h>
+
+#include <fstream>  // NOLINT
+#include <string>
+
+#include "theia/io/vocabulary_tree_format.h"
+#include "theia/matching/vocabulary_tree.h"
+#include "theia/util/filesystem.h"
+
+namespace theia {
+
+bool WriteVocabularyTree(const std::string& vocabulary_tree_file,
+                         const VocabularyTree& vocabulary_tree) {
+  // The vocabulary tree is written to a temporary file that is renamed once it
+  // is complete, so that other processes never read a partial vocabulary tree.
+  const std::string temporary_vocabulary_tree_file =
+      vocabulary_tree_file + ".tmp";
+  {
+    std::ofstream vocabulary_tree_writer(temporary_vocabulary_tree_file,
+                                         std::ios::out | std::ios::binary);
+    if (!vocabulary_tree_writer.is_open()) {
+      LOG(ERROR) << "Could not open the vocabulary tree file: "
+                 << temporary_vocabulary_tree_file << " for writing.";
+      return false;
+    }
+
+    // Make sure that Cereal is able to finish executing before the file is
+    // closed.
+    {
+      cereal::PortableBinaryOutputArchive output_archive(
+          vocabulary_tree_writer);
+      output_archive(
+          kVocabularyTreeMagic, kVocabularyTreeVersion, vocabulary_tree);
+    }
+    vocabulary_tree_writer.close();
+    if (vocabulary_tree_writer.fail()) {
+      LOG(ERROR) << "Could not write the vocabulary tree file: "
+                 << temporary_vocabulary_tree_file;
+      return false;
+    }
+  }
+
+  if (!RenameFile(temporary_vocabulary_tree_file, vocabulary_tree_file)) {
+    LOG(ERROR) << "Could not rename the vocabulary tree file "
+               << temporary_vocabulary_tree_file << " to "
+               << vocabulary_tree_file;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace theia
@@ -37,50 +37,222 @@
 #include <Eigen/Core>
 #include <glog/logging.h>
 #include <algorithm>
+#include <limits>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
 #include "theia/matching/distance.h"
 #include "theia/matching/feature_matcher_utils.h"
 #include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
 
 namespace theia {
 
+namespace {
 
-bool BruteForceFeatureMatcher::MatchImagePair(
-    const KeypointsAndDescriptors& features1,
-    const KeypointsAndDescriptors& features2,
-    std::vector<IndexedFeatureMatch>* matches) {
+// Descriptors are matched in blocks of kBlockSize x kBlockSize so that the two
+// blocks of descriptors and the block of the distance matrix computed from them
+// all stay in cache while we search for the nearest neighbors.
+static const int kBlockSize = 256;
 
-  const std::vector<Eigen::VectorXf>& descriptors1 = features1.descriptors;
-  const std::vector<Eigen::VectorXf>& descriptors2 = features2.descriptors;
-  matches->reserve(descriptors1.size());
+// The two nearest neighbors of a descriptor found so far.
+struct NearestNeighbors {
+  NearestNeighbors()
+      : index(-1),
+        distance(std::numeric_limits<float>::max()),
+        second_distance(std::numeric_limits<float>::max()) {}
 
-  const double sq_lowes_ratio =
-      this->options_.lowes_ratio * this->options_.lowes_ratio;
+  inline void Update(const int candidate_index,
+                     const float candidate_distance) {
+    if (candidate_distance < distance) {
+      second_distance = distance;
+      distance = candidate_distance;
+      index = candidate_index;
+    } else if (candidate_distance < second_distance) {
+      second_distance = candidate_distance;
+    }
+  }
 
-  // Compute forward matches.
-  L2 distance;
-  std::vector<IndexedFeatureMatch> temp_matches(descriptors2.size());
-  for (int i = 0; i < descriptors1.size(); i++) {
-    for (int j = 0; j < descriptors2.size(); j++) {
-      temp_matches[j] =
-          IndexedFeatureMatch(i, j, distance(descriptors1[i], descriptors2[j]));
+  int index;
+  float distance;
+  float second_distance;
+};
+
+// Finds the two nearest neighbors of every descriptor in image 1 among the
+// descriptors of image 2 (forward) and vice versa (reverse) with a single pass
+// over the distance matrix. The squared L2 distance is expanded as
+//
+//   ||x - y||^2 = ||x||^2 + ||y||^2 - 2 * x.dot(y)
+//
+// so that each block of the distance matrix is obtained from one matrix
+// multiplication, which Eigen vectorizes far better than computing the
+// distances one pair at a time.
+void FindNearestNeighbors(
+    const Eigen::Ref<const DescriptorMatrix>& descriptors1,
+    const Eigen::Ref<const DescriptorMatrix>& descriptors2,
+    std::vector<NearestNeighbors>* forward_neighbors,
+    std::vector<NearestNeighbors>* reverse_neighbors) {
+  const int num_descriptors1 = descriptors1.rows();
+  const int num_descriptors2 = descriptors2.rows();
+  forward_neighbors->resize(num_descriptors1);
+  reverse_neighbors->resize(num_descriptors2);
+
+  const Eigen::VectorXf squared_norms1 = descriptors1.rowwise().squaredNorm();
+  const Eigen::VectorXf squared_norms2 = descriptors2.rowwise().squaredNorm();
+
+  DescriptorMatrix similarity(std::min(kBlockSize, num_descriptors1),
+                              std::min(kBlockSize, num_descriptors2));
+  for (int row = 0; row < num_descriptors1; row += kBlockSize) {
+    const int num_rows = std::min(kBlockSize, num_descriptors1 - row);
+    for (int col = 0; col < num_descriptors2; col += kBlockSize) {
+      const int num_cols = std::min(kBlockSize, num_descriptors2 - col);
+      similarity.topLeftCorner(num_rows, num_cols).noalias() =
+          descriptors1.middleRows(row, num_rows) *
+          descriptors2.middleRows(col, num_cols).transpose();
+
+      for (int i = 0; i < num_rows; i++) {
+        const float squared_norm1 = squared_norms1(row + i);
+        NearestNeighbors& forward_neighbor = (*forward_neighbors)[row + i];
+        for (int j = 0; j < num_cols; j++) {
+          // Clamp the distance to zero since the expansion above may produce
+          // slightly negative values for (nearly) identical descriptors.
+          const float distance =
+              std::max(0.0f,
+                       squared_norm1 + squared_norms2(col + j) -
+                           2.0f * similarity(i, j));
+          forward_neighbor.Update(col + j, distance);
+          (*reverse_neighbors)[col + j].Update(row + i, distance);
+        }
+      }
     }
+  }
+}
+
+// Same as above for descriptors that are stored with reduced precision. The
+// distances are computed directly on the stored descriptors with the distance
+// functor (see L2Uint8 and L2Float16) and multiplied by distance_scale so that
+// they are in the units of the float descriptors. This reads 2x (FLOAT16) or 4x
+// (UINT8) less memory than the float descriptors and does not convert them.
+template <class Distance>
+void FindNearestNeighborsOfQuantizedDescriptors(
+    const typename Distance::DescriptorType descriptors1,
+    const int num_descriptors1,
+    const typename Distance::DescriptorType descriptors2,
+    const int num_descriptors2,
+    const int num_dimensions,
+    const float distance_scale,
+    std::vector<NearestNeighbors>* forward_neighbors,
+    std::vector<NearestNeighbors>* reverse_neighbors) {
+  forward_neighbors->resize(num_descriptors1);
+  reverse_neighbors->resize(num_descriptors2);
 
-    // Get the lowest distance matches.
-    std::partial_sort(temp_matches.begin(),
-                      temp_matches.begin() + 2,
-                      temp_matches.end(),
-                      CompareFeaturesByDistance);
-
-    // Add to the matches vector if lowes ratio test is turned off or it is
-    // turned on and passes the test.
-    if (!this->options_.use_lowes_ratio ||
-        temp_matches[0].distance < sq_lowes_ratio * temp_matches[1].distance) {
-      matches->emplace_back(temp_matches[0]);
+  const Distance squared_distance;
+  for (int row = 0; row < num_descriptors1; row += kBlockSize) {
+    const int num_rows = std::min(kBlockSize, num_descriptors1 - row);
+    for (int col = 0; col < num_descriptors2; col += kBlockSize) {
+      const int num_cols = std::min(kBlockSize, num_descriptors2 - col);
+      for (int i = row; i < row + num_rows; i++) {
+        const typename Distance::DescriptorType descriptor1 =
+            descriptors1 + i * num_dimensions;
+        NearestNeighbors& forward_neighbor = (*forward_neighbors)[i];
+        for (int j = col; j < col + num_cols; j++) {
+          const float distance =
+              distance_scale *
+              squared_distance(
+                  descriptor1, descriptors2 + j * num_dimensions,
+                  num_dimensions);
+          forward_neighbor.Update(j, distance);
+          (*reverse_neighbors)[j].Update(i, distance);
+        }
+      }
     }
   }
+}
 
+// Adds a match for each descriptor whose nearest neighbor passes the Lowe's
+// ratio test (if applicable).
+void AddMatchesFromNearestNeighbors(
+    const std::vector<NearestNeighbors>& nearest_neighbors,
+    const bool use_lowes_ratio,
+    const float sq_lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) {
+  for (int i = 0; i < nearest_neighbors.size(); i++) {
+    const NearestNeighbors& neighbors = nearest_neighbors[i];
+    if (!use_lowes_ratio ||
+        neighbors.distance < sq_lowes_ratio * neighbors.second_distance) {
+      matches->emplace_back(i, neighbors.index, neighbors.distance);
+    }
+  }
+}
+
+}  // namespace
+
+bool BruteForceFeatureMatcher::MatchImagePair(
+    const KeypointsAndDescriptors& features1,
+    const KeypointsAndDescriptors& features2,
+    std::vector<IndexedFeatureMatch>* matches) {
+  // Both the forward and reverse nearest neighbors are found at once, so the
+  // symmetric matches come at no additional cost. The descriptors are matched
+  // with the precision they are stored with.
+  std::vector<NearestNeighbors> forward_neighbors, reverse_neighbors;
+  const DescriptorPrecision precision = GetDescriptorPrecision(features1);
+  const bool same_precision = GetDescriptorPrecision(features2) == precision;
+  if (same_precision && precision == DescriptorPrecision::FLOAT32) {
+    FindNearestNeighbors(GetFloat32Descriptors(features1),
+                         GetFloat32Descriptors(features2),
+                         &forward_neighbors,
+                         &reverse_neighbors);
+  } else if (same_precision && precision == DescriptorPrecision::UINT8) {
+    const Eigen::Map<const Uint8DescriptorMatrix> descriptors1 =
+        GetUint8Descriptors(features1);
+    const Eigen::Map<const Uint8DescriptorMatrix> descriptors2 =
+        GetUint8Descriptors(features2);
+    FindNearestNeighborsOfQuantizedDescriptors<L2Uint8>(
+        descriptors1.data(),
+        descriptors1.rows(),
+        descriptors2.data(),
+        descriptors2.rows(),
+        descriptors1.cols(),
+        1.0f / (kUint8DescriptorScale * kUint8DescriptorScale),
+        &forward_neighbors,
+        &reverse_neighbors);
+  } else if (same_precision && precision == DescriptorPrecision::FLOAT16) {
+    const Eigen::Map<const Float16DescriptorMatrix> descriptors1 =
+        GetFloat16Descriptors(features1);
+    const Eigen::Map<const Float16DescriptorMatrix> descriptors2 =
+        GetFloat16Descriptors(features2);
+    FindNearestNeighborsOfQuantizedDescriptors<L2Float16>(descriptors1.data(),
+                                                          descriptors1.rows(),
+                                                          descriptors2.data(),
+                                                          descriptors2.rows(),
+                                                          descriptors1.cols(),
+                                                          1.0f,
+                                                          &forward_neighbors,
+                                                          &reverse_neighbors);
+  } else {
+    // Binary descriptors and images whose descriptors are stored with
+    // different precisions (e.g. in a packed feature store written with
+    // another precision) are matched as floats.
+    DescriptorMatrix descriptors1, descriptors2;
+    GetFloatDescriptors(features1, &descriptors1);
+    GetFloatDescriptors(features2, &descriptors2);
+    FindNearestNeighbors(
+        descriptors1, descriptors2, &forward_neighbors, &reverse_neighbors);
+  }
+  if (forward_neighbors.empty() || reverse_neighbors.empty()) {
+    return false;
+  }
+
+  const float sq_lowes_ratio =
+      this->options_.lowes_ratio * this->options_.lowes_ratio;
+
+  // Compute forward matches.
+  matches->reserve(forward_neighbors.size());
+  AddMatchesFromNearestNeighbors(forward_neighbors,
+                                 this->options_.use_lowes_ratio,
+                                 sq_lowes_ratio,
+                                 matches);
   if (matches->size() < this->options_.min_num_feature_matches) {
     return false;
   }
@@ -88,28 +260,11 @@ bool BruteForceFeatureMatcher::MatchImagePair(
   // Compute the symmetric matches, if applicable.
   if (this->options_.keep_only_symmetric_matches) {
     std::vector<IndexedFeatureMatch> reverse_matches;
-    temp_matches.resize(descriptors1.size());
-    // Only compute the distances for the valid matches.
-    for (int i = 0; i < descriptors2.size(); i++) {
-      for (int j = 0; j < descriptors1.size(); j++) {
-        temp_matches[j] = IndexedFeatureMatch(
-            i, j, distance(descriptors2[i], descriptors1[j]));
-      }
-
-      // Get the lowest distance matches.
-      std::partial_sort(temp_matches.begin(),
-                        temp_matches.begin() + 2,
-                        temp_matches.end(),
-                        CompareFeaturesByDistance);
-
-      // Add to the matches vector if lowes ratio test is turned off or it is
-      // turned on and passes the test.
-      if (!this->options_.use_lowes_ratio ||
-          temp_matches[0].distance <
-              sq_lowes_ratio * temp_matches[1].distance) {
-        reverse_matches.emplace_back(temp_matches[0]);
-      }
-    }
+    reverse_matches.reserve(reverse_neighbors.size());
+    AddMatchesFromNearestNeighbors(reverse_neighbors,
+                                   this->options_.use_lowes_ratio,
+                                   sq_lowes_ratio,
+                                   &reverse_matches);
     IntersectMatches(reverse_matches, matches);
   }
 
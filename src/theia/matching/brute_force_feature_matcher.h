@@ -47,7 +47,12 @@ struct IndexedFeatureMatch;
 struct KeypointsAndDescriptors;
 
 // Performs features matching between two sets of features using a brute force
-// matching method.
+// matching method. The descriptors of each image are packed into contiguous
+// matrices and the distance matrix is computed block by block with matrix
+// multiplications. The two nearest neighbors in both matching directions are
+// found from that single pass, so symmetric matching comes at no extra cost.
+// Descriptors that are stored with reduced precision (FLOAT16 or UINT8) are
+// compared directly with the L2Float16 and L2Uint8 distances instead.
 class BruteForceFeatureMatcher : public FeatureMatcher{
  public:
   explicit BruteForceFeatureMatcher(const FeatureMatcherOptions& options)
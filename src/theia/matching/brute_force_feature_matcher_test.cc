@@ -33,12 +33,22 @@
 // Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
 
 #include <Eigen/Core>
+#include <algorithm>
+#include <limits>
+#include <mutex>  // NOLINT
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "theia/io/packed_feature_store.h"
 #include "theia/matching/brute_force_feature_matcher.h"
 #include "theia/matching/distance.h"
 #include "theia/matching/feature_matcher.h"
+#include "theia/matching/feature_matcher_utils.h"
 #include "theia/matching/image_pair_match.h"
+#include "theia/util/random.h"
 
 #include "gtest/gtest.h"
 
@@ -283,4 +293,461 @@ TEST(BruteForceFeatureMatcherTest, SymmetricMatchesOutOfCore) {
   EXPECT_EQ(matches[0].correspondences.size(), 1);
 }
 
+// Returns the index of the nearest neighbor of the query descriptor if it
+// passes the ratio test, and -1 otherwise.
+int FindNearestNeighborExhaustively(const VectorXf& query,
+                                    const std::vector<VectorXf>& descriptors,
+                                    const float lowes_ratio) {
+  L2 distance;
+  int nearest_neighbor = -1;
+  float best_distance = std::numeric_limits<float>::max();
+  float second_best_distance = std::numeric_limits<float>::max();
+  for (int i = 0; i < descriptors.size(); i++) {
+    const float dist = distance(query, descriptors[i]);
+    if (dist < best_distance) {
+      second_best_distance = best_distance;
+      best_distance = dist;
+      nearest_neighbor = i;
+    } else if (dist < second_best_distance) {
+      second_best_distance = dist;
+    }
+  }
+  if (best_distance < lowes_ratio * lowes_ratio * second_best_distance) {
+    return nearest_neighbor;
+  }
+  return -1;
+}
+
+TEST(BruteForceFeatureMatcherTest, MultipleBlocksMatchExhaustiveSearch) {
+  // Use more descriptors than fit in a single block of the distance matrix so
+  // that the blocked nearest neighbor search is exercised.
+  static const int kNumDescriptors1 = 300;
+  static const int kNumDescriptors2 = 700;
+  static const int kSiftDimensions = 128;
+  static const float kLowesRatio = 0.8;
+  RandomNumberGenerator rng(59);
+
+  // Each descriptor in image 1 has a noisy copy in image 2.
+  std::vector<VectorXf> descriptor1(kNumDescriptors1);
+  std::vector<VectorXf> descriptor2(kNumDescriptors2);
+  for (int i = 0; i < kNumDescriptors2; i++) {
+    descriptor2[i].resize(kSiftDimensions);
+    rng.SetRandom(&descriptor2[i]);
+    descriptor2[i].normalize();
+  }
+  for (int i = 0; i < kNumDescriptors1; i++) {
+    descriptor1[i].resize(kSiftDimensions);
+    rng.SetRandom(&descriptor1[i]);
+    descriptor1[i] = descriptor2[2 * i] + 1.5 * descriptor1[i].normalized();
+    descriptor1[i].normalize();
+  }
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.match_out_of_core = false;
+  options.keypoints_and_descriptors_output_dir = "";
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.lowes_ratio = kLowesRatio;
+  options.perform_geometric_verification = false;
+
+  // The keypoint locations encode the descriptor index so that we can recover
+  // the matched indices from the correspondences.
+  std::vector<Keypoint> keypoints1(descriptor1.size());
+  std::vector<Keypoint> keypoints2(descriptor2.size());
+  for (int i = 0; i < keypoints1.size(); i++) {
+    keypoints1[i] = Keypoint(i, 0, Keypoint::OTHER);
+  }
+  for (int i = 0; i < keypoints2.size(); i++) {
+    keypoints2[i] = Keypoint(i, 0, Keypoint::OTHER);
+  }
+  BruteForceFeatureMatcher matcher(options);
+  matcher.AddImage("1", keypoints1, descriptor1);
+  matcher.AddImage("2", keypoints2, descriptor2);
+
+  // Match features.
+  std::vector<ImagePairMatch> matches;
+  matcher.MatchImages(&matches);
+  ASSERT_EQ(matches.size(), 1);
+
+  // Compute the expected symmetric matches exhaustively.
+  int num_expected_matches = 0;
+  for (int i = 0; i < kNumDescriptors1; i++) {
+    const int forward_match =
+        FindNearestNeighborExhaustively(descriptor1[i], descriptor2,
+                                        kLowesRatio);
+    if (forward_match != -1 &&
+        FindNearestNeighborExhaustively(descriptor2[forward_match],
+                                        descriptor1,
+                                        kLowesRatio) == i) {
+      ++num_expected_matches;
+    }
+  }
+  EXPECT_GT(num_expected_matches, 0);
+  ASSERT_EQ(matches[0].correspondences.size(), num_expected_matches);
+
+  for (const FeatureCorrespondence& match : matches[0].correspondences) {
+    const int index1 = static_cast<int>(match.feature1.x());
+    const int index2 = static_cast<int>(match.feature2.x());
+    EXPECT_EQ(FindNearestNeighborExhaustively(descriptor1[index1],
+                                              descriptor2,
+                                              kLowesRatio),
+              index2);
+    EXPECT_EQ(FindNearestNeighborExhaustively(descriptor2[index2],
+                                              descriptor1,
+                                              kLowesRatio),
+              index1);
+  }
+}
+
+// Matches the descriptors with the given precision and returns the matched
+// descriptor indices, which are encoded in the keypoint locations.
+std::set<std::pair<int, int> > MatchWithPrecision(
+    const std::vector<VectorXf>& descriptor1,
+    const std::vector<VectorXf>& descriptor2,
+    const DescriptorPrecision precision) {
+  FeatureMatcherOptions options;
+  options.match_out_of_core = false;
+  options.keypoints_and_descriptors_output_dir = "";
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.lowes_ratio = 0.8;
+  options.perform_geometric_verification = false;
+  options.descriptor_precision = precision;
+
+  std::vector<Keypoint> keypoints1(descriptor1.size());
+  std::vector<Keypoint> keypoints2(descriptor2.size());
+  for (int i = 0; i < keypoints1.size(); i++) {
+    keypoints1[i] = Keypoint(i, 0, Keypoint::OTHER);
+  }
+  for (int i = 0; i < keypoints2.size(); i++) {
+    keypoints2[i] = Keypoint(i, 0, Keypoint::OTHER);
+  }
+  BruteForceFeatureMatcher matcher(options);
+  matcher.AddImage("1", keypoints1, descriptor1);
+  matcher.AddImage("2", keypoints2, descriptor2);
+
+  std::vector<ImagePairMatch> matches;
+  matcher.MatchImages(&matches);
+  std::set<std::pair<int, int> > matched_indices;
+  for (const ImagePairMatch& match : matches) {
+    for (const FeatureCorrespondence& correspondence : match.correspondences) {
+      matched_indices.emplace(static_cast<int>(correspondence.feature1.x()),
+                              static_cast<int>(correspondence.feature2.x()));
+    }
+  }
+  return matched_indices;
+}
+
+TEST(BruteForceFeatureMatcherTest, ReducedPrecisionDescriptorsMatchLikeFloats) {
+  static const int kNumDescriptors1 = 200;
+  static const int kNumDescriptors2 = 400;
+  static const int kSiftDimensions = 128;
+  RandomNumberGenerator rng(61);
+
+  // SIFT-like descriptors with non-negative entries so that they may be
+  // quantized to 8 bits. Each descriptor in image 1 is a noisy copy of a
+  // descriptor in image 2.
+  std::vector<VectorXf> descriptor1(kNumDescriptors1);
+  std::vector<VectorXf> descriptor2(kNumDescriptors2);
+  for (int i = 0; i < kNumDescriptors2; i++) {
+    descriptor2[i].resize(kSiftDimensions);
+    rng.SetRandom(&descriptor2[i]);
+    descriptor2[i] = descriptor2[i].cwiseAbs().normalized();
+  }
+  for (int i = 0; i < kNumDescriptors1; i++) {
+    descriptor1[i].resize(kSiftDimensions);
+    rng.SetRandom(&descriptor1[i]);
+    descriptor1[i] =
+        (descriptor2[2 * i] + 0.05 * descriptor1[i].cwiseAbs()).normalized();
+  }
+
+  const std::set<std::pair<int, int> > float_matches = MatchWithPrecision(
+      descriptor1, descriptor2, DescriptorPrecision::FLOAT32);
+  ASSERT_GT(float_matches.size(), kNumDescriptors1 / 2);
+
+  // The quantized distances are computed directly on the reduced precision
+  // descriptors, so only matches that are close to the ratio test threshold
+  // may differ.
+  for (const DescriptorPrecision precision :
+       {DescriptorPrecision::FLOAT16, DescriptorPrecision::UINT8}) {
+    const std::set<std::pair<int, int> > quantized_matches =
+        MatchWithPrecision(descriptor1, descriptor2, precision);
+    int num_common_matches = 0;
+    for (const std::pair<int, int>& match : quantized_matches) {
+      num_common_matches += float_matches.count(match);
+    }
+    EXPECT_GE(num_common_matches, 0.95 * float_matches.size());
+    EXPECT_GE(num_common_matches, 0.95 * quantized_matches.size());
+  }
+}
+
+TEST(BruteForceFeatureMatcherTest, FeaturesFromPackedFeatureStore) {
+  static const int kNumImages = 3;
+  static const int kNumFeatures = 50;
+  static const int kSiftDimensions = 128;
+  RandomNumberGenerator rng(61);
+
+  // Each image contains noisy copies of the same descriptors.
+  DescriptorMatrix base_descriptors(kNumFeatures, kSiftDimensions);
+  rng.SetRandom(&base_descriptors);
+  std::vector<std::vector<Keypoint> > keypoints(kNumImages);
+  std::vector<DescriptorMatrix> descriptors(kNumImages);
+  for (int i = 0; i < kNumImages; i++) {
+    descriptors[i] = base_descriptors;
+    for (int j = 0; j < kNumFeatures; j++) {
+      Eigen::VectorXf noise(kSiftDimensions);
+      rng.SetRandom(&noise);
+      descriptors[i].row(j) += 0.1 * noise.transpose();
+      descriptors[i].row(j).normalize();
+      keypoints[i].emplace_back(j, i, Keypoint::SIFT);
+      keypoints[i].back().set_scale(0.5 * j);
+    }
+  }
+
+  // Write the features of all images to a packed feature store.
+  const std::string store_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/features.packed";
+  {
+    PackedFeatureStoreWriter writer;
+    ASSERT_TRUE(writer.Open(store_file));
+    for (int i = 0; i < kNumImages; i++) {
+      EXPECT_TRUE(writer.AddImage(std::to_string(i),
+                                  keypoints[i],
+                                  descriptors[i],
+                                  DescriptorPrecision::FLOAT32));
+    }
+    // Images may only be added once.
+    EXPECT_FALSE(writer.AddImage(
+        "0", keypoints[0], descriptors[0], DescriptorPrecision::FLOAT32));
+    EXPECT_TRUE(writer.Close());
+  }
+
+  // The descriptors can be accessed in the store without copying them.
+  PackedFeatureStore store;
+  ASSERT_TRUE(store.Open(store_file));
+  EXPECT_EQ(store.NumImages(), kNumImages);
+  PackedFeaturesView view;
+  EXPECT_FALSE(store.GetFeaturesView("3", &view));
+  ASSERT_TRUE(store.GetFeaturesView("1", &view));
+  EXPECT_EQ(view.num_features(), kNumFeatures);
+  EXPECT_EQ(view.descriptor_dimension(), kSiftDimensions);
+  EXPECT_EQ((view.float32_descriptors() - descriptors[1]).norm(), 0);
+  std::vector<Keypoint> read_keypoints;
+  view.GetKeypoints(&read_keypoints);
+  ASSERT_EQ(read_keypoints.size(), kNumFeatures);
+  EXPECT_EQ(read_keypoints[7].x(), keypoints[1][7].x());
+  EXPECT_EQ(read_keypoints[7].y(), keypoints[1][7].y());
+  EXPECT_EQ(read_keypoints[7].scale(), keypoints[1][7].scale());
+  EXPECT_EQ(read_keypoints[7].keypoint_type(), Keypoint::SIFT);
+  EXPECT_FALSE(read_keypoints[7].has_orientation());
+
+  // The matchers use the descriptors in the mapping without copying them.
+  KeypointsAndDescriptors packed_features;
+  packed_features.packed_features = view;
+  EXPECT_EQ(GetFloat32Descriptors(packed_features).data(),
+            view.float32_descriptors().data());
+
+  // Matching the features from the store gives the same matches as matching
+  // the features that are added directly.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.perform_geometric_verification = false;
+  BruteForceFeatureMatcher in_memory_matcher(options);
+  for (int i = 0; i < kNumImages; i++) {
+    in_memory_matcher.AddImage(std::to_string(i), keypoints[i], descriptors[i]);
+  }
+  std::vector<ImagePairMatch> expected_matches;
+  in_memory_matcher.MatchImages(&expected_matches);
+
+  options.match_out_of_core = true;
+  options.keypoints_and_descriptors_output_dir = GTEST_TESTING_OUTPUT_DIRECTORY;
+  options.packed_features_file = store_file;
+  BruteForceFeatureMatcher packed_matcher(options);
+  for (int i = 0; i < kNumImages; i++) {
+    packed_matcher.AddImage(std::to_string(i));
+  }
+  std::vector<ImagePairMatch> matches;
+  packed_matcher.MatchImages(&matches);
+
+  ASSERT_EQ(matches.size(), expected_matches.size());
+  for (const ImagePairMatch& expected_match : expected_matches) {
+    const auto match = std::find_if(
+        matches.begin(), matches.end(), [&](const ImagePairMatch& match) {
+          return match.image1 == expected_match.image1 &&
+                 match.image2 == expected_match.image2;
+        });
+    ASSERT_TRUE(match != matches.end());
+    ASSERT_EQ(match->correspondences.size(),
+              expected_match.correspondences.size());
+    EXPECT_GT(match->correspondences.size(), kNumFeatures / 2);
+    for (int i = 0; i < match->correspondences.size(); i++) {
+      EXPECT_EQ(match->correspondences[i].feature1,
+                expected_match.correspondences[i].feature1);
+      EXPECT_EQ(match->correspondences[i].feature2,
+                expected_match.correspondences[i].feature2);
+    }
+  }
+}
+
+TEST(BruteForceFeatureMatcherTest, ImageRetrievalSelectsImagePairs) {
+  static const int kNumScenes = 3;
+  static const int kNumImagesPerScene = 2;
+  static const int kNumFeatures = 100;
+  static const int kSiftDimensions = 128;
+  RandomNumberGenerator rng(61);
+
+  // The images of each scene contain noisy copies of the same descriptors, and
+  // the descriptors of different scenes are unrelated.
+  FeatureMatcherOptions options;
+  options.num_threads = 2;
+  options.min_num_feature_matches = 0;
+  options.perform_geometric_verification = false;
+  options.image_retrieval_num_neighbors = 1;
+  options.vocabulary_tree_options.branching_factor = 4;
+  options.vocabulary_tree_options.depth = 3;
+  BruteForceFeatureMatcher matcher(options);
+  for (int i = 0; i < kNumScenes; i++) {
+    DescriptorMatrix scene_descriptors(kNumFeatures, kSiftDimensions);
+    rng.SetRandom(&scene_descriptors);
+    for (int j = 0; j < kNumImagesPerScene; j++) {
+      DescriptorMatrix descriptors = scene_descriptors;
+      for (int k = 0; k < kNumFeatures; k++) {
+        Eigen::VectorXf noise(kSiftDimensions);
+        rng.SetRandom(&noise);
+        descriptors.row(k) += 0.01 * noise.transpose();
+      }
+      const std::vector<Keypoint> keypoints(kNumFeatures);
+      matcher.AddImage(std::to_string(i) + "_" + std::to_string(j),
+                       keypoints,
+                       descriptors);
+    }
+  }
+
+  // Only the images of the same scene are matched.
+  std::vector<ImagePairMatch> matches;
+  matcher.MatchImages(&matches);
+  ASSERT_EQ(matches.size(), kNumScenes);
+  for (const ImagePairMatch& match : matches) {
+    EXPECT_EQ(match.image1[0], match.image2[0]);
+    EXPECT_EQ(match.correspondences.size(), kNumFeatures);
+  }
+}
+
+TEST(BruteForceFeatureMatcherTest, PreemptiveMatchingRejectsUnrelatedImages) {
+  static const int kNumFeatures = 200;
+  static const int kSiftDimensions = 128;
+  RandomNumberGenerator rng(89);
+
+  // The first two images see the same scene and the third one does not.
+  DescriptorMatrix scene_descriptors(kNumFeatures, kSiftDimensions);
+  rng.SetRandom(&scene_descriptors);
+  DescriptorMatrix other_descriptors(kNumFeatures, kSiftDimensions);
+  rng.SetRandom(&other_descriptors);
+  std::vector<Keypoint> keypoints(kNumFeatures);
+  for (int i = 0; i < kNumFeatures; i++) {
+    keypoints[i].set_scale(i);
+    scene_descriptors.row(i).normalize();
+    other_descriptors.row(i).normalize();
+  }
+
+  for (const bool perform_preemptive_matching : {false, true}) {
+    FeatureMatcherOptions options;
+    options.min_num_feature_matches = 0;
+    options.perform_geometric_verification = false;
+    options.perform_preemptive_matching = perform_preemptive_matching;
+    BruteForceFeatureMatcher matcher(options);
+    matcher.AddImage("0", keypoints, scene_descriptors);
+    matcher.AddImage("1", keypoints, scene_descriptors);
+    matcher.AddImage("2", keypoints, other_descriptors);
+    std::vector<ImagePairMatch> matches;
+    matcher.MatchImages(&matches);
+    if (perform_preemptive_matching) {
+      ASSERT_EQ(matches.size(), 1);
+      EXPECT_EQ(matches[0].image1, "0");
+      EXPECT_EQ(matches[0].image2, "1");
+      EXPECT_EQ(matches[0].correspondences.size(), kNumFeatures);
+    } else {
+      EXPECT_EQ(matches.size(), 3);
+    }
+  }
+}
+
+TEST(BruteForceFeatureMatcherTest, AddImagesWhileMatching) {
+  static const int kNumImages = 6;
+  static const int kNumFeatures = 100;
+  static const int kSiftDimensions = 128;
+  RandomNumberGenerator rng(97);
+
+  // Each image sees a noisy copy of the same scene.
+  DescriptorMatrix scene_descriptors(kNumFeatures, kSiftDimensions);
+  rng.SetRandom(&scene_descriptors);
+  std::vector<Keypoint> keypoints(kNumFeatures);
+  std::unordered_map<std::string, DescriptorMatrix> descriptors;
+  for (int i = 0; i < kNumImages; i++) {
+    DescriptorMatrix noise(kNumFeatures, kSiftDimensions);
+    rng.SetRandom(&noise);
+    DescriptorMatrix& image_descriptors = descriptors[std::to_string(i)];
+    image_descriptors = scene_descriptors + 0.5 * noise;
+    for (int j = 0; j < kNumFeatures; j++) {
+      image_descriptors.row(j).normalize();
+    }
+  }
+
+  FeatureMatcherOptions options;
+  options.num_threads = 4;
+  options.min_num_feature_matches = 0;
+  options.perform_geometric_verification = false;
+
+  // Match the images that are added up front.
+  std::vector<ImagePairMatch> expected_matches;
+  BruteForceFeatureMatcher expected_matcher(options);
+  for (int i = 0; i < kNumImages - 1; i++) {
+    const std::string image_name = std::to_string(i);
+    expected_matcher.AddImage(image_name, keypoints, descriptors[image_name]);
+  }
+  expected_matcher.MatchImages(&expected_matches);
+
+  // Add the images while matching. The last image cannot be added, so the
+  // pairs with it are not matched.
+  std::vector<std::string> image_names;
+  for (int i = 0; i < kNumImages; i++) {
+    image_names.emplace_back(std::to_string(i));
+  }
+  const std::string failed_image_name = image_names.back();
+  BruteForceFeatureMatcher matcher(options);
+  std::mutex matcher_mutex;
+  std::vector<ImagePairMatch> matches;
+  matcher.AddAndMatchImages(
+      image_names,
+      [&](const std::string& image_name) {
+        if (image_name == failed_image_name) {
+          return false;
+        }
+        std::lock_guard<std::mutex> lock(matcher_mutex);
+        matcher.AddImage(image_name, keypoints, descriptors[image_name]);
+        return true;
+      },
+      [&matches](const ImagePairMatch& match) { matches.emplace_back(match); });
+
+  // The matches are found in a different order, so they are compared by pair.
+  std::unordered_map<std::string, int> num_correspondences;
+  for (const ImagePairMatch& match : matches) {
+    EXPECT_NE(match.image1, failed_image_name);
+    EXPECT_NE(match.image2, failed_image_name);
+    num_correspondences[match.image1 + "," + match.image2] =
+        match.correspondences.size();
+  }
+  ASSERT_EQ(matches.size(), expected_matches.size());
+  EXPECT_EQ(num_correspondences.size(), expected_matches.size());
+  for (const ImagePairMatch& match : expected_matches) {
+    const std::string pair_name = match.image1 + "," + match.image2;
+    ASSERT_EQ(num_correspondences.count(pair_name), 1) << pair_name;
+    EXPECT_GT(match.correspondences.size(), 0);
+    EXPECT_EQ(num_correspondences[pair_name], match.correspondences.size());
+  }
+}
+
 }  // namespace theia
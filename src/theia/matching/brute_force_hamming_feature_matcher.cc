@@ -0,0 +1,186 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/brute_force_hamming_feature_matcher.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/matching/distance.h"
+#include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/feature_matcher_utils.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+
+namespace theia {
+
+namespace {
+
+// Descriptors are matched in blocks of kBlockSize x kBlockSize so that both
+// blocks of descriptors stay in cache while we search for the nearest
+// neighbors. A block of 256 MLDB descriptors is about 16KB.
+static const int kBlockSize = 256;
+
+// The two nearest neighbors of a descriptor found so far.
+struct NearestNeighbors {
+  NearestNeighbors()
+      : index(-1),
+        distance(std::numeric_limits<int>::max()),
+        second_distance(std::numeric_limits<int>::max()) {}
+
+  inline void Update(const int candidate_index, const int candidate_distance) {
+    if (candidate_distance < distance) {
+      second_distance = distance;
+      distance = candidate_distance;
+      index = candidate_index;
+    } else if (candidate_distance < second_distance) {
+      second_distance = candidate_distance;
+    }
+  }
+
+  int index;
+  int distance;
+  int second_distance;
+};
+
+// Finds the two nearest neighbors of every descriptor in image 1 among the
+// descriptors of image 2 (forward) and vice versa (reverse) with a single pass
+// over all pairs of descriptors.
+void FindNearestNeighbors(
+    const Eigen::Map<const BinaryDescriptorMatrix>& descriptors1,
+    const Eigen::Map<const BinaryDescriptorMatrix>& descriptors2,
+    std::vector<NearestNeighbors>* forward_neighbors,
+    std::vector<NearestNeighbors>* reverse_neighbors) {
+  const int num_descriptors1 = descriptors1.rows();
+  const int num_descriptors2 = descriptors2.rows();
+  const int num_bytes = descriptors1.cols();
+  forward_neighbors->resize(num_descriptors1);
+  reverse_neighbors->resize(num_descriptors2);
+
+  const Hamming hamming;
+  for (int row = 0; row < num_descriptors1; row += kBlockSize) {
+    const int row_end = std::min(row + kBlockSize, num_descriptors1);
+    for (int col = 0; col < num_descriptors2; col += kBlockSize) {
+      const int col_end = std::min(col + kBlockSize, num_descriptors2);
+      for (int i = row; i < row_end; i++) {
+        const uint8_t* descriptor1 = descriptors1.row(i).data();
+        NearestNeighbors& forward_neighbor = (*forward_neighbors)[i];
+        for (int j = col; j < col_end; j++) {
+          const int distance =
+              hamming(descriptor1, descriptors2.row(j).data(), num_bytes);
+          forward_neighbor.Update(j, distance);
+          (*reverse_neighbors)[j].Update(i, distance);
+        }
+      }
+    }
+  }
+}
+
+// Adds a match for each descriptor whose nearest neighbor passes the Lowe's
+// ratio test (if applicable).
+void AddMatchesFromNearestNeighbors(
+    const std::vector<NearestNeighbors>& nearest_neighbors,
+    const bool use_lowes_ratio,
+    const float lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) {
+  for (int i = 0; i < nearest_neighbors.size(); i++) {
+    const NearestNeighbors& neighbors = nearest_neighbors[i];
+    if (!use_lowes_ratio ||
+        neighbors.distance <
+            lowes_ratio * static_cast<float>(neighbors.second_distance)) {
+      matches->emplace_back(i, neighbors.index, neighbors.distance);
+    }
+  }
+}
+
+}  // namespace
+
+BruteForceHammingFeatureMatcher::BruteForceHammingFeatureMatcher(
+    const FeatureMatcherOptions& options)
+    : FeatureMatcher(options) {
+  CHECK(options_.descriptor_precision == DescriptorPrecision::BINARY)
+      << "The descriptors must be stored with DescriptorPrecision::BINARY in "
+         "order to match them with the Hamming distance.";
+}
+
+bool BruteForceHammingFeatureMatcher::MatchImagePair(
+    const KeypointsAndDescriptors& features1,
+    const KeypointsAndDescriptors& features2,
+    std::vector<IndexedFeatureMatch>* matches) {
+  const Eigen::Map<const BinaryDescriptorMatrix> descriptors1 =
+      GetBinaryDescriptors(features1);
+  const Eigen::Map<const BinaryDescriptorMatrix> descriptors2 =
+      GetBinaryDescriptors(features2);
+  if (descriptors1.rows() == 0 || descriptors2.rows() == 0) {
+    return false;
+  }
+  CHECK_EQ(descriptors1.cols(), descriptors2.cols())
+      << "Cannot match binary descriptors of different sizes.";
+
+  // Both the forward and reverse nearest neighbors are found at once, so the
+  // symmetric matches come at no additional cost.
+  std::vector<NearestNeighbors> forward_neighbors, reverse_neighbors;
+  FindNearestNeighbors(
+      descriptors1, descriptors2, &forward_neighbors, &reverse_neighbors);
+
+  // Compute forward matches.
+  matches->reserve(forward_neighbors.size());
+  AddMatchesFromNearestNeighbors(forward_neighbors,
+                                 this->options_.use_lowes_ratio,
+                                 this->options_.lowes_ratio,
+                                 matches);
+  if (matches->size() < this->options_.min_num_feature_matches) {
+    return false;
+  }
+
+  // Compute the symmetric matches, if applicable.
+  if (this->options_.keep_only_symmetric_matches) {
+    std::vector<IndexedFeatureMatch> reverse_matches;
+    reverse_matches.reserve(reverse_neighbors.size());
+    AddMatchesFromNearestNeighbors(reverse_neighbors,
+                                   this->options_.use_lowes_ratio,
+                                   this->options_.lowes_ratio,
+                                   &reverse_matches);
+    IntersectMatches(reverse_matches, matches);
+  }
+
+  return matches->size() >= this->options_.min_num_feature_matches;
+}
+
+}  // namespace theia
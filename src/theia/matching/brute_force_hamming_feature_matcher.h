@@ -0,0 +1,75 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_BRUTE_FORCE_HAMMING_FEATURE_MATCHER_H_
+#define THEIA_MATCHING_BRUTE_FORCE_HAMMING_FEATURE_MATCHER_H_
+
+#include <vector>
+
+#include "theia/matching/feature_matcher.h"
+#include "theia/util/util.h"
+
+namespace theia {
+
+struct FeatureMatcherOptions;
+struct IndexedFeatureMatch;
+struct KeypointsAndDescriptors;
+
+// Performs brute force matching of binary descriptors (e.g. AKAZE MLDB) with
+// the Hamming distance. The packed bits of the descriptors are compared
+// directly with popcount instructions, so the descriptors are never converted
+// to floats. As with the BruteForceFeatureMatcher, the two nearest neighbors in
+// both matching directions are found in a single pass over blocks of the
+// descriptors. The descriptors must be stored with DescriptorPrecision::BINARY
+// and the Lowe's ratio is applied to the Hamming distances.
+class BruteForceHammingFeatureMatcher : public FeatureMatcher {
+ public:
+  explicit BruteForceHammingFeatureMatcher(
+      const FeatureMatcherOptions& options);
+  ~BruteForceHammingFeatureMatcher() {}
+
+ private:
+  bool MatchImagePair(
+      const KeypointsAndDescriptors& features1,
+      const KeypointsAndDescriptors& features2,
+      std::vector<IndexedFeatureMatch>* matches) override;
+
+  bool MatchesBinaryDescriptors() const override { return true; }
+
+  DISALLOW_COPY_AND_ASSIGN(BruteForceHammingFeatureMatcher);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_BRUTE_FORCE_HAMMING_FEATURE_MATCHER_H_
@@ -39,12 +39,15 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <bitset>
 #include <cmath>
+#include <numeric>
 #include <utility>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
 #include "theia/matching/distance.h"
-#include "theia/matching/feature_matcher.h"
 #include "theia/matching/indexed_feature_match.h"
 #include "theia/util/random.h"
 
@@ -52,15 +55,65 @@ namespace theia {
 
 namespace {
 
-void GetZeroMeanDescriptor(const std::vector<Eigen::VectorXf>& sift_desc,
-                           Eigen::VectorXf* mean) {
-  mean->setZero(sift_desc[0].size());
-  for (int i = 0; i < sift_desc.size(); i++) {
-    *mean += sift_desc[i];
+// The number of descriptors that are projected at once when hashing.
+static const int kHashingBlockSize = 1024;
+
+// The number of candidates (with the lowest hamming distance) for which the
+// euclidean distance is computed.
+static const int kNumTopCandidates = 10;
+
+void GetZeroMeanDescriptor(
+    const Eigen::Ref<const DescriptorMatrix>& sift_desc,
+    Eigen::VectorXf* mean) {
+  *mean = sift_desc.colwise().mean().transpose();
+}
+
+// Returns the number of bits that differ between the two hash codes. This
+// compiles to the popcnt instruction when it is available.
+inline int HammingDistance(const uint64_t* hash_code1,
+                           const uint64_t* hash_code2) {
+  int distance = 0;
+  for (int i = 0; i < kNumHashCodeWords; i++) {
+#if defined(__GNUC__) || defined(__clang__)
+    distance += __builtin_popcountll(hash_code1[i] ^ hash_code2[i]);
+#else
+    distance += static_cast<int>(
+        std::bitset<64>(hash_code1[i] ^ hash_code2[i]).count());
+#endif
   }
-  *mean /= static_cast<double>(sift_desc.size());
+  return distance;
 }
 
+// Updates the 64 bit FNV-1a hash with the bytes of the matrix entries.
+void UpdateFingerprint(const Eigen::MatrixXf& matrix, uint64_t* fingerprint) {
+  static const uint64_t kFnvPrime = 1099511628211ULL;
+  const unsigned char* bytes =
+      reinterpret_cast<const unsigned char*>(matrix.data());
+  for (int i = 0; i < matrix.size() * sizeof(float); i++) {
+    *fingerprint = (*fingerprint ^ bytes[i]) * kFnvPrime;
+  }
+}
+
+// Buffers used by CascadeHasher::MatchImages. One instance is kept per thread
+// and the buffers only ever grow, so matching does not allocate memory once the
+// buffers are large enough.
+struct MatchingScratch {
+  // All descriptors in the same buckets as the query descriptor (this may
+  // contain duplicates).
+  std::vector<int> candidate_descriptors;
+  // The unique candidate descriptors and their hamming distances to the query
+  // descriptor.
+  std::vector<int> unique_candidate_descriptors;
+  std::vector<uint8_t> candidate_hamming_distances;
+  // Flags to determine if we have already used a particular feature for
+  // matching (i.e., prevents duplicates).
+  std::vector<uint8_t> used_descriptor;
+  // The number of unique candidates with each hamming distance.
+  int num_descriptors_with_hamming_distance[kHashCodeSize + 1];
+  // The euclidean distances of the candidates with the best hamming distance.
+  std::vector<std::pair<float, int> > candidate_euclidean_distances;
+};
+
 }  // namespace
 
 bool CascadeHasher::Initialize(const int num_dimensions_of_descriptor) {
@@ -75,6 +128,8 @@ bool CascadeHasher::Initialize(const int num_dimensions_of_descriptor) {
   }
 
   // Initialize secondary hash projection.
+  stacked_secondary_hash_projection_.resize(kNumBucketGroups * kNumBucketBits,
+                                            num_dimensions_of_descriptor_);
   for (int i = 0; i < kNumBucketGroups; i++) {
     secondary_hash_projection_[i].resize(kNumBucketBits,
                                          num_dimensions_of_descriptor_);
@@ -83,46 +138,91 @@ bool CascadeHasher::Initialize(const int num_dimensions_of_descriptor) {
         secondary_hash_projection_[i](j, k) = rng_->RandGaussian(0.0, 1.0);
       }
     }
+    stacked_secondary_hash_projection_.middleRows(i * kNumBucketBits,
+                                                  kNumBucketBits) =
+        secondary_hash_projection_[i];
   }
 
+  static const uint64_t kFnvOffsetBasis = 14695981039346656037ULL;
+  fingerprint_ = kFnvOffsetBasis;
+  UpdateFingerprint(primary_hash_projection_, &fingerprint_);
+  UpdateFingerprint(stacked_secondary_hash_projection_, &fingerprint_);
+
   return true;
 }
 
 void CascadeHasher::CreateHashedDescriptors(
-    const std::vector<Eigen::VectorXf>& sift_desc,
+    const Eigen::Ref<const DescriptorMatrix>& sift_desc,
     HashedImage* hashed_image) const {
-  for (int i = 0; i < sift_desc.size(); i++) {
-    // Use the zero-mean shifted descriptor.
-    const auto descriptor = sift_desc[i] - hashed_image->mean_descriptor;
-    auto& hash_code = hashed_image->hashed_desc[i].hash_code;
-
-    // Compute hash code.
-    const Eigen::VectorXf primary_projection =
-        primary_hash_projection_ * descriptor;
-    for (int j = 0; j < kHashCodeSize; j++) {
-      hash_code[j] = primary_projection(j) > 0;
-    }
-
-    // Determine the bucket index for each group.
-    for (int j = 0; j < kNumBucketGroups; j++) {
-      uint16_t bucket_id = 0;
-      const Eigen::VectorXf secondary_projection =
-          secondary_hash_projection_[j] * descriptor;
+  const int num_descriptors = sift_desc.rows();
+  Eigen::MatrixXf descriptors, primary_projections, secondary_projections;
+  for (int block_start = 0; block_start < num_descriptors;
+       block_start += kHashingBlockSize) {
+    const int block_size =
+        std::min(kHashingBlockSize, num_descriptors - block_start);
+
+    // Use the zero-mean shifted descriptors. Each column of the projections
+    // corresponds to one descriptor.
+    descriptors = sift_desc.middleRows(block_start, block_size).rowwise() -
+                  hashed_image->mean_descriptor.transpose();
+    primary_projections.noalias() =
+        primary_hash_projection_ * descriptors.transpose();
+    secondary_projections.noalias() =
+        stacked_secondary_hash_projection_ * descriptors.transpose();
+
+    for (int i = 0; i < block_size; i++) {
+      HashedSiftDescriptor& hashed_desc =
+          hashed_image->hashed_desc[block_start + i];
+
+      // Compute hash code.
+      for (int j = 0; j < kNumHashCodeWords; j++) {
+        hashed_desc.hash_code[j] = 0;
+      }
+      for (int j = 0; j < kHashCodeSize; j++) {
+        if (primary_projections(j, i) > 0) {
+          hashed_desc.hash_code[j / 64] |= uint64_t(1) << (j % 64);
+        }
+      }
 
-      for (int k = 0; k < kNumBucketBits; k++) {
-        bucket_id = (bucket_id << 1) + (secondary_projection(k) > 0 ? 1 : 0);
+      // Determine the bucket index for each group.
+      for (int j = 0; j < kNumBucketGroups; j++) {
+        uint16_t bucket_id = 0;
+        for (int k = 0; k < kNumBucketBits; k++) {
+          bucket_id = (bucket_id << 1) +
+                      (secondary_projections(j * kNumBucketBits + k, i) > 0);
+        }
+        hashed_desc.bucket_ids[j] = bucket_id;
       }
-      hashed_image->hashed_desc[i].bucket_ids[j] = bucket_id;
     }
   }
 }
 
 void CascadeHasher::BuildBuckets(HashedImage* hashed_image) const {
-  for (int i = 0; i < kNumBucketGroups; i++) {
-    // Add the descriptor ID to the proper bucket group and id.
-    for (int j = 0; j < hashed_image->hashed_desc.size(); j++) {
-      const uint16_t bucket_id = hashed_image->hashed_desc[j].bucket_ids[i];
-      hashed_image->buckets[i][bucket_id].push_back(j);
+  const int num_descriptors = hashed_image->hashed_desc.size();
+  std::vector<int>& bucket_offsets = hashed_image->bucket_offsets;
+  bucket_offsets.assign(kNumBucketGroups * kNumBucketsPerGroup + 1, 0);
+
+  // Count the number of descriptors in each bucket and convert the counts to
+  // offsets.
+  for (const HashedSiftDescriptor& hashed_desc : hashed_image->hashed_desc) {
+    for (int i = 0; i < kNumBucketGroups; i++) {
+      ++bucket_offsets[i * kNumBucketsPerGroup + hashed_desc.bucket_ids[i] + 1];
+    }
+  }
+  std::partial_sum(bucket_offsets.begin(), bucket_offsets.end(),
+                   bucket_offsets.begin());
+
+  // Add the descriptor ID to the proper bucket group and id. Descriptors are
+  // added in order, so each bucket is sorted by descriptor ID.
+  std::vector<int> bucket_positions(bucket_offsets.begin(),
+                                    bucket_offsets.end() - 1);
+  hashed_image->bucket_descriptor_ids.resize(kNumBucketGroups *
+                                             num_descriptors);
+  for (int j = 0; j < num_descriptors; j++) {
+    const HashedSiftDescriptor& hashed_desc = hashed_image->hashed_desc[j];
+    for (int i = 0; i < kNumBucketGroups; i++) {
+      const int bucket = i * kNumBucketsPerGroup + hashed_desc.bucket_ids[i];
+      hashed_image->bucket_descriptor_ids[bucket_positions[bucket]++] = j;
     }
   }
 }
@@ -132,81 +232,53 @@ void CascadeHasher::BuildBuckets(HashedImage* hashed_image) const {
 //   2) Compute hash code and hash buckets.
 //   3) Construct buckets.
 HashedImage CascadeHasher::CreateHashedSiftDescriptors(
-    const std::vector<Eigen::VectorXf>& sift_desc) const {
+    const Eigen::Ref<const DescriptorMatrix>& sift_desc) const {
   HashedImage hashed_image;
 
-  // Allocate the buckets even if no descriptors exist to fill them.
-  hashed_image.buckets.resize(kNumBucketGroups);
-  for (int i = 0; i < kNumBucketGroups; i++) {
-    hashed_image.buckets[i].resize(kNumBucketsPerGroup);
-  }
-
-  if (sift_desc.size() == 0) {
-    return hashed_image;
-  }
-
-  GetZeroMeanDescriptor(sift_desc, &hashed_image.mean_descriptor);
-
-  // Allocate space for hash codes and bucket ids.
-  hashed_image.hashed_desc.resize(sift_desc.size());
+  if (sift_desc.rows() > 0) {
+    GetZeroMeanDescriptor(sift_desc, &hashed_image.mean_descriptor);
 
-  // Allocate space for each bucket id.
-  for (int i = 0; i < sift_desc.size(); i++) {
-    hashed_image.hashed_desc[i].bucket_ids.resize(kNumBucketGroups);
+    // Create hash codes for each feature.
+    hashed_image.hashed_desc.resize(sift_desc.rows());
+    CreateHashedDescriptors(sift_desc, &hashed_image);
   }
 
-  // Create hash codes for each feature.
-  CreateHashedDescriptors(sift_desc, &hashed_image);
-
-  // Build the buckets.
+  // Build the buckets. The bucket offsets are allocated even if no descriptors
+  // exist to fill them.
   BuildBuckets(&hashed_image);
   return hashed_image;
 }
 
 // Matches images with a fast matching scheme based on the hash codes
 // previously generated.
-void CascadeHasher::MatchImages(
+template <class SquaredDistance>
+void CascadeHasher::MatchHashedImages(
     const HashedImage& hashed_image1,
-    const std::vector<Eigen::VectorXf>& descriptors1,
     const HashedImage& hashed_image2,
-    const std::vector<Eigen::VectorXf>& descriptors2,
+    const SquaredDistance& squared_distance,
     const double lowes_ratio,
     std::vector<IndexedFeatureMatch>* matches) const {
-  if (descriptors1.size() == 0 || descriptors2.size() == 0) {
-    return;
-  }
-
-  static const int kNumTopCandidates = 10;
   const double sq_lowes_ratio = lowes_ratio * lowes_ratio;
-  L2 l2_distance;
+  const int num_descriptors1 = hashed_image1.hashed_desc.size();
+  const int num_descriptors2 = hashed_image2.hashed_desc.size();
 
   // Reserve space for the matches.
-  matches->reserve(
-      static_cast<int>(std::min(descriptors1.size(), descriptors2.size())));
-
-  // Preallocate the candidate descriptors container.
-  std::vector<int> candidate_descriptors;
-  candidate_descriptors.reserve(descriptors2.size());
-
-  // Preallocated hamming distances. Each column indicates the hamming distance
-  // and the rows collect the descriptor ids with that
-  // distance. num_descriptors_with_hamming_distance keeps track of how many
-  // descriptors have that distance.
-  Eigen::MatrixXi candidate_hamming_distances(descriptors2.size(),
-                                              kHashCodeSize + 1);
-  Eigen::VectorXi num_descriptors_with_hamming_distance(kHashCodeSize + 1);
-
-  // Preallocate the container for keeping euclidean distances.
-  std::vector<std::pair<float, int> > candidate_euclidean_distances;
-  candidate_euclidean_distances.reserve(kNumTopCandidates);
+  matches->reserve(std::min(num_descriptors1, num_descriptors2));
+
+#ifdef THEIA_HAS_THREAD_LOCAL_KEYWORD
+  static thread_local MatchingScratch scratch;
+#else
+  MatchingScratch scratch;
+#endif  // THEIA_HAS_THREAD_LOCAL_KEYWORD
+  if (scratch.used_descriptor.size() < num_descriptors2) {
+    scratch.used_descriptor.resize(num_descriptors2);
+  }
 
-  // A preallocated vector to determine if we have already used a particular
-  // feature for matching (i.e., prevents duplicates).
-  std::vector<bool> used_descriptor(descriptors2.size());
-  for (int i = 0; i < hashed_image1.hashed_desc.size(); i++) {
-    candidate_descriptors.clear();
-    num_descriptors_with_hamming_distance.setZero();
-    candidate_euclidean_distances.clear();
+  for (int i = 0; i < num_descriptors1; i++) {
+    scratch.candidate_descriptors.clear();
+    scratch.unique_candidate_descriptors.clear();
+    scratch.candidate_hamming_distances.clear();
+    scratch.candidate_euclidean_distances.clear();
 
     const auto& hashed_desc = hashed_image1.hashed_desc[i];
 
@@ -214,66 +286,153 @@ void CascadeHasher::MatchImages(
     // bucket id as the query descriptor.
     for (int j = 0; j < kNumBucketGroups; j++) {
       const uint16_t bucket_id = hashed_desc.bucket_ids[j];
-      for (const auto& feature_id : hashed_image2.buckets[j][bucket_id]) {
-        candidate_descriptors.emplace_back(feature_id);
-        used_descriptor[feature_id] = false;
+      const int* bucket_end = hashed_image2.BucketEnd(j, bucket_id);
+      for (const int* feature_id = hashed_image2.BucketBegin(j, bucket_id);
+           feature_id != bucket_end;
+           ++feature_id) {
+        scratch.candidate_descriptors.emplace_back(*feature_id);
+        scratch.used_descriptor[*feature_id] = false;
       }
     }
 
-    // Skip matching this descriptor if there are not at least 2 candidates.
-    if (candidate_descriptors.size() <= kNumTopCandidates) {
+    // Skip matching this descriptor if there are not enough candidates.
+    if (scratch.candidate_descriptors.size() <= kNumTopCandidates) {
       continue;
     }
 
-    // Compute the hamming distance of all candidates based on the comp hash
-    // code. Put the descriptors into buckets corresponding to their hamming
-    // distance.
-    for (const int candidate_id : candidate_descriptors) {
-      if (used_descriptor[candidate_id]) {
+    // Compute the hamming distance of all unique candidates based on the hash
+    // code and count the number of candidates with each hamming distance.
+    std::fill(scratch.num_descriptors_with_hamming_distance,
+              scratch.num_descriptors_with_hamming_distance + kHashCodeSize + 1,
+              0);
+    for (const int candidate_id : scratch.candidate_descriptors) {
+      if (scratch.used_descriptor[candidate_id]) {
         continue;
       }
-      used_descriptor[candidate_id] = true;
-      const uint8_t hamming_distance =
-          (hashed_desc.hash_code ^
-           hashed_image2.hashed_desc[candidate_id].hash_code).count();
-      candidate_hamming_distances(
-          num_descriptors_with_hamming_distance(hamming_distance)++,
-          hamming_distance) = candidate_id;
+      scratch.used_descriptor[candidate_id] = true;
+      const int hamming_distance = HammingDistance(
+          hashed_desc.hash_code,
+          hashed_image2.hashed_desc[candidate_id].hash_code);
+      scratch.unique_candidate_descriptors.emplace_back(candidate_id);
+      scratch.candidate_hamming_distances.emplace_back(hamming_distance);
+      ++scratch.num_descriptors_with_hamming_distance[hamming_distance];
     }
 
-    // Compute the euclidean distance of the k descriptors with the best hamming
-    // distance.
-    candidate_euclidean_distances.reserve(kNumTopCandidates);
-    for (int j = 0; j < candidate_hamming_distances.cols(); j++) {
-      for (int k = 0; k < num_descriptors_with_hamming_distance(j); k++) {
-        const int candidate_id = candidate_hamming_distances(k, j);
-        const float distance =
-            l2_distance(descriptors2[candidate_id], descriptors1[i]);
-        candidate_euclidean_distances.emplace_back(distance, candidate_id);
-        if (candidate_euclidean_distances.size() > kNumTopCandidates) {
-          break;
-        }
-      }
-      if (candidate_euclidean_distances.size() > kNumTopCandidates) {
-        break;
+    // Find the hamming distance threshold such that the k + 1 candidates with
+    // the best hamming distance are used. Candidates that have the threshold
+    // distance are used in the order that they were found.
+    int max_hamming_distance = 0;
+    int num_candidates_below_max_hamming_distance = 0;
+    while (max_hamming_distance < kHashCodeSize &&
+           num_candidates_below_max_hamming_distance +
+                   scratch.num_descriptors_with_hamming_distance
+                       [max_hamming_distance] <=
+               kNumTopCandidates) {
+      num_candidates_below_max_hamming_distance +=
+          scratch.num_descriptors_with_hamming_distance[max_hamming_distance];
+      ++max_hamming_distance;
+    }
+    int num_candidates_at_max_hamming_distance =
+        kNumTopCandidates + 1 - num_candidates_below_max_hamming_distance;
+
+    // Compute the euclidean distance of the k + 1 descriptors with the best
+    // hamming distance.
+    for (int j = 0; j < scratch.unique_candidate_descriptors.size(); j++) {
+      const int hamming_distance = scratch.candidate_hamming_distances[j];
+      if (hamming_distance > max_hamming_distance ||
+          (hamming_distance == max_hamming_distance &&
+           num_candidates_at_max_hamming_distance-- <= 0)) {
+        continue;
       }
+      const int candidate_id = scratch.unique_candidate_descriptors[j];
+      const float distance = squared_distance(i, candidate_id);
+      scratch.candidate_euclidean_distances.emplace_back(distance,
+                                                         candidate_id);
     }
 
     // Find the top 2 candidates based on euclidean distance.
-    std::partial_sort(candidate_euclidean_distances.begin(),
-                      candidate_euclidean_distances.begin() + 2,
-                      candidate_euclidean_distances.end());
+    std::partial_sort(scratch.candidate_euclidean_distances.begin(),
+                      scratch.candidate_euclidean_distances.begin() + 2,
+                      scratch.candidate_euclidean_distances.end());
 
     // Only add to output matches if it passes the ratio test.
-    if (candidate_euclidean_distances[0].first >
-        candidate_euclidean_distances[1].first * sq_lowes_ratio) {
+    if (scratch.candidate_euclidean_distances[0].first >
+        scratch.candidate_euclidean_distances[1].first * sq_lowes_ratio) {
       continue;
     }
 
     matches->emplace_back(i,
-                          candidate_euclidean_distances[0].second,
-                          candidate_euclidean_distances[0].first);
+                          scratch.candidate_euclidean_distances[0].second,
+                          scratch.candidate_euclidean_distances[0].first);
+  }
+}
+
+
+void CascadeHasher::MatchImages(
+    const HashedImage& hashed_image1,
+    const Eigen::Ref<const DescriptorMatrix>& descriptors1,
+    const HashedImage& hashed_image2,
+    const Eigen::Ref<const DescriptorMatrix>& descriptors2,
+    const double lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) const {
+  if (descriptors1.rows() == 0 || descriptors2.rows() == 0) {
+    return;
+  }
+  MatchHashedImages(hashed_image1,
+                    hashed_image2,
+                    [&](const int i, const int j) {
+                      return (descriptors2.row(j) - descriptors1.row(i))
+                          .squaredNorm();
+                    },
+                    lowes_ratio,
+                    matches);
+}
+
+void CascadeHasher::MatchImages(
+    const HashedImage& hashed_image1,
+    const Eigen::Ref<const Uint8DescriptorMatrix>& descriptors1,
+    const HashedImage& hashed_image2,
+    const Eigen::Ref<const Uint8DescriptorMatrix>& descriptors2,
+    const double lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) const {
+  if (descriptors1.rows() == 0 || descriptors2.rows() == 0) {
+    return;
+  }
+  const L2Uint8 l2_uint8;
+  const float distance_scale =
+      1.0f / (kUint8DescriptorScale * kUint8DescriptorScale);
+  MatchHashedImages(hashed_image1,
+                    hashed_image2,
+                    [&](const int i, const int j) {
+                      return distance_scale *
+                             l2_uint8(descriptors1.row(i).data(),
+                                      descriptors2.row(j).data(),
+                                      descriptors1.cols());
+                    },
+                    lowes_ratio,
+                    matches);
+}
+
+void CascadeHasher::MatchImages(
+    const HashedImage& hashed_image1,
+    const Eigen::Ref<const Float16DescriptorMatrix>& descriptors1,
+    const HashedImage& hashed_image2,
+    const Eigen::Ref<const Float16DescriptorMatrix>& descriptors2,
+    const double lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) const {
+  if (descriptors1.rows() == 0 || descriptors2.rows() == 0) {
+    return;
   }
+  const L2Float16 l2_float16;
+  MatchHashedImages(hashed_image1,
+                    hashed_image2,
+                    [&](const int i, const int j) {
+                      return l2_float16(descriptors1.row(i).data(),
+                                        descriptors2.row(j).data(),
+                                        descriptors1.cols());
+                    },
+                    lowes_ratio,
+                    matches);
 }
 
 }  // namespace theia
@@ -35,21 +35,27 @@
 #ifndef THEIA_MATCHING_CASCADE_HASHER_H_
 #define THEIA_MATCHING_CASCADE_HASHER_H_
 
+#include <cereal/access.hpp>
+#include <cereal/types/common.hpp>
+#include <cereal/types/vector.hpp>
 #include <Eigen/Core>
 #include <stdint.h>
-#include <bitset>
 #include <memory>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/io/eigen_serializable.h"
 #include "theia/util/random.h"
 
 namespace theia {
 
 struct IndexedFeatureMatch;
-typedef std::vector<int> Bucket;
 
 // The number of dimensions of the Hash code.
 static const int kHashCodeSize = 128;
+// The number of 64 bit words used to store a hash code.
+static const int kNumHashCodeWords = kHashCodeSize / 64;
 // The number of bucket bits.
 static const int kNumBucketBits = 10;
 // The number of bucket groups.
@@ -57,25 +63,72 @@ static const int kNumBucketGroups = 6;
 // The number of buckets in each group.
 static const int kNumBucketsPerGroup = 1 << kNumBucketBits;
 
+// The hashed descriptor is a plain fixed size struct so that the hashed
+// descriptors of an image are stored contiguously without any additional heap
+// allocations.
 struct HashedSiftDescriptor {
-  // Hash code generated by the primary hashing function.
-  std::bitset<kHashCodeSize> hash_code;
+  // Hash code generated by the primary hashing function. Bit j of the hash code
+  // is bit (j % 64) of hash_code[j / 64].
+  uint64_t hash_code[kNumHashCodeWords];
   // Each bucket_ids[x] = y means the descriptor belongs to bucket y in bucket
   // group x.
-  std::vector<uint16_t> bucket_ids;
+  uint16_t bucket_ids[kNumBucketGroups];
+
+ private:
+  // Templated method for disk I/O with cereal. This method tells cereal which
+  // data members should be used when reading/writing to/from disk.
+  friend class cereal::access;
+  template <class Archive>
+  void serialize(Archive& ar) {  // NOLINT
+    ar(hash_code, bucket_ids);
+  }
 };
 
 struct HashedImage {
   HashedImage() {}
 
+  // Returns the ids of the descriptors in bucket bucket_id of bucket group
+  // bucket_group as the range [begin, end).
+  const int* BucketBegin(const int bucket_group, const int bucket_id) const {
+    return bucket_descriptor_ids.data() +
+           bucket_offsets[bucket_group * kNumBucketsPerGroup + bucket_id];
+  }
+  const int* BucketEnd(const int bucket_group, const int bucket_id) const {
+    return bucket_descriptor_ids.data() +
+           bucket_offsets[bucket_group * kNumBucketsPerGroup + bucket_id + 1];
+  }
+
+  // The number of bytes used by the hashed image.
+  size_t NumBytes() const {
+    return sizeof(*this) + mean_descriptor.size() * sizeof(float) +
+           hashed_desc.capacity() * sizeof(HashedSiftDescriptor) +
+           bucket_offsets.capacity() * sizeof(int) +
+           bucket_descriptor_ids.capacity() * sizeof(int);
+  }
+
   // The mean of all descriptors (used for hashing).
   Eigen::VectorXf mean_descriptor;
 
   // The hash information.
   std::vector<HashedSiftDescriptor> hashed_desc;
 
-  // buckets[bucket_group][bucket_id] = bucket (container of sift ids).
-  std::vector<std::vector<Bucket> > buckets;
+  // The buckets are stored in compressed sparse row format. With
+  // i = g * kNumBucketsPerGroup + b, the ids of the descriptors in bucket b of
+  // bucket group g are stored in bucket_descriptor_ids at the positions
+  // [bucket_offsets[i], bucket_offsets[i + 1]). bucket_offsets has
+  // kNumBucketGroups * kNumBucketsPerGroup + 1 entries and
+  // bucket_descriptor_ids has kNumBucketGroups entries per descriptor.
+  std::vector<int> bucket_offsets;
+  std::vector<int> bucket_descriptor_ids;
+
+ private:
+  // Templated method for disk I/O with cereal. This method tells cereal which
+  // data members should be used when reading/writing to/from disk.
+  friend class cereal::access;
+  template <class Archive>
+  void serialize(Archive& ar, const std::uint32_t version) {  // NOLINT
+    ar(mean_descriptor, hashed_desc, bucket_offsets, bucket_descriptor_ids);
+  }
 };
 
 // This hasher will hash SIFT descriptors with a two-step hashing system. The
@@ -88,34 +141,74 @@ struct HashedImage {
 // this class we ask that you please cite this paper.
 class CascadeHasher {
  public:
-  CascadeHasher() : rng_(std::make_shared<RandomNumberGenerator>()) {}
-  CascadeHasher(std::shared_ptr<RandomNumberGenerator> rng) : rng_(rng) {}
+  CascadeHasher()
+      : rng_(std::make_shared<RandomNumberGenerator>()), fingerprint_(0) {}
+  CascadeHasher(std::shared_ptr<RandomNumberGenerator> rng)
+      : rng_(rng), fingerprint_(0) {}
 
   // Creates the hashing projections. This must be called before using the
   // cascade hasher.
   bool Initialize(const int num_dimensions_of_descriptor);
 
-  // Creates the hash codes for the sift descriptors and returns the hashed
-  // information.
+  // Returns a fingerprint of the hashing projections. Hashed images can only be
+  // matched against each other if they were created with identical projections
+  // (e.g. from the same random seed), so the fingerprint is stored along with
+  // hashed images that are written to disk.
+  uint64_t Fingerprint() const { return fingerprint_; }
+
+  // Creates the hash codes for the sift descriptors (one descriptor per row)
+  // and returns the hashed information.
   HashedImage CreateHashedSiftDescriptors(
-      const std::vector<Eigen::VectorXf>& sift_desc) const;
+      const Eigen::Ref<const DescriptorMatrix>& sift_desc) const;
 
   // Matches images with a fast matching scheme based on the hash codes
-  // previously generated.
+  // previously generated. This method is thread safe and reuses per-thread
+  // scratch buffers so that no memory is allocated after the first call on
+  // each thread (apart from the output matches).
   void MatchImages(const HashedImage& hashed_desc1,
-                   const std::vector<Eigen::VectorXf>& descriptors1,
+                   const Eigen::Ref<const DescriptorMatrix>& descriptors1,
                    const HashedImage& hashed_desc2,
-                   const std::vector<Eigen::VectorXf>& descriptors2,
+                   const Eigen::Ref<const DescriptorMatrix>& descriptors2,
                    const double lowes_ratio,
                    std::vector<IndexedFeatureMatch>* matches) const;
 
+  // Same as above for descriptors that are stored with reduced precision. The
+  // euclidean distances of the candidates are computed directly on the stored
+  // descriptors (see L2Uint8 and L2Float16) and are returned in the units of
+  // the float descriptors.
+  void MatchImages(const HashedImage& hashed_desc1,
+                   const Eigen::Ref<const Uint8DescriptorMatrix>& descriptors1,
+                   const HashedImage& hashed_desc2,
+                   const Eigen::Ref<const Uint8DescriptorMatrix>& descriptors2,
+                   const double lowes_ratio,
+                   std::vector<IndexedFeatureMatch>* matches) const;
+  void MatchImages(
+      const HashedImage& hashed_desc1,
+      const Eigen::Ref<const Float16DescriptorMatrix>& descriptors1,
+      const HashedImage& hashed_desc2,
+      const Eigen::Ref<const Float16DescriptorMatrix>& descriptors2,
+      const double lowes_ratio,
+      std::vector<IndexedFeatureMatch>* matches) const;
+
  private:
   std::shared_ptr<RandomNumberGenerator> rng_;
 
+  // Matches the hashed images. squared_distance(i, j) must return the squared
+  // euclidean distance between the i-th descriptor of the first image and the
+  // j-th descriptor of the second image.
+  template <class SquaredDistance>
+  void MatchHashedImages(const HashedImage& hashed_image1,
+                         const HashedImage& hashed_image2,
+                         const SquaredDistance& squared_distance,
+                         const double lowes_ratio,
+                         std::vector<IndexedFeatureMatch>* matches) const;
+
   // Creates the hash code for each descriptor and determines which buckets each
-  // descriptor belongs to.
-  void CreateHashedDescriptors(const std::vector<Eigen::VectorXf>& sift_desc,
-                               HashedImage* hashed_image) const;
+  // descriptor belongs to. The projections of all descriptors are computed at
+  // once as matrix products.
+  void CreateHashedDescriptors(
+      const Eigen::Ref<const DescriptorMatrix>& sift_desc,
+      HashedImage* hashed_image) const;
 
   // Builds the buckets for an image based on the bucket ids and groups of the
   // sift descriptors.
@@ -124,13 +217,22 @@ class CascadeHasher {
   // Number of dimensions of the descriptors.
   int num_dimensions_of_descriptor_;
 
+  // The fingerprint of the projection matrices.
+  uint64_t fingerprint_;
+
   // Projection matrix of the primary hashing function.
   Eigen::MatrixXf primary_hash_projection_;
 
   // Projection matrices of the secondary hashing function.
   Eigen::MatrixXf secondary_hash_projection_[kNumBucketGroups];
+
+  // The projection matrices of all secondary hashing functions stacked into a
+  // single (kNumBucketGroups * kNumBucketBits) x num_dimensions matrix.
+  Eigen::MatrixXf stacked_secondary_hash_projection_;
 };
 
 }  // namespace theia
 
+CEREAL_CLASS_VERSION(theia::HashedImage, 0);
+
 #endif  // THEIA_MATCHING_CASCADE_HASHER_H_
@@ -0,0 +1,129 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/matching/cascade_hasher.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/util/random.h"
+
+namespace theia {
+
+namespace {
+
+static const int kNumDescriptors = 500;
+static const int kNumDescriptorDimensions = 128;
+
+DescriptorMatrix RandomDescriptors(RandomNumberGenerator* rng) {
+  DescriptorMatrix descriptors(kNumDescriptors, kNumDescriptorDimensions);
+  for (int i = 0; i < kNumDescriptors; i++) {
+    for (int j = 0; j < kNumDescriptorDimensions; j++) {
+      descriptors(i, j) = rng->RandFloat(0.0f, 1.0f);
+    }
+    descriptors.row(i).normalize();
+  }
+  return descriptors;
+}
+
+}  // namespace
+
+TEST(CascadeHasherTest, EmptyImage) {
+  CascadeHasher hasher(std::make_shared<RandomNumberGenerator>(53));
+  hasher.Initialize(kNumDescriptorDimensions);
+  const HashedImage hashed_image =
+      hasher.CreateHashedSiftDescriptors(DescriptorMatrix());
+  EXPECT_TRUE(hashed_image.hashed_desc.empty());
+  for (int i = 0; i < kNumBucketGroups; i++) {
+    for (int j = 0; j < kNumBucketsPerGroup; j++) {
+      EXPECT_EQ(hashed_image.BucketBegin(i, j), hashed_image.BucketEnd(i, j));
+    }
+  }
+}
+
+TEST(CascadeHasherTest, EachDescriptorIsInOneBucketPerGroup) {
+  std::shared_ptr<RandomNumberGenerator> rng =
+      std::make_shared<RandomNumberGenerator>(53);
+  CascadeHasher hasher(rng);
+  hasher.Initialize(kNumDescriptorDimensions);
+  const DescriptorMatrix descriptors = RandomDescriptors(rng.get());
+  const HashedImage hashed_image =
+      hasher.CreateHashedSiftDescriptors(descriptors);
+  ASSERT_EQ(hashed_image.hashed_desc.size(), kNumDescriptors);
+
+  for (int i = 0; i < kNumBucketGroups; i++) {
+    std::vector<int> num_occurrences(kNumDescriptors, 0);
+    for (int j = 0; j < kNumBucketsPerGroup; j++) {
+      int previous_id = -1;
+      for (const int* id = hashed_image.BucketBegin(i, j);
+           id != hashed_image.BucketEnd(i, j);
+           ++id) {
+        // Buckets are sorted by descriptor id and agree with the bucket ids.
+        EXPECT_GT(*id, previous_id);
+        EXPECT_EQ(hashed_image.hashed_desc[*id].bucket_ids[i], j);
+        ++num_occurrences[*id];
+        previous_id = *id;
+      }
+    }
+    for (int j = 0; j < kNumDescriptors; j++) {
+      EXPECT_EQ(num_occurrences[j], 1);
+    }
+  }
+}
+
+TEST(CascadeHasherTest, IdenticalImagesMatch) {
+  std::shared_ptr<RandomNumberGenerator> rng =
+      std::make_shared<RandomNumberGenerator>(53);
+  CascadeHasher hasher(rng);
+  hasher.Initialize(kNumDescriptorDimensions);
+  const DescriptorMatrix descriptors = RandomDescriptors(rng.get());
+  const HashedImage hashed_image =
+      hasher.CreateHashedSiftDescriptors(descriptors);
+
+  // Every descriptor that has enough candidates to be matched is matched to
+  // itself.
+  std::vector<IndexedFeatureMatch> matches;
+  hasher.MatchImages(hashed_image, descriptors, hashed_image, descriptors,
+                     0.8, &matches);
+  EXPECT_GT(matches.size(), 0);
+  for (const IndexedFeatureMatch& match : matches) {
+    EXPECT_EQ(match.feature1_ind, match.feature2_ind);
+    EXPECT_EQ(match.distance, 0);
+  }
+}
+
+}  // namespace theia
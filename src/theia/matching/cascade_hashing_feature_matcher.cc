@@ -36,60 +36,57 @@
 
 #include <Eigen/Core>
 #include <glog/logging.h>
+#include <stdint.h>
 
+#include <functional>
 #include <memory>
 #include <mutex>  // NOLINT
 #include <string>
 #include <thread>  // NOLINT
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/io/hashed_image_format.h"
+#include "theia/io/read_hashed_image.h"
+#include "theia/io/write_hashed_image.h"
 #include "theia/matching/cascade_hasher.h"
 #include "theia/matching/feature_matcher.h"
 #include "theia/matching/feature_matcher_utils.h"
 #include "theia/matching/indexed_feature_match.h"
-#include "theia/util/lru_cache.h"
+#include "theia/util/concurrent_lru_cache.h"
+#include "theia/util/filesystem.h"
 #include "theia/util/map_util.h"
+#include "theia/util/random.h"
 #include "theia/util/threadpool.h"
 #include "theia/util/util.h"
 
 namespace theia {
-namespace {
-// An LRU cache that will manage the keypoints and descriptors of interest.
-typedef LRUCache<std::string, std::shared_ptr<KeypointsAndDescriptors> >
-KeypointAndDescriptorCache;
-
-// A unique pointer to a keypoint and descriptor cache.
-typedef std::unique_ptr<KeypointAndDescriptorCache>
-KeypointAndDescriptorCachePtr;
-
-void CreateHashedImage(
-    const std::string& image_name,
-    const std::string& feature_filename,
-    const std::unique_ptr<CascadeHasher>& cascade_hasher,
-    const KeypointAndDescriptorCachePtr& kpts_and_descriptors_cache,
-    std::mutex* hashed_images_mutex,
-    std::unordered_map<std::string, HashedImage>* hashed_images) {
-  // Get the features from the cache and create hashed descriptors.
-  std::shared_ptr<KeypointsAndDescriptors> features =
-      kpts_and_descriptors_cache->Fetch(feature_filename);
-  // Create the hashing information.
-  const HashedImage& hashed_image =
-      cascade_hasher->CreateHashedSiftDescriptors(features->descriptors);
-  {
-    std::lock_guard<std::mutex> lock(*hashed_images_mutex);
-    (*hashed_images)[image_name] = hashed_image;
-    VLOG(1) << "Created the hashed descriptors for image: " << image_name;
-  }
-}
 
-}  // namespace
+CascadeHashingFeatureMatcher::CascadeHashingFeatureMatcher(
+    const FeatureMatcherOptions& options)
+    : FeatureMatcher(options) {
+  std::function<std::shared_ptr<HashedImage>(const std::string&)>
+      fetch_hashed_image =
+          std::bind(&CascadeHashingFeatureMatcher::FetchHashedImage,
+                    this,
+                    std::placeholders::_1);
+  std::function<size_t(const std::shared_ptr<HashedImage>&)>
+      hashed_image_size = [](const std::shared_ptr<HashedImage>& hashed_image) {
+        return hashed_image->NumBytes();
+      };
+  hashed_images_cache_.reset(new HashedImageCache(
+      fetch_hashed_image, hashed_image_size, GetCacheOptions()));
+}
 
 // Initializes the cascade hasher (only if needed).
 void CascadeHashingFeatureMatcher::InitializeCascadeHasher(
     int descriptor_dimension) {
-  // Initialize the cascade hasher if needed.
+  // Initialize the cascade hasher if needed. A fixed seed is used so that the
+  // hashed images written to disk may be reused.
   if (cascade_hasher_.get() == nullptr && descriptor_dimension > 0) {
-    cascade_hasher_.reset(new CascadeHasher());
+    cascade_hasher_.reset(new CascadeHasher(
+        std::make_shared<RandomNumberGenerator>(
+            options_.cascade_hashing_seed)));
     CHECK(cascade_hasher_->Initialize(descriptor_dimension))
         << "Could not initialize the cascade hasher.";
   }
@@ -98,95 +95,104 @@ void CascadeHashingFeatureMatcher::InitializeCascadeHasher(
 void CascadeHashingFeatureMatcher::AddImage(
     const std::string& image,
     const std::vector<Keypoint>& keypoints,
-    const std::vector<Eigen::VectorXf>& descriptors) {
+    const DescriptorMatrix& descriptors) {
   // This will save the descriptors and keypoints to disk and set up our LRU
   // cache.
   FeatureMatcher::AddImage(image, keypoints, descriptors);
 
-  if (cascade_hasher_.get() == nullptr && descriptors.size() > 0) {
-    cascade_hasher_.reset(new CascadeHasher());
-    CHECK(cascade_hasher_->Initialize(descriptors[0].size()))
-        << "Could not initialize the cascade hasher.";
-  }
+  // Initialize the cascade hasher if needed.
+  InitializeCascadeHasher(descriptors.cols());
 
-  // Create the hashing information.
-  if (!ContainsKey(hashed_images_, image)) {
-    hashed_images_[image] =
-      cascade_hasher_->CreateHashedSiftDescriptors(descriptors);
-    VLOG(1) << "Created the hashed descriptors for image: " << image;
+  // Create the hashing information from the features as they are stored,
+  // which may have reduced precision.
+  if (!hashed_images_cache_->ExistsInCache(image)) {
+    HashImage(image, *GetKeypointsAndDescriptors(image));
   }
 }
 
 void CascadeHashingFeatureMatcher::AddImage(
     const std::string& image,
     const std::vector<Keypoint>& keypoints,
-    const std::vector<Eigen::VectorXf>& descriptors,
+    const DescriptorMatrix& descriptors,
     const CameraIntrinsicsPrior& intrinsics) {
   // This will save the descriptors and keypoints to disk and set up our LRU
   // cache.
   FeatureMatcher::AddImage(image, keypoints, descriptors, intrinsics);
 
-  if (cascade_hasher_.get() == nullptr && descriptors.size() > 0) {
-    cascade_hasher_.reset(new CascadeHasher());
-    CHECK(cascade_hasher_->Initialize(descriptors[0].size()))
-        << "Could not initialize the cascade hasher.";
-  }
+  // Initialize the cascade hasher if needed.
+  InitializeCascadeHasher(descriptors.cols());
 
-  // Create the hashing information.
-  if (!ContainsKey(hashed_images_, image)) {
-    hashed_images_[image] =
-      cascade_hasher_->CreateHashedSiftDescriptors(descriptors);
-    VLOG(1) << "Created the hashed descriptors for image: " << image;
+  // Create the hashing information from the features as they are stored,
+  // which may have reduced precision.
+  if (!hashed_images_cache_->ExistsInCache(image)) {
+    HashImage(image, *GetKeypointsAndDescriptors(image));
   }
 }
 
 void CascadeHashingFeatureMatcher::AddImage(const std::string& image_name) {
-  image_names_.push_back(image_name);
-
-  // Get the features from the cache and create hashed descriptors.
-  std::shared_ptr<KeypointsAndDescriptors> features =
-      this->keypoints_and_descriptors_cache_->Fetch(
-          FeatureFilenameFromImage(image_name));
+  FeatureMatcher::AddImage(image_name);
 
   // Initialize the cascade hasher if needed.
-  InitializeCascadeHasher(features->descriptors[0].size());
+  std::shared_ptr<KeypointsAndDescriptors> features =
+      GetKeypointsAndDescriptors(image_name);
+  InitializeCascadeHasher(GetDescriptorDimension(*features));
 
   // Create the hashing information.
-  hashed_images_[image_name] =
-      cascade_hasher_->CreateHashedSiftDescriptors(features->descriptors);
-  VLOG(1) << "Created the hashed descriptors for image: " << image_name;
+  if (!hashed_images_cache_->ExistsInCache(image_name)) {
+    CreateHashedImage(image_name);
+  }
 }
 
 void CascadeHashingFeatureMatcher::AddImage(
     const std::string& image_name, const CameraIntrinsicsPrior& intrinsics) {
-  image_names_.push_back(image_name);
-  intrinsics_[image_name] = intrinsics;
-  // Get the features from the cache and create hashed descriptors.
-  std::shared_ptr<KeypointsAndDescriptors> features =
-      this->keypoints_and_descriptors_cache_->Fetch(
-          FeatureFilenameFromImage(image_name));
+  FeatureMatcher::AddImage(image_name, intrinsics);
 
   // Initialize the cascade hasher if needed.
-  InitializeCascadeHasher(features->descriptors[0].size());
+  std::shared_ptr<KeypointsAndDescriptors> features =
+      GetKeypointsAndDescriptors(image_name);
+  InitializeCascadeHasher(GetDescriptorDimension(*features));
 
   // Create the hashing information.
-  hashed_images_[image_name] =
-      cascade_hasher_->CreateHashedSiftDescriptors(features->descriptors);
-  VLOG(1) << "Created the hashed descriptors for image: " << image_name;
+  if (!hashed_images_cache_->ExistsInCache(image_name)) {
+    CreateHashedImage(image_name);
+  }
+}
+
+void CascadeHashingFeatureMatcher::CreateHashedImage(
+    const std::string& image_name) {
+  // The cascade hasher is initialized once an image with descriptors is added,
+  // so if it does not exist yet then the image has no descriptors to hash.
+  if (cascade_hasher_ == nullptr) {
+    return;
+  }
+
+  // Reuse the hashed image file from a previous run if it was created with the
+  // same hashing projections from the same descriptors. It will be read from
+  // disk when it is needed.
+  const std::shared_ptr<KeypointsAndDescriptors> features =
+      GetKeypointsAndDescriptors(image_name);
+  HashedImageHeader header;
+  if (options_.match_out_of_core &&
+      ReadHashedImageHeader(HashedImageFilenameFromImage(image_name),
+                            &header) &&
+      header == HashedImageHeaderOfFeatures(*features)) {
+    VLOG(1) << "Reusing the hashed descriptors for image: " << image_name;
+    return;
+  }
+
+  HashImage(image_name, *features);
 }
 
 void CascadeHashingFeatureMatcher::CreateHashedImagesInParallel(
-    const std::vector<std::string>& image_names,
-    const std::vector<std::string>& feature_filenames) {
+    const std::vector<std::string>& image_names) {
   ThreadPool thread_pool(options_.num_threads);
   for (int i = 0; i < image_names.size(); ++i) {
-    thread_pool.Add(CreateHashedImage,
-                    std::cref(image_names[i]),
-                    std::cref(feature_filenames[i]),
-                    std::cref(cascade_hasher_),
-                    std::cref(this->keypoints_and_descriptors_cache_),
-                    &hashed_images_lock_,
-                    &hashed_images_);
+    if (hashed_images_cache_->ExistsInCache(image_names[i])) {
+      continue;
+    }
+    thread_pool.Add(&CascadeHashingFeatureMatcher::CreateHashedImage,
+                    this,
+                    std::cref(image_names[i]));
   }
 }
 
@@ -199,17 +205,143 @@ void CascadeHashingFeatureMatcher::AddImages(
   image_names_.insert(image_names_.end(),
                       image_names.begin(),
                       image_names.end());
-  std::vector<std::string> feature_filenames(image_names.size());
-  for (int i = 0; i < image_names.size(); ++i) {
-    intrinsics_[image_names[i]] = intrinsics[i];
-    feature_filenames[i] = FeatureFilenameFromImage(image_names[i]);
+  {
+    std::lock_guard<std::mutex> lock(intrinsics_mutex_);
+    for (int i = 0; i < image_names.size(); ++i) {
+      intrinsics_[image_names[i]] = intrinsics[i];
+    }
+  }
+  // Initialize cascade hasher (if needed) from the first image that has
+  // descriptors.
+  for (int i = 0; i < image_names.size() && cascade_hasher_ == nullptr; ++i) {
+    std::shared_ptr<KeypointsAndDescriptors> features =
+        GetKeypointsAndDescriptors(image_names[i]);
+    InitializeCascadeHasher(GetDescriptorDimension(*features));
   }
-  // Initialize cascade hasher (if needed).
-  std::shared_ptr<KeypointsAndDescriptors> features =
-      this->keypoints_and_descriptors_cache_->Fetch(feature_filenames[0]);
-  InitializeCascadeHasher(features->descriptors[0].size());
   // Create the hashed images.
-  CreateHashedImagesInParallel(image_names, feature_filenames);
+  CreateHashedImagesInParallel(image_names);
+}
+
+HashedImageHeader CascadeHashingFeatureMatcher::HashedImageHeaderOfFeatures(
+    const KeypointsAndDescriptors& features) const {
+  HashedImageHeader header;
+  header.hasher_fingerprint = cascade_hasher_->Fingerprint();
+  header.num_descriptors = features.keypoints.size();
+  header.descriptor_dimension = GetDescriptorDimension(features);
+  header.descriptor_checksum = ComputeDescriptorChecksum(features);
+  return header;
+}
+
+void CascadeHashingFeatureMatcher::HashImage(
+    const std::string& image_name, const KeypointsAndDescriptors& features) {
+  // Images without descriptors are never matched, so they are not hashed.
+  if (features.keypoints.empty()) {
+    return;
+  }
+
+  // The projections are computed on float descriptors, so descriptors that are
+  // stored with reduced precision are converted once for hashing.
+  DescriptorMatrix descriptors;
+  GetFloatDescriptors(features, &descriptors);
+  std::shared_ptr<HashedImage> hashed_image(new HashedImage(
+      cascade_hasher_->CreateHashedSiftDescriptors(descriptors)));
+  if (options_.match_out_of_core) {
+    const std::string hashed_image_file =
+        HashedImageFilenameFromImage(image_name);
+    CHECK(WriteHashedImage(hashed_image_file,
+                           HashedImageHeaderOfFeatures(features),
+                           *hashed_image))
+        << "Could not write the hashed descriptors for image " << image_name
+        << " to file " << hashed_image_file;
+  }
+  hashed_images_cache_->Insert(image_name, hashed_image);
+  VLOG(1) << "Created the hashed descriptors for image: " << image_name;
+}
+
+std::shared_ptr<HashedImage> CascadeHashingFeatureMatcher::FetchHashedImage(
+    const std::string& image_name) {
+  const std::shared_ptr<KeypointsAndDescriptors> features =
+      GetKeypointsAndDescriptors(image_name);
+  std::shared_ptr<HashedImage> hashed_image(new HashedImage);
+  const std::string hashed_image_file =
+      HashedImageFilenameFromImage(image_name);
+  if (options_.match_out_of_core &&
+      ReadHashedImage(hashed_image_file,
+                      HashedImageHeaderOfFeatures(*features),
+                      hashed_image.get())) {
+    num_bytes_read_ += FileSize(hashed_image_file);
+    return hashed_image;
+  }
+
+  // The hashed image file does not exist or it was created with different
+  // hashing projections or from other descriptors, so the descriptors must be
+  // hashed again.
+  DescriptorMatrix descriptors;
+  GetFloatDescriptors(*features, &descriptors);
+  *hashed_image = cascade_hasher_->CreateHashedSiftDescriptors(descriptors);
+  return hashed_image;
+}
+
+std::string CascadeHashingFeatureMatcher::HashedImageFilenameFromImage(
+    const std::string& image) {
+  std::string output_dir = options_.keypoints_and_descriptors_output_dir;
+  // Add a trailing slash if one does not exist.
+  if (output_dir.back() != '/') {
+    output_dir = output_dir + "/";
+  }
+  return output_dir + image + ".hashed_image";
+}
+
+void CascadeHashingFeatureMatcher::PrefetchImage(
+    const std::string& image_name) {
+  FeatureMatcher::PrefetchImage(image_name);
+  hashed_images_cache_->Prefetch(image_name);
+}
+
+void CascadeHashingFeatureMatcher::MatchHashedImages(
+    const HashedImage& hashed_image1,
+    const KeypointsAndDescriptors& features1,
+    const HashedImage& hashed_image2,
+    const KeypointsAndDescriptors& features2,
+    const double lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) const {
+  const DescriptorPrecision precision = GetDescriptorPrecision(features1);
+  const bool same_precision = GetDescriptorPrecision(features2) == precision;
+  if (same_precision && precision == DescriptorPrecision::FLOAT32) {
+    cascade_hasher_->MatchImages(hashed_image1,
+                                 GetFloat32Descriptors(features1),
+                                 hashed_image2,
+                                 GetFloat32Descriptors(features2),
+                                 lowes_ratio,
+                                 matches);
+  } else if (same_precision && precision == DescriptorPrecision::UINT8) {
+    cascade_hasher_->MatchImages(hashed_image1,
+                                 GetUint8Descriptors(features1),
+                                 hashed_image2,
+                                 GetUint8Descriptors(features2),
+                                 lowes_ratio,
+                                 matches);
+  } else if (same_precision && precision == DescriptorPrecision::FLOAT16) {
+    cascade_hasher_->MatchImages(hashed_image1,
+                                 GetFloat16Descriptors(features1),
+                                 hashed_image2,
+                                 GetFloat16Descriptors(features2),
+                                 lowes_ratio,
+                                 matches);
+  } else {
+    // Images whose descriptors are stored with different precisions (e.g. in a
+    // packed feature store written with another precision) are matched as
+    // floats.
+    DescriptorMatrix descriptors1, descriptors2;
+    GetFloatDescriptors(features1, &descriptors1);
+    GetFloatDescriptors(features2, &descriptors2);
+    cascade_hasher_->MatchImages(hashed_image1,
+                                 descriptors1,
+                                 hashed_image2,
+                                 descriptors2,
+                                 lowes_ratio,
+                                 matches);
+  }
 }
 
 bool CascadeHashingFeatureMatcher::MatchImagePair(
@@ -219,26 +351,29 @@ bool CascadeHashingFeatureMatcher::MatchImagePair(
   const double lowes_ratio =
       (this->options_.use_lowes_ratio) ? this->options_.lowes_ratio : 1.0;
 
-  // Get references to the hashed images for each set of features.
-  HashedImage& hashed_features1 =
-      FindOrDie(hashed_images_, features1.image_name);
+  // Images without descriptors do not have a hashed image.
+  if (features1.keypoints.empty() || features2.keypoints.empty()) {
+    return matches->size() >= this->options_.min_num_feature_matches;
+  }
 
-  HashedImage& hashed_features2 =
-      FindOrDie(hashed_images_, features2.image_name);
+  // Get the hashed images for each set of features. By using a shared_ptr
+  // the hashed images stay alive while they are used even if the cache evicts
+  // them.
+  const std::shared_ptr<HashedImage> hashed_features1 =
+      hashed_images_cache_->Fetch(features1.image_name);
+  const std::shared_ptr<HashedImage> hashed_features2 =
+      hashed_images_cache_->Fetch(features2.image_name);
 
-  cascade_hasher_->MatchImages(hashed_features1, features1.descriptors,
-                               hashed_features2, features2.descriptors,
-                               lowes_ratio, matches);
+  MatchHashedImages(*hashed_features1, features1,
+                    *hashed_features2, features2,
+                    lowes_ratio, matches);
   // Only do symmetric matching if enough matches exist to begin with.
   if (matches->size() >= this->options_.min_num_feature_matches &&
       this->options_.keep_only_symmetric_matches) {
     std::vector<IndexedFeatureMatch> backwards_matches;
-    cascade_hasher_->MatchImages(hashed_features2,
-                                 features2.descriptors,
-                                 hashed_features1,
-                                 features1.descriptors,
-                                 lowes_ratio,
-                                 &backwards_matches);
+    MatchHashedImages(*hashed_features2, features2,
+                      *hashed_features1, features1,
+                      lowes_ratio, &backwards_matches);
     IntersectMatches(backwards_matches, matches);
   }
 
@@ -37,12 +37,12 @@
 
 #include <memory>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
+#include "theia/io/hashed_image_format.h"
 #include "theia/matching/cascade_hasher.h"
 #include "theia/matching/feature_matcher.h"
-#include "theia/util/hash.h"
+#include "theia/util/concurrent_lru_cache.h"
 
 namespace theia {
 class Keypoint;
@@ -55,18 +55,20 @@ struct KeypointsAndDescriptors;
 // efficient but can only be used with float features like SIFT.
 class CascadeHashingFeatureMatcher : public FeatureMatcher {
  public:
-  explicit CascadeHashingFeatureMatcher(const FeatureMatcherOptions& options)
-      : FeatureMatcher(options) {}
+  explicit CascadeHashingFeatureMatcher(const FeatureMatcherOptions& options);
   ~CascadeHashingFeatureMatcher() {}
 
   // These methods are the same as the base class except that the HashedImage is
-  // created as the descriptors are added.
+  // created as the descriptors are added. For out-of-core matching the hashed
+  // images are written to disk next to the features and are loaded through an
+  // LRU cache. Existing hashed image files are reused if they were created with
+  // the same cascade_hashing_seed from the same descriptors.
   void AddImage(const std::string& image_name,
                 const std::vector<Keypoint>& keypoints,
-                const std::vector<Eigen::VectorXf>& descriptors) override;
+                const DescriptorMatrix& descriptors) override;
   void AddImage(const std::string& image_name,
                 const std::vector<Keypoint>& keypoints,
-                const std::vector<Eigen::VectorXf>& descriptors,
+                const DescriptorMatrix& descriptors,
                 const CameraIntrinsicsPrior& intrinsics) override;
   void AddImage(const std::string& image_name) override;
   void AddImage(const std::string& image_name,
@@ -76,25 +78,63 @@ class CascadeHashingFeatureMatcher : public FeatureMatcher {
   void AddImages(const std::vector<std::string>& image_names,
                  const std::vector<CameraIntrinsicsPrior>& intrinsics) override;
 
+  using FeatureMatcher::AddImage;
+
  private:
   bool MatchImagePair(
       const KeypointsAndDescriptors& features1,
       const KeypointsAndDescriptors& features2,
       std::vector<IndexedFeatureMatch>* matches) override;
 
+  // Matches the descriptors of the first image to those of the second image.
+  // The distances are computed on the descriptors with the precision they are
+  // stored with, so reduced precision descriptors are not converted to floats.
+  void MatchHashedImages(const HashedImage& hashed_image1,
+                         const KeypointsAndDescriptors& features1,
+                         const HashedImage& hashed_image2,
+                         const KeypointsAndDescriptors& features2,
+                         const double lowes_ratio,
+                         std::vector<IndexedFeatureMatch>* matches) const;
+
+  // Prefetches the hashed image in addition to the features of the image.
+  void PrefetchImage(const std::string& image_name) override;
+
   // Initializes the cascade hasher (only if needed).
   void InitializeCascadeHasher(int descriptor_dimension);
 
+  // Creates the hashed image for a single image unless a valid hashed image
+  // file already exists for out-of-core matching. This function is called by
+  // the threadpool and is thus thread safe.
+  void CreateHashedImage(const std::string& image_name);
+
   // Creates the hashed images in parallel.
   void CreateHashedImagesInParallel(
-      const std::vector<std::string>& image_names,
-      const std::vector<std::string>& feature_filenames);
+      const std::vector<std::string>& image_names);
+
+  // Returns the header that a valid hashed image file of the features has.
+  HashedImageHeader HashedImageHeaderOfFeatures(
+      const KeypointsAndDescriptors& features) const;
+
+  // Hashes the descriptors of the image. The hashed image is written to disk
+  // if matching is performed out-of-core and is added to the cache.
+  void HashImage(const std::string& image_name,
+                 const KeypointsAndDescriptors& features);
+
+  // Reads the hashed image from disk. If no valid hashed image file exists then
+  // the hashed image is created from the descriptors. This function is utilized
+  // by the internal cache to preserve memory.
+  std::shared_ptr<HashedImage> FetchHashedImage(const std::string& image_name);
+
+  // Returns the filepath of the hashed image file given the image name.
+  std::string HashedImageFilenameFromImage(const std::string& image);
 
-  std::unordered_map<std::string, HashedImage> hashed_images_;
   std::unique_ptr<CascadeHasher> cascade_hasher_;
 
-  // Guard for the hashed images map.
-  std::mutex hashed_images_lock_;
+  // An LRU cache that manages the hashed images. The cache has the same
+  // capacity as the cache of keypoints and descriptors.
+  typedef ConcurrentLRUCache<std::string, std::shared_ptr<HashedImage> >
+      HashedImageCache;
+  std::unique_ptr<HashedImageCache> hashed_images_cache_;
 
   DISALLOW_COPY_AND_ASSIGN(CascadeHashingFeatureMatcher);
 };
@@ -33,12 +33,18 @@
 // Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
 
 #include <Eigen/Core>
+#include <stdint.h>
+#include <string>
 #include <vector>
 
+#include "theia/io/hashed_image_format.h"
+#include "theia/io/read_hashed_image.h"
+#include "theia/io/write_keypoints_and_descriptors.h"
 #include "theia/matching/cascade_hashing_feature_matcher.h"
 #include "theia/matching/distance.h"
 #include "theia/matching/feature_matcher.h"
 #include "theia/matching/image_pair_match.h"
+#include "theia/util/random.h"
 
 #include "gtest/gtest.h"
 
@@ -85,6 +91,60 @@ TEST(CascadeHashingFeatureMatcherTest, NoOptionsInCore) {
   EXPECT_EQ(matches[0].correspondences.size(), kNumDescriptors);
 }
 
+TEST(CascadeHashingFeatureMatcherTest, ReducedPrecisionDescriptorsInCore) {
+  // Enough descriptors are needed so that the hash buckets contain more
+  // candidates than the number of top candidates that are compared.
+  static const int kNumSiftDescriptors = 2000;
+  static const int kSiftDimensions = 128;
+  RandomNumberGenerator rng(67);
+
+  // Set up distinct SIFT-like descriptors that are repeated in both images.
+  std::vector<VectorXf> descriptor1(kNumSiftDescriptors);
+  for (int i = 0; i < kNumSiftDescriptors; i++) {
+    descriptor1[i].resize(kSiftDimensions);
+    rng.SetRandom(&descriptor1[i]);
+    descriptor1[i] = descriptor1[i].cwiseAbs().normalized();
+  }
+  const std::vector<VectorXf> descriptor2 = descriptor1;
+
+  // The keypoint locations encode the descriptor index so that we can recover
+  // the matched indices from the correspondences.
+  std::vector<Keypoint> keypoints(kNumSiftDescriptors);
+  for (int i = 0; i < kNumSiftDescriptors; i++) {
+    keypoints[i] = Keypoint(i, 0, Keypoint::OTHER);
+  }
+
+  for (const DescriptorPrecision precision :
+       {DescriptorPrecision::FLOAT16, DescriptorPrecision::UINT8}) {
+    // Set options.
+    FeatureMatcherOptions options;
+    options.match_out_of_core = false;
+    options.keypoints_and_descriptors_output_dir = "";
+    options.min_num_feature_matches = 0;
+    options.keep_only_symmetric_matches = true;
+    options.use_lowes_ratio = true;
+    options.perform_geometric_verification = false;
+    options.descriptor_precision = precision;
+
+    // Add features.
+    CascadeHashingFeatureMatcher matcher(options);
+    matcher.AddImage("1", keypoints, descriptor1);
+    matcher.AddImage("2", keypoints, descriptor2);
+
+    // Match features.
+    std::vector<ImagePairMatch> matches;
+    matcher.MatchImages(&matches);
+
+    // Descriptors are only skipped if their buckets contain too few
+    // candidates, and every match should be to the copy of the descriptor.
+    ASSERT_EQ(matches.size(), 1);
+    EXPECT_GT(matches[0].correspondences.size(), 0.95 * kNumSiftDescriptors);
+    for (const FeatureCorrespondence& match : matches[0].correspondences) {
+      EXPECT_EQ(match.feature1.x(), match.feature2.x());
+    }
+  }
+}
+
 TEST(CascadeHashingFeatureMatcherTest, RatioTestInCore) {
   // Set up descriptors.
   std::vector<VectorXf> descriptor1(1);
@@ -199,6 +259,106 @@ TEST(CascadeHashingFeatureMatcherTest, RatioTestOutOfCore) {
   EXPECT_EQ(matches[0].correspondences.size(), 0);
 }
 
+TEST(CascadeHashingFeatureMatcherTest, HashedImagesAreReusedOutOfCore) {
+  // Set up descriptors.
+  std::vector<VectorXf> descriptor1(kNumDescriptors);
+  std::vector<VectorXf> descriptor2(kNumDescriptors);
+  for (int i = 0; i < kNumDescriptors; i++) {
+    // Avoid a zero vector.
+    descriptor1[i] = VectorXf::Constant(kNumDescriptorDimensions, 1);
+    descriptor2[i] = VectorXf::Constant(kNumDescriptorDimensions, 1);
+    descriptor1[i].normalize();
+    descriptor2[i].normalize();
+  }
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.match_out_of_core = true;
+  options.keypoints_and_descriptors_output_dir = GTEST_TESTING_OUTPUT_DIRECTORY;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = false;
+  options.perform_geometric_verification = false;
+  const std::string hashed_image_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/hashed1.hashed_image";
+
+  // Add features. The hashed images are written to disk.
+  std::vector<Keypoint> keypoints1(descriptor1.size());
+  std::vector<Keypoint> keypoints2(descriptor2.size());
+  HashedImageHeader header;
+  {
+    CascadeHashingFeatureMatcher matcher(options);
+    matcher.AddImage("hashed1", keypoints1, descriptor1);
+    matcher.AddImage("hashed2", keypoints2, descriptor2);
+  }
+  EXPECT_TRUE(ReadHashedImageHeader(hashed_image_file, &header));
+  EXPECT_EQ(header.num_descriptors, kNumDescriptors);
+  EXPECT_EQ(header.descriptor_dimension, kNumDescriptorDimensions);
+
+  // Match the images from the features on disk with the same seed. The hashed
+  // images are reused.
+  {
+    CascadeHashingFeatureMatcher matcher(options);
+    matcher.AddImage("hashed1");
+    matcher.AddImage("hashed2");
+    std::vector<ImagePairMatch> matches;
+    matcher.MatchImages(&matches);
+    EXPECT_EQ(matches[0].correspondences.size(), kNumDescriptors);
+
+    HashedImageHeader reused_header;
+    EXPECT_TRUE(ReadHashedImageHeader(hashed_image_file, &reused_header));
+    EXPECT_EQ(reused_header, header);
+  }
+
+  // With a different seed the hashed images must be created again.
+  options.cascade_hashing_seed = 1;
+  {
+    CascadeHashingFeatureMatcher matcher(options);
+    matcher.AddImage("hashed1");
+    matcher.AddImage("hashed2");
+    std::vector<ImagePairMatch> matches;
+    matcher.MatchImages(&matches);
+    EXPECT_EQ(matches[0].correspondences.size(), kNumDescriptors);
+
+    HashedImageHeader new_header;
+    EXPECT_TRUE(ReadHashedImageHeader(hashed_image_file, &new_header));
+    EXPECT_NE(new_header.hasher_fingerprint, header.hasher_fingerprint);
+    EXPECT_EQ(new_header.descriptor_checksum, header.descriptor_checksum);
+    header = new_header;
+  }
+
+  // If the features are extracted again, the hashed image of the old features
+  // must not be reused even though the hasher and the number of descriptors
+  // are the same.
+  for (int i = 0; i < kNumDescriptors; i++) {
+    descriptor1[i](0) = 2.0;
+    descriptor1[i].normalize();
+    descriptor2[i] = descriptor1[i];
+  }
+  ASSERT_TRUE(WriteKeypointsAndDescriptors(
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/hashed1.features",
+      keypoints1,
+      descriptor1));
+  ASSERT_TRUE(WriteKeypointsAndDescriptors(
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/hashed2.features",
+      keypoints2,
+      descriptor2));
+  {
+    CascadeHashingFeatureMatcher matcher(options);
+    matcher.AddImage("hashed1");
+    matcher.AddImage("hashed2");
+    std::vector<ImagePairMatch> matches;
+    matcher.MatchImages(&matches);
+    EXPECT_EQ(matches[0].correspondences.size(), kNumDescriptors);
+
+    HashedImageHeader new_header;
+    EXPECT_TRUE(ReadHashedImageHeader(hashed_image_file, &new_header));
+    EXPECT_EQ(new_header.hasher_fingerprint, header.hasher_fingerprint);
+    EXPECT_EQ(new_header.num_descriptors, header.num_descriptors);
+    EXPECT_NE(new_header.descriptor_checksum, header.descriptor_checksum);
+  }
+}
+
 TEST(CascadeHashingFeatureMatcherTest, NoDescriptorsInCore) {
   // Set up descriptors.
   std::vector<VectorXf> descriptor1;
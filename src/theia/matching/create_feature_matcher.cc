@@ -38,9 +38,12 @@
 #include <memory>
 
 #include "theia/matching/brute_force_feature_matcher.h"
+#include "theia/matching/brute_force_hamming_feature_matcher.h"
 #include "theia/matching/cascade_hashing_feature_matcher.h"
 #include "theia/matching/distance.h"
 #include "theia/matching/feature_matcher.h"
+#include "theia/matching/kd_tree_feature_matcher.h"
+#include "theia/matching/multi_index_hashing_feature_matcher.h"
 
 namespace theia {
 
@@ -52,6 +55,12 @@ std::unique_ptr<FeatureMatcher> CreateFeatureMatcher(
     matcher.reset(new CascadeHashingFeatureMatcher(options));
   } else if (matching_strategy == MatchingStrategy::BRUTE_FORCE) {
     matcher.reset(new BruteForceFeatureMatcher(options));
+  } else if (matching_strategy == MatchingStrategy::KD_TREE) {
+    matcher.reset(new KdTreeFeatureMatcher(options));
+  } else if (matching_strategy == MatchingStrategy::BRUTE_FORCE_HAMMING) {
+    matcher.reset(new BruteForceHammingFeatureMatcher(options));
+  } else if (matching_strategy == MatchingStrategy::MULTI_INDEX_HASHING) {
+    matcher.reset(new MultiIndexHashingFeatureMatcher(options));
   } else {
     LOG(FATAL) << "Invalid matching strategy specified.";
   }
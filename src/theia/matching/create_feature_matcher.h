@@ -45,10 +45,15 @@ struct FeatureMatcherOptions;
 enum class MatchingStrategy {
   BRUTE_FORCE = 0,
   CASCADE_HASHING = 1,
+  KD_TREE = 2,
+  BRUTE_FORCE_HAMMING = 3,
+  MULTI_INDEX_HASHING = 4,
 };
 
-// A factory method for creating an L2-based feature matcher (i.e. for float
-// descriptors).
+// A factory method for creating a feature matcher. BRUTE_FORCE_HAMMING and
+// MULTI_INDEX_HASHING match binary descriptors with the Hamming distance and
+// require FeatureMatcherOptions::descriptor_precision to be BINARY. All other
+// strategies are L2-based (i.e. for float descriptors).
 std::unique_ptr<FeatureMatcher> CreateFeatureMatcher(
     const MatchingStrategy& matching_strategy,
     const FeatureMatcherOptions& options);
@@ -0,0 +1,144 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/distance.h"
+
+#include <stdint.h>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+
+namespace theia {
+
+L2Uint8::DistanceType L2Uint8::operator()(const uint8_t* descriptor_a,
+                                          const uint8_t* descriptor_b,
+                                          const int num_dimensions) const {
+  int i = 0;
+  int distance = 0;
+#if defined(__AVX2__)
+  __m256i sum = _mm256_setzero_si256();
+  for (; i + 16 <= num_dimensions; i += 16) {
+    const __m256i a = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(descriptor_a + i)));
+    const __m256i b = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(descriptor_b + i)));
+    const __m256i difference = _mm256_sub_epi16(a, b);
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(difference, difference));
+  }
+  __m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                                 _mm256_extracti128_si256(sum, 1));
+  sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0x4e));
+  sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0xb1));
+  distance = _mm_cvtsi128_si32(sum128);
+#elif defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sum = _mm_setzero_si128();
+  for (; i + 16 <= num_dimensions; i += 16) {
+    const __m128i a =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(descriptor_a + i));
+    const __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(descriptor_b + i));
+    const __m128i difference_low = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero),
+                                                 _mm_unpacklo_epi8(b, zero));
+    const __m128i difference_high = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero),
+                                                  _mm_unpackhi_epi8(b, zero));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(difference_low, difference_low));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(difference_high, difference_high));
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  distance = _mm_cvtsi128_si32(sum);
+#endif
+  for (; i < num_dimensions; i++) {
+    const int difference = static_cast<int>(descriptor_a[i]) - descriptor_b[i];
+    distance += difference * difference;
+  }
+  return distance;
+}
+
+L2Float16::DistanceType L2Float16::operator()(const uint16_t* descriptor_a,
+                                              const uint16_t* descriptor_b,
+                                              const int num_dimensions) const {
+  int i = 0;
+  float distance = 0.0f;
+#if defined(__F16C__)
+  __m256 sum = _mm256_setzero_ps();
+  for (; i + 8 <= num_dimensions; i += 8) {
+    const __m256 a = _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(descriptor_a + i)));
+    const __m256 b = _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(descriptor_b + i)));
+    const __m256 difference = _mm256_sub_ps(a, b);
+    sum = _mm256_add_ps(sum, _mm256_mul_ps(difference, difference));
+  }
+  __m128 sum128 = _mm_add_ps(_mm256_castps256_ps128(sum),
+                             _mm256_extractf128_ps(sum, 1));
+  sum128 = _mm_add_ps(sum128, _mm_movehl_ps(sum128, sum128));
+  sum128 = _mm_add_ss(sum128, _mm_shuffle_ps(sum128, sum128, 0x55));
+  distance = _mm_cvtss_f32(sum128);
+#endif
+  for (; i < num_dimensions; i++) {
+    const float difference =
+        HalfToFloat(descriptor_a[i]) - HalfToFloat(descriptor_b[i]);
+    distance += difference * difference;
+  }
+  return distance;
+}
+
+Hamming::DistanceType Hamming::operator()(const uint8_t* descriptor_a,
+                                          const uint8_t* descriptor_b,
+                                          const int num_bytes) const {
+  int i = 0;
+  int distance = 0;
+  // The descriptors are not necessarily aligned (e.g. the rows of a 61 byte
+  // MLDB descriptor matrix), so the words are loaded with memcpy.
+  for (; i + 8 <= num_bytes; i += 8) {
+    uint64_t word_a, word_b;
+    std::memcpy(&word_a, descriptor_a + i, sizeof(word_a));
+    std::memcpy(&word_b, descriptor_b + i, sizeof(word_b));
+    distance += __builtin_popcountll(word_a ^ word_b);
+  }
+  for (; i < num_bytes; i++) {
+    distance += __builtin_popcount(descriptor_a[i] ^ descriptor_b[i]);
+  }
+  return distance;
+}
+
+}  // namespace theia
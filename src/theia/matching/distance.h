@@ -37,10 +37,13 @@
 
 #include <Eigen/Core>
 #include <glog/logging.h>
+#include <stdint.h>
 
 namespace theia {
 // This file includes all of the distance metrics that are used:
-// L2 distance for euclidean features.
+// L2 distance for euclidean features, L2 distances for euclidean features that
+// are stored with reduced precision (see QuantizedDescriptorMatrix), and the
+// Hamming distance for binary features.
 
 // Squared Euclidean distance functor. We let Eigen handle the SSE optimization.
 // NOTE: This assumes that each vector has a unit norm:
@@ -56,6 +59,42 @@ struct L2 {
   }
 };
 
+// Squared Euclidean distance between descriptors stored as UINT8. The distance
+// is in units of the quantized values, i.e. it must be divided by the square of
+// kUint8DescriptorScale to obtain the distance between the float descriptors.
+// The distance is computed with SSE2 or AVX2 instructions when available.
+struct L2Uint8 {
+  typedef int DistanceType;
+  typedef const uint8_t* DescriptorType;
+
+  DistanceType operator()(const uint8_t* descriptor_a,
+                          const uint8_t* descriptor_b,
+                          const int num_dimensions) const;
+};
+
+// Squared Euclidean distance between descriptors stored as half precision
+// floats. The distance is computed with F16C instructions when available.
+struct L2Float16 {
+  typedef float DistanceType;
+  typedef const uint16_t* DescriptorType;
+
+  DistanceType operator()(const uint16_t* descriptor_a,
+                          const uint16_t* descriptor_b,
+                          const int num_dimensions) const;
+};
+
+// Hamming distance between binary descriptors whose bits are packed into
+// num_bytes bytes (see DescriptorPrecision::BINARY). The bits are counted 64 at
+// a time with the popcount instruction when it is available.
+struct Hamming {
+  typedef int DistanceType;
+  typedef const uint8_t* DescriptorType;
+
+  DistanceType operator()(const uint8_t* descriptor_a,
+                          const uint8_t* descriptor_b,
+                          const int num_bytes) const;
+};
+
 }  // namespace theia
 
 #endif  // THEIA_MATCHING_DISTANCE_H_
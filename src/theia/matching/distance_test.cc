@@ -36,8 +36,10 @@
 #include <glog/logging.h>
 #include <bitset>
 #include <string>
+#include <vector>
 #include "gtest/gtest.h"
 
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
 #include "theia/util/random.h"
 #include "theia/matching/distance.h"
 
@@ -76,5 +78,72 @@ TEST(L2Distance, KnownDistance) {
   }
 }
 
+// Dimensions that are not a multiple of the SIMD width test the scalar tail.
+TEST(L2Uint8Distance, KnownDistance) {
+  const int kDimensions[] = { 1, 15, 64, 128, 131 };
+  for (const int num_dimensions : kDimensions) {
+    std::vector<uint8_t> descriptor1(num_dimensions);
+    std::vector<uint8_t> descriptor2(num_dimensions);
+    for (int n = 0; n < kNumTrials; n++) {
+      int expected_distance = 0;
+      for (int i = 0; i < num_dimensions; i++) {
+        descriptor1[i] = static_cast<uint8_t>(rng.RandInt(0, 255));
+        descriptor2[i] = static_cast<uint8_t>(rng.RandInt(0, 255));
+        const int diff = descriptor1[i] - descriptor2[i];
+        expected_distance += diff * diff;
+      }
+      L2Uint8 l2_dist;
+      ASSERT_EQ(
+          l2_dist(descriptor1.data(), descriptor2.data(), num_dimensions),
+          expected_distance);
+    }
+  }
+}
+
+TEST(L2Float16Distance, KnownDistance) {
+  const int kDimensions[] = { 1, 15, 64, 128, 131 };
+  for (const int num_dimensions : kDimensions) {
+    std::vector<uint16_t> descriptor1(num_dimensions);
+    std::vector<uint16_t> descriptor2(num_dimensions);
+    for (int n = 0; n < kNumTrials; n++) {
+      double expected_distance = 0;
+      for (int i = 0; i < num_dimensions; i++) {
+        descriptor1[i] = FloatToHalf(rng.RandFloat(-1.0f, 1.0f));
+        descriptor2[i] = FloatToHalf(rng.RandFloat(-1.0f, 1.0f));
+        const double diff =
+            HalfToFloat(descriptor1[i]) - HalfToFloat(descriptor2[i]);
+        expected_distance += diff * diff;
+      }
+      L2Float16 l2_dist;
+      ASSERT_NEAR(
+          l2_dist(descriptor1.data(), descriptor2.data(), num_dimensions),
+          expected_distance,
+          1e-5 * num_dimensions);
+    }
+  }
+}
+
+// Sizes that are not a multiple of 8 bytes test the byte-wise tail. 61 bytes is
+// the size of an AKAZE MLDB descriptor.
+TEST(HammingDistance, KnownDistance) {
+  const int kNumBytes[] = { 1, 7, 32, 61, 64 };
+  for (const int num_bytes : kNumBytes) {
+    std::vector<uint8_t> descriptor1(num_bytes);
+    std::vector<uint8_t> descriptor2(num_bytes);
+    for (int n = 0; n < kNumTrials; n++) {
+      int expected_distance = 0;
+      for (int i = 0; i < num_bytes; i++) {
+        descriptor1[i] = static_cast<uint8_t>(rng.RandInt(0, 255));
+        descriptor2[i] = static_cast<uint8_t>(rng.RandInt(0, 255));
+        expected_distance +=
+            std::bitset<8>(descriptor1[i] ^ descriptor2[i]).count();
+      }
+      Hamming hamming_dist;
+      ASSERT_EQ(hamming_dist(descriptor1.data(), descriptor2.data(), num_bytes),
+                expected_distance);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace theia
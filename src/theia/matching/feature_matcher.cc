@@ -37,33 +37,73 @@
 #include <glog/logging.h>
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iomanip>
 #include <limits>
 #include <memory>
 #include <mutex>  // NOLINT
+#include <sstream>  // NOLINT
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 #include "theia/io/read_keypoints_and_descriptors.h"
+#include "theia/io/read_vocabulary_tree.h"
 #include "theia/io/write_keypoints_and_descriptors.h"
+#include "theia/io/write_vocabulary_tree.h"
 #include "theia/matching/feature_correspondence.h"
 #include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/feature_matcher_utils.h"
+#include "theia/matching/feature_prefetcher.h"
 #include "theia/matching/image_pair_match.h"
+#include "theia/matching/inverted_file.h"
 #include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/matching/matching_journal.h"
+#include "theia/matching/vocabulary_tree.h"
 #include "theia/sfm/camera_intrinsics_prior.h"
 #include "theia/sfm/two_view_match_geometric_verification.h"
+#include "theia/util/concurrent_lru_cache.h"
 #include "theia/util/filesystem.h"
-#include "theia/util/lru_cache.h"
 #include "theia/util/map_util.h"
+#include "theia/util/random.h"
 #include "theia/util/threadpool.h"
+#include "theia/util/timer.h"
 #include "theia/util/util.h"
+#include "theia/util/work_stealing_thread_pool.h"
 
 namespace theia {
 
+namespace {
+
+// The number of completed image pairs that each worker collects before it
+// writes them to the matching journal. At most this many pairs per worker are
+// matched again if matching is interrupted.
+static const int kMatchingJournalBatchSize = 64;
+
+// Returns the number of bytes used by the features of an image. Descriptors
+// that are referenced in a packed feature store are not counted since they are
+// held in memory (and evicted) by the operating system.
+size_t NumBytesOfFeatures(
+    const std::shared_ptr<KeypointsAndDescriptors>& features) {
+  return features->keypoints.size() * sizeof(features->keypoints[0]) +
+         features->descriptors.size() * sizeof(features->descriptors(0, 0)) +
+         features->quantized_descriptors.NumBytes();
+}
+
+}  // namespace
+
 FeatureMatcher::FeatureMatcher(const FeatureMatcherOptions& options)
-    : options_(options) {
+    : options_(options),
+      num_bytes_read_(0),
+      num_preemptively_rejected_pairs_(0),
+      num_unmatched_pairs_(0),
+      num_unverified_pairs_(0),
+      num_pairs_without_features_(0) {
   if (options_.match_out_of_core) {
     CHECK_GT(options_.cache_capacity, 2)
         << "The cache capacity must be greater than 2 in order to perform out "
@@ -80,6 +120,14 @@ FeatureMatcher::FeatureMatcher(const FeatureMatcherOptions& options)
     // If we want to perform all-in-memory matching then set the cache size to
     // the maximum.
     options_.cache_capacity = std::numeric_limits<int>::max();
+    options_.cache_capacity_in_bytes = std::numeric_limits<size_t>::max();
+  }
+
+  if (!options_.packed_features_file.empty()) {
+    packed_feature_store_.reset(new PackedFeatureStore);
+    CHECK(packed_feature_store_->Open(options_.packed_features_file))
+        << "Could not open the packed feature store "
+        << options_.packed_features_file;
   }
 
   // Because the function that defines how the cache fetches features from disk
@@ -95,18 +143,39 @@ FeatureMatcher::FeatureMatcher(const FeatureMatcherOptions& options)
   // to retreive files from disk, it will only do so if
   // options_.match_out_of_core is set to true.
   keypoints_and_descriptors_cache_.reset(new KeypointAndDescriptorCache(
-      fetch_features_from_cache, options_.cache_capacity));
+      fetch_features_from_cache, NumBytesOfFeatures, GetCacheOptions()));
+}
+
+ConcurrentLRUCacheOptions FeatureMatcher::GetCacheOptions() const {
+  ConcurrentLRUCacheOptions cache_options;
+  cache_options.max_cache_entries = options_.cache_capacity;
+  cache_options.max_cache_size = options_.cache_capacity_in_bytes;
+  // Each shard holds an equal part of the cache capacity, so the shards must
+  // be large enough for the hashing of the image names to spread the images
+  // evenly across them.
+  if (options_.match_out_of_core) {
+    cache_options.num_shards =
+        std::min(16, std::max(1, options_.cache_capacity / 32));
+  } else {
+    cache_options.num_shards = std::max(1, options_.num_threads);
+  }
+  return cache_options;
 }
 
 void FeatureMatcher::AddImage(const std::string& image_name,
                               const std::vector<Keypoint>& keypoints,
-                              const std::vector<Eigen::VectorXf>& descriptors) {
+                              const DescriptorMatrix& descriptors) {
+  CHECK_EQ(keypoints.size(), descriptors.rows())
+      << "The number of keypoints and descriptors must be the same.";
   image_names_.push_back(image_name);
 
   // Write the features file to disk.
   const std::string features_file = FeatureFilenameFromImage(image_name);
   if (options_.match_out_of_core) {
-    CHECK(WriteKeypointsAndDescriptors(features_file, keypoints, descriptors))
+    CHECK(WriteKeypointsAndDescriptors(features_file,
+                                       keypoints,
+                                       descriptors,
+                                       options_.descriptor_precision))
         << "Could not read features for image " << image_name << " from file "
         << features_file;
   }
@@ -116,19 +185,42 @@ void FeatureMatcher::AddImage(const std::string& image_name,
       new KeypointsAndDescriptors);
   keypoints_and_descriptors->image_name = image_name;
   keypoints_and_descriptors->keypoints = keypoints;
-  keypoints_and_descriptors->descriptors = descriptors;
-  keypoints_and_descriptors_cache_->Insert(features_file,
+  if (options_.descriptor_precision == DescriptorPrecision::FLOAT32) {
+    keypoints_and_descriptors->descriptors = descriptors;
+  } else {
+    keypoints_and_descriptors->quantized_descriptors.Quantize(
+        descriptors, options_.descriptor_precision);
+  }
+  keypoints_and_descriptors_cache_->Insert(image_name,
                                            keypoints_and_descriptors);
 }
 
 void FeatureMatcher::AddImage(const std::string& image_name,
                               const std::vector<Keypoint>& keypoints,
-                              const std::vector<Eigen::VectorXf>& descriptors,
+                              const DescriptorMatrix& descriptors,
                               const CameraIntrinsicsPrior& intrinsics) {
   AddImage(image_name, keypoints, descriptors);
+  std::lock_guard<std::mutex> lock(intrinsics_mutex_);
   intrinsics_[image_name] = intrinsics;
 }
 
+void FeatureMatcher::AddImage(const std::string& image_name,
+                              const std::vector<Keypoint>& keypoints,
+                              const std::vector<Eigen::VectorXf>& descriptors) {
+  DescriptorMatrix descriptor_matrix;
+  DescriptorsToMatrix(descriptors, &descriptor_matrix);
+  AddImage(image_name, keypoints, descriptor_matrix);
+}
+
+void FeatureMatcher::AddImage(const std::string& image_name,
+                              const std::vector<Keypoint>& keypoints,
+                              const std::vector<Eigen::VectorXf>& descriptors,
+                              const CameraIntrinsicsPrior& intrinsics) {
+  DescriptorMatrix descriptor_matrix;
+  DescriptorsToMatrix(descriptors, &descriptor_matrix);
+  AddImage(image_name, keypoints, descriptor_matrix, intrinsics);
+}
+
 void FeatureMatcher::AddImage(const std::string& image_name) {
   image_names_.push_back(image_name);
 }
@@ -136,6 +228,7 @@ void FeatureMatcher::AddImage(const std::string& image_name) {
 void FeatureMatcher::AddImage(const std::string& image_name,
                               const CameraIntrinsicsPrior& intrinsics) {
   image_names_.push_back(image_name);
+  std::lock_guard<std::mutex> lock(intrinsics_mutex_);
   intrinsics_[image_name] = intrinsics;
 }
 
@@ -146,6 +239,7 @@ void FeatureMatcher::AddImages(
   image_names_.reserve(image_names.size() + image_names_.size());
   image_names_.insert(
       image_names_.end(), image_names.begin(), image_names.end());
+  std::lock_guard<std::mutex> lock(intrinsics_mutex_);
   for (int i = 0; i < image_names.size(); ++i) {
     intrinsics_[image_names[i]] = intrinsics[i];
   }
@@ -162,138 +256,664 @@ std::string FeatureMatcher::FeatureFilenameFromImage(const std::string& image) {
 
 std::shared_ptr<KeypointsAndDescriptors>
 FeatureMatcher::FetchKeypointsAndDescriptorsFromDisk(
-    const std::string& features_file) {
+    const std::string& image_name) {
   std::shared_ptr<KeypointsAndDescriptors> keypoints_and_descriptors(
       new KeypointsAndDescriptors);
+  keypoints_and_descriptors->image_name = image_name;
+
+  // Reference the descriptors in the packed feature store if it contains the
+  // image. Only the keypoints are copied.
+  if (packed_feature_store_ != nullptr &&
+      packed_feature_store_->GetFeaturesView(
+          image_name, &keypoints_and_descriptors->packed_features)) {
+    keypoints_and_descriptors->packed_features.GetKeypoints(
+        &keypoints_and_descriptors->keypoints);
+    return keypoints_and_descriptors;
+  }
 
   // Read in the features file from disk.
+  const std::string features_file = FeatureFilenameFromImage(image_name);
+  num_bytes_read_ += FileSize(features_file);
+  if (options_.descriptor_precision == DescriptorPrecision::FLOAT32) {
+    CHECK(ReadKeypointsAndDescriptors(features_file,
+                                      &keypoints_and_descriptors->keypoints,
+                                      &keypoints_and_descriptors->descriptors))
+        << "Could not read features from file " << features_file;
+    return keypoints_and_descriptors;
+  }
+
+  QuantizedDescriptorMatrix& quantized_descriptors =
+      keypoints_and_descriptors->quantized_descriptors;
   CHECK(ReadKeypointsAndDescriptors(features_file,
                                     &keypoints_and_descriptors->keypoints,
-                                    &keypoints_and_descriptors->descriptors))
+                                    &quantized_descriptors))
       << "Could not read features from file " << features_file;
+
+  // The features file may have been written with a different precision.
+  if (quantized_descriptors.precision() != options_.descriptor_precision) {
+    DescriptorMatrix descriptors;
+    quantized_descriptors.Dequantize(&descriptors);
+    quantized_descriptors.Quantize(descriptors, options_.descriptor_precision);
+  }
   return keypoints_and_descriptors;
 }
 
+void FeatureMatcher::PrefetchImage(const std::string& image_name) {
+  keypoints_and_descriptors_cache_->Prefetch(image_name);
+}
+
+std::shared_ptr<KeypointsAndDescriptors>
+FeatureMatcher::GetKeypointsAndDescriptors(const std::string& image_name) {
+  return keypoints_and_descriptors_cache_->Fetch(image_name);
+}
+
+bool FeatureMatcher::HasPackedFeatures(const std::string& image_name) const {
+  return packed_feature_store_ != nullptr &&
+         packed_feature_store_->HasImage(image_name);
+}
+
 void FeatureMatcher::SetImagePairsToMatch(
     const std::vector<std::pair<std::string, std::string> >& pairs_to_match) {
   pairs_to_match_ = pairs_to_match;
 }
 
+void FeatureMatcher::TrainVocabularyTree(VocabularyTree* vocabulary_tree) {
+  // Sample the same number of descriptors from each image so that the
+  // vocabulary represents all images.
+  const int num_images = image_names_.size();
+  const int num_descriptors_per_image = std::max(
+      1, options_.vocabulary_tree_num_training_descriptors / num_images);
+  std::vector<DescriptorMatrix> sampled_descriptors(num_images);
+  std::unique_ptr<ThreadPool> pool(
+      new ThreadPool(std::min(options_.num_threads, num_images)));
+  for (int i = 0; i < num_images; i++) {
+    pool->Add([this, i, num_descriptors_per_image, &sampled_descriptors]() {
+      DescriptorMatrix descriptors;
+      GetFloatDescriptors(
+          *keypoints_and_descriptors_cache_->Fetch(image_names_[i]),
+          &descriptors);
+
+      // Choose the descriptors with a partial Fisher-Yates shuffle. Each image
+      // has its own seed so that the samples do not depend on the order in
+      // which the threads process the images.
+      const int num_descriptors = descriptors.rows();
+      const int num_samples =
+          std::min(num_descriptors, num_descriptors_per_image);
+      RandomNumberGenerator rng(options_.vocabulary_tree_options.seed + i);
+      std::vector<int> permutation(num_descriptors);
+      for (int j = 0; j < num_descriptors; j++) {
+        permutation[j] = j;
+      }
+      sampled_descriptors[i].resize(num_samples, descriptors.cols());
+      for (int j = 0; j < num_samples; j++) {
+        std::swap(permutation[j],
+                  permutation[rng.RandInt(j, num_descriptors - 1)]);
+        sampled_descriptors[i].row(j) = descriptors.row(permutation[j]);
+      }
+    });
+  }
+  // Wait for all images to be sampled.
+  pool.reset(nullptr);
+
+  int num_training_descriptors = 0;
+  int descriptor_dimension = 0;
+  for (const DescriptorMatrix& descriptors : sampled_descriptors) {
+    num_training_descriptors += descriptors.rows();
+    if (descriptors.rows() > 0) {
+      descriptor_dimension = descriptors.cols();
+    }
+  }
+  DescriptorMatrix training_descriptors(num_training_descriptors,
+                                        descriptor_dimension);
+  int row = 0;
+  for (const DescriptorMatrix& descriptors : sampled_descriptors) {
+    if (descriptors.rows() > 0) {
+      training_descriptors.middleRows(row, descriptors.rows()) = descriptors;
+      row += descriptors.rows();
+    }
+  }
+  sampled_descriptors.clear();
+
+  VocabularyTree::Options vocabulary_tree_options =
+      options_.vocabulary_tree_options;
+  vocabulary_tree_options.num_threads = options_.num_threads;
+  CHECK(vocabulary_tree->Train(vocabulary_tree_options, training_descriptors))
+      << "Could not train the vocabulary tree for image retrieval.";
+  LOG(INFO) << "Trained a vocabulary tree with " << vocabulary_tree->NumWords()
+            << " visual words on " << num_training_descriptors
+            << " descriptors.";
+}
+
+void FeatureMatcher::RetrieveImagePairsToMatch(
+    std::vector<std::pair<std::string, std::string> >* image_pairs) {
+  CHECK_NOTNULL(image_pairs)->clear();
+  CHECK_GT(options_.image_retrieval_num_neighbors, 0);
+  const int num_images = image_names_.size();
+  if (num_images < 2) {
+    return;
+  }
+
+  // All shards must retrieve the same image pairs, so they must use the same
+  // vocabulary tree. It is trained and written by shard 0 only, and the other
+  // shards read it once it has been written.
+  if (options_.num_shards > 1) {
+    CHECK(!options_.vocabulary_tree_file.empty())
+        << "A vocabulary tree file must be given to retrieve the image pairs "
+           "of a shard.";
+    CHECK(options_.shard_index == 0 ||
+          FileExists(options_.vocabulary_tree_file))
+        << "The vocabulary tree " << options_.vocabulary_tree_file
+        << " does not exist. It is trained by shard 0, which must be run "
+           "before the other shards.";
+  }
+
+  // Load the vocabulary tree if it has been trained before.
+  VocabularyTree vocabulary_tree;
+  if (!options_.vocabulary_tree_file.empty() &&
+      FileExists(options_.vocabulary_tree_file)) {
+    CHECK(ReadVocabularyTree(options_.vocabulary_tree_file, &vocabulary_tree))
+        << "Could not read the vocabulary tree from "
+        << options_.vocabulary_tree_file;
+    LOG(INFO) << "Loaded a vocabulary tree with " << vocabulary_tree.NumWords()
+              << " visual words from " << options_.vocabulary_tree_file;
+  } else {
+    TrainVocabularyTree(&vocabulary_tree);
+    if (!options_.vocabulary_tree_file.empty() &&
+        !WriteVocabularyTree(options_.vocabulary_tree_file, vocabulary_tree)) {
+      LOG(ERROR) << "Could not write the vocabulary tree to "
+                 << options_.vocabulary_tree_file;
+    }
+  }
+
+  // Quantize the descriptors of each image to visual words.
+  InvertedFile inverted_file(vocabulary_tree.NumWords());
+  std::unique_ptr<ThreadPool> pool(
+      new ThreadPool(std::min(options_.num_threads, num_images)));
+  for (int i = 0; i < num_images; i++) {
+    pool->Add([this, i, &vocabulary_tree, &inverted_file]() {
+      DescriptorMatrix descriptors;
+      GetFloatDescriptors(
+          *keypoints_and_descriptors_cache_->Fetch(image_names_[i]),
+          &descriptors);
+      std::vector<int> words;
+      if (descriptors.rows() > 0) {
+        CHECK_EQ(descriptors.cols(), vocabulary_tree.DescriptorDimension())
+            << "The descriptors of image " << image_names_[i]
+            << " do not have the dimension of the vocabulary tree.";
+        vocabulary_tree.Quantize(descriptors, &words);
+      }
+      inverted_file.AddImage(image_names_[i], words);
+    });
+  }
+  // Wait for all images to be added.
+  pool.reset(nullptr);
+
+  inverted_file.BuildIndex();
+  inverted_file.FindImagePairsToMatch(options_.image_retrieval_num_neighbors,
+                                      options_.num_threads,
+                                      image_pairs);
+  LOG(INFO) << "Image retrieval selected " << image_pairs->size()
+            << " image pairs to match out of "
+            << static_cast<int64_t>(num_images) * (num_images - 1) / 2
+            << " possible image pairs.";
+}
+
 void FeatureMatcher::MatchImages(std::vector<ImagePairMatch>* matches) {
-  // If SetImagePairsToMatch has not been called, match all image-to-image
-  // pairs.
-  if (pairs_to_match_.size() == 0) {
+  CHECK_NOTNULL(matches);
+  MatchImages([matches](const ImagePairMatch& match) {
+    matches->emplace_back(match);
+  });
+}
+
+void FeatureMatcher::MatchImages(const ImagePairMatchCallback& callback) {
+  MatchImagePairs(image_names_, AddImageFunction(), callback);
+}
+
+void FeatureMatcher::AddAndMatchImages(
+    const std::vector<std::string>& image_names,
+    const AddImageFunction& add_image,
+    const ImagePairMatchCallback& callback) {
+  CHECK(add_image) << "A function to add the images must be given.";
+  MatchImagePairs(image_names, add_image, callback);
+}
+
+void FeatureMatcher::MatchImagePairs(
+    const std::vector<std::string>& image_names,
+    const AddImageFunction& add_image,
+    const ImagePairMatchCallback& callback) {
+  // If SetImagePairsToMatch has not been called, match the image pairs found
+  // with image retrieval or all image-to-image pairs. Image retrieval needs the
+  // features of all images, so it is not possible if the images are added
+  // while matching.
+  const bool add_images_while_matching = static_cast<bool>(add_image);
+  LOG_IF(WARNING,
+         add_images_while_matching && pairs_to_match_.size() == 0 &&
+             options_.image_retrieval_num_neighbors > 0)
+      << "Image retrieval is not possible when the images are added while "
+         "matching, so all image pairs are matched.";
+  if (pairs_to_match_.size() == 0 && !add_images_while_matching &&
+      options_.image_retrieval_num_neighbors > 0) {
+    RetrieveImagePairsToMatch(&pairs_to_match_);
+  } else if (pairs_to_match_.size() == 0) {
     // Compute the total number of potential matches.
     const int num_pairs_to_match =
-        image_names_.size() * (image_names_.size() - 1) / 2;
-    matches->reserve(num_pairs_to_match);
-
+        image_names.size() * (image_names.size() - 1) / 2;
     pairs_to_match_.reserve(num_pairs_to_match);
-    // Create a list of all possible image pairs.
-    for (int i = 0; i < image_names_.size(); i++) {
-      for (int j = i + 1; j < image_names_.size(); j++) {
-        pairs_to_match_.emplace_back(image_names_[i], image_names_[j]);
+    // Create a list of all possible image pairs. The images are sorted by name
+    // since the order in which they are added may differ between runs (e.g.
+    // when the features are extracted by several threads), so that the list of
+    // pairs that the matching journal refers to does not change.
+    std::vector<std::string> sorted_image_names = image_names;
+    std::sort(sorted_image_names.begin(), sorted_image_names.end());
+    for (int i = 0; i < sorted_image_names.size(); i++) {
+      for (int j = i + 1; j < sorted_image_names.size(); j++) {
+        pairs_to_match_.emplace_back(sorted_image_names[i],
+                                     sorted_image_names[j]);
+      }
+    }
+  }
+
+  // Only match the shard of the image pairs that this process is responsible
+  // for when matching is distributed over several processes.
+  if (options_.num_shards > 1) {
+    const int num_pairs = pairs_to_match_.size();
+    SelectShardOfImagePairs(image_names,
+                            options_.num_shards,
+                            options_.shard_index,
+                            options_.shard_strategy,
+                            &pairs_to_match_);
+    LOG(INFO) << "Matching " << pairs_to_match_.size() << " of " << num_pairs
+              << " image pairs in shard " << options_.shard_index << " of "
+              << options_.num_shards << ".";
+  }
+
+  // If matching is resumed, skip the pairs that were completed before. The
+  // journal refers to the pairs by their index in the list of all pairs, which
+  // does not depend on the order in which the pairs are matched below.
+  std::unique_ptr<MatchingJournal> journal;
+  std::vector<int> journal_pair_indices;
+  if (!options_.matching_journal_file.empty()) {
+    journal.reset(new MatchingJournal());
+    CHECK(journal->Open(options_.matching_journal_file, pairs_to_match_))
+        << "Could not open the matching journal "
+        << options_.matching_journal_file;
+    std::vector<std::pair<std::string, std::string> > remaining_pairs;
+    for (int i = 0; i < pairs_to_match_.size(); i++) {
+      if (!journal->IsCompleted(i)) {
+        remaining_pairs.emplace_back(pairs_to_match_[i]);
+        journal_pair_indices.emplace_back(i);
+      }
+    }
+    LOG(INFO) << "Skipping " << journal->NumCompletedPairs() << " of "
+              << pairs_to_match_.size()
+              << " image pairs that were already matched according to the "
+                 "matching journal "
+              << options_.matching_journal_file;
+    pairs_to_match_.swap(remaining_pairs);
+  }
+  if (pairs_to_match_.empty()) {
+    LOG(INFO) << "There are no image pairs to match.";
+    if (add_images_while_matching) {
+      for (const std::string& image_name : image_names) {
+        LOG_IF(ERROR, !add_image(image_name))
+            << "Could not add image " << image_name << " to the matcher.";
       }
     }
+    return;
   }
 
-  // Add workers for matching. It is more efficient to let each thread compute
-  // multiple matches at a time than add each matching task to the pool. This is
-  // sort of like OpenMP's dynamic schedule in that it is able to balance
-  // threads fairly efficiently.
+  // Each image pair is matched by its own task, and a pair that passes feature
+  // matching is verified by a second task. The tasks run on a work stealing
+  // pool: a worker runs the verification of the pair it matched next unless an
+  // idle worker steals it, so the verification of a pair overlaps with the
+  // matching of other pairs and no worker sits idle while slow pairs finish.
   const int num_matches = pairs_to_match_.size();
+  std::atomic<int> num_matched_pairs(0);
+  num_preemptively_rejected_pairs_ = 0;
+  num_unmatched_pairs_ = 0;
+  num_unverified_pairs_ = 0;
+  num_pairs_without_features_ = 0;
   const int num_threads =
       std::min(options_.num_threads, static_cast<int>(num_matches));
-  std::unique_ptr<ThreadPool> pool(new ThreadPool(num_threads));
-  const int interval_step =
-      std::min(this->kMaxThreadingStepSize_, num_matches / num_threads);
-  for (int i = 0; i < num_matches; i += interval_step) {
-    const int end_interval = std::min(num_matches, i + interval_step);
-    pool->Add(&FeatureMatcher::MatchAndVerifyImagePairs,
-              this,
-              i,
-              end_interval,
-              matches);
+  std::unique_ptr<WorkStealingThreadPool> pool(
+      new WorkStealingThreadPool(num_threads));
+
+  // Records a pair in the journal once its match (if any) has been passed to
+  // the callback. Each worker collects its completed pairs and writes them to
+  // the journal in batches, so the journal is not locked and flushed for every
+  // pair. The remaining pairs are written once all tasks have finished.
+  std::vector<std::vector<int> > completed_pairs_of_workers(num_threads);
+  const std::function<void(int)> record_pair =
+      [&journal, &journal_pair_indices, &pool, &completed_pairs_of_workers](
+          const int pair_index) {
+        if (journal == nullptr) {
+          return;
+        }
+        std::vector<int>& completed_pairs =
+            completed_pairs_of_workers[pool->WorkerIndexOfThisThread()];
+        completed_pairs.emplace_back(journal_pair_indices[pair_index]);
+        if (completed_pairs.size() >= kMatchingJournalBatchSize) {
+          CHECK(journal->MarkCompleted(completed_pairs));
+          completed_pairs.clear();
+        }
+      };
+  typedef std::shared_ptr<PutativeImagePairMatch> PutativeImagePairMatchPtr;
+  const std::function<void(int, PutativeImagePairMatchPtr)> verify_pair =
+      [this, &callback, &num_matched_pairs, &record_pair](
+          const int pair_index, PutativeImagePairMatchPtr putative_match) {
+        ImagePairMatch image_pair_match;
+        if (VerifyImagePair(pair_index, *putative_match, &image_pair_match)) {
+          ++num_matched_pairs;
+          std::lock_guard<std::mutex> lock(mutex_);
+          callback(image_pair_match);
+        }
+        record_pair(pair_index);
+      };
+  const std::function<void(int)> match_pair =
+      [this, &pool, &verify_pair, &record_pair](const int pair_index) {
+        PutativeImagePairMatchPtr putative_match(new PutativeImagePairMatch);
+        if (!MatchFeaturesOfImagePair(pair_index, putative_match.get())) {
+          record_pair(pair_index);
+          return;
+        }
+        pool->Add(std::bind(verify_pair, pair_index, putative_match));
+      };
+
+  Timer timer;
+  if (add_images_while_matching) {
+    // Each image is added by its own task, and each image pair is matched as
+    // soon as the task that adds the second of its images finishes. The pairs
+    // are added to the queue of that worker, which runs them before adding
+    // another image, so the features of an image are matched while they are
+    // still in the cache.
+    std::unordered_map<std::string, int> image_indices;
+    for (int i = 0; i < image_names.size(); i++) {
+      image_indices.emplace(image_names[i], i);
+    }
+    std::vector<std::vector<int> > pairs_of_images(image_names.size());
+    std::vector<std::pair<int, int> > image_indices_of_pairs(num_matches);
+    std::unique_ptr<std::atomic<int>[]> num_images_to_add(
+        new std::atomic<int>[num_matches]);
+    for (int i = 0; i < num_matches; i++) {
+      const int* image1_index = FindOrNull(image_indices,
+                                           pairs_to_match_[i].first);
+      const int* image2_index = FindOrNull(image_indices,
+                                           pairs_to_match_[i].second);
+      if (image1_index == nullptr || image2_index == nullptr) {
+        LOG(WARNING) << "Cannot match images " << pairs_to_match_[i].first
+                     << " and " << pairs_to_match_[i].second
+                     << " since an image is not added.";
+        num_images_to_add[i] = -1;
+        ++num_pairs_without_features_;
+        continue;
+      }
+      image_indices_of_pairs[i] = std::make_pair(*image1_index, *image2_index);
+      num_images_to_add[i] = 2;
+      pairs_of_images[*image1_index].emplace_back(i);
+      pairs_of_images[*image2_index].emplace_back(i);
+    }
+
+    // Each flag is written by the task that adds the image before it updates
+    // the pairs of the image, so the flags of both images are visible to the
+    // task that updates a pair last.
+    std::vector<char> image_was_added(image_names.size(), 0);
+    for (int i = 0; i < image_names.size(); i++) {
+      pool->Add([this,
+                 i,
+                 &image_names,
+                 &add_image,
+                 &pool,
+                 &match_pair,
+                 &pairs_of_images,
+                 &image_indices_of_pairs,
+                 &num_images_to_add,
+                 &image_was_added]() {
+        image_was_added[i] = add_image(image_names[i]);
+        LOG_IF(ERROR, !image_was_added[i])
+            << "Could not add image " << image_names[i] << " to the matcher.";
+        for (const int pair_index : pairs_of_images[i]) {
+          if (--num_images_to_add[pair_index] > 0) {
+            continue;
+          }
+          const std::pair<int, int>& image_indices_of_pair =
+              image_indices_of_pairs[pair_index];
+          if (image_was_added[image_indices_of_pair.first] &&
+              image_was_added[image_indices_of_pair.second]) {
+            pool->Add(std::bind(match_pair, pair_index));
+          } else {
+            ++num_pairs_without_features_;
+          }
+        }
+      });
+    }
+    pool->Wait();
+  } else if (options_.match_out_of_core) {
+    // Match the pairs in blocks that share images so that the features stay in
+    // the cache while they are needed. The blocks are started in order, and the
+    // pairs of a block are added to the queue of the worker that started it, so
+    // the workers only steal pairs of blocks whose features are in the cache.
+    // The threads work on consecutive blocks which share one group of images,
+    // so the groups are sized such that the shared group and the other group of
+    // each thread fit in the cache. Some slack is left since the shards of the
+    // cache do not fill up evenly.
+    const int usable_cache_capacity =
+        options_.cache_capacity - options_.cache_capacity / 4;
+    const int images_per_group =
+        std::max(1, usable_cache_capacity / (num_threads + 1));
+    std::vector<int> block_ends;
+    OrderImagePairsForCacheLocality(
+        image_names_,
+        images_per_group,
+        &pairs_to_match_,
+        &block_ends,
+        journal != nullptr ? &journal_pair_indices : nullptr);
+
+    // Read the features of the next blocks while the current blocks are
+    // matched. Each block adds about one group of new images to the cache, so
+    // the blocks that are read ahead fit in the slack left above.
+    std::unique_ptr<FeaturePrefetcher> prefetcher;
+    if (options_.prefetch_features) {
+      const int num_blocks_ahead = std::max(
+          1, (options_.cache_capacity - usable_cache_capacity) /
+                 images_per_group);
+      prefetcher.reset(new FeaturePrefetcher(
+          pairs_to_match_,
+          block_ends,
+          num_blocks_ahead,
+          std::bind(
+              &FeatureMatcher::PrefetchImage, this, std::placeholders::_1)));
+    }
+
+    int block_start = 0;
+    for (int i = 0; i < block_ends.size(); i++) {
+      const int block_end = block_ends[i];
+      FeaturePrefetcher* block_prefetcher = prefetcher.get();
+      pool->Add([block_prefetcher,
+                 i,
+                 block_start,
+                 block_end,
+                 &pool,
+                 &match_pair]() {
+        if (block_prefetcher != nullptr) {
+          block_prefetcher->NotifyBlockStarted(i);
+        }
+        // The pairs are added in reverse order since a worker runs the most
+        // recently added of its tasks first.
+        for (int j = block_end - 1; j >= block_start; j--) {
+          pool->Add(std::bind(match_pair, j));
+        }
+      });
+      block_start = block_end;
+    }
+    // Wait for all tasks to finish before stopping the prefetcher.
+    pool->Wait();
+  } else {
+    for (int i = 0; i < num_matches; i++) {
+      pool->Add(std::bind(match_pair, i));
+    }
+    pool->Wait();
   }
-  // Wait for all threads to finish.
+  LogWorkerUtilization(*pool, timer.ElapsedTimeInSeconds());
   pool.reset(nullptr);
+  if (journal != nullptr) {
+    for (const std::vector<int>& completed_pairs :
+         completed_pairs_of_workers) {
+      CHECK(journal->MarkCompleted(completed_pairs));
+    }
+  }
 
-  VLOG(1) << "Matched " << matches->size() << " image pairs out of "
+  VLOG(1) << "Matched " << num_matched_pairs.load() << " image pairs out of "
           << num_matches << " possible image pairs.";
+  LOG(INFO) << "Of " << num_matches << " image pairs, "
+            << num_preemptively_rejected_pairs_.load()
+            << " were rejected by preemptive matching, "
+            << num_unmatched_pairs_.load()
+            << " were rejected by feature matching, "
+            << num_unverified_pairs_.load()
+            << " were rejected by geometric verification, and "
+            << num_matched_pairs.load() << " were matched.";
+  LOG_IF(WARNING, num_pairs_without_features_ > 0)
+      << num_pairs_without_features_.load()
+      << " image pairs were not matched because an image could not be "
+         "added.";
+  if (options_.match_out_of_core) {
+    LOG(INFO) << "Out-of-core matching had "
+              << keypoints_and_descriptors_cache_->NumCacheMisses()
+              << " feature cache misses and "
+              << keypoints_and_descriptors_cache_->NumCacheHits()
+              << " cache hits, and read " << num_bytes_read_.load()
+              << " bytes from disk.";
+    if (options_.prefetch_features) {
+      const int num_prefetches =
+          keypoints_and_descriptors_cache_->NumPrefetches();
+      const int num_prefetch_hits =
+          keypoints_and_descriptors_cache_->NumPrefetchHits();
+      LOG(INFO) << "Prefetched the features of " << num_prefetches
+                << " images, of which " << num_prefetch_hits
+                << " were used for matching (prefetch hit rate: "
+                << (num_prefetches > 0
+                        ? 100.0 * num_prefetch_hits / num_prefetches
+                        : 0.0)
+                << "%).";
+    }
+  }
 }
 
-void FeatureMatcher::MatchAndVerifyImagePairs(
-    const int start_index,
-    const int end_index,
-    std::vector<ImagePairMatch>* matches) {
-  for (int i = start_index; i < end_index; i++) {
-    const std::string image1_name = pairs_to_match_[i].first;
-    const std::string image2_name = pairs_to_match_[i].second;
-
-    // Match the image pair. If the pair fails to match then continue to the
-    // next match.
-    ImagePairMatch image_pair_match;
-    image_pair_match.image1 = image1_name;
-    image_pair_match.image2 = image2_name;
-
-    // Get the keypoints and descriptors from the cache. By using a shared_ptr
-    // here we ensure that keypoints and descriptors will live in the cache as
-    // long as they are currently being used in a matching thread, so the cache
-    // will never evict these entries while they are still being used.
-    std::shared_ptr<KeypointsAndDescriptors> features1 =
-        keypoints_and_descriptors_cache_->Fetch(
-            FeatureFilenameFromImage(image1_name));
-    features1->image_name = image1_name;
-    std::shared_ptr<KeypointsAndDescriptors> features2 =
-        keypoints_and_descriptors_cache_->Fetch(
-            FeatureFilenameFromImage(image2_name));
-    features2->image_name = image2_name;
-
-    // Compute the visual matches from feature descriptors.
-    std::vector<IndexedFeatureMatch> putative_matches;
-    if (!MatchImagePair(*features1, *features2, &putative_matches)) {
-      VLOG(2)
-          << "Could not match a sufficient number of features between images "
-          << image1_name << " and " << image2_name;
-      continue;
+bool FeatureMatcher::MatchFeaturesOfImagePair(
+    const int pair_index, PutativeImagePairMatch* putative_match) {
+  const std::string& image1_name = pairs_to_match_[pair_index].first;
+  const std::string& image2_name = pairs_to_match_[pair_index].second;
+
+  // Get the keypoints and descriptors from the cache. By using a shared_ptr
+  // here we ensure that keypoints and descriptors will live in the cache as
+  // long as they are currently being used in a matching thread, so the cache
+  // will never evict these entries while they are still being used. The
+  // cached features are shared by all matching threads, so they are not
+  // modified here.
+  putative_match->features1 = GetKeypointsAndDescriptors(image1_name);
+  putative_match->features2 = GetKeypointsAndDescriptors(image2_name);
+  const KeypointsAndDescriptors& features1 = *putative_match->features1;
+  const KeypointsAndDescriptors& features2 = *putative_match->features2;
+
+  // Reject image pairs that are unlikely to overlap by matching only a few
+  // features of each image before all features are matched.
+  if (options_.perform_preemptive_matching) {
+    const int num_preemptive_matches =
+        CountPreemptiveMatches(features1,
+                               features2,
+                               options_.preemptive_matching_num_features,
+                               options_.lowes_ratio,
+                               MatchesBinaryDescriptors());
+    if (num_preemptive_matches < options_.preemptive_matching_min_num_matches) {
+      VLOG(2) << "Images " << image1_name << " and " << image2_name
+              << " were rejected by preemptive matching with "
+              << num_preemptive_matches << " preemptive matches.";
+      ++num_preemptively_rejected_pairs_;
+      return false;
     }
+  }
 
-    // Perform geometric verification if applicable.
-    if (options_.perform_geometric_verification) {
-      // If geometric verification fails, do not add the match to the output.
-      if (!GeometricVerification(
-              *features1, *features2, putative_matches, &image_pair_match)) {
-        VLOG(2) << "Geometric verification between images " << image1_name
-                << " and " << image2_name << " failed.";
-        continue;
-      }
-    } else {
-      // If no geometric verification is performed then the putative matches are
-      // output.
-      image_pair_match.correspondences.reserve(putative_matches.size());
-      for (int i = 0; i < putative_matches.size(); i++) {
-        const Keypoint& keypoint1 =
-            features1->keypoints[putative_matches[i].feature1_ind];
-        const Keypoint& keypoint2 =
-            features2->keypoints[putative_matches[i].feature2_ind];
-        image_pair_match.correspondences.emplace_back(
-            Feature(keypoint1.x(), keypoint1.y()),
-            Feature(keypoint2.x(), keypoint2.y()));
-      }
-    }
+  // Compute the visual matches from feature descriptors.
+  if (!MatchImagePair(
+          features1, features2, &putative_match->putative_matches)) {
+    VLOG(2)
+        << "Could not match a sufficient number of features between images "
+        << image1_name << " and " << image2_name;
+    ++num_unmatched_pairs_;
+    return false;
+  }
+  return true;
+}
 
-    // Log information about the matching results.
-    VLOG(1) << "Images " << image1_name << " and " << image2_name
-            << " were matched with " << image_pair_match.correspondences.size()
-            << " verified matches and "
-            << image_pair_match.twoview_info.num_homography_inliers
-            << " homography matches out of " << putative_matches.size()
-            << " putative matches.";
-    {
-      std::lock_guard<std::mutex> lock(mutex_);
-      matches->push_back(image_pair_match);
+bool FeatureMatcher::VerifyImagePair(
+    const int pair_index,
+    const PutativeImagePairMatch& putative_match,
+    ImagePairMatch* image_pair_match) {
+  const KeypointsAndDescriptors& features1 = *putative_match.features1;
+  const KeypointsAndDescriptors& features2 = *putative_match.features2;
+  const std::vector<IndexedFeatureMatch>& putative_matches =
+      putative_match.putative_matches;
+  image_pair_match->image1 = pairs_to_match_[pair_index].first;
+  image_pair_match->image2 = pairs_to_match_[pair_index].second;
+
+  // Perform geometric verification if applicable.
+  if (options_.perform_geometric_verification) {
+    // If geometric verification fails, do not add the match to the output.
+    if (!GeometricVerification(
+            features1, features2, putative_matches, image_pair_match)) {
+      VLOG(2) << "Geometric verification between images "
+              << image_pair_match->image1 << " and "
+              << image_pair_match->image2 << " failed.";
+      ++num_unverified_pairs_;
+      return false;
+    }
+  } else {
+    // If no geometric verification is performed then the putative matches are
+    // output.
+    image_pair_match->correspondences.reserve(putative_matches.size());
+    for (int i = 0; i < putative_matches.size(); i++) {
+      const Keypoint& keypoint1 =
+          features1.keypoints[putative_matches[i].feature1_ind];
+      const Keypoint& keypoint2 =
+          features2.keypoints[putative_matches[i].feature2_ind];
+      image_pair_match->correspondences.emplace_back(
+          Feature(keypoint1.x(), keypoint1.y()),
+          Feature(keypoint2.x(), keypoint2.y()));
     }
   }
+
+  // Log information about the matching results.
+  VLOG(1) << "Images " << image_pair_match->image1 << " and "
+          << image_pair_match->image2 << " were matched with "
+          << image_pair_match->correspondences.size()
+          << " verified matches and "
+          << image_pair_match->twoview_info.num_homography_inliers
+          << " homography matches out of " << putative_matches.size()
+          << " putative matches.";
+  return true;
+}
+
+void FeatureMatcher::LogWorkerUtilization(const WorkStealingThreadPool& pool,
+                                          const double elapsed_seconds) const {
+  const std::vector<WorkStealingThreadPool::WorkerStatistics> statistics =
+      pool.GetWorkerStatistics();
+  std::ostringstream utilization;
+  int num_tasks = 0;
+  int num_stolen_tasks = 0;
+  for (int i = 0; i < statistics.size(); i++) {
+    const double worker_utilization =
+        elapsed_seconds > 0.0
+            ? 100.0 * statistics[i].busy_time_in_seconds / elapsed_seconds
+            : 100.0;
+    utilization << (i > 0 ? ", " : "") << std::fixed << std::setprecision(1)
+                << worker_utilization << "%";
+    num_tasks += statistics[i].num_tasks;
+    num_stolen_tasks += statistics[i].num_stolen_tasks;
+  }
+  LOG(INFO) << "Matching took " << elapsed_seconds << " seconds with "
+            << statistics.size() << " threads (utilization per thread: "
+            << utilization.str() << "). " << num_stolen_tasks << " of "
+            << num_tasks << " tasks were stolen by idle threads.";
 }
 
 bool FeatureMatcher::GeometricVerification(
@@ -301,10 +921,14 @@ bool FeatureMatcher::GeometricVerification(
     const KeypointsAndDescriptors& features2,
     const std::vector<IndexedFeatureMatch>& putative_matches,
     ImagePairMatch* image_pair_match) {
-  const CameraIntrinsicsPrior intrinsics1 = FindWithDefault(
-      intrinsics_, features1.image_name, CameraIntrinsicsPrior());
-  const CameraIntrinsicsPrior intrinsics2 = FindWithDefault(
-      intrinsics_, features2.image_name, CameraIntrinsicsPrior());
+  CameraIntrinsicsPrior intrinsics1, intrinsics2;
+  {
+    std::lock_guard<std::mutex> lock(intrinsics_mutex_);
+    intrinsics1 = FindWithDefault(
+        intrinsics_, features1.image_name, CameraIntrinsicsPrior());
+    intrinsics2 = FindWithDefault(
+        intrinsics_, features2.image_name, CameraIntrinsicsPrior());
+  }
 
   TwoViewMatchGeometricVerification geometric_verification(
       options_.geometric_verification_options,
@@ -37,6 +37,8 @@
 
 #include <Eigen/Core>
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>  // NOLINT
 #include <string>
@@ -44,8 +46,11 @@
 #include <utility>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/io/packed_feature_store.h"
 #include "theia/matching/feature_matcher_options.h"
-#include "theia/util/lru_cache.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/util/concurrent_lru_cache.h"
 #include "theia/util/util.h"
 
 namespace theia {
@@ -54,6 +59,18 @@ struct CameraIntrinsicsPrior;
 struct ImagePairMatch;
 struct IndexedFeatureMatche;
 struct KeypointsAndDescriptors;
+class VocabularyTree;
+class WorkStealingThreadPool;
+
+// A function that receives each image pair match as soon as it is found. The
+// matcher invokes the callback from its matching threads but never from two
+// threads at the same time, so the callback does not have to be thread safe.
+typedef std::function<void(const ImagePairMatch&)> ImagePairMatchCallback;
+
+// A function that adds the features of an image to the matcher with one of the
+// AddImage methods, e.g. after extracting them from the image. It returns false
+// if the image could not be added. See FeatureMatcher::AddAndMatchImages.
+typedef std::function<bool(const std::string&)> AddImageFunction;
 
 // Class for matching features between images. The intended use for these
 // classes is for matching photos in image collections, so all pairwise matches
@@ -73,6 +90,9 @@ struct KeypointsAndDescriptors;
 //   // Or, with geometric verification:
 //   VerifyTwoViewMatchesOptions geometric_verification_options;
 //   matcher.MatchImages(geometric_verification_options, &matches);
+//   // Or, to process (e.g., write to disk) each match as soon as it is found
+//   // instead of holding all matches in memory:
+//   matcher.MatchImages([&](const ImagePairMatch& match) { ... });
 //
 // The matches and match quality depend on the options passed to the feature
 // matching.
@@ -82,23 +102,33 @@ class FeatureMatcher {
   virtual ~FeatureMatcher() {}
 
   // Adds an image to the matcher with no known intrinsics for this image. The
-  // caller still owns the keypoints and descriptors so they must remain valid
-  // objects throughout the matching. The image name must be a unique identifier
-  // for the image.
+  // i-th row of the descriptor matrix is the descriptor of the i-th keypoint.
+  // The keypoints and descriptors are copied into the matcher. The image name
+  // must be a unique identifier for the image.
   virtual void AddImage(const std::string& image_name,
                         const std::vector<Keypoint>& keypoints,
-                        const std::vector<Eigen::VectorXf>& descriptors);
+                        const DescriptorMatrix& descriptors);
 
   // Adds an image to the matcher with the known camera intrinsics. The
-  // intrinsics (if known) are useful for geometric verification. The caller
-  // still owns the keypoints and descriptors so they must remain valid objects
-  // throughout the matching. The image name must be a unique identifier for the
-  // image.
+  // intrinsics (if known) are useful for geometric verification. The keypoints
+  // and descriptors are copied into the matcher. The image name must be a
+  // unique identifier for the image.
   virtual void AddImage(const std::string& image_name,
                         const std::vector<Keypoint>& keypoints,
-                        const std::vector<Eigen::VectorXf>& descriptors,
+                        const DescriptorMatrix& descriptors,
                         const CameraIntrinsicsPrior& intrinsics);
 
+  // Same as above, but the descriptors are given as a vector of descriptors.
+  // The descriptors are converted to a descriptor matrix and added with the
+  // methods above.
+  void AddImage(const std::string& image_name,
+                const std::vector<Keypoint>& keypoints,
+                const std::vector<Eigen::VectorXf>& descriptors);
+  void AddImage(const std::string& image_name,
+                const std::vector<Keypoint>& keypoints,
+                const std::vector<Eigen::VectorXf>& descriptors,
+                const CameraIntrinsicsPrior& intrinsics);
+
   // If features have been written to disk, the matcher can directly work with
   // them from the feature files so that you do not have to "add" them to the
   // matcher. This assumes that feature files have been written in the format:
@@ -118,14 +148,48 @@ class FeatureMatcher {
   // min_num_feature_matches are returned.
   virtual void MatchImages(std::vector<ImagePairMatch>* matches);
 
+  // Same as above, but each match is passed to the callback as soon as it is
+  // found instead of being collected in a vector. This keeps the memory usage
+  // bounded for large image collections, e.g. by appending the matches to a
+  // matches file with MatchesWriter.
+  virtual void MatchImages(const ImagePairMatchCallback& callback);
+
+  // Same as above, but the images are added to the matcher while matching so
+  // that, e.g., the features of some images are extracted while other images
+  // are matched. add_image is called once for each of the image names from the
+  // matching threads, so it may be called from several threads at once and
+  // must serialize its calls to AddImage. Each image pair is matched as soon as
+  // both of its images have been added. The pairs set with SetImagePairsToMatch
+  // are matched, or all pairs of the image names otherwise; image retrieval is
+  // not possible since it needs the features of all images.
+  void AddAndMatchImages(const std::vector<std::string>& image_names,
+                         const AddImageFunction& add_image,
+                         const ImagePairMatchCallback& callback);
+
   // Set the image pairs that will be matched when MatchImages or
   // MatchImagesWithGeometricVerification is called. This is an optional method;
   // if it is not called, then all possible image-to-image pairs will be
-  // matched. The vector should contain unique pairs of image names that should
-  // be matched.
+  // matched (or the pairs found with image retrieval, see
+  // FeatureMatcherOptions::image_retrieval_num_neighbors). The vector should
+  // contain unique pairs of image names that should be matched.
   virtual void SetImagePairsToMatch(
       const std::vector<std::pair<std::string, std::string> >& pairs_to_match);
 
+  // Returns the pairs of each image and its
+  // FeatureMatcherOptions::image_retrieval_num_neighbors most similar images
+  // according to a vocabulary tree. The vocabulary tree is read from
+  // FeatureMatcherOptions::vocabulary_tree_file if possible, and trained on the
+  // descriptors of the images otherwise. All images must be added before this
+  // is called. MatchImages uses these pairs if no pairs have been set, and they
+  // may be combined with other candidate pairs (see CombineImagePairs).
+  void RetrieveImagePairsToMatch(
+      std::vector<std::pair<std::string, std::string> >* image_pairs);
+
+  // Returns true if the features of the image are held by the packed feature
+  // store (see FeatureMatcherOptions::packed_features_file), in which case the
+  // image may be added by name only.
+  bool HasPackedFeatures(const std::string& image_name) const;
+
  protected:
   // NOTE: This method should be overridden in the subclass implementations!
   // Returns true if the image pair is a valid match.
@@ -134,12 +198,32 @@ class FeatureMatcher {
       const KeypointsAndDescriptors& features2,
       std::vector<IndexedFeatureMatch>* matched_features) = 0;
 
-  // Performs matching and geometric verification (if desired) on the
-  // pairs_to_match_ between the specified indices. This is useful for thread
-  // pooling.
-  virtual void MatchAndVerifyImagePairs(const int start_index,
-                                        const int end_index,
-                                        std::vector<ImagePairMatch>* matches);
+  // The features of an image pair along with their putative matches, which are
+  // passed from feature matching to geometric verification.
+  struct PutativeImagePairMatch {
+    std::shared_ptr<KeypointsAndDescriptors> features1;
+    std::shared_ptr<KeypointsAndDescriptors> features2;
+    std::vector<IndexedFeatureMatch> putative_matches;
+  };
+
+  // Matches the image pairs of the images and passes each match to the
+  // callback. If add_image is set, the images are added while matching (see
+  // AddAndMatchImages).
+  void MatchImagePairs(const std::vector<std::string>& image_names,
+                       const AddImageFunction& add_image,
+                       const ImagePairMatchCallback& callback);
+
+  // The two stages of matching an image pair of pairs_to_match_. The first
+  // stage matches the features of the images (after preemptive matching, if
+  // enabled) and returns false if the image pair is rejected. The second stage
+  // performs geometric verification (if desired) on the putative matches and
+  // returns false if the image pair is rejected. Both stages may be called
+  // from several threads at once.
+  bool MatchFeaturesOfImagePair(const int pair_index,
+                                PutativeImagePairMatch* putative_match);
+  bool VerifyImagePair(const int pair_index,
+                       const PutativeImagePairMatch& putative_match,
+                       ImagePairMatch* image_pair_match);
 
   // Performs geometric verification. By making this a virtual method, derived
   // classes may implement custom verification methods (e.g., if rotations are
@@ -151,19 +235,45 @@ class FeatureMatcher {
       const std::vector<IndexedFeatureMatch>& putative_matches,
       ImagePairMatch* image_pair_match);
 
-  // Fetches keypoints and descriptors from disk. This function is utilized by
-  // the internal cache to preserve memory.
+  // Fetches keypoints and descriptors of the image from disk, either from the
+  // packed feature store or from the feature file of the image. This function
+  // is utilized by the internal cache to preserve memory.
   std::shared_ptr<KeypointsAndDescriptors> FetchKeypointsAndDescriptorsFromDisk(
-      const std::string& features_file);
+      const std::string& image_name);
+
+  // Returns the keypoints and descriptors of the image from the cache. The
+  // descriptors are not copied or converted, so they keep the precision they
+  // are stored with (see FeatureMatcherOptions::descriptor_precision) and may
+  // be referenced in the packed feature store. They must be accessed with the
+  // functions of feature_matcher_utils.h, e.g. GetFloat32Descriptors or
+  // GetUint8Descriptors.
+  std::shared_ptr<KeypointsAndDescriptors> GetKeypointsAndDescriptors(
+      const std::string& image_name);
+
+  // Returns true if the matcher compares the packed bits of binary descriptors
+  // (see DescriptorPrecision::BINARY and GetBinaryDescriptors) instead of float
+  // descriptors, so the descriptors do not have to be converted to floats.
+  virtual bool MatchesBinaryDescriptors() const { return false; }
+
+  // Trains the vocabulary tree on descriptors sampled from all images.
+  void TrainVocabularyTree(VocabularyTree* vocabulary_tree);
 
   // Returns the filepath of the feature file given the image name.
   std::string FeatureFilenameFromImage(const std::string& image);
 
-  // Each Threadpool worker will perform matching on this many image pairs.  It
-  // is more efficient to let each thread compute multiple matches at a time
-  // than add each matching task to the pool. This is sort of like OpenMP's
-  // dynamic schedule in that it is able to balance threads fairly efficiently.
-  const int kMaxThreadingStepSize_ = 20;
+  // Loads the data needed to match the image into the cache(s) ahead of time.
+  // This is called from a background thread during out-of-core matching, so
+  // derived classes that override it to prefetch additional data must do so in
+  // a thread safe manner.
+  virtual void PrefetchImage(const std::string& image_name);
+
+  // Returns the options for the caches of the matcher, which are limited by the
+  // cache capacity and the cache memory budget of the matching options.
+  ConcurrentLRUCacheOptions GetCacheOptions() const;
+
+  // Logs the fraction of the time that each thread of the pool spent matching.
+  void LogWorkerUtilization(const WorkStealingThreadPool& pool,
+                            const double elapsed_seconds) const;
 
   FeatureMatcherOptions options_;
 
@@ -171,14 +281,37 @@ class FeatureMatcher {
   std::vector<std::string> image_names_;
 
   // An LRU cache that will manage the keypoints and descriptors of interest.
-  typedef LRUCache<std::string, std::shared_ptr<KeypointsAndDescriptors> >
+  // The cache is keyed by the image name and may be accessed by all matching
+  // threads at once.
+  typedef ConcurrentLRUCache<std::string,
+                             std::shared_ptr<KeypointsAndDescriptors> >
       KeypointAndDescriptorCache;
   std::unique_ptr<KeypointAndDescriptorCache> keypoints_and_descriptors_cache_;
 
+  // The packed feature store that features are read from, if any.
+  std::unique_ptr<PackedFeatureStore> packed_feature_store_;
+
+  // The intrinsics are guarded by a mutex since images may be added while
+  // other images are matched.
   std::unordered_map<std::string, CameraIntrinsicsPrior> intrinsics_;
+  std::mutex intrinsics_mutex_;
   std::vector<std::pair<std::string, std::string> > pairs_to_match_;
   std::mutex mutex_;
 
+  // The number of bytes that have been read from disk during out-of-core
+  // matching.
+  std::atomic<size_t> num_bytes_read_;
+
+  // The number of image pairs that were rejected by preemptive matching, by
+  // matching all features, and by geometric verification.
+  std::atomic<int> num_preemptively_rejected_pairs_;
+  std::atomic<int> num_unmatched_pairs_;
+  std::atomic<int> num_unverified_pairs_;
+
+  // The number of image pairs that were not matched because one of the images
+  // could not be added while matching.
+  std::atomic<int> num_pairs_without_features_;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(FeatureMatcher);
 };
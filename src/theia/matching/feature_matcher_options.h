@@ -35,12 +35,32 @@
 #ifndef THEIA_MATCHING_FEATURE_MATCHER_OPTIONS_H_
 #define THEIA_MATCHING_FEATURE_MATCHER_OPTIONS_H_
 
+#include <limits>
 #include <string>
 
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/matching/vocabulary_tree.h"
 #include "theia/sfm/two_view_match_geometric_verification.h"
 
 namespace theia {
 
+// The type of approximate nearest neighbor search index that is built for the
+// descriptors of each image when matching with the KD_TREE strategy.
+enum class KdTreeIndexType {
+  RANDOMIZED_KD_FOREST = 0,
+  HIERARCHICAL_KMEANS = 1,
+};
+
+// How the image pairs are split into shards when matching is distributed over
+// several processes (see FeatureMatcherOptions::num_shards). PAIRS splits the
+// list of image pairs into consecutive ranges. IMAGE_BLOCKS tiles the matrix of
+// image pairs into blocks of images and assigns whole blocks to each shard, so
+// each process only needs the features of a subset of the images.
+enum class MatchingShardStrategy {
+  PAIRS = 0,
+  IMAGE_BLOCKS = 1,
+};
+
 // Options for matching image collections.
 struct FeatureMatcherOptions {
   // Number of threads to use in parallel for matching.
@@ -58,11 +78,131 @@ struct FeatureMatcherOptions {
   // valid writeable directory.
   std::string keypoints_and_descriptors_output_dir = "";
 
+  // If set, the features of images that are added without features (i.e. with
+  // FeatureMatcher::AddImage(image_name)) are read from this packed feature
+  // store (see PackedFeatureStore) instead of from individual feature files.
+  // The store is memory mapped, so the descriptors are not copied into the
+  // cache and reading them does not require any deserialization.
+  std::string packed_features_file = "";
+
   // We store the descriptors of up to cache_capacity images in the cache at a
   // given time. The higher the cache capacity, the more memory is required to
   // perform image-to-image matching.
   int cache_capacity = 128;
 
+  // The maximum number of bytes used by the features in the cache. Images are
+  // evicted from the cache once either this budget or the cache capacity above
+  // is exceeded. Cascade hashing keeps the hashed images in a second cache with
+  // the same limits.
+  size_t cache_capacity_in_bytes = std::numeric_limits<size_t>::max();
+
+  // If true, out-of-core matching reads the features of upcoming image pairs
+  // into the cache in a background thread while the current image pairs are
+  // matched. Only a few blocks of image pairs are read ahead so that the
+  // prefetched features fit in the part of the cache that is left free by the
+  // matching threads.
+  bool prefetch_features = true;
+
+  // The precision used to store the descriptors in the cache and in the
+  // feature files written for out-of-core matching. FLOAT16 and UINT8 reduce
+  // the memory and disk space needed per image by 2x and 4x, so more images fit
+  // into the cache. The BRUTE_FORCE and CASCADE_HASHING strategies compute the
+  // distances directly on the reduced precision descriptors (see L2Uint8 and
+  // L2Float16). KD_TREE converts the descriptors of each image to floats once
+  // when it builds the search index of the image. UINT8 is intended for SIFT
+  // descriptors.
+  DescriptorPrecision descriptor_precision = DescriptorPrecision::FLOAT32;
+
+  // The seed of the random hashing projections used for cascade hashing. For
+  // out-of-core matching the hashed images are written next to the feature
+  // files and are reused by later runs that use the same seed instead of
+  // hashing the descriptors again, unless the descriptors of the image have
+  // changed.
+  unsigned int cascade_hashing_seed = 0;
+
+  // The search index built for each image by the KD_TREE matching strategy.
+  // A forest of kd_tree_num_trees randomized kd-trees is used by default. A
+  // hierarchical k-means tree with kd_tree_kmeans_branching children per node
+  // is slower to build but may be more accurate for the same number of checks.
+  KdTreeIndexType kd_tree_index_type = KdTreeIndexType::RANDOMIZED_KD_FOREST;
+  int kd_tree_num_trees = 4;
+  int kd_tree_kmeans_branching = 32;
+
+  // The maximum number of leaves that are visited when searching for the
+  // nearest neighbors of a descriptor with the KD_TREE matching strategy.
+  // Higher values give more accurate nearest neighbors at the cost of speed.
+  int kd_tree_max_checks = 128;
+
+  // The hash tables built for each image by the MULTI_INDEX_HASHING matching
+  // strategy. The binary descriptors are split into substrings of
+  // multi_index_hashing_substring_bits bits (at most 16) and each of the first
+  // multi_index_hashing_num_tables substrings is indexed by a hash table. The
+  // nearest neighbors of a descriptor are only searched among the descriptors
+  // that have a substring within multi_index_hashing_search_radius bits (at
+  // most 2) of the corresponding substring of the query. More tables and a
+  // larger radius find more of the true nearest neighbors at the cost of speed.
+  int multi_index_hashing_num_tables = 16;
+  int multi_index_hashing_substring_bits = 12;
+  int multi_index_hashing_search_radius = 1;
+
+  // If positive and no image pairs have been set with
+  // FeatureMatcher::SetImagePairsToMatch, image retrieval is used to choose the
+  // image pairs to match instead of matching all pairs of images. Each image is
+  // matched with the image_retrieval_num_neighbors images that are most similar
+  // to it according to a TF-IDF weighted bag of visual words (see
+  // VocabularyTree and InvertedFile), so the number of image pairs grows
+  // linearly instead of quadratically with the number of images.
+  int image_retrieval_num_neighbors = 0;
+
+  // The vocabulary tree used for image retrieval is read from this file if it
+  // exists. Otherwise the vocabulary tree is trained with
+  // vocabulary_tree_options on at most vocabulary_tree_num_training_descriptors
+  // descriptors sampled evenly from all images, and it is written to this file
+  // (if set) so that it can be reused.
+  std::string vocabulary_tree_file = "";
+  VocabularyTree::Options vocabulary_tree_options;
+  int vocabulary_tree_num_training_descriptors = 500000;
+
+  // If set, the image pairs that have been matched (whether they were matched
+  // successfully or rejected) are recorded in this journal file (see
+  // MatchingJournal) so that matching can be resumed after an interruption. If
+  // the journal exists and was written for the same image pairs, the pairs that
+  // were completed before are skipped. Pairs are recorded once the callback of
+  // FeatureMatcher::MatchImages has returned for their matches, so the callback
+  // must persist each match before it returns (e.g. by flushing the
+  // MatchesWriter that it is written to). The pairs are recorded in batches, so
+  // the last pairs that were matched before an interruption are matched again
+  // and the callback should skip matches that it has already persisted.
+  std::string matching_journal_file = "";
+
+  // Matching may be distributed over several processes (e.g. one per socket or
+  // machine) that share the feature files or packed feature store. The image
+  // pairs are split into num_shards shards and only the pairs of shard
+  // shard_index (in [0, num_shards)) are matched. All processes must add the
+  // same images (in any order) and select the same image pairs so that the
+  // shards do not overlap. The features must be extracted before the shards
+  // are matched so that the processes do not write the same feature files.
+  // Image retrieval requires vocabulary_tree_file, which is trained and written
+  // by shard 0 only and must exist before the other shards are started. The
+  // matches of each shard are usually written to their own matches file and
+  // combined with MergeMatchesFiles.
+  int num_shards = 1;
+  int shard_index = 0;
+  MatchingShardStrategy shard_strategy = MatchingShardStrategy::IMAGE_BLOCKS;
+
+  // If true, each image pair is first matched preemptively with only the
+  // preemptive_matching_num_features features of each image that have the
+  // largest scale (or an evenly spaced subsample of the features if the
+  // keypoints have no scale). Image pairs with fewer than
+  // preemptive_matching_min_num_matches preemptive matches that pass the ratio
+  // test are rejected without matching all of their features. Most image pairs
+  // of unordered image collections do not overlap, so this avoids most of the
+  // matching work at the cost of rejecting a few image pairs with little
+  // overlap.
+  bool perform_preemptive_matching = false;
+  int preemptive_matching_num_features = 100;
+  int preemptive_matching_min_num_matches = 4;
+
   // Only symmetric matches are kept.
   bool keep_only_symmetric_matches = true;
 
@@ -35,10 +35,21 @@
 #include "theia/matching/feature_matcher_utils.h"
 
 #include <glog/logging.h>
+#include <stdint.h>
+#include <algorithm>
+#include <limits>
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/matching/distance.h"
 #include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/util/hash.h"
 #include "theia/util/map_util.h"
 
 namespace theia {
@@ -70,4 +81,459 @@ void IntersectMatches(const std::vector<IndexedFeatureMatch>& backwards_matches,
   }
 }
 
+void OrderImagePairsForCacheLocality(
+    const std::vector<std::string>& image_names,
+    const int images_per_group,
+    std::vector<std::pair<std::string, std::string> >* pairs,
+    std::vector<int>* block_ends,
+    std::vector<int>* pair_indices) {
+  CHECK_NOTNULL(pairs);
+  CHECK_NOTNULL(block_ends)->clear();
+  CHECK_GT(images_per_group, 0);
+  if (pair_indices != nullptr) {
+    CHECK_EQ(pair_indices->size(), pairs->size());
+  }
+
+  // Assign each image to a group.
+  std::unordered_map<std::string, int> image_indices;
+  image_indices.reserve(image_names.size());
+  for (const std::string& image_name : image_names) {
+    image_indices.emplace(image_name, image_indices.size());
+  }
+  for (const auto& pair : *pairs) {
+    image_indices.emplace(pair.first, image_indices.size());
+    image_indices.emplace(pair.second, image_indices.size());
+  }
+  const int num_groups =
+      (image_indices.size() + images_per_group - 1) / images_per_group;
+
+  // Order the blocks of the upper triangle of the pair matrix row by row in a
+  // serpentine order so that consecutive blocks always share a group. Forward
+  // rows run from the diagonal block to the block of the last group. Backward
+  // rows run from the block of the last group towards the diagonal and end
+  // with the diagonal block followed by the block next to it, so that the next
+  // row starts at its diagonal block. The directions alternate such that the
+  // second to last row runs forward, so each backward row (except for the last
+  // row, which only has its diagonal block) has at least three blocks and
+  // starts at the block of the last group like the forward row before it ends.
+  // The rank of each block is computed directly from its row and column since
+  // there are far too many blocks to enumerate for large image collections.
+  const int64_t num_groups64 = num_groups;
+  const auto block_rank = [num_groups64](const int64_t row,
+                                         const int64_t column) -> int64_t {
+    const int64_t row_start = row * num_groups64 - row * (row - 1) / 2;
+    const int64_t row_length = num_groups64 - row;
+    if (row_length % 2 == 0) {
+      return row_start + column - row;
+    } else if (column > row + 1) {
+      return row_start + num_groups64 - 1 - column;
+    } else if (column == row) {
+      return row_start + std::max<int64_t>(row_length - 2, 0);
+    }
+    return row_start + row_length - 1;
+  };
+
+  // Sort the pairs by block. Ties are broken by the position of the pair so
+  // that the relative order of the pairs within a block is preserved.
+  std::vector<std::pair<int64_t, int> > ranked_pairs(pairs->size());
+  for (int i = 0; i < pairs->size(); i++) {
+    const int group1 =
+        FindOrDie(image_indices, (*pairs)[i].first) / images_per_group;
+    const int group2 =
+        FindOrDie(image_indices, (*pairs)[i].second) / images_per_group;
+    ranked_pairs[i] = std::make_pair(
+        block_rank(std::min(group1, group2), std::max(group1, group2)), i);
+  }
+  std::sort(ranked_pairs.begin(), ranked_pairs.end());
+
+  std::vector<std::pair<std::string, std::string> > ordered_pairs(
+      pairs->size());
+  std::vector<int> ordered_pair_indices(
+      pair_indices != nullptr ? pairs->size() : 0);
+  for (int i = 0; i < ranked_pairs.size(); i++) {
+    if (i > 0 && ranked_pairs[i].first != ranked_pairs[i - 1].first) {
+      block_ends->emplace_back(i);
+    }
+    const int pair_index = ranked_pairs[i].second;
+    ordered_pairs[i] = std::move((*pairs)[pair_index]);
+    if (pair_indices != nullptr) {
+      ordered_pair_indices[i] = (*pair_indices)[pair_index];
+    }
+  }
+  if (!ranked_pairs.empty()) {
+    block_ends->emplace_back(ranked_pairs.size());
+  }
+  pairs->swap(ordered_pairs);
+  if (pair_indices != nullptr) {
+    pair_indices->swap(ordered_pair_indices);
+  }
+}
+
+void SelectShardOfImagePairs(
+    const std::vector<std::string>& image_names,
+    const int num_shards,
+    const int shard_index,
+    const MatchingShardStrategy shard_strategy,
+    std::vector<std::pair<std::string, std::string> >* pairs) {
+  CHECK_NOTNULL(pairs);
+  CHECK_GT(num_shards, 0);
+  CHECK_GE(shard_index, 0);
+  CHECK_LT(shard_index, num_shards);
+  if (num_shards == 1) {
+    return;
+  }
+
+  // Sort the images and the pairs by name so that the shards only depend on
+  // which images and pairs are given and not on their order, which may differ
+  // between the processes (e.g. if the images are added in the order in which
+  // their features are extracted). The pairs are compared regardless of the
+  // order of their images.
+  std::vector<std::string> sorted_image_names = image_names;
+  std::sort(sorted_image_names.begin(), sorted_image_names.end());
+  std::sort(pairs->begin(),
+            pairs->end(),
+            [](const std::pair<std::string, std::string>& pair1,
+               const std::pair<std::string, std::string>& pair2) {
+              const auto images1 = std::minmax(pair1.first, pair1.second);
+              const auto images2 = std::minmax(pair2.first, pair2.second);
+              if (images1 != images2) {
+                return images1 < images2;
+              }
+              return pair1.first < pair2.first;
+            });
+
+  // Split the pairs into ranges of pairs that are assigned to the same shard.
+  // Without image blocks, each pair forms its own range.
+  std::vector<int> range_ends;
+  if (shard_strategy == MatchingShardStrategy::IMAGE_BLOCKS) {
+    // Use a few blocks per shard so that the shards receive a similar number of
+    // pairs even though the blocks on the diagonal hold only half as many pairs
+    // as the others.
+    static const int kNumBlocksPerShard = 4;
+    std::unordered_set<std::string> images(sorted_image_names.begin(),
+                                           sorted_image_names.end());
+    for (const auto& pair : *pairs) {
+      images.emplace(pair.first);
+      images.emplace(pair.second);
+    }
+    int num_groups = 1;
+    const int min_num_blocks = kNumBlocksPerShard * num_shards;
+    while (num_groups * (num_groups + 1) / 2 < min_num_blocks) {
+      ++num_groups;
+    }
+    const int images_per_group =
+        std::max<int>(1, (images.size() + num_groups - 1) / num_groups);
+    OrderImagePairsForCacheLocality(
+        sorted_image_names, images_per_group, pairs, &range_ends);
+  } else {
+    range_ends.resize(pairs->size());
+    for (int i = 0; i < pairs->size(); i++) {
+      range_ends[i] = i + 1;
+    }
+  }
+
+  // Assign consecutive ranges to each shard such that each shard receives
+  // about the same number of pairs. A range belongs to the shard that contains
+  // its middle pair.
+  const int64_t num_pairs = pairs->size();
+  std::vector<std::pair<std::string, std::string> > shard_pairs;
+  int range_start = 0;
+  for (const int range_end : range_ends) {
+    const int64_t middle = (static_cast<int64_t>(range_start) + range_end) / 2;
+    if (middle * num_shards / num_pairs == shard_index) {
+      shard_pairs.insert(shard_pairs.end(),
+                         pairs->begin() + range_start,
+                         pairs->begin() + range_end);
+    }
+    range_start = range_end;
+  }
+  pairs->swap(shard_pairs);
+}
+
+void SelectPreemptiveFeatures(const std::vector<Keypoint>& keypoints,
+                              const int num_features,
+                              std::vector<int>* feature_indices) {
+  CHECK_NOTNULL(feature_indices)->clear();
+  CHECK_GE(num_features, 0);
+  const int num_keypoints = keypoints.size();
+  const int num_selected_features = std::min(num_features, num_keypoints);
+  if (num_selected_features == 0) {
+    return;
+  }
+
+  if (!keypoints[0].has_scale()) {
+    feature_indices->reserve(num_selected_features);
+    for (int i = 0; i < num_selected_features; i++) {
+      feature_indices->emplace_back(
+          static_cast<int64_t>(i) * num_keypoints / num_selected_features);
+    }
+    return;
+  }
+
+  feature_indices->resize(num_keypoints);
+  for (int i = 0; i < num_keypoints; i++) {
+    (*feature_indices)[i] = i;
+  }
+  std::nth_element(feature_indices->begin(),
+                   feature_indices->begin() + num_selected_features - 1,
+                   feature_indices->end(),
+                   [&keypoints](const int index1, const int index2) {
+                     return keypoints[index1].scale() >
+                            keypoints[index2].scale();
+                   });
+  feature_indices->resize(num_selected_features);
+}
+
+int CountPreemptiveMatches(const KeypointsAndDescriptors& features1,
+                           const KeypointsAndDescriptors& features2,
+                           const int num_features,
+                           const float lowes_ratio,
+                           const bool binary_descriptors) {
+  std::vector<int> feature_indices1, feature_indices2;
+  SelectPreemptiveFeatures(
+      features1.keypoints, num_features, &feature_indices1);
+  SelectPreemptiveFeatures(
+      features2.keypoints, num_features, &feature_indices2);
+  if (feature_indices1.empty() || feature_indices2.empty()) {
+    return 0;
+  }
+
+  // The distances between all preemptive features of the two images. The
+  // squared Euclidean distances of float descriptors are compared with the
+  // squared ratio.
+  Eigen::MatrixXf distances(feature_indices1.size(), feature_indices2.size());
+  float ratio = lowes_ratio;
+  if (binary_descriptors) {
+    const Eigen::Map<const BinaryDescriptorMatrix> descriptors1 =
+        GetBinaryDescriptors(features1);
+    const Eigen::Map<const BinaryDescriptorMatrix> descriptors2 =
+        GetBinaryDescriptors(features2);
+    const Hamming hamming;
+    for (int i = 0; i < feature_indices1.size(); i++) {
+      for (int j = 0; j < feature_indices2.size(); j++) {
+        distances(i, j) =
+            hamming(descriptors1.row(feature_indices1[i]).data(),
+                    descriptors2.row(feature_indices2[j]).data(),
+                    descriptors1.cols());
+      }
+    }
+  } else {
+    DescriptorMatrix descriptors1, descriptors2;
+    GetFloatDescriptors(features1, feature_indices1, &descriptors1);
+    GetFloatDescriptors(features2, feature_indices2, &descriptors2);
+    distances = (-2.0f * descriptors1 * descriptors2.transpose()).colwise() +
+                descriptors1.rowwise().squaredNorm();
+    distances.rowwise() += descriptors2.rowwise().squaredNorm().transpose();
+    ratio *= lowes_ratio;
+  }
+
+  // Count the features of the first image whose nearest neighbor passes the
+  // ratio test.
+  int num_matches = 0;
+  for (int i = 0; i < distances.rows(); i++) {
+    float distance = std::numeric_limits<float>::max();
+    float second_distance = std::numeric_limits<float>::max();
+    for (int j = 0; j < distances.cols(); j++) {
+      if (distances(i, j) < distance) {
+        second_distance = distance;
+        distance = distances(i, j);
+      } else if (distances(i, j) < second_distance) {
+        second_distance = distances(i, j);
+      }
+    }
+    if (distance < ratio * second_distance) {
+      ++num_matches;
+    }
+  }
+  return num_matches;
+}
+
+namespace {
+
+// The descriptors of an image with the precision they are stored with. The
+// descriptors are stored contiguously with one descriptor per row.
+struct StoredDescriptors {
+  DescriptorPrecision precision = DescriptorPrecision::FLOAT32;
+  const uint8_t* data = nullptr;
+  int rows = 0;
+  int cols = 0;
+};
+
+StoredDescriptors GetStoredDescriptors(
+    const KeypointsAndDescriptors& features) {
+  StoredDescriptors stored;
+  const PackedFeaturesView& packed_features = features.packed_features;
+  const QuantizedDescriptorMatrix& quantized_descriptors =
+      features.quantized_descriptors;
+  if (!packed_features.empty()) {
+    stored.precision = packed_features.precision();
+    stored.rows = packed_features.num_features();
+    stored.cols = packed_features.descriptor_dimension();
+    switch (stored.precision) {
+      case DescriptorPrecision::FLOAT32:
+        stored.data = reinterpret_cast<const uint8_t*>(
+            packed_features.float32_descriptors().data());
+        break;
+      case DescriptorPrecision::FLOAT16:
+        stored.data = reinterpret_cast<const uint8_t*>(
+            packed_features.float16_descriptors().data());
+        break;
+      case DescriptorPrecision::UINT8:
+        stored.data = packed_features.uint8_descriptors().data();
+        break;
+      default:
+        stored.data = packed_features.binary_descriptors().data();
+    }
+  } else if (quantized_descriptors.rows() > 0) {
+    stored.precision = quantized_descriptors.precision();
+    stored.rows = quantized_descriptors.rows();
+    stored.cols = quantized_descriptors.cols();
+    switch (stored.precision) {
+      case DescriptorPrecision::FLOAT32:
+        stored.data = reinterpret_cast<const uint8_t*>(
+            quantized_descriptors.float32_descriptors().data());
+        break;
+      case DescriptorPrecision::FLOAT16:
+        stored.data = reinterpret_cast<const uint8_t*>(
+            quantized_descriptors.float16_descriptors().data());
+        break;
+      case DescriptorPrecision::UINT8:
+        stored.data = quantized_descriptors.uint8_descriptors().data();
+        break;
+      default:
+        stored.data = quantized_descriptors.binary_descriptors().data();
+    }
+  } else {
+    stored.data =
+        reinterpret_cast<const uint8_t*>(features.descriptors.data());
+    stored.rows = features.descriptors.rows();
+    stored.cols = features.descriptors.cols();
+  }
+  return stored;
+}
+
+}  // namespace
+
+DescriptorPrecision GetDescriptorPrecision(
+    const KeypointsAndDescriptors& features) {
+  return GetStoredDescriptors(features).precision;
+}
+
+int GetDescriptorDimension(const KeypointsAndDescriptors& features) {
+  return GetStoredDescriptors(features).cols;
+}
+
+uint64_t ComputeDescriptorChecksum(const KeypointsAndDescriptors& features) {
+  const StoredDescriptors stored = GetStoredDescriptors(features);
+  const uint8_t precision = static_cast<uint8_t>(stored.precision);
+  const uint64_t checksum = Fnv1aHash(&precision, sizeof(precision));
+  return Fnv1aHash(
+      stored.data,
+      static_cast<size_t>(stored.rows) *
+          DescriptorSizeInBytes(stored.precision, stored.cols),
+      checksum);
+}
+
+void GetFloatDescriptors(const KeypointsAndDescriptors& features,
+                         DescriptorMatrix* descriptors) {
+  const StoredDescriptors stored = GetStoredDescriptors(features);
+  DequantizeDescriptors(
+      stored.precision, stored.data, stored.rows, stored.cols, descriptors);
+}
+
+void GetFloatDescriptors(const KeypointsAndDescriptors& features,
+                         const std::vector<int>& indices,
+                         DescriptorMatrix* descriptors) {
+  const StoredDescriptors stored = GetStoredDescriptors(features);
+  const int num_descriptors = indices.size();
+  if (CHECK_NOTNULL(descriptors)->rows() < num_descriptors ||
+      descriptors->cols() != stored.cols) {
+    descriptors->resize(num_descriptors, stored.cols);
+  }
+
+  if (stored.precision == DescriptorPrecision::FLOAT32) {
+    const Eigen::Map<const DescriptorMatrix> float_descriptors(
+        reinterpret_cast<const float*>(stored.data), stored.rows, stored.cols);
+    for (int i = 0; i < num_descriptors; i++) {
+      descriptors->row(i) = float_descriptors.row(indices[i]);
+    }
+    return;
+  }
+
+  const size_t descriptor_size =
+      DescriptorSizeInBytes(stored.precision, stored.cols);
+  DescriptorMatrix descriptor;
+  for (int i = 0; i < num_descriptors; i++) {
+    DCHECK_LT(indices[i], stored.rows);
+    DequantizeDescriptors(stored.precision,
+                          stored.data + indices[i] * descriptor_size,
+                          1,
+                          stored.cols,
+                          &descriptor);
+    descriptors->row(i) = descriptor;
+  }
+}
+
+Eigen::Map<const DescriptorMatrix> GetFloat32Descriptors(
+    const KeypointsAndDescriptors& features) {
+  if (!features.packed_features.empty()) {
+    CHECK(features.packed_features.precision() == DescriptorPrecision::FLOAT32)
+        << "The descriptors of image " << features.image_name
+        << " in the packed feature store are not float descriptors.";
+    return features.packed_features.float32_descriptors();
+  }
+
+  // Reduced precision descriptors are held by the quantized descriptors and the
+  // descriptor matrix is empty.
+  CHECK(features.quantized_descriptors.rows() == 0 ||
+        features.quantized_descriptors.precision() ==
+            DescriptorPrecision::FLOAT32)
+      << "The descriptors of image " << features.image_name
+      << " are stored with reduced precision.";
+  const DescriptorMatrix& descriptors =
+      features.quantized_descriptors.rows() > 0
+          ? features.quantized_descriptors.float32_descriptors()
+          : features.descriptors;
+  return Eigen::Map<const DescriptorMatrix>(
+      descriptors.data(), descriptors.rows(), descriptors.cols());
+}
+
+Eigen::Map<const Uint8DescriptorMatrix> GetUint8Descriptors(
+    const KeypointsAndDescriptors& features) {
+  const StoredDescriptors stored = GetStoredDescriptors(features);
+  CHECK(stored.precision == DescriptorPrecision::UINT8)
+      << "The descriptors of image " << features.image_name
+      << " are not stored with DescriptorPrecision::UINT8.";
+  return Eigen::Map<const Uint8DescriptorMatrix>(
+      stored.data, stored.rows, stored.cols);
+}
+
+Eigen::Map<const Float16DescriptorMatrix> GetFloat16Descriptors(
+    const KeypointsAndDescriptors& features) {
+  const StoredDescriptors stored = GetStoredDescriptors(features);
+  CHECK(stored.precision == DescriptorPrecision::FLOAT16)
+      << "The descriptors of image " << features.image_name
+      << " are not stored with DescriptorPrecision::FLOAT16.";
+  return Eigen::Map<const Float16DescriptorMatrix>(
+      reinterpret_cast<const uint16_t*>(stored.data), stored.rows, stored.cols);
+}
+
+Eigen::Map<const BinaryDescriptorMatrix> GetBinaryDescriptors(
+    const KeypointsAndDescriptors& features) {
+  if (!features.packed_features.empty()) {
+    CHECK(features.packed_features.precision() == DescriptorPrecision::BINARY)
+        << "The descriptors of image " << features.image_name
+        << " in the packed feature store are not binary descriptors.";
+    return features.packed_features.binary_descriptors();
+  }
+
+  const QuantizedDescriptorMatrix& descriptors = features.quantized_descriptors;
+  CHECK(descriptors.precision() == DescriptorPrecision::BINARY)
+      << "Binary descriptors must be stored with DescriptorPrecision::BINARY.";
+  return Eigen::Map<const BinaryDescriptorMatrix>(
+      descriptors.binary_descriptors().data(),
+      descriptors.binary_descriptors().rows(),
+      descriptors.binary_descriptors().cols());
+}
+
 }  // namespace theia
@@ -35,16 +35,130 @@
 #ifndef THEIA_MATCHING_FEATURE_MATCHER_UTILS_H_
 #define THEIA_MATCHING_FEATURE_MATCHER_UTILS_H_
 
+#include <Eigen/Core>
+#include <stdint.h>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/matching/feature_matcher_options.h"
+
 namespace theia {
 struct IndexedFeatureMatch;
+struct KeypointsAndDescriptors;
 
 // Modifies forward matches so that it removes all matches that are not
 // contained in the backwards matches.
 void IntersectMatches(const std::vector<IndexedFeatureMatch>& backwards_matches,
                       std::vector<IndexedFeatureMatch>* forward_matches);
 
+// Reorders the image pairs so that pairs which share images are matched close
+// together. This keeps an LRU cache of features effective when matching
+// out-of-core, since each feature file is then read from disk only a few times
+// instead of once for almost every pair.
+//
+// The images are split into consecutive groups of images_per_group images (in
+// the order of image_names, followed by any images that only appear in the
+// pairs) which tiles the pair matrix into blocks. The pairs are sorted by block
+// and the blocks are ordered row by row in a serpentine order so that
+// consecutive blocks share a group of images. The relative order of pairs
+// within a block is preserved. The index one past the last pair of each
+// non-empty block is returned in block_ends. If pair_indices is not null, it
+// must hold a value for each pair and it is reordered along with the pairs.
+void OrderImagePairsForCacheLocality(
+    const std::vector<std::string>& image_names,
+    const int images_per_group,
+    std::vector<std::pair<std::string, std::string> >* pairs,
+    std::vector<int>* block_ends,
+    std::vector<int>* pair_indices = nullptr);
+
+// Keeps only the image pairs of shard shard_index out of num_shards. Every
+// image pair belongs to exactly one shard, and the shards depend only on the
+// set of image names, the set of pairs (regardless of the order of the images
+// of each pair), and the strategy. The order of the image names and pairs does
+// not matter, so processes that are given the same images and pairs in any
+// order select disjoint shards. With MatchingShardStrategy::IMAGE_BLOCKS
+// the pairs are tiled into blocks as in OrderImagePairsForCacheLocality and
+// each shard receives consecutive blocks, so the pairs of a shard touch only a
+// few groups of images. The pairs of the shard are returned in the order of
+// the blocks.
+void SelectShardOfImagePairs(
+    const std::vector<std::string>& image_names,
+    const int num_shards,
+    const int shard_index,
+    const MatchingShardStrategy shard_strategy,
+    std::vector<std::pair<std::string, std::string> >* pairs);
+
+// Returns the indices of the (at most) num_features features that are used to
+// match an image preemptively. These are the features with the largest scale,
+// since they are the most likely to be seen in other images, or an evenly
+// spaced subsample of the features if the keypoints do not have a scale.
+void SelectPreemptiveFeatures(const std::vector<Keypoint>& keypoints,
+                              const int num_features,
+                              std::vector<int>* feature_indices);
+
+// Matches the preemptive features (see SelectPreemptiveFeatures) of the first
+// image to those of the second image and returns the number of matches that
+// pass the ratio test with lowes_ratio. This is a cheap test of whether the
+// images overlap before all of their features are matched. The descriptors of
+// the preemptive features are converted to floats unless binary_descriptors is
+// true, in which case the Hamming distance between the binary descriptors is
+// used.
+int CountPreemptiveMatches(const KeypointsAndDescriptors& features1,
+                           const KeypointsAndDescriptors& features2,
+                           const int num_features,
+                           const float lowes_ratio,
+                           const bool binary_descriptors);
+
+// Returns the precision and the number of dimensions of the descriptors of the
+// features, which are either held by the features or referenced in the packed
+// feature store.
+DescriptorPrecision GetDescriptorPrecision(
+    const KeypointsAndDescriptors& features);
+int GetDescriptorDimension(const KeypointsAndDescriptors& features);
+
+// Returns a checksum of the descriptors of the features as they are stored,
+// including their precision. Data that is derived from the descriptors and
+// saved to disk (e.g. hashed images) stores the checksum so that it is not
+// reused for other descriptors.
+uint64_t ComputeDescriptorChecksum(const KeypointsAndDescriptors& features);
+
+// Copies the descriptors of the features and converts them to floats if they
+// are stored with reduced precision. The second version only copies the
+// descriptors with the given indices, i.e. the i-th row of the output is the
+// descriptor of feature indices[i]. It writes the first indices.size() rows of
+// the output, which is only resized if it has fewer rows or a different number
+// of columns so that it may be reused as a buffer.
+void GetFloatDescriptors(const KeypointsAndDescriptors& features,
+                         DescriptorMatrix* descriptors);
+void GetFloatDescriptors(const KeypointsAndDescriptors& features,
+                         const std::vector<int>& indices,
+                         DescriptorMatrix* descriptors);
+
+// Returns the float descriptors of the features without copying them. They are
+// either held by the descriptor matrix or referenced in the packed feature
+// store, whose memory mapping is kept alive by the features. Each row holds one
+// descriptor. The descriptors must be stored with DescriptorPrecision::FLOAT32.
+Eigen::Map<const DescriptorMatrix> GetFloat32Descriptors(
+    const KeypointsAndDescriptors& features);
+
+// Same as above for descriptors that are stored with DescriptorPrecision::UINT8
+// and DescriptorPrecision::FLOAT16, which are matched without converting them
+// to floats (see L2Uint8 and L2Float16).
+Eigen::Map<const Uint8DescriptorMatrix> GetUint8Descriptors(
+    const KeypointsAndDescriptors& features);
+Eigen::Map<const Float16DescriptorMatrix> GetFloat16Descriptors(
+    const KeypointsAndDescriptors& features);
+
+// Returns the packed bits of the binary descriptors of the features, which are
+// either held by the quantized descriptors or referenced in the packed feature
+// store. Each row holds one descriptor. The descriptors must be stored with
+// DescriptorPrecision::BINARY.
+Eigen::Map<const BinaryDescriptorMatrix> GetBinaryDescriptors(
+    const KeypointsAndDescriptors& features);
+
 }  // namespace theia
 
 #endif  // THEIA_MATCHING_FEATURE_MATCHER_UTILS_H_
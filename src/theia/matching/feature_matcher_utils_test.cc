@@ -32,12 +32,21 @@
 // Please contact the author of this library if you have any questions.
 // Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
 
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "theia/matching/feature_matcher_options.h"
 #include "theia/matching/feature_matcher_utils.h"
 #include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/util/lru_cache.h"
+#include "theia/util/random.h"
 
 namespace theia {
 
@@ -53,4 +62,372 @@ TEST(FeatureMatcherUtils, IntersectMatches) {
   EXPECT_EQ(matches[0].feature2_ind, 1);
 }
 
+namespace {
+
+typedef std::pair<std::string, std::string> ImageNamePair;
+
+// Returns the number of cache misses of an LRU cache with the given capacity
+// when the images of the pairs are fetched in order.
+int NumCacheMisses(const std::vector<ImageNamePair>& pairs,
+                   const int cache_capacity) {
+  std::function<int(const std::string&)> fetch = [](const std::string& key) {
+    return 0;
+  };
+  LRUCache<std::string, int> cache(fetch, cache_capacity);
+  for (const ImageNamePair& pair : pairs) {
+    cache.Fetch(pair.first);
+    cache.Fetch(pair.second);
+  }
+  return cache.NumCacheMisses();
+}
+
+}  // namespace
+
+TEST(FeatureMatcherUtils, OrderImagePairsForCacheLocality) {
+  static const int kNumImages = 60;
+  static const int kImagesPerGroup = 6;
+  static const int kCacheCapacity = 2 * kImagesPerGroup;
+
+  std::vector<std::string> image_names;
+  for (int i = 0; i < kNumImages; i++) {
+    image_names.emplace_back(std::to_string(i));
+  }
+  std::vector<ImageNamePair> pairs;
+  for (int i = 0; i < kNumImages; i++) {
+    for (int j = i + 1; j < kNumImages; j++) {
+      pairs.emplace_back(image_names[i], image_names[j]);
+    }
+  }
+
+  std::vector<ImageNamePair> ordered_pairs = pairs;
+  std::vector<int> block_ends;
+  std::vector<int> pair_indices(pairs.size());
+  for (int i = 0; i < pairs.size(); i++) {
+    pair_indices[i] = i;
+  }
+  OrderImagePairsForCacheLocality(image_names,
+                                  kImagesPerGroup,
+                                  &ordered_pairs,
+                                  &block_ends,
+                                  &pair_indices);
+
+  // All pairs must be kept, and the pair indices are reordered along with the
+  // pairs.
+  EXPECT_EQ(std::set<ImageNamePair>(pairs.begin(), pairs.end()),
+            std::set<ImageNamePair>(ordered_pairs.begin(),
+                                    ordered_pairs.end()));
+  for (int i = 0; i < ordered_pairs.size(); i++) {
+    EXPECT_EQ(ordered_pairs[i], pairs[pair_indices[i]]);
+  }
+
+  // Each block contains the pairs between two groups of images.
+  const int num_groups = kNumImages / kImagesPerGroup;
+  EXPECT_EQ(block_ends.size(), num_groups * (num_groups + 1) / 2);
+  EXPECT_EQ(block_ends.back(), pairs.size());
+  int block_start = 0;
+  for (const int block_end : block_ends) {
+    std::set<int> groups;
+    for (int i = block_start; i < block_end; i++) {
+      groups.insert(std::stoi(ordered_pairs[i].first) / kImagesPerGroup);
+      groups.insert(std::stoi(ordered_pairs[i].second) / kImagesPerGroup);
+    }
+    EXPECT_LE(groups.size(), 2);
+    block_start = block_end;
+  }
+
+  // The ordered pairs only need to read each group of images a few times
+  // whereas the row-major order reads almost every image for every pair.
+  const int num_ordered_misses = NumCacheMisses(ordered_pairs, kCacheCapacity);
+  const int num_row_major_misses = NumCacheMisses(pairs, kCacheCapacity);
+  EXPECT_LT(num_ordered_misses, kNumImages * num_groups);
+  EXPECT_LT(3 * num_ordered_misses, num_row_major_misses);
+}
+
+TEST(FeatureMatcherUtils, OrderImagePairsForCacheLocalityIsSerpentine) {
+  static const int kImagesPerGroup = 2;
+
+  for (int num_groups = 1; num_groups <= 8; num_groups++) {
+    const int num_images = num_groups * kImagesPerGroup;
+    std::vector<std::string> image_names;
+    for (int i = 0; i < num_images; i++) {
+      image_names.emplace_back(std::to_string(i));
+    }
+    std::vector<ImageNamePair> pairs;
+    for (int i = 0; i < num_images; i++) {
+      for (int j = i + 1; j < num_images; j++) {
+        pairs.emplace_back(image_names[i], image_names[j]);
+      }
+    }
+    std::vector<int> block_ends;
+    OrderImagePairsForCacheLocality(
+        image_names, kImagesPerGroup, &pairs, &block_ends);
+    ASSERT_EQ(block_ends.size(), num_groups * (num_groups + 1) / 2);
+
+    // The groups of each block, i.e. its row and column in the pair matrix.
+    std::vector<std::pair<int, int> > blocks;
+    for (const int block_end : block_ends) {
+      const ImageNamePair& pair = pairs[block_end - 1];
+      blocks.emplace_back(std::stoi(pair.first) / kImagesPerGroup,
+                          std::stoi(pair.second) / kImagesPerGroup);
+    }
+
+    // Consecutive blocks share a group.
+    for (int i = 1; i < blocks.size(); i++) {
+      const std::pair<int, int>& block1 = blocks[i - 1];
+      const std::pair<int, int>& block2 = blocks[i];
+      EXPECT_TRUE(block1.first == block2.first ||
+                  block1.first == block2.second ||
+                  block1.second == block2.first ||
+                  block1.second == block2.second)
+          << "Blocks " << i - 1 << " and " << i << " of " << num_groups
+          << " groups do not share a group.";
+    }
+
+    // The blocks are ordered row by row. The second to last row runs forward
+    // from the diagonal, and the rows alternate between forward and backward
+    // rows, which end with the diagonal block and the block next to it.
+    int block_index = 0;
+    for (int row = 0; row < num_groups; row++) {
+      std::vector<int> columns;
+      if ((num_groups - row) % 2 == 0) {
+        for (int column = row; column < num_groups; column++) {
+          columns.emplace_back(column);
+        }
+      } else {
+        for (int column = num_groups - 1; column > row + 1; column--) {
+          columns.emplace_back(column);
+        }
+        columns.emplace_back(row);
+        if (row + 1 < num_groups) {
+          columns.emplace_back(row + 1);
+        }
+      }
+      for (const int column : columns) {
+        EXPECT_EQ(blocks[block_index], std::make_pair(row, column));
+        ++block_index;
+      }
+    }
+  }
+}
+
+TEST(FeatureMatcherUtils, OrderImagePairsForCacheLocalityOfManyGroups) {
+  // With one image per group there are 100k groups, so the pair matrix has far
+  // more blocks than can be enumerated or counted with an int.
+  static const int kNumImages = 100000;
+
+  std::vector<std::string> image_names;
+  for (int i = 0; i < kNumImages; i++) {
+    image_names.emplace_back(std::to_string(i));
+  }
+  std::vector<ImageNamePair> pairs = {
+    ImageNamePair("99998", "99999"), ImageNamePair("0", "99999"),
+    ImageNamePair("50000", "50001"), ImageNamePair("1", "99999"),
+    ImageNamePair("0", "1")
+  };
+  std::vector<int> block_ends;
+  OrderImagePairsForCacheLocality(image_names, 1, &pairs, &block_ends);
+
+  // The first row runs forward and the second row runs backward from the last
+  // column, while the row of image 50000 comes much later.
+  const std::vector<ImageNamePair> expected_pairs = {
+    ImageNamePair("0", "1"), ImageNamePair("0", "99999"),
+    ImageNamePair("1", "99999"), ImageNamePair("50000", "50001"),
+    ImageNamePair("99998", "99999")
+  };
+  EXPECT_EQ(pairs, expected_pairs);
+  EXPECT_EQ(block_ends, std::vector<int>({ 1, 2, 3, 4, 5 }));
+}
+
+TEST(FeatureMatcherUtils, SelectShardOfImagePairs) {
+  static const int kNumImages = 60;
+  static const int kNumShards = 5;
+
+  std::vector<std::string> image_names;
+  for (int i = 0; i < kNumImages; i++) {
+    image_names.emplace_back(std::to_string(i));
+  }
+  std::vector<ImageNamePair> pairs;
+  for (int i = 0; i < kNumImages; i++) {
+    for (int j = i + 1; j < kNumImages; j++) {
+      pairs.emplace_back(image_names[i], image_names[j]);
+    }
+  }
+
+  // The shards partition the pairs into parts of about the same size.
+  for (const MatchingShardStrategy shard_strategy :
+       {MatchingShardStrategy::PAIRS, MatchingShardStrategy::IMAGE_BLOCKS}) {
+    std::set<ImageNamePair> all_shard_pairs;
+    int num_shard_pairs = 0;
+    for (int i = 0; i < kNumShards; i++) {
+      std::vector<ImageNamePair> shard_pairs = pairs;
+      SelectShardOfImagePairs(
+          image_names, kNumShards, i, shard_strategy, &shard_pairs);
+      EXPECT_GT(shard_pairs.size(), pairs.size() / kNumShards / 2);
+      EXPECT_LT(shard_pairs.size(), 2 * pairs.size() / kNumShards);
+      all_shard_pairs.insert(shard_pairs.begin(), shard_pairs.end());
+      num_shard_pairs += shard_pairs.size();
+
+      // Each shard of image blocks only needs the features of some images.
+      if (shard_strategy == MatchingShardStrategy::IMAGE_BLOCKS) {
+        std::set<std::string> shard_images;
+        for (const ImageNamePair& pair : shard_pairs) {
+          shard_images.insert(pair.first);
+          shard_images.insert(pair.second);
+        }
+        EXPECT_LT(shard_images.size(), kNumImages);
+      }
+    }
+    EXPECT_EQ(num_shard_pairs, pairs.size());
+    EXPECT_EQ(all_shard_pairs,
+              std::set<ImageNamePair>(pairs.begin(), pairs.end()));
+  }
+}
+
+TEST(FeatureMatcherUtils, SelectShardOfImagePairsDoesNotDependOnOrder) {
+  static const int kNumImages = 40;
+  static const int kNumShards = 3;
+  static const int kNumOrders = 4;
+  std::mt19937 rng(61);
+
+  std::vector<std::string> image_names;
+  for (int i = 0; i < kNumImages; i++) {
+    image_names.emplace_back("image" + std::to_string(i));
+  }
+
+  for (const MatchingShardStrategy shard_strategy :
+       {MatchingShardStrategy::PAIRS, MatchingShardStrategy::IMAGE_BLOCKS}) {
+    // The pairs of each shard for the first order of the images.
+    std::vector<std::set<ImageNamePair> > shards(kNumShards);
+    for (int order = 0; order < kNumOrders; order++) {
+      // Add the images in a different order, which also changes the order of
+      // the images of the pairs, and shuffle the pairs.
+      std::vector<std::string> shuffled_image_names = image_names;
+      std::shuffle(
+          shuffled_image_names.begin(), shuffled_image_names.end(), rng);
+      std::vector<ImageNamePair> pairs;
+      for (int i = 0; i < kNumImages; i++) {
+        for (int j = i + 1; j < kNumImages; j++) {
+          pairs.emplace_back(shuffled_image_names[i], shuffled_image_names[j]);
+        }
+      }
+      std::shuffle(pairs.begin(), pairs.end(), rng);
+
+      std::set<ImageNamePair> all_shard_pairs;
+      int num_shard_pairs = 0;
+      for (int i = 0; i < kNumShards; i++) {
+        std::vector<ImageNamePair> shard_pairs = pairs;
+        SelectShardOfImagePairs(
+            shuffled_image_names, kNumShards, i, shard_strategy, &shard_pairs);
+        std::set<ImageNamePair> shard;
+        for (const ImageNamePair& pair : shard_pairs) {
+          shard.emplace(std::min(pair.first, pair.second),
+                        std::max(pair.first, pair.second));
+        }
+        all_shard_pairs.insert(shard.begin(), shard.end());
+        num_shard_pairs += shard_pairs.size();
+
+        // Each shard holds the same pairs regardless of the order.
+        if (order == 0) {
+          shards[i] = shard;
+        } else {
+          EXPECT_EQ(shard, shards[i]);
+        }
+      }
+
+      // The shards do not overlap and cover all pairs.
+      EXPECT_EQ(num_shard_pairs, pairs.size());
+      EXPECT_EQ(all_shard_pairs.size(), pairs.size());
+    }
+  }
+}
+
+TEST(FeatureMatcherUtils, SelectShardOfImagePairsOfFewImages) {
+  // Some shards may be left empty if there are only a few pairs, but together
+  // the shards still cover each pair exactly once.
+  for (const int num_images : {2, 3, 8}) {
+    std::vector<std::string> image_names;
+    for (int i = 0; i < num_images; i++) {
+      image_names.emplace_back(std::to_string(i));
+    }
+    std::vector<ImageNamePair> pairs;
+    for (int i = 0; i < num_images; i++) {
+      for (int j = i + 1; j < num_images; j++) {
+        pairs.emplace_back(image_names[i], image_names[j]);
+      }
+    }
+
+    for (const int num_shards : {3, 5}) {
+      for (const MatchingShardStrategy shard_strategy :
+           {MatchingShardStrategy::PAIRS,
+            MatchingShardStrategy::IMAGE_BLOCKS}) {
+        std::set<ImageNamePair> all_shard_pairs;
+        int num_shard_pairs = 0;
+        for (int i = 0; i < num_shards; i++) {
+          std::vector<ImageNamePair> shard_pairs = pairs;
+          SelectShardOfImagePairs(
+              image_names, num_shards, i, shard_strategy, &shard_pairs);
+          all_shard_pairs.insert(shard_pairs.begin(), shard_pairs.end());
+          num_shard_pairs += shard_pairs.size();
+        }
+        EXPECT_EQ(num_shard_pairs, pairs.size());
+        EXPECT_EQ(all_shard_pairs,
+                  std::set<ImageNamePair>(pairs.begin(), pairs.end()));
+      }
+    }
+  }
+}
+
+TEST(FeatureMatcherUtils, SelectPreemptiveFeatures) {
+  static const int kNumFeatures = 10;
+  std::vector<Keypoint> keypoints(kNumFeatures);
+  std::vector<int> feature_indices;
+  SelectPreemptiveFeatures(keypoints, 5, &feature_indices);
+  EXPECT_EQ(feature_indices, std::vector<int>({0, 2, 4, 6, 8}));
+
+  // The features with the largest scale are selected.
+  for (int i = 0; i < kNumFeatures; i++) {
+    keypoints[i].set_scale((i * 7) % kNumFeatures);
+  }
+  SelectPreemptiveFeatures(keypoints, 3, &feature_indices);
+  std::set<int> scales;
+  for (const int feature_index : feature_indices) {
+    scales.insert(keypoints[feature_index].scale());
+  }
+  EXPECT_EQ(scales, std::set<int>({7, 8, 9}));
+
+  SelectPreemptiveFeatures(keypoints, 2 * kNumFeatures, &feature_indices);
+  EXPECT_EQ(feature_indices.size(), kNumFeatures);
+}
+
+TEST(FeatureMatcherUtils, CountPreemptiveMatches) {
+  static const int kNumFeatures = 200;
+  static const int kNumPreemptiveFeatures = 50;
+  static const int kDescriptorDimension = 128;
+  RandomNumberGenerator rng(59);
+
+  // The second image sees the features of the first image with the largest
+  // scale, and the third image sees none of them.
+  KeypointsAndDescriptors features1, features2, features3;
+  features1.keypoints.resize(kNumFeatures);
+  features1.descriptors.resize(kNumFeatures, kDescriptorDimension);
+  rng.SetRandom(&features1.descriptors);
+  for (int i = 0; i < kNumFeatures; i++) {
+    features1.keypoints[i].set_scale(i);
+    features1.descriptors.row(i).normalize();
+  }
+  features2 = features1;
+  features3 = features1;
+  rng.SetRandom(&features3.descriptors);
+  for (int i = 0; i < kNumFeatures; i++) {
+    features3.descriptors.row(i).normalize();
+  }
+
+  EXPECT_EQ(CountPreemptiveMatches(
+                features1, features2, kNumPreemptiveFeatures, 0.8, false),
+            kNumPreemptiveFeatures);
+  EXPECT_LT(CountPreemptiveMatches(
+                features1, features3, kNumPreemptiveFeatures, 0.8, false),
+            kNumPreemptiveFeatures / 5);
+}
+
 }  // namespace theia
@@ -0,0 +1,121 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/feature_prefetcher.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace theia {
+
+FeaturePrefetcher::FeaturePrefetcher(
+    const std::vector<std::pair<std::string, std::string> >& pairs,
+    const std::vector<int>& block_ends,
+    const int num_blocks_ahead,
+    const std::function<void(const std::string&)>& prefetch_image)
+    : pairs_(pairs),
+      block_ends_(block_ends),
+      num_blocks_ahead_(num_blocks_ahead),
+      prefetch_image_(prefetch_image),
+      num_started_blocks_(0),
+      num_prefetched_blocks_(0),
+      stop_(false) {
+  CHECK_GT(num_blocks_ahead_, 0);
+  prefetch_thread_ = std::thread(&FeaturePrefetcher::PrefetchBlocks, this);
+}
+
+FeaturePrefetcher::~FeaturePrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  block_started_.notify_all();
+  prefetch_thread_.join();
+}
+
+void FeaturePrefetcher::NotifyBlockStarted(const int block) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_started_blocks_ = std::max(num_started_blocks_, block + 1);
+  }
+  block_started_.notify_all();
+}
+
+int FeaturePrefetcher::NumPrefetchedBlocks() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_prefetched_blocks_;
+}
+
+void FeaturePrefetcher::PrefetchBlocks() {
+  std::unordered_set<std::string> block_images;
+  for (int block = 0; block < block_ends_.size(); block++) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      block_started_.wait(lock, [this, block]() {
+        return stop_ || block < num_started_blocks_ + num_blocks_ahead_;
+      });
+      if (stop_) {
+        return;
+      }
+      // Prefetching is only useful for blocks that have not been started yet.
+      if (block < num_started_blocks_) {
+        continue;
+      }
+    }
+
+    const int block_start = block == 0 ? 0 : block_ends_[block - 1];
+    block_images.clear();
+    for (int i = block_start; i < block_ends_[block]; i++) {
+      for (const std::string* image : {&pairs_[i].first, &pairs_[i].second}) {
+        if (block_images.insert(*image).second) {
+          prefetch_image_(*image);
+        }
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++num_prefetched_blocks_;
+  }
+}
+
+}  // namespace theia
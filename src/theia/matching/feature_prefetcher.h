@@ -0,0 +1,102 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_FEATURE_PREFETCHER_H_
+#define THEIA_MATCHING_FEATURE_PREFETCHER_H_
+
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "theia/util/util.h"
+
+namespace theia {
+
+// Reads the features of upcoming image pairs in a background thread so that
+// out-of-core matching overlaps reading features from disk with matching. The
+// image pairs are matched in blocks (see OrderImagePairsForCacheLocality) and
+// the matching threads report when they start matching a block. The prefetcher
+// then prefetches the images of the next num_blocks_ahead blocks in order by
+// calling prefetch_image for each image, which should load the image into the
+// cache used for matching. The look-ahead window is bounded so that prefetched
+// images do not evict the images of the blocks that are being matched.
+class FeaturePrefetcher {
+ public:
+  // The pairs and block ends must remain valid while the prefetcher is
+  // running. The background thread is started upon construction.
+  FeaturePrefetcher(
+      const std::vector<std::pair<std::string, std::string> >& pairs,
+      const std::vector<int>& block_ends,
+      const int num_blocks_ahead,
+      const std::function<void(const std::string&)>& prefetch_image);
+
+  // Stops prefetching and waits for the background thread to finish.
+  ~FeaturePrefetcher();
+
+  // Must be called when a matching thread starts matching a block. Blocks that
+  // were already started are not prefetched anymore.
+  void NotifyBlockStarted(const int block);
+
+  // Returns the number of blocks that have been prefetched.
+  int NumPrefetchedBlocks();
+
+ private:
+  // Prefetches the images of each block once it is within the look-ahead
+  // window. This is run in the background thread.
+  void PrefetchBlocks();
+
+  const std::vector<std::pair<std::string, std::string> >& pairs_;
+  const std::vector<int>& block_ends_;
+  const int num_blocks_ahead_;
+  const std::function<void(const std::string&)> prefetch_image_;
+
+  std::mutex mutex_;
+  std::condition_variable block_started_;
+  // The index one past the last block that has been started.
+  int num_started_blocks_;
+  int num_prefetched_blocks_;
+  bool stop_;
+
+  std::thread prefetch_thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(FeaturePrefetcher);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_FEATURE_PREFETCHER_H_
@@ -0,0 +1,128 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/feature_prefetcher.h"
+
+#include <chrono>  // NOLINT
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+namespace {
+
+// Records the images that are prefetched.
+class PrefetchRecorder {
+ public:
+  void Prefetch(const std::string& image) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    images_.push_back(image);
+  }
+
+  std::vector<std::string> Images() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return images_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::string> images_;
+};
+
+// Waits until the prefetcher has prefetched the given number of blocks.
+void WaitForPrefetchedBlocks(FeaturePrefetcher* prefetcher,
+                             const int num_blocks) {
+  for (int i = 0; i < 1000; i++) {
+    if (prefetcher->NumPrefetchedBlocks() >= num_blocks) {
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+}  // namespace
+
+TEST(FeaturePrefetcher, PrefetchesBlocksWithinTheLookAheadWindow) {
+  const std::vector<std::pair<std::string, std::string> > pairs = {
+      {"a", "b"}, {"a", "c"}, {"b", "c"}, {"c", "d"}, {"d", "e"}, {"e", "f"}};
+  const std::vector<int> block_ends = {3, 4, 5, 6};
+  PrefetchRecorder recorder;
+  FeaturePrefetcher prefetcher(
+      pairs, block_ends, 2, [&recorder](const std::string& image) {
+        recorder.Prefetch(image);
+      });
+
+  // Before any block is started only the first two blocks are prefetched and
+  // each image is prefetched once per block.
+  WaitForPrefetchedBlocks(&prefetcher, 2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(prefetcher.NumPrefetchedBlocks(), 2);
+  EXPECT_EQ(recorder.Images(),
+            std::vector<std::string>({"a", "b", "c", "c", "d"}));
+
+  // Starting the first block moves the window by one block.
+  prefetcher.NotifyBlockStarted(0);
+  WaitForPrefetchedBlocks(&prefetcher, 3);
+  EXPECT_EQ(prefetcher.NumPrefetchedBlocks(), 3);
+  EXPECT_EQ(recorder.Images(),
+            std::vector<std::string>({"a", "b", "c", "c", "d", "d", "e"}));
+
+  // Blocks that have already been started are skipped.
+  prefetcher.NotifyBlockStarted(3);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(prefetcher.NumPrefetchedBlocks(), 3);
+  EXPECT_EQ(recorder.Images().size(), 7);
+}
+
+TEST(FeaturePrefetcher, StopsWhenDestroyed) {
+  const std::vector<std::pair<std::string, std::string> > pairs = {
+      {"a", "b"}, {"c", "d"}, {"e", "f"}};
+  const std::vector<int> block_ends = {1, 2, 3};
+  PrefetchRecorder recorder;
+  {
+    FeaturePrefetcher prefetcher(
+        pairs, block_ends, 1, [&recorder](const std::string& image) {
+          recorder.Prefetch(image);
+        });
+    WaitForPrefetchedBlocks(&prefetcher, 1);
+  }
+  EXPECT_EQ(recorder.Images(), std::vector<std::string>({"a", "b"}));
+}
+
+}  // namespace theia
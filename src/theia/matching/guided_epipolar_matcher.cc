@@ -37,21 +37,22 @@
 #include <Eigen/Core>
 #include <stdint.h>
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
 #include <limits>
+#include <numeric>
+#include <random>
+#include <tuple>
 #include <vector>
-#include <unordered_map>
-#include <unordered_set>
-
-#include "flann/flann.hpp"
 
+#include "theia/matching/feature_matcher_utils.h"
 #include "theia/matching/keypoints_and_descriptors.h"
-#include "theia/matching/distance.h"
 #include "theia/matching/indexed_feature_match.h"
 #include "theia/sfm/camera/camera.h"
 #include "theia/sfm/pose/fundamental_matrix_util.h"
-#include "theia/util/map_util.h"
-#include "theia/util/hash.h"
 #include "theia/util/random.h"
+#include "theia/util/threadpool.h"
 
 namespace theia {
 namespace {
@@ -86,6 +87,19 @@ void DecodeLineEndpoints(const uint64_t encoded_endpoint,
   endpoints->emplace_back(static_cast<double>(x2), static_cast<double>(y2));
 }
 
+// Adds the feature to the candidates of the epiline group unless it was
+// already added.
+void AddCandidate(const int feature_index,
+                  const int group_index,
+                  std::vector<int>* candidate_group,
+                  std::vector<int>* candidates) {
+  if ((*candidate_group)[feature_index] == group_index) {
+    return;
+  }
+  (*candidate_group)[feature_index] = group_index;
+  candidates->emplace_back(feature_index);
+}
+
 }  // namespace
 
 // Creates the grid structure for the fast epipolar lookup. This method must
@@ -100,98 +114,139 @@ bool GuidedEpipolarMatcher::Initialize(
   }
 
   // Create a fast lookup for determining if a feature has already been matched.
-  for (const IndexedFeatureMatch match : matches) {
-    matched_features1_.insert(match.feature1_ind);
-    matched_features2_.insert(match.feature2_ind);
+  matched_features1_.assign(features1_.keypoints.size(), false);
+  matched_features2_.assign(features2_.keypoints.size(), false);
+  for (const IndexedFeatureMatch& match : matches) {
+    matched_features1_[match.feature1_ind] = true;
+    matched_features2_[match.feature2_ind] = true;
   }
 
-  const double half_cell_width = options_.guided_matching_max_distance_pixels;
-  const double offset = half_cell_width;
-  image_grids_.emplace_back(ImageGrid(half_cell_width, 0, 0));
-  image_grids_.emplace_back(ImageGrid(half_cell_width, offset, 0));
-  image_grids_.emplace_back(ImageGrid(half_cell_width, 0, offset));
-  image_grids_.emplace_back(ImageGrid(half_cell_width, offset, offset));
-
-  // These helper vectors will be used to find the bounding box of the
-  // features. This will help constrain the search along epipolar lines later.
-  std::vector<double> x, y;
-  x.reserve(features2_.keypoints.size());
-  y.reserve(features2_.keypoints.size());
-  // For each grid, add all features from features2.
+  // Gather the unmatched features of image 2 and find their bounding box. This
+  // will help constrain the search along epipolar lines later.
+  std::vector<int> unmatched_features2;
+  unmatched_features2.reserve(features2_.keypoints.size());
+  top_left_.setConstant(std::numeric_limits<double>::max());
+  bottom_right_.setConstant(std::numeric_limits<double>::lowest());
   for (int i = 0; i < features2_.keypoints.size(); i++) {
     // TODO(csweeney): Test if the epipolar line of feature2 features is within
     // the image bounds of image 1. If not, we can skip the feature entirely.
-    if (ContainsKey(matched_features2_, i)) {
+    if (matched_features2_[i]) {
       continue;
     }
-    for (int j = 0; j < image_grids_.size(); j++) {
-      image_grids_[j].AddFeature(i,
-                                 features2_.keypoints[i].x(),
-                                 features2_.keypoints[i].y());
-    }
-    x.emplace_back(features2_.keypoints[i].x());
-    y.emplace_back(features2_.keypoints[i].y());
+    unmatched_features2.emplace_back(i);
+    const Eigen::Vector2d point(features2_.keypoints[i].x(),
+                                features2_.keypoints[i].y());
+    top_left_ = top_left_.cwiseMin(point);
+    bottom_right_ = bottom_right_.cwiseMax(point);
   }
 
-  // Set the bounding box of the features.
-  const auto& minmax_x = std::minmax_element(x.begin(), x.end());
-  const auto& minmax_y = std::minmax_element(y.begin(), y.end());
-  top_left_.x() = *minmax_x.first;
-  top_left_.y() = *minmax_y.first;
-  bottom_right_.x() = *minmax_x.second;
-  bottom_right_.y() = *minmax_y.second;
+  if (unmatched_features2.empty()) {
+    return false;
+  }
 
+  // The closest 2x2 window of cells to a point on an epipolar line contains
+  // all features within the guided matching distance along the axes.
+  image_grid_.reset(
+      new ImageGrid(options_.guided_matching_max_distance_pixels));
+  image_grid_->Build(features2_.keypoints, unmatched_features2);
   return true;
 }
 
 bool GuidedEpipolarMatcher::GetMatches(
     std::vector<IndexedFeatureMatch>* matches) {
   const int num_input_matches = matches->size();
-  const double lowes_ratio_sq = options_.lowes_ratio * options_.lowes_ratio;
 
-  Initialize(*matches);
+  // There is nothing left to match if all features in image 2 are matched.
+  if (!Initialize(*matches)) {
+    return true;
+  }
 
   // Group all epipolar lines.
   std::vector<EpilineGroup> epiline_groups;
   GroupEpipolarLines(&epiline_groups);
 
+  // Draw the random seed of each epiline group up front so that the matches do
+  // not depend on the order in which the groups are matched.
+  std::vector<unsigned> group_seeds(epiline_groups.size());
+  for (unsigned& group_seed : group_seeds) {
+    group_seed = rng_->RandInt(0, std::numeric_limits<int>::max());
+  }
+
   // Go through each epiline group and perform guided matching by only
-  // retrieving features near the epiline once per group.
-  for (const EpilineGroup& epiline_group : epiline_groups) {
+  // retrieving features near the epiline once per group. The groups are
+  // independent, so they are distributed across the threads.
+  std::vector<std::vector<IndexedFeatureMatch> > group_matches(
+      epiline_groups.size());
+  std::atomic<int> next_group_index(0);
+  const int num_threads = std::min(options_.num_threads,
+                                   static_cast<int>(epiline_groups.size()));
+  if (num_threads <= 1) {
+    MatchEpilineGroups(epiline_groups, group_seeds, &next_group_index,
+                       &group_matches);
+  } else {
+    ThreadPool pool(num_threads);
+    for (int i = 0; i < num_threads; i++) {
+      pool.Add(&GuidedEpipolarMatcher::MatchEpilineGroups, this,
+               std::cref(epiline_groups), std::cref(group_seeds),
+               &next_group_index, &group_matches);
+    }
+  }
+
+  for (const std::vector<IndexedFeatureMatch>& new_matches : group_matches) {
+    matches->insert(matches->end(), new_matches.begin(), new_matches.end());
+  }
+
+  const int num_added_matches = matches->size() - num_input_matches;
+  LOG_IF(INFO, num_added_matches > 0)
+      << "Guided matching added " << num_added_matches << " features to "
+      << num_input_matches << " existing matches out of "
+      << (std::min(features1_.keypoints.size(), features2_.keypoints.size()))
+      << " possible matches.";
+
+  return true;
+}
+
+void GuidedEpipolarMatcher::MatchEpilineGroups(
+    const std::vector<EpilineGroup>& epiline_groups,
+    const std::vector<unsigned>& group_seeds,
+    std::atomic<int>* next_group_index,
+    std::vector<std::vector<IndexedFeatureMatch> >* group_matches) const {
+  const float lowes_ratio_sq = options_.lowes_ratio * options_.lowes_ratio;
+
+  MatchingBuffers buffers;
+  buffers.candidate_group.resize(features2_.keypoints.size(), -1);
+
+  int group_index;
+  while ((group_index = next_group_index->fetch_add(1)) <
+         epiline_groups.size()) {
+    const EpilineGroup& epiline_group = epiline_groups[group_index];
+
     // Find all features close to this epiline.
-    std::vector<int> candidate_keypoint_indices;
-    FindFeaturesNearEpipolarLines(epiline_group, &candidate_keypoint_indices);
+    FindFeaturesNearEpipolarLines(group_index, epiline_group,
+                                  group_seeds[group_index], &buffers);
+    // The Lowes ratio test requires at least 2 candidate matches.
+    if (buffers.candidate_keypoint_indices.size() < 2) {
+      continue;
+    }
 
-    // Build a KD-tree for those features and query the tree to get the nearest
-    // neighbor matches for each feature in this epiline group.
-    std::vector<std::vector<float> > nn_distances;
-    std::vector<std::vector<int> > nn_indices;
-    FindKNearestNeighbors(epiline_group.features, candidate_keypoint_indices,
-                          &nn_distances, &nn_indices);
+    // Get the nearest neighbor matches for each feature in this epiline group.
+    FindKNearestNeighbors(epiline_group.features, &buffers);
 
     // For each feature in the epiline group, check the Lowes ratio of the top 2
     // nearest neighbors to determine if the match is valid.
-    for (int i = 0; i < nn_distances.size(); i++) {
+    for (int i = 0; i < epiline_group.features.size(); i++) {
+      const float* nn_distances = &buffers.nn_distances[2 * i];
       // If the top 2 distance pass lowes ratio test then add the match to the
       // output.
-      if (nn_distances[i][0] < nn_distances[i][1] * lowes_ratio_sq) {
+      if (nn_distances[0] < nn_distances[1] * lowes_ratio_sq) {
         IndexedFeatureMatch match;
         match.feature1_ind = epiline_group.features[i];
-        match.feature2_ind = nn_indices[i][0];
-        match.distance = nn_distances[i][0];
-        matches->emplace_back(match);
+        match.feature2_ind = buffers.nn_indices[2 * i];
+        match.distance = nn_distances[0];
+        (*group_matches)[group_index].emplace_back(match);
       }
     }
   }
-
-  const int num_added_matches = matches->size() - num_input_matches;
-  LOG_IF(INFO, num_added_matches > 0)
-      << "Guided matching added " << num_added_matches << " features to "
-      << num_input_matches << " existing matches out of "
-      << (std::min(features1_.keypoints.size(), features2_.keypoints.size()))
-      << " possible matches.";
-
-  return true;
 }
 
 void GuidedEpipolarMatcher::GroupEpipolarLines(
@@ -212,7 +267,7 @@ void GuidedEpipolarMatcher::GroupEpipolarLines(
   std::vector<std::pair<uint64_t, int> > sorted_endpoints;
   sorted_endpoints.reserve(features1_.keypoints.size());
   for (int i = 0; i < features1_.keypoints.size(); i++) {
-    if (ContainsKey(matched_features1_, i)) {
+    if (matched_features1_[i]) {
       continue;
     }
 
@@ -274,11 +329,16 @@ void GuidedEpipolarMatcher::GroupEpipolarLines(
 }
 
 void GuidedEpipolarMatcher::FindFeaturesNearEpipolarLines(
+    const int group_index,
     const EpilineGroup& epiline_group,
-    std::vector<int>* candidate_keypoint_indices) {
+    const unsigned seed,
+    MatchingBuffers* buffers) const {
   static const int kMinNumMatchesFound = 50;
 
   const std::vector<Eigen::Vector2d>& line_endpoints = epiline_group.endpoints;
+  std::vector<int>* candidate_keypoint_indices =
+      &buffers->candidate_keypoint_indices;
+  candidate_keypoint_indices->clear();
 
   // The number of steps required to "walk" between the line endpoints.
   const int num_steps =
@@ -287,7 +347,6 @@ void GuidedEpipolarMatcher::FindFeaturesNearEpipolarLines(
 
   // Sample the epipolar line equally between the points where it intersects
   // the features bounding box.
-  std::unordered_set<int> candidate_keypoints;
   const Eigen::Vector2d line_delta =
       (line_endpoints[0] - line_endpoints[1]) / static_cast<double>(num_steps);
   Eigen::Vector2d sample_point = line_endpoints[1];
@@ -295,31 +354,28 @@ void GuidedEpipolarMatcher::FindFeaturesNearEpipolarLines(
   for (int i = 0; i < num_steps; i++) {
     sample_point += line_delta;
 
-    // Find the cell center among all grids that is closest and add the
-    // keypoints belonging to that cell.
-    std::vector<int> new_keypoints;
-    FindClosestCellAndKeypoints(sample_point, &new_keypoints);
-    candidate_keypoints.insert(new_keypoints.begin(), new_keypoints.end());
+    // Find the cells that are closest and add the keypoints belonging to them.
+    FindClosestCellAndKeypoints(sample_point, group_index, buffers);
   }
 
   // If we do not have enough features then the lowes ratio test is not
   // meaningful. Add some random features here so that lowes ratio is more
   // informative of whether we have a good match or not.
-  if (candidate_keypoints.size() < kMinNumMatchesFound) {
-    const int num_current_keypoints = candidate_keypoints.size();
+  if (candidate_keypoint_indices->size() < kMinNumMatchesFound) {
+    std::minstd_rand generator(seed);
+    std::uniform_int_distribution<int> distribution(
+        0, features2_.keypoints.size() - 1);
+    const int num_current_keypoints = candidate_keypoint_indices->size();
     for (int i = num_current_keypoints; i < kMinNumMatchesFound; i++) {
-      candidate_keypoints.insert(
-          rng_->RandInt(0, features2_.keypoints.size() - 1));
+      AddCandidate(distribution(generator), group_index,
+                   &buffers->candidate_group, candidate_keypoint_indices);
     }
   }
-  candidate_keypoint_indices->insert(candidate_keypoint_indices->end(),
-                                     candidate_keypoints.begin(),
-                                     candidate_keypoints.end());
 }
 
 void GuidedEpipolarMatcher::FindEpipolarLineIntersection(
     const Eigen::Vector3d& epipolar_line,
-    std::vector<Eigen::Vector2d>* lines) {
+    std::vector<Eigen::Vector2d>* lines) const {
   const double y_of_left_intersection =
       -(epipolar_line.z() + epipolar_line.x() * top_left_.x()) /
       epipolar_line.y();
@@ -357,114 +413,156 @@ void GuidedEpipolarMatcher::FindEpipolarLineIntersection(
 
 void GuidedEpipolarMatcher::FindKNearestNeighbors(
     const std::vector<int>& query_feature_indices,
-    const std::vector<int>& candidate_feature_indices,
-    std::vector<std::vector<float> >* nn_distances,
-    std::vector<std::vector<int> >* nn_indices) {
-  static const int kNumNearestNeighbors = 2;
-  static const int kMinNumLeafsVisited = 50;
-  const int num_descriptor_dimensions = features1_.descriptors[0].size();
-
-  // Gather the query descriptors.
-  Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      query_descriptors(query_feature_indices.size(),
-                        num_descriptor_dimensions);
-  for (int i = 0; i < query_feature_indices.size(); i++) {
-    const int match_index = query_feature_indices[i];
-    query_descriptors.row(i) = features1_.descriptors[match_index];
+    MatchingBuffers* buffers) const {
+  const std::vector<int>& candidate_feature_indices =
+      buffers->candidate_keypoint_indices;
+  const int num_queries = query_feature_indices.size();
+  const int num_candidates = candidate_feature_indices.size();
+
+  // Gather the query and candidate descriptors, which are converted to floats
+  // if they are stored with reduced precision. The buffers only grow so that
+  // they are not reallocated for each epiline group.
+  DescriptorMatrix& query_descriptors = buffers->query_descriptors;
+  GetFloatDescriptors(features1_, query_feature_indices, &query_descriptors);
+  DescriptorMatrix& candidate_descriptors = buffers->candidate_descriptors;
+  GetFloatDescriptors(
+      features2_, candidate_feature_indices, &candidate_descriptors);
+  if (buffers->candidate_squared_norms.size() < num_candidates) {
+    buffers->candidate_squared_norms.resize(num_candidates);
   }
-  flann::Matrix<float> flann_query_descriptors(query_descriptors.data(),
-                                               query_descriptors.rows(),
-                                               query_descriptors.cols());
-
-  // Gather the candidate matching descriptors.
-  Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
-      candidate_descriptors(candidate_feature_indices.size(),
-                            num_descriptor_dimensions);
-  for (int i = 0; i < candidate_feature_indices.size(); i++) {
-    const int match_index = candidate_feature_indices[i];
-    candidate_descriptors.row(i) = features2_.descriptors[match_index];
+  for (int i = 0; i < num_candidates; i++) {
+    buffers->candidate_squared_norms(i) =
+        candidate_descriptors.row(i).squaredNorm();
+  }
+  Eigen::MatrixXf& dot_products = buffers->descriptor_dot_products;
+  if (dot_products.rows() < num_candidates ||
+      dot_products.cols() < num_queries) {
+    dot_products.resize(std::max<int>(dot_products.rows(), num_candidates),
+                        std::max<int>(dot_products.cols(), num_queries));
   }
 
-  // Create the searchable KD-tree with FLANN.
-  flann::Matrix<float> flann_candidate_descriptors(
-      candidate_descriptors.data(), candidate_descriptors.rows(),
-      candidate_descriptors.cols());
-
-  flann::Index<flann::L2<float> > flann_kd_tree(
-      flann_candidate_descriptors, flann::KDTreeSingleIndexParams());
-  flann_kd_tree.buildIndex();
-
-  // Query the KD-tree to get the top 2 nearest neighbors.
-  const int max_leafs_to_check =
-      std::max(static_cast<int>(candidate_descriptors.rows() * 0.2),
-               kMinNumLeafsVisited);
-  flann_kd_tree.knnSearch(flann_query_descriptors, *nn_indices, *nn_distances,
-                          kNumNearestNeighbors,
-                          flann::SearchParams(max_leafs_to_check));
+  // The candidate sets are small, so an exhaustive search is faster than
+  // building a search index. The squared L2 distances are computed as
+  // |q|^2 + |c|^2 - 2 * q.c with a single matrix product.
+  dot_products.topLeftCorner(num_candidates, num_queries).noalias() =
+      candidate_descriptors.topRows(num_candidates) *
+      query_descriptors.topRows(num_queries).transpose();
 
   // Output the top 2 matches.
-  for (int i = 0; i < query_feature_indices.size(); i++) {
-    // Change the NN indices to be the feature index instead of the index of the
-    // FLANN matrix.
-    for (int j = 0; j < kNumNearestNeighbors; j++) {
-      const int flann_index = (*nn_indices)[i][j];
-      (*nn_indices)[i][j] = candidate_feature_indices[flann_index];
+  buffers->nn_distances.resize(2 * num_queries);
+  buffers->nn_indices.resize(2 * num_queries);
+  for (int i = 0; i < num_queries; i++) {
+    const float query_squared_norm = query_descriptors.row(i).squaredNorm();
+    float* nn_distances = &buffers->nn_distances[2 * i];
+    int* nn_indices = &buffers->nn_indices[2 * i];
+    nn_distances[0] = nn_distances[1] = std::numeric_limits<float>::max();
+    nn_indices[0] = nn_indices[1] = -1;
+    for (int j = 0; j < num_candidates; j++) {
+      const float distance =
+          std::max(0.0f,
+                   query_squared_norm + buffers->candidate_squared_norms(j) -
+                       2.0f * dot_products(j, i));
+      if (distance < nn_distances[0]) {
+        nn_distances[1] = nn_distances[0];
+        nn_indices[1] = nn_indices[0];
+        nn_distances[0] = distance;
+        nn_indices[0] = candidate_feature_indices[j];
+      } else if (distance < nn_distances[1]) {
+        nn_distances[1] = distance;
+        nn_indices[1] = candidate_feature_indices[j];
+      }
     }
   }
 }
 
 void GuidedEpipolarMatcher::FindClosestCellAndKeypoints(
-    const Eigen::Vector2d& point, std::vector<int>* new_keypoints) {
-  int min_grid = 0;
-  Eigen::Vector2i min_grid_center;
-  double min_dist = std::numeric_limits<double>::max();
-
-  // Find the grid cell with the closest center.
-  for (int i = 0; i < 4; i++) {
-    Eigen::Vector2i grid_center;
-    image_grids_[i].GetClosestGridCenter(point.x(), point.y(), &grid_center);
-    const double dist = (grid_center.cast<double>() - point).squaredNorm();
-    if (dist < min_dist) {
-      min_grid = i;
-      min_dist = dist;
-      std::swap(min_grid_center, grid_center);
+    const Eigen::Vector2d& point,
+    const int group_index,
+    MatchingBuffers* buffers) const {
+  // Every 2x2 window of cells is centered on a corner of the grid. Use the
+  // window centered on the corner closest to the point, which is the corner at
+  // the top left of the cell containing the point shifted by half a cell.
+  const double half_cell_size =
+      options_.guided_matching_max_distance_pixels / 2.0;
+  const Eigen::Vector2i corner = image_grid_->GetCell(
+      point.x() + half_cell_size, point.y() + half_cell_size);
+
+  // Get the features from the cells of the window.
+  const std::vector<int>& features = image_grid_->features();
+  for (int row = corner.y() - 1; row <= corner.y(); row++) {
+    int begin, end;
+    image_grid_->GetFeaturesInRow(row, corner.x() - 1, corner.x(), &begin,
+                                  &end);
+    for (int i = begin; i < end; i++) {
+      AddCandidate(features[i], group_index, &buffers->candidate_group,
+                   &buffers->candidate_keypoint_indices);
     }
   }
-
-  // Get the features from the closest grid cell.
-  image_grids_[min_grid].GetFeaturesFromCell(min_grid_center, new_keypoints);
 }
 
-GuidedEpipolarMatcher::ImageGrid::ImageGrid(const double cell_size,
-                                            const double cell_offset_x,
-                                            const double cell_offset_y)
-    : cell_size_(cell_size),
-      cell_offset_x_(cell_offset_x),
-      cell_offset_y_(cell_offset_y) {
-  cells_.reserve(10000);
-}
+GuidedEpipolarMatcher::ImageGrid::ImageGrid(const double cell_size)
+    : cell_size_(cell_size), min_row_(0) {}
+
+void GuidedEpipolarMatcher::ImageGrid::Build(
+    const std::vector<Keypoint>& keypoints,
+    const std::vector<int>& feature_indices) {
+  row_offsets_.clear();
+  cell_columns_.clear();
+  cell_features_.clear();
+  if (feature_indices.empty()) {
+    return;
+  }
 
-void GuidedEpipolarMatcher::ImageGrid::AddFeature(const int feature_index,
-                                                  const double x,
-                                                  const double y) {
-  Eigen::Vector2i grid_center;
-  GetClosestGridCenter(x, y, &grid_center);
-  cells_[grid_center].emplace_back(feature_index);
+  // Sort the features by their cell in row-major order.
+  std::vector<std::tuple<int, int, int> > sorted_features;
+  sorted_features.reserve(feature_indices.size());
+  for (const int feature_index : feature_indices) {
+    const Eigen::Vector2i cell =
+        GetCell(keypoints[feature_index].x(), keypoints[feature_index].y());
+    sorted_features.emplace_back(cell.y(), cell.x(), feature_index);
+  }
+  std::sort(sorted_features.begin(), sorted_features.end());
+
+  // Count the features in each row and accumulate the counts into the offsets
+  // of the rows.
+  min_row_ = std::get<0>(sorted_features.front());
+  const int num_rows = std::get<0>(sorted_features.back()) - min_row_ + 1;
+  row_offsets_.assign(num_rows + 1, 0);
+  cell_columns_.reserve(sorted_features.size());
+  cell_features_.reserve(sorted_features.size());
+  for (const auto& sorted_feature : sorted_features) {
+    ++row_offsets_[std::get<0>(sorted_feature) - min_row_ + 1];
+    cell_columns_.emplace_back(std::get<1>(sorted_feature));
+    cell_features_.emplace_back(std::get<2>(sorted_feature));
+  }
+  std::partial_sum(row_offsets_.begin(), row_offsets_.end(),
+                   row_offsets_.begin());
 }
 
-void GuidedEpipolarMatcher::ImageGrid::GetClosestGridCenter(
-    const double x, const double y, Eigen::Vector2i* grid_center) {
-  grid_center->x() = static_cast<int>(
-      std::floor((x - cell_offset_x_) / (2.0 * cell_size_)) * 2.0 * cell_size_ +
-      cell_size_ + cell_offset_x_);
-  grid_center->y() = static_cast<int>(
-      std::floor((y - cell_offset_y_) / (2.0 * cell_size_)) * 2.0 * cell_size_ +
-      + cell_size_ + cell_offset_y_);
+Eigen::Vector2i GuidedEpipolarMatcher::ImageGrid::GetCell(
+    const double x, const double y) const {
+  return Eigen::Vector2i(static_cast<int>(std::floor(x / cell_size_)),
+                         static_cast<int>(std::floor(y / cell_size_)));
 }
 
-void GuidedEpipolarMatcher::ImageGrid::GetFeaturesFromCell(
-    const Eigen::Vector2i& cell_center, std::vector<int>* feature_indices) {
-  *feature_indices = FindWithDefault(cells_, cell_center, std::vector<int>());
+void GuidedEpipolarMatcher::ImageGrid::GetFeaturesInRow(const int row,
+                                                        const int min_column,
+                                                        const int max_column,
+                                                        int* begin,
+                                                        int* end) const {
+  const int row_index = row - min_row_;
+  if (row_index < 0 ||
+      row_index + 1 >= static_cast<int>(row_offsets_.size())) {
+    *begin = *end = 0;
+    return;
+  }
+
+  const auto& row_begin = cell_columns_.begin() + row_offsets_[row_index];
+  const auto& row_end = cell_columns_.begin() + row_offsets_[row_index + 1];
+  *begin =
+      std::lower_bound(row_begin, row_end, min_column) - cell_columns_.begin();
+  *end = std::upper_bound(cell_columns_.begin() + *begin, row_end, max_column) -
+         cell_columns_.begin();
 }
 
 }  // namespace theia
@@ -36,16 +36,15 @@
 #define THEIA_MATCHING_GUIDED_EPIPOLAR_MATCHER_H_
 
 #include <Eigen/Core>
+#include <atomic>
 #include <memory>
-#include <unordered_map>
-#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "theia/alignment/alignment.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/matching/keypoints_and_descriptors.h"
 #include "theia/sfm/camera/camera.h"
-#include "theia/util/hash.h"
 
 namespace theia {
 class RandomNumberGenerator;
@@ -67,6 +66,10 @@ class GuidedEpipolarMatcher {
     // nearest neighbor's match distance is less than lowes_ratio * the second
     // nearest neighbor's descriptor distance.
     double lowes_ratio = 0.8;
+
+    // Number of threads used to match the groups of epipolar lines. The
+    // matches that are found do not depend on the number of threads.
+    int num_threads = 1;
   };
 
   GuidedEpipolarMatcher(const Options& options,
@@ -86,30 +89,43 @@ class GuidedEpipolarMatcher {
   bool GetMatches(std::vector<IndexedFeatureMatch>* matches);
 
  private:
-  // This helper class provides quick and easy access to the image grids that
-  // are used to rapidly find features near epipolar lines.
+  // This helper class provides quick and easy access to the features near a
+  // point so that features near epipolar lines may be found rapidly. The grid
+  // is stored in compressed sparse row format: each row of cells holds the
+  // features in that row sorted by the column of their cell, so the memory
+  // used is proportional to the number of rows and features rather than to the
+  // number of cells.
   class ImageGrid {
    public:
-    ImageGrid(const double cell_size,
-              const double cell_offset_x,
-              const double cell_offset_y);
+    explicit ImageGrid(const double cell_size);
+
+    // Assigns the given features to the grid cells. Any features previously
+    // added to the grid are removed.
+    void Build(const std::vector<Keypoint>& keypoints,
+               const std::vector<int>& feature_indices);
 
-    // Add a feature the the grid and assign it to a cell.
-    void AddFeature(const int feature_index, const double x, const double y);
+    // Retrieve the cell that contains the point.
+    Eigen::Vector2i GetCell(const double x, const double y) const;
 
-    // Retrieve the closest cell center to the point.
-    void GetClosestGridCenter(const double x, const double y,
-                              Eigen::Vector2i* grid_center);
+    // Sets [*begin, *end) to the range of features() that lie within the given
+    // row in the columns min_column through max_column.
+    void GetFeaturesInRow(const int row,
+                          const int min_column,
+                          const int max_column,
+                          int* begin,
+                          int* end) const;
 
-    // Get all features that lie within the cell specified by the center.
-    void GetFeaturesFromCell(const Eigen::Vector2i& cell_center,
-                             std::vector<int>* feature_indices);
+    const std::vector<int>& features() const { return cell_features_; }
 
    private:
-    // A container for the grid cells. The mapping is such the the cell center
-    // contains all keypoints in the cell.
-    std::unordered_map<Eigen::Vector2i, std::vector<int>> cells_;
-    double cell_size_, cell_offset_x_, cell_offset_y_;
+    double cell_size_;
+    int min_row_;
+    // The features of row i are held in cell_features_[row_offsets_[i]]
+    // through cell_features_[row_offsets_[i + 1] - 1] and are sorted by the
+    // column of their cell, which is held in cell_columns_.
+    std::vector<int> row_offsets_;
+    std::vector<int> cell_columns_;
+    std::vector<int> cell_features_;
   };
 
   // Holds a group of features with similar epiplines as a single epiline.
@@ -118,6 +134,22 @@ class GuidedEpipolarMatcher {
     std::vector<int> features;
   };
 
+  // Scratch space for matching an epiline group. Each thread owns one instance
+  // so that the buffers are only allocated once and then reused for all of the
+  // epiline groups that the thread matches.
+  struct MatchingBuffers {
+    // The index of the last epiline group that added each feature of image 2
+    // to the candidates, used to remove duplicate candidates.
+    std::vector<int> candidate_group;
+    std::vector<int> candidate_keypoint_indices;
+    DescriptorMatrix query_descriptors;
+    DescriptorMatrix candidate_descriptors;
+    Eigen::MatrixXf descriptor_dot_products;
+    Eigen::VectorXf candidate_squared_norms;
+    std::vector<float> nn_distances;
+    std::vector<int> nn_indices;
+  };
+
   // Creates the grid structure for the fast epipolar lookup.
   bool Initialize(const std::vector<IndexedFeatureMatch>& matches);
 
@@ -125,33 +157,41 @@ class GuidedEpipolarMatcher {
   // workload may be reduced.
   void GroupEpipolarLines(std::vector<EpilineGroup>* epiline_groups);
 
-  // Finds all features near a given epipolar line.
-  void FindFeaturesNearEpipolarLines(
-      const EpilineGroup& epiline_group,
-      std::vector<int>* candidate_keypoint_indices);
+  // Matches the features of the epiline groups until no groups are left. The
+  // next group to match is taken from next_group_index so that multiple threads
+  // may run this method concurrently. The matches of group i are written to
+  // group_matches[i].
+  void MatchEpilineGroups(
+      const std::vector<EpilineGroup>& epiline_groups,
+      const std::vector<unsigned>& group_seeds,
+      std::atomic<int>* next_group_index,
+      std::vector<std::vector<IndexedFeatureMatch> >* group_matches) const;
+
+  // Finds all features near a given epipolar line. The random number seed is
+  // used to select additional features if too few features are near the line.
+  void FindFeaturesNearEpipolarLines(const int group_index,
+                                     const EpilineGroup& epiline_group,
+                                     const unsigned seed,
+                                     MatchingBuffers* buffers) const;
 
   // Finds the intersection of an epipolar line with the bounding box of the
   // features.
   void FindEpipolarLineIntersection(const Eigen::Vector3d& epipolar_line,
-                                    std::vector<Eigen::Vector2d>* lines);
-
-  // Computes a fundamental matrix from the cameras.
-  Eigen::Matrix3d ComputeFundamentalMatrix();
+                                    std::vector<Eigen::Vector2d>* lines) const;
 
-  // Finds the closest grid cell among all image grids and returns the keypoints
-  // in that cell.
+  // Finds the closest window of 2x2 grid cells to the point and adds the
+  // keypoints in those cells to the candidates of the epiline group.
   void FindClosestCellAndKeypoints(const Eigen::Vector2d& point,
-                                   std::vector<int>* new_keypoints);
+                                   const int group_index,
+                                   MatchingBuffers* buffers) const;
 
   // Given the set of query descriptors (in features1) and the candidate matches
-  // (in features2), return the top 2 nearest neighbor distances and indices
-  // where the index is the index in features2 of the match. The format is
-  // nn_distances[query_feature_index][nn_number] where nn_number == 0 is the
-  // closest neighbor by descriptor distance.
+  // (in features2) held in the buffers, compute the top 2 nearest neighbor
+  // squared distances and indices where the index is the index in features2 of
+  // the match. The format is nn_distances[2 * query_index + nn_number] where
+  // nn_number == 0 is the closest neighbor by descriptor distance.
   void FindKNearestNeighbors(const std::vector<int>& query_feature_indices,
-                             const std::vector<int>& candidate_feature_indices,
-                             std::vector<std::vector<float> >* nn_distances,
-                             std::vector<std::vector<int> >* nn_indices);
+                             MatchingBuffers* buffers) const;
 
   const Options options_;
   const Camera& camera1_, camera2_;
@@ -160,8 +200,8 @@ class GuidedEpipolarMatcher {
   std::shared_ptr<RandomNumberGenerator> rng_;
 
   Eigen::Vector2d top_left_, bottom_right_;
-  std::vector<ImageGrid> image_grids_;
-  std::unordered_set<int> matched_features1_, matched_features2_;
+  std::unique_ptr<ImageGrid> image_grid_;
+  std::vector<bool> matched_features1_, matched_features2_;
 };
 
 }  // namespace theia
@@ -54,7 +54,8 @@ std::shared_ptr<RandomNumberGenerator> rng =
 
 void TestGuidedEpipolarMatcher(const int num_valid_matches,
                                const int num_invalid_matches,
-                               const int num_provided_matches) {
+                               const int num_provided_matches,
+                               const int num_threads = 1) {
   static const int kNumDescriptorDimensions = 128;
 
   // Set up two cameras, with camera 1 being at the coordinate system origin.
@@ -71,6 +72,10 @@ void TestGuidedEpipolarMatcher(const int num_valid_matches,
   // Create 3d points and reproject them into both images to form
   // correspondences.
   KeypointsAndDescriptors features1, features2;
+  features1.descriptors.resize(num_valid_matches + num_invalid_matches,
+                               kNumDescriptorDimensions);
+  features2.descriptors.resize(num_valid_matches + num_invalid_matches,
+                               kNumDescriptorDimensions);
   for (int i = 0; i < num_valid_matches; i++) {
     Eigen::Vector4d point(rng->RandDouble(-2.0, 2.0),
                           rng->RandDouble(-2.0, 2.0),
@@ -93,8 +98,8 @@ void TestGuidedEpipolarMatcher(const int num_valid_matches,
     Eigen::VectorXf descriptor(kNumDescriptorDimensions);
     rng->SetRandom(&descriptor);
     descriptor.normalize();
-    features1.descriptors.emplace_back(descriptor);
-    features2.descriptors.emplace_back(descriptor);
+    features1.descriptors.row(i) = descriptor.transpose();
+    features2.descriptors.row(i) = descriptor.transpose();
   }
 
   // Add bogus features to the image that have no matches.
@@ -108,9 +113,11 @@ void TestGuidedEpipolarMatcher(const int num_valid_matches,
                                      Keypoint::OTHER);
     Eigen::VectorXf rand_vec(kNumDescriptorDimensions);
     rng->SetRandom(&rand_vec);
-    features1.descriptors.emplace_back(rand_vec.normalized());
+    features1.descriptors.row(num_valid_matches + i) =
+        rand_vec.normalized().transpose();
     rng->SetRandom(&rand_vec);
-    features2.descriptors.emplace_back(rand_vec.normalized());
+    features2.descriptors.row(num_valid_matches + i) =
+        rand_vec.normalized().transpose();
   }
 
   // Add some pre-computed matches if applicable.
@@ -120,19 +127,42 @@ void TestGuidedEpipolarMatcher(const int num_valid_matches,
     match.feature1_ind = i;
     match.feature2_ind = i;
     match.distance =
-        (features1.descriptors[i] - features2.descriptors[i]).squaredNorm();
+        (features1.descriptors.row(i) - features2.descriptors.row(i))
+            .squaredNorm();
     matches.emplace_back(match);
   }
 
+  const std::vector<IndexedFeatureMatch> provided_matches = matches;
+
   // Run guided matching.
+  static const int kSeed = 71;
   GuidedEpipolarMatcher::Options options;
-  options.rng = rng;
+  options.rng = std::make_shared<RandomNumberGenerator>(kSeed);
+  options.num_threads = num_threads;
   GuidedEpipolarMatcher matcher(options, camera1, camera2, features1,
                                 features2);
 
   // Ensure that the guided matching returns true.
   EXPECT_TRUE(matcher.GetMatches(&matches));
 
+  // The matches must not depend on the number of threads.
+  if (num_threads > 1) {
+    std::vector<IndexedFeatureMatch> single_threaded_matches =
+        provided_matches;
+    options.rng = std::make_shared<RandomNumberGenerator>(kSeed);
+    options.num_threads = 1;
+    GuidedEpipolarMatcher single_threaded_matcher(options, camera1, camera2,
+                                                  features1, features2);
+    EXPECT_TRUE(single_threaded_matcher.GetMatches(&single_threaded_matches));
+    ASSERT_EQ(matches.size(), single_threaded_matches.size());
+    for (int i = 0; i < matches.size(); i++) {
+      EXPECT_EQ(matches[i].feature1_ind,
+                single_threaded_matches[i].feature1_ind);
+      EXPECT_EQ(matches[i].feature2_ind,
+                single_threaded_matches[i].feature2_ind);
+    }
+  }
+
   // Ensure enough matches were found.
   EXPECT_GT(matches.size(), num_provided_matches);
 
@@ -160,4 +190,14 @@ TEST(GuidedEpipolarMatcherTest, WithInputMatchesLarge) {
   TestGuidedEpipolarMatcher(2000, 500, 1000);
 }
 
+TEST(GuidedEpipolarMatcherTest, MultithreadedNoInputMatches) {
+  static const int kNumThreads = 4;
+  TestGuidedEpipolarMatcher(2000, 500, 0, kNumThreads);
+}
+
+TEST(GuidedEpipolarMatcherTest, MultithreadedWithInputMatches) {
+  static const int kNumThreads = 4;
+  TestGuidedEpipolarMatcher(2000, 500, 1000, kNumThreads);
+}
+
 }  // namespace theia
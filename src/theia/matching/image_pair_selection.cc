@@ -0,0 +1,197 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/image_pair_selection.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "flann/flann.hpp"
+
+namespace theia {
+
+namespace {
+
+// Appends the pair of image indices such that the smaller index is first.
+void AddImagePair(const int image1,
+                  const int image2,
+                  std::vector<std::pair<int, int> >* image_pairs) {
+  if (image1 != image2) {
+    image_pairs->emplace_back(std::min(image1, image2),
+                              std::max(image1, image2));
+  }
+}
+
+// Removes duplicate image pairs and converts the image indices to names.
+void ImageIndexPairsToNames(
+    const std::vector<std::string>& image_names,
+    std::vector<std::pair<int, int> >* image_index_pairs,
+    std::vector<std::pair<std::string, std::string> >* image_pairs) {
+  std::sort(image_index_pairs->begin(), image_index_pairs->end());
+  image_index_pairs->erase(
+      std::unique(image_index_pairs->begin(), image_index_pairs->end()),
+      image_index_pairs->end());
+
+  image_pairs->clear();
+  image_pairs->reserve(image_index_pairs->size());
+  for (const auto& image_index_pair : *image_index_pairs) {
+    image_pairs->emplace_back(image_names[image_index_pair.first],
+                              image_names[image_index_pair.second]);
+  }
+}
+
+}  // namespace
+
+void SelectImagePairsByPosition(
+    const ImagePairSelectionOptions& options,
+    const std::vector<std::string>& image_names,
+    const std::vector<Eigen::Vector3d>& positions,
+    std::vector<std::pair<std::string, std::string> >* image_pairs) {
+  CHECK_NOTNULL(image_pairs)->clear();
+  CHECK_EQ(image_names.size(), positions.size());
+  CHECK_GE(options.num_nearest_neighbors_by_position, 0);
+  CHECK_GE(options.max_distance_between_positions, 0.0);
+  const int num_images = positions.size();
+  if (num_images < 2) {
+    return;
+  }
+
+  // Build an exact kd-tree over the positions. The positions are copied since
+  // FLANN does not copy the dataset.
+  Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor> position_matrix(
+      num_images, 3);
+  for (int i = 0; i < num_images; i++) {
+    position_matrix.row(i) = positions[i].transpose();
+  }
+  flann::Matrix<double> flann_positions(
+      position_matrix.data(), num_images, 3);
+  flann::Index<flann::L2<double> > index(flann_positions,
+                                         flann::KDTreeSingleIndexParams());
+  index.buildIndex();
+
+  std::vector<std::pair<int, int> > image_index_pairs;
+  // The nearest neighbor of each image is the image itself, so one more
+  // neighbor is searched for.
+  if (options.num_nearest_neighbors_by_position > 0) {
+    const int num_neighbors =
+        std::min(num_images, options.num_nearest_neighbors_by_position + 1);
+    std::vector<std::vector<int> > neighbors;
+    std::vector<std::vector<double> > squared_distances;
+    index.knnSearch(flann_positions,
+                    neighbors,
+                    squared_distances,
+                    num_neighbors,
+                    flann::SearchParams(flann::FLANN_CHECKS_UNLIMITED));
+    for (int i = 0; i < num_images; i++) {
+      for (const int neighbor : neighbors[i]) {
+        AddImagePair(i, neighbor, &image_index_pairs);
+      }
+    }
+  }
+
+  // FLANN's L2 distance is the squared Euclidean distance.
+  if (options.max_distance_between_positions > 0.0) {
+    std::vector<std::vector<int> > neighbors;
+    std::vector<std::vector<double> > squared_distances;
+    const double max_distance = options.max_distance_between_positions;
+    index.radiusSearch(flann_positions,
+                       neighbors,
+                       squared_distances,
+                       max_distance * max_distance,
+                       flann::SearchParams(flann::FLANN_CHECKS_UNLIMITED));
+    for (int i = 0; i < num_images; i++) {
+      for (const int neighbor : neighbors[i]) {
+        AddImagePair(i, neighbor, &image_index_pairs);
+      }
+    }
+  }
+
+  ImageIndexPairsToNames(image_names, &image_index_pairs, image_pairs);
+}
+
+void SelectSequentialImagePairs(
+    const ImagePairSelectionOptions& options,
+    const std::vector<std::string>& image_names,
+    std::vector<std::pair<std::string, std::string> >* image_pairs) {
+  CHECK_NOTNULL(image_pairs)->clear();
+  CHECK_GE(options.sequential_window_size, 0);
+  CHECK_GE(options.loop_closure_interval, 0);
+  const int num_images = image_names.size();
+
+  std::vector<std::pair<int, int> > image_index_pairs;
+  for (int i = 0; i < num_images; i++) {
+    const int window_end =
+        std::min(num_images, i + options.sequential_window_size + 1);
+    for (int j = i + 1; j < window_end; j++) {
+      AddImagePair(i, j, &image_index_pairs);
+    }
+  }
+
+  if (options.loop_closure_interval > 0) {
+    const int interval = options.loop_closure_interval;
+    for (int i = 0; i < num_images; i += interval) {
+      for (int j = i + interval; j < num_images; j += interval) {
+        AddImagePair(i, j, &image_index_pairs);
+      }
+    }
+  }
+
+  ImageIndexPairsToNames(image_names, &image_index_pairs, image_pairs);
+}
+
+void CombineImagePairs(
+    const std::vector<std::vector<std::pair<std::string, std::string> > >&
+        candidate_image_pairs,
+    std::vector<std::pair<std::string, std::string> >* image_pairs) {
+  CHECK_NOTNULL(image_pairs)->clear();
+  for (const auto& candidates : candidate_image_pairs) {
+    for (const auto& candidate : candidates) {
+      if (candidate.first < candidate.second) {
+        image_pairs->emplace_back(candidate.first, candidate.second);
+      } else if (candidate.second < candidate.first) {
+        image_pairs->emplace_back(candidate.second, candidate.first);
+      }
+    }
+  }
+  std::sort(image_pairs->begin(), image_pairs->end());
+  image_pairs->erase(std::unique(image_pairs->begin(), image_pairs->end()),
+                     image_pairs->end());
+}
+
+}  // namespace theia
@@ -0,0 +1,97 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_IMAGE_PAIR_SELECTION_H_
+#define THEIA_MATCHING_IMAGE_PAIR_SELECTION_H_
+
+#include <Eigen/Core>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace theia {
+
+// Options for proposing the image pairs to match from the positions of the
+// images (e.g., GPS) and the order in which the images were captured. Matching
+// only these pairs instead of all image pairs reduces the cost of matching
+// drastically for aerial surveys, video, and other sequential captures.
+struct ImagePairSelectionOptions {
+  // Each image with a known position is paired with its
+  // num_nearest_neighbors_by_position nearest images and with all images that
+  // are within max_distance_between_positions of it (in the unit of the
+  // positions, e.g. meters for ECEF coordinates). Set these to 0 to disable
+  // them.
+  int num_nearest_neighbors_by_position = 0;
+  double max_distance_between_positions = 0.0;
+
+  // Each image is paired with the next sequential_window_size images in capture
+  // order. Set to 0 to disable.
+  int sequential_window_size = 0;
+
+  // Every loop_closure_interval-th image in capture order is paired with all
+  // other such images so that revisited places are matched (e.g. the start and
+  // end of a closed loop). Set to 0 to disable.
+  int loop_closure_interval = 0;
+};
+
+// Proposes the pairs of images that are close to each other. A kd-tree is
+// built over the positions to find the nearest neighbors and the neighbors
+// within the maximum distance of each image. Each pair is returned only once.
+void SelectImagePairsByPosition(
+    const ImagePairSelectionOptions& options,
+    const std::vector<std::string>& image_names,
+    const std::vector<Eigen::Vector3d>& positions,
+    std::vector<std::pair<std::string, std::string> >* image_pairs);
+
+// Proposes the pairs of images within a sliding window of the capture order as
+// well as periodic loop closure candidates. The images must be given in
+// capture order.
+void SelectSequentialImagePairs(
+    const ImagePairSelectionOptions& options,
+    const std::vector<std::string>& image_names,
+    std::vector<std::pair<std::string, std::string> >* image_pairs);
+
+// Returns the union of the candidate image pairs (e.g. from image retrieval,
+// positions, and capture order). Pairs are unordered, so (a, b) and (b, a) are
+// the same pair, and pairs of an image with itself are removed. The combined
+// pairs are sorted.
+void CombineImagePairs(
+    const std::vector<std::vector<std::pair<std::string, std::string> > >&
+        candidate_image_pairs,
+    std::vector<std::pair<std::string, std::string> >* image_pairs);
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_IMAGE_PAIR_SELECTION_H_
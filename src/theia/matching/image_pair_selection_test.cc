@@ -0,0 +1,138 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "theia/matching/image_pair_selection.h"
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+typedef std::vector<std::pair<std::string, std::string> > ImagePairs;
+
+namespace {
+
+std::vector<std::string> CreateImageNames(const int num_images) {
+  std::vector<std::string> image_names(num_images);
+  for (int i = 0; i < num_images; i++) {
+    image_names[i] = std::to_string(i);
+  }
+  return image_names;
+}
+
+}  // namespace
+
+TEST(SelectImagePairsByPosition, NearestNeighbors) {
+  // Two groups of images that are far apart.
+  const std::vector<std::string> image_names = CreateImageNames(5);
+  const std::vector<Eigen::Vector3d> positions = {
+    Eigen::Vector3d(0, 0, 0),
+    Eigen::Vector3d(1, 0, 0),
+    Eigen::Vector3d(0, 3, 0),
+    Eigen::Vector3d(1000, 0, 0),
+    Eigen::Vector3d(1000, 2, 0)
+  };
+
+  ImagePairSelectionOptions options;
+  options.num_nearest_neighbors_by_position = 1;
+  ImagePairs image_pairs;
+  SelectImagePairsByPosition(options, image_names, positions, &image_pairs);
+  const ImagePairs expected_pairs = {{"0", "1"}, {"0", "2"}, {"3", "4"}};
+  EXPECT_EQ(image_pairs, expected_pairs);
+
+  // Each image has at most 4 other images.
+  options.num_nearest_neighbors_by_position = 10;
+  SelectImagePairsByPosition(options, image_names, positions, &image_pairs);
+  EXPECT_EQ(image_pairs.size(), 10);
+}
+
+TEST(SelectImagePairsByPosition, MaxDistance) {
+  const std::vector<std::string> image_names = CreateImageNames(4);
+  const std::vector<Eigen::Vector3d> positions = {
+    Eigen::Vector3d(0, 0, 0),
+    Eigen::Vector3d(1, 0, 0),
+    Eigen::Vector3d(0, 3, 0),
+    Eigen::Vector3d(0, 10, 0)
+  };
+
+  ImagePairSelectionOptions options;
+  options.max_distance_between_positions = 3.5;
+  ImagePairs image_pairs;
+  SelectImagePairsByPosition(options, image_names, positions, &image_pairs);
+  const ImagePairs expected_pairs = {{"0", "1"}, {"0", "2"}, {"1", "2"}};
+  EXPECT_EQ(image_pairs, expected_pairs);
+}
+
+TEST(SelectSequentialImagePairs, WindowAndLoopClosures) {
+  const std::vector<std::string> image_names = CreateImageNames(7);
+
+  ImagePairSelectionOptions options;
+  options.sequential_window_size = 2;
+  ImagePairs image_pairs;
+  SelectSequentialImagePairs(options, image_names, &image_pairs);
+  const ImagePairs expected_window_pairs = {
+    {"0", "1"}, {"0", "2"}, {"1", "2"}, {"1", "3"}, {"2", "3"}, {"2", "4"},
+    {"3", "4"}, {"3", "5"}, {"4", "5"}, {"4", "6"}, {"5", "6"}
+  };
+  EXPECT_EQ(image_pairs, expected_window_pairs);
+
+  // Images 0, 3, and 6 are matched with each other.
+  options.sequential_window_size = 1;
+  options.loop_closure_interval = 3;
+  SelectSequentialImagePairs(options, image_names, &image_pairs);
+  const ImagePairs expected_pairs = {
+    {"0", "1"}, {"0", "3"}, {"0", "6"}, {"1", "2"}, {"2", "3"}, {"3", "4"},
+    {"3", "6"}, {"4", "5"}, {"5", "6"}
+  };
+  EXPECT_EQ(image_pairs, expected_pairs);
+}
+
+TEST(CombineImagePairs, Union) {
+  const std::vector<ImagePairs> candidate_image_pairs = {
+    {{"a", "b"}, {"c", "b"}},
+    {{"b", "a"}, {"d", "d"}, {"a", "c"}},
+    {}
+  };
+  ImagePairs image_pairs;
+  CombineImagePairs(candidate_image_pairs, &image_pairs);
+  const ImagePairs expected_pairs = {{"a", "b"}, {"a", "c"}, {"b", "c"}};
+  EXPECT_EQ(image_pairs, expected_pairs);
+}
+
+}  // namespace theia
@@ -0,0 +1,258 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/inverted_file.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "theia/util/map_util.h"
+#include "theia/util/threadpool.h"
+
+namespace theia {
+
+namespace {
+
+// Each thread queries this many images at a time.
+static const int kNumQueriesPerTask = 64;
+
+// Sorts the candidates by decreasing score and keeps the best ones. Ties are
+// broken by the image index so that the results are deterministic.
+void SelectMostSimilarImages(
+    const int num_neighbors,
+    std::vector<std::pair<int, float> >* similar_images) {
+  const auto more_similar = [](const std::pair<int, float>& lhs,
+                               const std::pair<int, float>& rhs) {
+    return lhs.second > rhs.second ||
+           (lhs.second == rhs.second && lhs.first < rhs.first);
+  };
+  const int num_similar_images =
+      std::min(num_neighbors, static_cast<int>(similar_images->size()));
+  std::partial_sort(similar_images->begin(),
+                    similar_images->begin() + num_similar_images,
+                    similar_images->end(),
+                    more_similar);
+  similar_images->resize(num_similar_images);
+}
+
+}  // namespace
+
+InvertedFile::InvertedFile(const int num_words) : num_words_(num_words) {
+  CHECK_GT(num_words_, 0);
+}
+
+void InvertedFile::AddImage(const std::string& image_name,
+                            const std::vector<int>& words) {
+  // Count the occurrences of each word.
+  std::vector<int> sorted_words = words;
+  std::sort(sorted_words.begin(), sorted_words.end());
+  std::vector<std::pair<int, float> > bag_of_words;
+  for (int i = 0; i < sorted_words.size(); i++) {
+    CHECK_GE(sorted_words[i], 0);
+    CHECK_LT(sorted_words[i], num_words_);
+    if (i == 0 || sorted_words[i] != sorted_words[i - 1]) {
+      bag_of_words.emplace_back(sorted_words[i], 0.0f);
+    }
+    bag_of_words.back().second += 1.0f;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(image_indices_.emplace(image_name, image_names_.size()).second)
+      << "The image " << image_name << " was added to the inverted file twice.";
+  image_names_.emplace_back(image_name);
+  bags_of_words_.emplace_back(std::move(bag_of_words));
+}
+
+void InvertedFile::BuildIndex() {
+  // Order the images by name so that the index does not depend on the order in
+  // which the images were added by different threads.
+  std::vector<int> order(image_names_.size());
+  for (int i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [this](const int lhs, const int rhs) {
+    return image_names_[lhs] < image_names_[rhs];
+  });
+  std::vector<std::string> sorted_image_names(order.size());
+  std::vector<std::vector<std::pair<int, float> > > sorted_bags_of_words(
+      order.size());
+  for (int i = 0; i < order.size(); i++) {
+    sorted_image_names[i].swap(image_names_[order[i]]);
+    sorted_bags_of_words[i].swap(bags_of_words_[order[i]]);
+    image_indices_[sorted_image_names[i]] = i;
+  }
+  image_names_.swap(sorted_image_names);
+  bags_of_words_.swap(sorted_bags_of_words);
+
+  // The inverse document frequency of a word is log(N / N_w), where N_w is the
+  // number of images that contain the word. Words that appear in every image
+  // do not help to distinguish the images and have zero weight.
+  std::vector<int> num_images_with_word(num_words_, 0);
+  for (const auto& bag_of_words : bags_of_words_) {
+    for (const auto& word : bag_of_words) {
+      ++num_images_with_word[word.first];
+    }
+  }
+
+  inverted_file_.clear();
+  inverted_file_.resize(num_words_);
+  const float num_images = bags_of_words_.size();
+  for (int i = 0; i < bags_of_words_.size(); i++) {
+    float squared_norm = 0.0f;
+    for (auto& word : bags_of_words_[i]) {
+      word.second *= std::log(num_images / num_images_with_word[word.first]);
+      squared_norm += word.second * word.second;
+    }
+    if (squared_norm == 0.0f) {
+      continue;
+    }
+
+    const float inverse_norm = 1.0f / std::sqrt(squared_norm);
+    for (auto& word : bags_of_words_[i]) {
+      word.second *= inverse_norm;
+      if (word.second > 0.0f) {
+        inverted_file_[word.first].emplace_back(i, word.second);
+      }
+    }
+  }
+}
+
+void InvertedFile::QueryImage(
+    const int image_index,
+    const int num_neighbors,
+    std::vector<float>* scores,
+    std::vector<std::pair<int, float> >* similar_images) const {
+  CHECK_EQ(inverted_file_.size(), num_words_)
+      << "BuildIndex must be called before querying the inverted file.";
+  similar_images->clear();
+
+  // Accumulate the dot products with all images that share a word with the
+  // query. The weights are never negative, so an image becomes a candidate
+  // when its score first becomes positive. Words and products with zero weight
+  // (e.g. of words that appear in every image) are skipped so that they
+  // neither add an image twice nor add images with zero similarity.
+  for (const auto& word : bags_of_words_[image_index]) {
+    if (word.second == 0.0f) {
+      continue;
+    }
+    for (const auto& image_with_word : inverted_file_[word.first]) {
+      const float weight = word.second * image_with_word.second;
+      if (image_with_word.first == image_index || weight == 0.0f) {
+        continue;
+      }
+      float& score = (*scores)[image_with_word.first];
+      if (score == 0.0f) {
+        similar_images->emplace_back(image_with_word.first, 0.0f);
+      }
+      score += weight;
+    }
+  }
+
+  for (auto& similar_image : *similar_images) {
+    similar_image.second = (*scores)[similar_image.first];
+    (*scores)[similar_image.first] = 0.0f;
+  }
+  SelectMostSimilarImages(num_neighbors, similar_images);
+}
+
+void InvertedFile::QueryImage(
+    const std::string& image_name,
+    const int num_neighbors,
+    std::vector<std::pair<std::string, float> >* similar_images) const {
+  CHECK_NOTNULL(similar_images)->clear();
+  std::vector<float> scores(image_names_.size(), 0.0f);
+  std::vector<std::pair<int, float> > similar_image_indices;
+  QueryImage(FindOrDie(image_indices_, image_name),
+             num_neighbors,
+             &scores,
+             &similar_image_indices);
+  for (const auto& similar_image : similar_image_indices) {
+    similar_images->emplace_back(image_names_[similar_image.first],
+                                 similar_image.second);
+  }
+}
+
+void InvertedFile::FindImagePairsToMatch(
+    const int num_neighbors,
+    const int num_threads,
+    std::vector<std::pair<std::string, std::string> >* image_pairs) const {
+  CHECK_NOTNULL(image_pairs)->clear();
+  const int num_images = image_names_.size();
+
+  // Query all images in parallel. Each task reuses its buffer of scores for
+  // all of its queries.
+  std::vector<std::vector<std::pair<int, float> > > similar_images(num_images);
+  std::unique_ptr<ThreadPool> pool(
+      new ThreadPool(std::max(1, std::min(num_threads, num_images))));
+  for (int start = 0; start < num_images; start += kNumQueriesPerTask) {
+    const int end = std::min(num_images, start + kNumQueriesPerTask);
+    pool->Add([this, start, end, num_neighbors, num_images, &similar_images]() {
+      std::vector<float> scores(num_images, 0.0f);
+      for (int i = start; i < end; i++) {
+        QueryImage(i, num_neighbors, &scores, &similar_images[i]);
+      }
+    });
+  }
+  // Wait for all queries to finish.
+  pool.reset(nullptr);
+
+  // Each pair may be found by the queries of both of its images.
+  std::vector<std::pair<int, int> > image_index_pairs;
+  image_index_pairs.reserve(num_images * num_neighbors);
+  for (int i = 0; i < num_images; i++) {
+    for (const auto& similar_image : similar_images[i]) {
+      image_index_pairs.emplace_back(std::min(i, similar_image.first),
+                                     std::max(i, similar_image.first));
+    }
+  }
+  std::sort(image_index_pairs.begin(), image_index_pairs.end());
+  image_index_pairs.erase(
+      std::unique(image_index_pairs.begin(), image_index_pairs.end()),
+      image_index_pairs.end());
+
+  image_pairs->reserve(image_index_pairs.size());
+  for (const auto& image_index_pair : image_index_pairs) {
+    image_pairs->emplace_back(image_names_[image_index_pair.first],
+                              image_names_[image_index_pair.second]);
+  }
+}
+
+}  // namespace theia
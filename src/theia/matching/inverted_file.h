@@ -0,0 +1,122 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_INVERTED_FILE_H_
+#define THEIA_MATCHING_INVERTED_FILE_H_
+
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "theia/util/util.h"
+
+namespace theia {
+
+// An inverted file for image retrieval with a visual vocabulary (e.g., a
+// VocabularyTree). Each image is described by a bag of visual words that is
+// weighted with TF-IDF and normalized, and the similarity of two images is the
+// dot product of their weighted bags of words. The inverted file stores the
+// images that contain each visual word, so the images that are similar to an
+// image are found by only visiting the images that share a visual word with it.
+// Typical use case is:
+//   InvertedFile inverted_file(vocabulary_tree.NumWords());
+//   for (int i = 0; i < num_images; i++) {
+//     std::vector<int> words;
+//     vocabulary_tree.Quantize(descriptors[i], &words);
+//     inverted_file.AddImage(image_names[i], words);
+//   }
+//   inverted_file.BuildIndex();
+//   std::vector<std::pair<std::string, std::string> > image_pairs;
+//   inverted_file.FindImagePairsToMatch(num_neighbors, num_threads,
+//                                       &image_pairs);
+class InvertedFile {
+ public:
+  explicit InvertedFile(const int num_words);
+
+  // Adds the visual words of the descriptors of an image. This method is
+  // thread-safe. All images must be added before BuildIndex is called.
+  void AddImage(const std::string& image_name, const std::vector<int>& words);
+
+  // Computes the TF-IDF weights of the images and builds the inverted file.
+  void BuildIndex();
+
+  // Returns the (at most) num_neighbors images that are most similar to the
+  // image along with their similarity scores, sorted from most to least
+  // similar. The image itself is not returned.
+  void QueryImage(
+      const std::string& image_name,
+      const int num_neighbors,
+      std::vector<std::pair<std::string, float> >* similar_images) const;
+
+  // Returns the pairs of each image and its num_neighbors most similar images.
+  // Each pair is only returned once, so there are at most
+  // num_images * num_neighbors pairs. The queries are run in parallel.
+  void FindImagePairsToMatch(
+      const int num_neighbors,
+      const int num_threads,
+      std::vector<std::pair<std::string, std::string> >* image_pairs) const;
+
+  int NumImages() const { return image_names_.size(); }
+
+ private:
+  // Returns the indices and scores of the most similar images to the image.
+  // The scores must have one zero entry per image, and are reset to zero before
+  // returning so that they can be reused by the next query.
+  void QueryImage(const int image_index,
+                  const int num_neighbors,
+                  std::vector<float>* scores,
+                  std::vector<std::pair<int, float> >* similar_images) const;
+
+  const int num_words_;
+  std::mutex mutex_;
+
+  std::vector<std::string> image_names_;
+  std::unordered_map<std::string, int> image_indices_;
+
+  // The TF-IDF weighted bag of words of each image, as (word, weight) pairs
+  // sorted by word. Before BuildIndex is called the weights are the number of
+  // occurrences of the words.
+  std::vector<std::vector<std::pair<int, float> > > bags_of_words_;
+
+  // The images that contain each word and the weight of the word in the image.
+  std::vector<std::vector<std::pair<int, float> > > inverted_file_;
+
+  DISALLOW_COPY_AND_ASSIGN(InvertedFile);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_INVERTED_FILE_H_
@@ -0,0 +1,107 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "theia/matching/inverted_file.h"
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+namespace {
+
+// Adds images that each contain a common word, which carries no information,
+// and a few words that they share with one other image.
+void AddImages(InvertedFile* inverted_file) {
+  inverted_file->AddImage("a", {0, 1, 2, 3, 3});
+  inverted_file->AddImage("b", {0, 1, 2, 3, 4});
+  inverted_file->AddImage("c", {0, 5, 6, 7, 4});
+  inverted_file->AddImage("d", {0, 5, 6, 7, 8});
+  inverted_file->AddImage("e", {0, 9});
+  inverted_file->BuildIndex();
+}
+
+}  // namespace
+
+TEST(InvertedFile, QueryImage) {
+  InvertedFile inverted_file(10);
+  AddImages(&inverted_file);
+  EXPECT_EQ(inverted_file.NumImages(), 5);
+
+  std::vector<std::pair<std::string, float> > similar_images;
+  inverted_file.QueryImage("a", 4, &similar_images);
+  // Image a only shares informative words with image b.
+  ASSERT_EQ(similar_images.size(), 1);
+  EXPECT_EQ(similar_images[0].first, "b");
+  EXPECT_GT(similar_images[0].second, 0.5);
+  EXPECT_LE(similar_images[0].second, 1.0 + 1e-6);
+
+  // Image c shares more words with d than with b.
+  inverted_file.QueryImage("c", 4, &similar_images);
+  ASSERT_EQ(similar_images.size(), 2);
+  EXPECT_EQ(similar_images[0].first, "d");
+  EXPECT_EQ(similar_images[1].first, "b");
+  EXPECT_GT(similar_images[0].second, similar_images[1].second);
+
+  inverted_file.QueryImage("c", 1, &similar_images);
+  ASSERT_EQ(similar_images.size(), 1);
+  EXPECT_EQ(similar_images[0].first, "d");
+
+  // Image e has no informative words in common with any image.
+  inverted_file.QueryImage("e", 4, &similar_images);
+  EXPECT_TRUE(similar_images.empty());
+}
+
+TEST(InvertedFile, FindImagePairsToMatch) {
+  InvertedFile inverted_file(10);
+  AddImages(&inverted_file);
+
+  std::vector<std::pair<std::string, std::string> > image_pairs;
+  inverted_file.FindImagePairsToMatch(1, 2, &image_pairs);
+  // The pair (c, d) is found by both queries but only returned once.
+  const std::vector<std::pair<std::string, std::string> > expected_pairs = {
+    {"a", "b"}, {"c", "d"}
+  };
+  EXPECT_EQ(image_pairs, expected_pairs);
+
+  inverted_file.FindImagePairsToMatch(2, 2, &image_pairs);
+  const std::vector<std::pair<std::string, std::string> >
+      expected_pairs_with_two_neighbors = {{"a", "b"}, {"b", "c"}, {"c", "d"}};
+  EXPECT_EQ(image_pairs, expected_pairs_with_two_neighbors);
+}
+
+}  // namespace theia
@@ -0,0 +1,228 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/kd_tree_feature_matcher.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flann/flann.hpp"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/feature_matcher_utils.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/util/concurrent_lru_cache.h"
+
+namespace theia {
+
+// The search index of the descriptors of a single image. FLANN does not copy
+// the data that an index is built on, so the index owns a copy of the
+// descriptors. This way the index remains valid even after the features of the
+// image are evicted from the feature cache. The copy holds float descriptors
+// even if the features are stored with reduced precision, so it is also used
+// to query the indices of other images.
+struct KdTreeIndex {
+  size_t NumBytes() const {
+    size_t num_bytes = sizeof(*this) + descriptors.size() * sizeof(float);
+    if (index != nullptr) {
+      num_bytes += index->usedMemory();
+    }
+    return num_bytes;
+  }
+
+  DescriptorMatrix descriptors;
+  std::unique_ptr<flann::Index<flann::L2<float> > > index;
+};
+
+namespace {
+
+// Finds the two nearest neighbors of each query descriptor in the index and
+// adds a match for each descriptor whose nearest neighbor passes the Lowe's
+// ratio test (if applicable). FLANN returns squared L2 distances so the squared
+// ratio is used.
+void FindMatchesWithIndex(const KdTreeIndex& index,
+                          const DescriptorMatrix& query_descriptors,
+                          const int max_checks,
+                          const bool use_lowes_ratio,
+                          const float sq_lowes_ratio,
+                          std::vector<IndexedFeatureMatch>* matches) {
+  const int num_queries = query_descriptors.rows();
+  const int num_neighbors =
+      std::min(2, static_cast<int>(index.descriptors.rows()));
+
+  // FLANN only reads the query descriptors, but its interface requires a
+  // non-const pointer.
+  flann::Matrix<float> flann_queries(
+      const_cast<float*>(query_descriptors.data()),
+      num_queries,
+      query_descriptors.cols());
+
+  // FLANN leaves the output untouched for neighbors that were not found within
+  // the check budget.
+  std::vector<size_t> nn_indices(num_queries * num_neighbors,
+                                 std::numeric_limits<size_t>::max());
+  std::vector<float> nn_distances(num_queries * num_neighbors,
+                                  std::numeric_limits<float>::max());
+  flann::Matrix<size_t> flann_indices(
+      nn_indices.data(), num_queries, num_neighbors);
+  flann::Matrix<float> flann_distances(
+      nn_distances.data(), num_queries, num_neighbors);
+  index.index->knnSearch(flann_queries,
+                         flann_indices,
+                         flann_distances,
+                         num_neighbors,
+                         flann::SearchParams(max_checks));
+
+  matches->reserve(matches->size() + num_queries);
+  for (int i = 0; i < num_queries; i++) {
+    const size_t nn_index = flann_indices[i][0];
+    if (nn_index >= index.descriptors.rows()) {
+      continue;
+    }
+
+    const float distance = flann_distances[i][0];
+    const float second_distance = num_neighbors > 1
+                                      ? flann_distances[i][1]
+                                      : std::numeric_limits<float>::max();
+    if (!use_lowes_ratio || distance < sq_lowes_ratio * second_distance) {
+      matches->emplace_back(i, nn_index, distance);
+    }
+  }
+}
+
+}  // namespace
+
+KdTreeFeatureMatcher::KdTreeFeatureMatcher(
+    const FeatureMatcherOptions& options)
+    : FeatureMatcher(options) {
+  CHECK_GT(options_.kd_tree_max_checks, 0);
+  std::function<std::shared_ptr<KdTreeIndex>(const std::string&)>
+      build_index = std::bind(&KdTreeFeatureMatcher::BuildKdTreeIndex,
+                              this,
+                              std::placeholders::_1);
+  std::function<size_t(const std::shared_ptr<KdTreeIndex>&)> index_size =
+      [](const std::shared_ptr<KdTreeIndex>& index) {
+        return index->NumBytes();
+      };
+  kd_tree_index_cache_.reset(
+      new KdTreeIndexCache(build_index, index_size, GetCacheOptions()));
+}
+
+KdTreeFeatureMatcher::~KdTreeFeatureMatcher() {}
+
+std::shared_ptr<KdTreeIndex> KdTreeFeatureMatcher::BuildKdTreeIndex(
+    const std::string& image_name) {
+  std::shared_ptr<KdTreeIndex> index(new KdTreeIndex);
+  GetFloatDescriptors(*GetKeypointsAndDescriptors(image_name),
+                      &index->descriptors);
+  // Images without descriptors are never matched.
+  if (index->descriptors.rows() == 0) {
+    return index;
+  }
+
+  const flann::Matrix<float> flann_descriptors(index->descriptors.data(),
+                                               index->descriptors.rows(),
+                                               index->descriptors.cols());
+  if (options_.kd_tree_index_type == KdTreeIndexType::HIERARCHICAL_KMEANS) {
+    index->index.reset(new flann::Index<flann::L2<float> >(
+        flann_descriptors,
+        flann::KMeansIndexParams(options_.kd_tree_kmeans_branching)));
+  } else {
+    index->index.reset(new flann::Index<flann::L2<float> >(
+        flann_descriptors,
+        flann::KDTreeIndexParams(options_.kd_tree_num_trees)));
+  }
+  index->index->buildIndex();
+  VLOG(1) << "Built the search index for image: " << image_name;
+  return index;
+}
+
+void KdTreeFeatureMatcher::PrefetchImage(const std::string& image_name) {
+  FeatureMatcher::PrefetchImage(image_name);
+  kd_tree_index_cache_->Prefetch(image_name);
+}
+
+bool KdTreeFeatureMatcher::MatchImagePair(
+    const KeypointsAndDescriptors& features1,
+    const KeypointsAndDescriptors& features2,
+    std::vector<IndexedFeatureMatch>* matches) {
+  const float sq_lowes_ratio =
+      this->options_.lowes_ratio * this->options_.lowes_ratio;
+
+  // Compute forward matches by querying the index of the second image with the
+  // float descriptors held by the index of the first image. By using a
+  // shared_ptr the indices stay alive while they are used even if the cache
+  // evicts them.
+  const std::shared_ptr<KdTreeIndex> index1 =
+      kd_tree_index_cache_->Fetch(features1.image_name);
+  const std::shared_ptr<KdTreeIndex> index2 =
+      kd_tree_index_cache_->Fetch(features2.image_name);
+  if (index1->descriptors.rows() == 0 || index2->descriptors.rows() == 0) {
+    return false;
+  }
+  FindMatchesWithIndex(*index2,
+                       index1->descriptors,
+                       this->options_.kd_tree_max_checks,
+                       this->options_.use_lowes_ratio,
+                       sq_lowes_ratio,
+                       matches);
+  if (matches->size() < this->options_.min_num_feature_matches) {
+    return false;
+  }
+
+  // Compute the symmetric matches, if applicable.
+  if (this->options_.keep_only_symmetric_matches) {
+    std::vector<IndexedFeatureMatch> reverse_matches;
+    FindMatchesWithIndex(*index1,
+                         index2->descriptors,
+                         this->options_.kd_tree_max_checks,
+                         this->options_.use_lowes_ratio,
+                         sq_lowes_ratio,
+                         &reverse_matches);
+    IntersectMatches(reverse_matches, matches);
+  }
+
+  return matches->size() >= this->options_.min_num_feature_matches;
+}
+
+}  // namespace theia
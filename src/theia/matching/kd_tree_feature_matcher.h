@@ -0,0 +1,90 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_KD_TREE_FEATURE_MATCHER_H_
+#define THEIA_MATCHING_KD_TREE_FEATURE_MATCHER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "theia/matching/feature_matcher.h"
+#include "theia/util/concurrent_lru_cache.h"
+#include "theia/util/util.h"
+
+namespace theia {
+struct IndexedFeatureMatch;
+struct KeypointsAndDescriptors;
+struct KdTreeIndex;
+
+// Performs feature matching with approximate nearest neighbor search using the
+// FLANN library. A search index (either a forest of randomized kd-trees or a
+// hierarchical k-means tree) is built once for the descriptors of each image
+// and is kept in an LRU cache alongside the features so that it is reused by
+// all image pairs that contain the image. The two nearest neighbors of each
+// descriptor are then found by querying the index of the other image, visiting
+// at most FeatureMatcherOptions::kd_tree_max_checks leaves, which allows
+// trading accuracy for speed. This is usually much faster than brute force
+// matching for images with many features.
+class KdTreeFeatureMatcher : public FeatureMatcher {
+ public:
+  explicit KdTreeFeatureMatcher(const FeatureMatcherOptions& options);
+  ~KdTreeFeatureMatcher();
+
+ private:
+  bool MatchImagePair(
+      const KeypointsAndDescriptors& features1,
+      const KeypointsAndDescriptors& features2,
+      std::vector<IndexedFeatureMatch>* matches) override;
+
+  // Prefetches the search index in addition to the features of the image.
+  void PrefetchImage(const std::string& image_name) override;
+
+  // Builds the search index for the descriptors of the image. This function is
+  // utilized by the internal cache so that the indices are only kept in memory
+  // while they are needed.
+  std::shared_ptr<KdTreeIndex> BuildKdTreeIndex(const std::string& image_name);
+
+  // An LRU cache that manages the search indices. The cache has the same
+  // capacity as the cache of keypoints and descriptors.
+  typedef ConcurrentLRUCache<std::string, std::shared_ptr<KdTreeIndex> >
+      KdTreeIndexCache;
+  std::unique_ptr<KdTreeIndexCache> kd_tree_index_cache_;
+
+  DISALLOW_COPY_AND_ASSIGN(KdTreeFeatureMatcher);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_KD_TREE_FEATURE_MATCHER_H_
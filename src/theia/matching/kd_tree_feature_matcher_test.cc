@@ -0,0 +1,177 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/matching/kd_tree_feature_matcher.h"
+#include "theia/test/feature_matcher_test_utils.h"
+#include "theia/util/random.h"
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+using Eigen::VectorXf;
+
+static const int kNumDescriptors = 200;
+static const int kNumDescriptorDimensions = 32;
+
+// Creates random descriptors for the first image and slightly perturbed copies
+// of them in reverse order for the second image, so that descriptor i of the
+// first image corresponds to descriptor kNumDescriptors - 1 - i of the second.
+void CreateCorrespondingDescriptors(std::vector<VectorXf>* descriptors1,
+                                    std::vector<VectorXf>* descriptors2) {
+  RandomNumberGenerator rng(59);
+  descriptors1->resize(kNumDescriptors);
+  descriptors2->resize(kNumDescriptors);
+  for (int i = 0; i < kNumDescriptors; i++) {
+    VectorXf descriptor(kNumDescriptorDimensions);
+    rng.SetRandom(&descriptor);
+    (*descriptors1)[i] = descriptor.normalized();
+
+    VectorXf noise(kNumDescriptorDimensions);
+    rng.SetRandom(&noise);
+    (*descriptors2)[kNumDescriptors - 1 - i] =
+        (descriptor + 0.01 * noise).normalized();
+  }
+}
+
+void TestMatchCorrespondingDescriptors(const FeatureMatcherOptions& options) {
+  std::vector<VectorXf> descriptors1, descriptors2;
+  CreateCorrespondingDescriptors(&descriptors1, &descriptors2);
+  test::ExpectCorrespondingDescriptorsMatch<KdTreeFeatureMatcher>(
+      options, "kd_tree", descriptors1, descriptors2);
+}
+
+TEST(KdTreeFeatureMatcherTest, RandomizedKdForestInCore) {
+  FeatureMatcherOptions options;
+  options.match_out_of_core = false;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+  options.kd_tree_index_type = KdTreeIndexType::RANDOMIZED_KD_FOREST;
+  // Visit all leaves so that the exact nearest neighbors are found.
+  options.kd_tree_max_checks = kNumDescriptors * 4;
+  TestMatchCorrespondingDescriptors(options);
+}
+
+TEST(KdTreeFeatureMatcherTest, HierarchicalKMeansOutOfCore) {
+  FeatureMatcherOptions options;
+  options.match_out_of_core = true;
+  options.keypoints_and_descriptors_output_dir = GTEST_TESTING_OUTPUT_DIRECTORY;
+  options.cache_capacity = 4;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+  options.kd_tree_index_type = KdTreeIndexType::HIERARCHICAL_KMEANS;
+  options.kd_tree_kmeans_branching = 8;
+  options.kd_tree_max_checks = kNumDescriptors;
+  TestMatchCorrespondingDescriptors(options);
+}
+
+TEST(KdTreeFeatureMatcherTest, RatioTest) {
+  // Set up descriptors.
+  std::vector<VectorXf> descriptor1(1);
+  std::vector<VectorXf> descriptor2(2);
+  descriptor1[0] = VectorXf::Constant(kNumDescriptorDimensions, 1).normalized();
+
+  // Set the two descriptors to be very close to each other so that they do not
+  // pass the ratio test.
+  descriptor2[0] = VectorXf::Constant(kNumDescriptorDimensions, 1);
+  descriptor2[0](0) = 0.9;
+  descriptor2[0].normalize();
+  descriptor2[1] = VectorXf::Constant(kNumDescriptorDimensions, 1);
+  descriptor2[1](0) = 0.89;
+  descriptor2[1].normalize();
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = false;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+
+  // Add features.
+  std::vector<Keypoint> keypoints1(descriptor1.size());
+  std::vector<Keypoint> keypoints2(descriptor2.size());
+  KdTreeFeatureMatcher matcher(options);
+  matcher.AddImage("1", keypoints1, descriptor1);
+  matcher.AddImage("2", keypoints2, descriptor2);
+
+  // Match features.
+  std::vector<ImagePairMatch> matches;
+  matcher.MatchImages(&matches);
+
+  // Check that the results are valid.
+  ASSERT_EQ(matches.size(), 1);
+  EXPECT_EQ(matches[0].correspondences.size(), 0);
+}
+
+TEST(KdTreeFeatureMatcherTest, NoDescriptors) {
+  std::vector<VectorXf> descriptor1;
+  std::vector<VectorXf> descriptor2(2);
+  descriptor2[0] = VectorXf::Constant(kNumDescriptorDimensions, 1);
+  descriptor2[0].normalize();
+  descriptor2[1] = VectorXf::Constant(kNumDescriptorDimensions, 1);
+  descriptor2[1].normalize();
+
+  // Set options.
+  FeatureMatcherOptions options;
+  options.min_num_feature_matches = 30;
+  options.perform_geometric_verification = false;
+
+  // Add features.
+  std::vector<Keypoint> keypoints1(descriptor1.size());
+  std::vector<Keypoint> keypoints2(descriptor2.size());
+  KdTreeFeatureMatcher matcher(options);
+  matcher.AddImage("1", keypoints1, descriptor1);
+  matcher.AddImage("2", keypoints2, descriptor2);
+
+  // Match features.
+  std::vector<ImagePairMatch> matches;
+  matcher.MatchImages(&matches);
+
+  // Check that the results are valid.
+  EXPECT_EQ(matches.size(), 0);
+}
+
+}  // namespace theia
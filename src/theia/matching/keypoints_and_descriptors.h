@@ -39,16 +39,30 @@
 #include <string>
 #include <vector>
 
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
 #include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/io/packed_feature_store.h"
 
 namespace theia {
 
 // This struct is used by the internal cache to hold keypoints and descriptors
-// when the are retrieved from the cache.
+// when the are retrieved from the cache. The i-th row of the descriptor matrix
+// is the descriptor of the i-th keypoint.
 struct KeypointsAndDescriptors {
   std::string image_name;
   std::vector<Keypoint> keypoints;
-  std::vector<Eigen::VectorXf> descriptors;
+  DescriptorMatrix descriptors;
+
+  // If the descriptors are stored with reduced precision (see
+  // FeatureMatcherOptions::descriptor_precision) they are held here instead and
+  // the descriptor matrix above is empty.
+  QuantizedDescriptorMatrix quantized_descriptors;
+
+  // If the features are read from a packed feature store, the descriptors are
+  // not copied out of the memory mapped store. They are referenced by this view
+  // instead and both descriptor matrices above are empty.
+  PackedFeaturesView packed_features;
 };
 
 }  // namespace theia
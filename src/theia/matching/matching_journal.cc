@@ -0,0 +1,198 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/matching_journal.h"
+
+#include <glog/logging.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>  // NOLINT
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "theia/util/filesystem.h"
+#include "theia/util/hash.h"
+
+namespace theia {
+
+namespace {
+
+// Journal files begin with a header that holds the magic number, the format
+// version, the byte order mark, the number of image pairs, and the hash of the
+// image pair names. The header is followed by records that each hold the start
+// and end index of a range of completed pairs and the checksum of the range.
+const uint64_t kMatchingJournalMagic = 0x54484549414a524eULL;
+const uint32_t kMatchingJournalVersion = 1;
+const uint32_t kMatchingJournalByteOrderMark = 0x01020304;
+const int kMatchingJournalHeaderSize = 32;
+const int kMatchingJournalRecordSize = 24;
+
+uint64_t HashImagePairs(
+    const std::vector<std::pair<std::string, std::string> >& pairs) {
+  static const char kSeparator = '\0';
+  uint64_t hash = Fnv1aHash(nullptr, 0);
+  for (const auto& pair : pairs) {
+    hash = Fnv1aHash(pair.first.data(), pair.first.size(), hash);
+    hash = Fnv1aHash(&kSeparator, sizeof(kSeparator), hash);
+    hash = Fnv1aHash(pair.second.data(), pair.second.size(), hash);
+    hash = Fnv1aHash(&kSeparator, sizeof(kSeparator), hash);
+  }
+  return hash;
+}
+
+}  // namespace
+
+MatchingJournal::MatchingJournal() : num_completed_pairs_(0) {}
+
+bool MatchingJournal::Open(
+    const std::string& journal_file,
+    const std::vector<std::pair<std::string, std::string> >& pairs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(!journal_writer_.is_open()) << "The matching journal is already open.";
+  journal_file_ = journal_file;
+  completed_.assign(pairs.size(), false);
+  num_completed_pairs_ = 0;
+
+  const uint64_t num_pairs = pairs.size();
+  const uint64_t pairs_hash = HashImagePairs(pairs);
+  char header[kMatchingJournalHeaderSize] = {0};
+  std::memcpy(header, &kMatchingJournalMagic, sizeof(uint64_t));
+  std::memcpy(header + 8, &kMatchingJournalVersion, sizeof(uint32_t));
+  std::memcpy(header + 12, &kMatchingJournalByteOrderMark, sizeof(uint32_t));
+  std::memcpy(header + 16, &num_pairs, sizeof(uint64_t));
+  std::memcpy(header + 24, &pairs_hash, sizeof(uint64_t));
+
+  // Read the completed pairs if the journal was written for the same pairs.
+  bool resume = false;
+  uint64_t journal_size = kMatchingJournalHeaderSize;
+  if (FileExists(journal_file)) {
+    std::ifstream journal_reader(journal_file, std::ios::in | std::ios::binary);
+    char existing_header[kMatchingJournalHeaderSize];
+    resume = journal_reader.read(existing_header, kMatchingJournalHeaderSize) &&
+             std::memcmp(header, existing_header, kMatchingJournalHeaderSize) ==
+                 0;
+    char record[kMatchingJournalRecordSize];
+    while (resume && journal_reader.read(record, kMatchingJournalRecordSize)) {
+      uint64_t start, end, checksum;
+      std::memcpy(&start, record, sizeof(uint64_t));
+      std::memcpy(&end, record + 8, sizeof(uint64_t));
+      std::memcpy(&checksum, record + 16, sizeof(uint64_t));
+      if (checksum != Fnv1aHash(record, 16) || start > end || end > num_pairs) {
+        break;
+      }
+      for (uint64_t i = start; i < end; i++) {
+        if (!completed_[i]) {
+          completed_[i] = true;
+          ++num_completed_pairs_;
+        }
+      }
+      journal_size += kMatchingJournalRecordSize;
+    }
+    if (!resume) {
+      LOG(WARNING) << "The matching journal " << journal_file
+                   << " was written for different image pairs. A new journal "
+                      "is started.";
+    }
+  }
+
+  if (resume) {
+    // Overwrite a record that may have been partially written.
+    journal_writer_.open(journal_file,
+                         std::ios::in | std::ios::out | std::ios::binary);
+    journal_writer_.seekp(journal_size);
+  } else {
+    journal_writer_.open(journal_file, std::ios::out | std::ios::binary);
+    journal_writer_.write(header, kMatchingJournalHeaderSize);
+    journal_writer_.flush();
+  }
+  if (!journal_writer_) {
+    LOG(ERROR) << "Could not open the matching journal: " << journal_file
+               << " for writing.";
+    return false;
+  }
+  return true;
+}
+
+bool MatchingJournal::IsCompleted(const int pair_index) const {
+  return completed_[pair_index];
+}
+
+bool MatchingJournal::MarkCompleted(const std::vector<int>& pair_indices) {
+  std::vector<int> sorted_pair_indices = pair_indices;
+  std::sort(sorted_pair_indices.begin(), sorted_pair_indices.end());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  CHECK(journal_writer_.is_open()) << "The matching journal is not open.";
+  int range_start = 0;
+  for (int i = 0; i < sorted_pair_indices.size(); i++) {
+    const int pair_index = sorted_pair_indices[i];
+    CHECK_LT(pair_index, completed_.size());
+    if (!completed_[pair_index]) {
+      completed_[pair_index] = true;
+      ++num_completed_pairs_;
+    }
+
+    // Write the range once the next index is not consecutive.
+    if (i + 1 == sorted_pair_indices.size() ||
+        sorted_pair_indices[i + 1] > pair_index + 1) {
+      WriteRange(sorted_pair_indices[range_start], pair_index + 1);
+      range_start = i + 1;
+    }
+  }
+
+  // The ranges are flushed together so that the journal file is written once
+  // per batch of completed pairs.
+  journal_writer_.flush();
+  if (!journal_writer_) {
+    LOG(ERROR) << "Could not write to the matching journal " << journal_file_;
+    return false;
+  }
+  return true;
+}
+
+void MatchingJournal::WriteRange(const int start, const int end) {
+  const uint64_t range[2] = {static_cast<uint64_t>(start),
+                             static_cast<uint64_t>(end)};
+  char record[kMatchingJournalRecordSize];
+  std::memcpy(record, range, sizeof(range));
+  const uint64_t checksum = Fnv1aHash(record, sizeof(range));
+  std::memcpy(record + sizeof(range), &checksum, sizeof(checksum));
+  journal_writer_.write(record, kMatchingJournalRecordSize);
+}
+
+}  // namespace theia
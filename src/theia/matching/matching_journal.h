@@ -0,0 +1,94 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_MATCHING_JOURNAL_H_
+#define THEIA_MATCHING_MATCHING_JOURNAL_H_
+
+#include <stdint.h>
+
+#include <fstream>  // NOLINT
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "theia/util/util.h"
+
+namespace theia {
+
+// Records which image pairs have been completely matched (whether they were
+// matched successfully or rejected) so that matching can be resumed after it
+// was interrupted. The journal is tied to one list of image pairs: it holds the
+// number of pairs and a hash of the pair names, and the completed pairs are
+// stored as ranges of indices into the list. Each range is appended to the
+// journal file as a fixed size record with a checksum, and the records of each
+// call to MarkCompleted are flushed together, so a journal that was not closed
+// properly loses at most the pairs that were being recorded.
+class MatchingJournal {
+ public:
+  MatchingJournal();
+
+  // Opens the journal for the image pairs. If the journal file exists and was
+  // written for the same image pairs, the completed pairs are read from it and
+  // new completed pairs are appended to it. Otherwise a new journal is started.
+  bool Open(const std::string& journal_file,
+            const std::vector<std::pair<std::string, std::string> >& pairs);
+
+  // Returns true if the pair with the index was recorded as completed.
+  bool IsCompleted(const int pair_index) const;
+
+  int NumCompletedPairs() const { return num_completed_pairs_; }
+
+  // Records the pairs with the indices as completed. Consecutive indices are
+  // stored as a single range, and the journal file is flushed once. This method
+  // is thread safe.
+  bool MarkCompleted(const std::vector<int>& pair_indices);
+
+ private:
+  // Appends the range of completed pairs to the journal file without flushing
+  // it. The mutex must be held by the caller.
+  void WriteRange(const int start, const int end);
+
+  std::mutex mutex_;
+  std::string journal_file_;
+  std::ofstream journal_writer_;
+  std::vector<bool> completed_;
+  int num_completed_pairs_;
+
+  DISALLOW_COPY_AND_ASSIGN(MatchingJournal);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_MATCHING_JOURNAL_H_
@@ -0,0 +1,177 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <cstdio>
+#include <fstream>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/matching/brute_force_feature_matcher.h"
+#include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/matching/matching_journal.h"
+#include "theia/util/random.h"
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+namespace {
+
+std::vector<std::pair<std::string, std::string> > ImagePairs(
+    const int num_images) {
+  std::vector<std::pair<std::string, std::string> > pairs;
+  for (int i = 0; i < num_images; i++) {
+    for (int j = i + 1; j < num_images; j++) {
+      pairs.emplace_back(std::to_string(i), std::to_string(j));
+    }
+  }
+  return pairs;
+}
+
+}  // namespace
+
+TEST(MatchingJournal, ResumesCompletedPairs) {
+  const std::string journal_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/resume.journal";
+  const auto pairs = ImagePairs(5);
+  std::remove(journal_file.c_str());
+  {
+    MatchingJournal journal;
+    ASSERT_TRUE(journal.Open(journal_file, pairs));
+    EXPECT_EQ(journal.NumCompletedPairs(), 0);
+    EXPECT_TRUE(journal.MarkCompleted({7, 3, 2, 4}));
+    EXPECT_EQ(journal.NumCompletedPairs(), 4);
+  }
+
+  // The pairs that were completed before are read when the journal is opened
+  // again, and new pairs are appended.
+  {
+    MatchingJournal journal;
+    ASSERT_TRUE(journal.Open(journal_file, pairs));
+    EXPECT_EQ(journal.NumCompletedPairs(), 4);
+    for (int i = 0; i < pairs.size(); i++) {
+      EXPECT_EQ(journal.IsCompleted(i), i == 7 || (i >= 2 && i <= 4));
+    }
+    EXPECT_TRUE(journal.MarkCompleted({0, 3}));
+    EXPECT_EQ(journal.NumCompletedPairs(), 5);
+  }
+
+  // A record that was only partially written is ignored and overwritten.
+  {
+    std::ofstream writer(journal_file,
+                         std::ios::out | std::ios::app | std::ios::binary);
+    writer.write("partial", 7);
+  }
+  {
+    MatchingJournal journal;
+    ASSERT_TRUE(journal.Open(journal_file, pairs));
+    EXPECT_EQ(journal.NumCompletedPairs(), 5);
+    EXPECT_TRUE(journal.MarkCompleted({9}));
+  }
+  {
+    MatchingJournal journal;
+    ASSERT_TRUE(journal.Open(journal_file, pairs));
+    EXPECT_EQ(journal.NumCompletedPairs(), 6);
+    EXPECT_TRUE(journal.IsCompleted(9));
+  }
+}
+
+TEST(MatchingJournal, StartsOverForDifferentPairs) {
+  const std::string journal_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/different.journal";
+  std::remove(journal_file.c_str());
+  {
+    MatchingJournal journal;
+    ASSERT_TRUE(journal.Open(journal_file, ImagePairs(4)));
+    EXPECT_TRUE(journal.MarkCompleted({0, 1}));
+  }
+
+  auto pairs = ImagePairs(4);
+  pairs[1].second = "other";
+  MatchingJournal journal;
+  ASSERT_TRUE(journal.Open(journal_file, pairs));
+  EXPECT_EQ(journal.NumCompletedPairs(), 0);
+  EXPECT_FALSE(journal.IsCompleted(0));
+}
+
+TEST(MatchingJournal, FeatureMatcherSkipsCompletedPairs) {
+  static const int kNumImages = 4;
+  static const int kNumFeatures = 20;
+  static const int kSiftDimensions = 128;
+  RandomNumberGenerator rng(79);
+  const std::string journal_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/matcher.journal";
+  const auto pairs = ImagePairs(kNumImages);
+
+  FeatureMatcherOptions options;
+  options.num_threads = 2;
+  options.min_num_feature_matches = 0;
+  options.perform_geometric_verification = false;
+  options.matching_journal_file = journal_file;
+  std::vector<Keypoint> keypoints(kNumFeatures);
+  std::vector<DescriptorMatrix> descriptors(kNumImages);
+  for (int i = 0; i < kNumImages; i++) {
+    descriptors[i].resize(kNumFeatures, kSiftDimensions);
+    rng.SetRandom(&descriptors[i]);
+  }
+
+  // Record that some pairs were matched in an earlier run.
+  std::remove(journal_file.c_str());
+  {
+    MatchingJournal journal;
+    ASSERT_TRUE(journal.Open(journal_file, pairs));
+    ASSERT_TRUE(journal.MarkCompleted({0, 2, 3}));
+  }
+
+  // Only the remaining pairs are matched, and they are recorded as well.
+  for (const int num_expected_matches : {3, 0}) {
+    BruteForceFeatureMatcher matcher(options);
+    for (int i = 0; i < kNumImages; i++) {
+      matcher.AddImage(std::to_string(i), keypoints, descriptors[i]);
+    }
+    std::vector<ImagePairMatch> matches;
+    matcher.MatchImages(&matches);
+    ASSERT_EQ(matches.size(), num_expected_matches);
+    for (const ImagePairMatch& match : matches) {
+      const auto pair = std::make_pair(match.image1, match.image2);
+      EXPECT_TRUE(pair == pairs[1] || pair == pairs[4] || pair == pairs[5]);
+    }
+  }
+}
+
+}  // namespace theia
@@ -0,0 +1,329 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/multi_index_hashing_feature_matcher.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/matching/distance.h"
+#include "theia/matching/feature_matcher.h"
+#include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/feature_matcher_utils.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/util/concurrent_lru_cache.h"
+
+namespace theia {
+
+// The hash tables of the binary descriptors of a single image. Table t indexes
+// the t-th substring of substring_bits bits of each descriptor. The tables are
+// stored in compressed form: the indices of the descriptors whose t-th
+// substring has the value b are
+//
+//   feature_indices[bucket_offsets[t * (num_buckets + 1) + b] ...
+//                   bucket_offsets[t * (num_buckets + 1) + b + 1]]
+//
+// where feature_indices holds the indices sorted by substring for each table.
+struct MultiIndexHashTables {
+  size_t NumBytes() const {
+    return sizeof(*this) +
+           (bucket_offsets.size() + feature_indices.size()) * sizeof(int);
+  }
+
+  int num_tables = 0;
+  int substring_bits = 0;
+  int num_buckets = 0;
+  std::vector<int> bucket_offsets;
+  std::vector<int> feature_indices;
+};
+
+namespace {
+
+// Returns num_bits bits of the packed binary descriptor starting at bit
+// first_bit. At most 16 bits are read, so the bits span at most three bytes.
+inline int GetSubstring(const uint8_t* descriptor,
+                        const int num_bytes,
+                        const int first_bit,
+                        const int num_bits) {
+  const int first_byte = first_bit >> 3;
+  const int last_byte = std::min(first_byte + 3, num_bytes);
+  uint32_t bits = 0;
+  for (int i = first_byte; i < last_byte; i++) {
+    bits |= static_cast<uint32_t>(descriptor[i]) << (8 * (i - first_byte));
+  }
+  return (bits >> (first_bit & 7)) & ((1u << num_bits) - 1);
+}
+
+// Returns all substrings within the search radius (of at most 2) of the given
+// substring.
+void GetSubstringsWithinRadius(const int substring,
+                               const int num_bits,
+                               const int search_radius,
+                               std::vector<int>* substrings) {
+  substrings->clear();
+  substrings->emplace_back(substring);
+  if (search_radius < 1) {
+    return;
+  }
+  for (int i = 0; i < num_bits; i++) {
+    substrings->emplace_back(substring ^ (1 << i));
+  }
+  if (search_radius < 2) {
+    return;
+  }
+  for (int i = 0; i < num_bits; i++) {
+    for (int j = i + 1; j < num_bits; j++) {
+      substrings->emplace_back(substring ^ (1 << i) ^ (1 << j));
+    }
+  }
+}
+
+void BuildMultiIndexHashTables(
+    const Eigen::Map<const BinaryDescriptorMatrix>& descriptors,
+    const int num_tables,
+    const int substring_bits,
+    MultiIndexHashTables* tables) {
+  const int num_descriptors = descriptors.rows();
+  const int num_bytes = descriptors.cols();
+  const int num_bits = num_bytes * 8;
+  tables->substring_bits = std::min(substring_bits, num_bits);
+  tables->num_tables =
+      std::max(1, std::min(num_tables, num_bits / tables->substring_bits));
+  tables->num_buckets = 1 << tables->substring_bits;
+
+  // Sort the descriptors of each table into the buckets with a counting sort.
+  const int offsets_per_table = tables->num_buckets + 1;
+  tables->bucket_offsets.assign(tables->num_tables * offsets_per_table, 0);
+  tables->feature_indices.resize(tables->num_tables * num_descriptors);
+  std::vector<int> substrings(num_descriptors);
+  for (int t = 0; t < tables->num_tables; t++) {
+    int* offsets = tables->bucket_offsets.data() + t * offsets_per_table;
+    for (int i = 0; i < num_descriptors; i++) {
+      substrings[i] = GetSubstring(descriptors.row(i).data(),
+                                   num_bytes,
+                                   t * tables->substring_bits,
+                                   tables->substring_bits);
+      ++offsets[substrings[i] + 1];
+    }
+    for (int b = 0; b < tables->num_buckets; b++) {
+      offsets[b + 1] += offsets[b];
+    }
+
+    std::vector<int> bucket_positions(offsets, offsets + tables->num_buckets);
+    int* feature_indices =
+        tables->feature_indices.data() + t * num_descriptors;
+    for (int i = 0; i < num_descriptors; i++) {
+      feature_indices[bucket_positions[substrings[i]]++] = i;
+    }
+  }
+}
+
+// Finds matches for the query descriptors among the indexed descriptors. Only
+// the indexed descriptors that have a substring within the search radius of
+// the corresponding substring of the query are compared with the query.
+void FindMatchesWithHashTables(
+    const MultiIndexHashTables& tables,
+    const Eigen::Map<const BinaryDescriptorMatrix>& indexed_descriptors,
+    const Eigen::Map<const BinaryDescriptorMatrix>& query_descriptors,
+    const int search_radius,
+    const bool use_lowes_ratio,
+    const float lowes_ratio,
+    std::vector<IndexedFeatureMatch>* matches) {
+  const int num_indexed_descriptors = indexed_descriptors.rows();
+  const int num_bytes = indexed_descriptors.cols();
+  const int offsets_per_table = tables.num_buckets + 1;
+  const Hamming hamming;
+
+  // The last query that each indexed descriptor was compared with, so that
+  // descriptors found in several buckets are only compared once.
+  std::vector<int> last_query(num_indexed_descriptors, -1);
+  std::vector<int> substrings;
+  for (int i = 0; i < query_descriptors.rows(); i++) {
+    const uint8_t* query = query_descriptors.row(i).data();
+    int nearest_index = -1;
+    int nearest_distance = std::numeric_limits<int>::max();
+    int second_nearest_distance = std::numeric_limits<int>::max();
+    for (int t = 0; t < tables.num_tables; t++) {
+      const int* offsets = tables.bucket_offsets.data() + t * offsets_per_table;
+      const int* feature_indices =
+          tables.feature_indices.data() + t * num_indexed_descriptors;
+      GetSubstringsWithinRadius(GetSubstring(query,
+                                             num_bytes,
+                                             t * tables.substring_bits,
+                                             tables.substring_bits),
+                                tables.substring_bits,
+                                search_radius,
+                                &substrings);
+      for (const int substring : substrings) {
+        for (int k = offsets[substring]; k < offsets[substring + 1]; k++) {
+          const int index = feature_indices[k];
+          if (last_query[index] == i) {
+            continue;
+          }
+          last_query[index] = i;
+
+          const int distance = hamming(
+              query, indexed_descriptors.row(index).data(), num_bytes);
+          if (distance < nearest_distance) {
+            second_nearest_distance = nearest_distance;
+            nearest_distance = distance;
+            nearest_index = index;
+          } else if (distance < second_nearest_distance) {
+            second_nearest_distance = distance;
+          }
+        }
+      }
+    }
+
+    if (nearest_index < 0) {
+      continue;
+    }
+    if (!use_lowes_ratio ||
+        nearest_distance <
+            lowes_ratio * static_cast<float>(second_nearest_distance)) {
+      matches->emplace_back(i, nearest_index, nearest_distance);
+    }
+  }
+}
+
+}  // namespace
+
+MultiIndexHashingFeatureMatcher::MultiIndexHashingFeatureMatcher(
+    const FeatureMatcherOptions& options)
+    : FeatureMatcher(options) {
+  CHECK(options_.descriptor_precision == DescriptorPrecision::BINARY)
+      << "The descriptors must be stored with DescriptorPrecision::BINARY in "
+         "order to match them with multi-index hashing.";
+  CHECK_GT(options_.multi_index_hashing_num_tables, 0);
+  CHECK_GT(options_.multi_index_hashing_substring_bits, 0);
+  CHECK_LE(options_.multi_index_hashing_substring_bits, 16);
+  CHECK_GE(options_.multi_index_hashing_search_radius, 0);
+  CHECK_LE(options_.multi_index_hashing_search_radius, 2);
+
+  std::function<std::shared_ptr<MultiIndexHashTables>(const std::string&)>
+      build_hash_tables =
+          std::bind(&MultiIndexHashingFeatureMatcher::BuildHashTables,
+                    this,
+                    std::placeholders::_1);
+  std::function<size_t(const std::shared_ptr<MultiIndexHashTables>&)>
+      hash_tables_size =
+          [](const std::shared_ptr<MultiIndexHashTables>& tables) {
+            return tables->NumBytes();
+          };
+  hash_tables_cache_.reset(new HashTablesCache(
+      build_hash_tables, hash_tables_size, GetCacheOptions()));
+}
+
+MultiIndexHashingFeatureMatcher::~MultiIndexHashingFeatureMatcher() {}
+
+std::shared_ptr<MultiIndexHashTables>
+MultiIndexHashingFeatureMatcher::BuildHashTables(
+    const std::string& image_name) {
+  const std::shared_ptr<KeypointsAndDescriptors> features =
+      GetKeypointsAndDescriptors(image_name);
+  std::shared_ptr<MultiIndexHashTables> tables(new MultiIndexHashTables);
+  BuildMultiIndexHashTables(GetBinaryDescriptors(*features),
+                            options_.multi_index_hashing_num_tables,
+                            options_.multi_index_hashing_substring_bits,
+                            tables.get());
+  VLOG(1) << "Built the multi-index hash tables for image: " << image_name;
+  return tables;
+}
+
+void MultiIndexHashingFeatureMatcher::PrefetchImage(
+    const std::string& image_name) {
+  FeatureMatcher::PrefetchImage(image_name);
+  hash_tables_cache_->Prefetch(image_name);
+}
+
+bool MultiIndexHashingFeatureMatcher::MatchImagePair(
+    const KeypointsAndDescriptors& features1,
+    const KeypointsAndDescriptors& features2,
+    std::vector<IndexedFeatureMatch>* matches) {
+  const Eigen::Map<const BinaryDescriptorMatrix> descriptors1 =
+      GetBinaryDescriptors(features1);
+  const Eigen::Map<const BinaryDescriptorMatrix> descriptors2 =
+      GetBinaryDescriptors(features2);
+  if (descriptors1.rows() == 0 || descriptors2.rows() == 0) {
+    return false;
+  }
+  CHECK_EQ(descriptors1.cols(), descriptors2.cols())
+      << "Cannot match binary descriptors of different sizes.";
+
+  // Compute forward matches with the hash tables of the second image. By using
+  // a shared_ptr the hash tables stay alive while they are used even if the
+  // cache evicts them.
+  const std::shared_ptr<MultiIndexHashTables> tables2 =
+      hash_tables_cache_->Fetch(features2.image_name);
+  matches->reserve(descriptors1.rows());
+  FindMatchesWithHashTables(*tables2,
+                            descriptors2,
+                            descriptors1,
+                            this->options_.multi_index_hashing_search_radius,
+                            this->options_.use_lowes_ratio,
+                            this->options_.lowes_ratio,
+                            matches);
+  if (matches->size() < this->options_.min_num_feature_matches) {
+    return false;
+  }
+
+  // Compute the symmetric matches, if applicable.
+  if (this->options_.keep_only_symmetric_matches) {
+    const std::shared_ptr<MultiIndexHashTables> tables1 =
+        hash_tables_cache_->Fetch(features1.image_name);
+    std::vector<IndexedFeatureMatch> reverse_matches;
+    FindMatchesWithHashTables(*tables1,
+                              descriptors1,
+                              descriptors2,
+                              this->options_.multi_index_hashing_search_radius,
+                              this->options_.use_lowes_ratio,
+                              this->options_.lowes_ratio,
+                              &reverse_matches);
+    IntersectMatches(reverse_matches, matches);
+  }
+
+  return matches->size() >= this->options_.min_num_feature_matches;
+}
+
+}  // namespace theia
@@ -0,0 +1,100 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_MULTI_INDEX_HASHING_FEATURE_MATCHER_H_
+#define THEIA_MATCHING_MULTI_INDEX_HASHING_FEATURE_MATCHER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "theia/matching/feature_matcher.h"
+#include "theia/util/concurrent_lru_cache.h"
+#include "theia/util/util.h"
+
+namespace theia {
+struct IndexedFeatureMatch;
+struct KeypointsAndDescriptors;
+struct MultiIndexHashTables;
+
+// Performs matching of binary descriptors (e.g. AKAZE MLDB) with multi-index
+// hashing as described in "Fast Search in Hamming Space with Multi-Index
+// Hashing" by Norouzi et al. (CVPR 2012). The descriptors of each image are
+// split into substrings which are indexed by hash tables. Two descriptors that
+// are close in Hamming distance must have some substrings that are close as
+// well, so only the descriptors that share a (nearly) identical substring with
+// a query are compared with the full Hamming distance. The hash tables are
+// built once per image and are kept in an LRU cache alongside the features.
+//
+// The nearest neighbors are approximate since descriptors that have no close
+// substring are never compared, but true matches of binary descriptors are
+// rarely missed with the default options. The descriptors must be stored with
+// DescriptorPrecision::BINARY and the Lowe's ratio is applied to the Hamming
+// distances.
+class MultiIndexHashingFeatureMatcher : public FeatureMatcher {
+ public:
+  explicit MultiIndexHashingFeatureMatcher(
+      const FeatureMatcherOptions& options);
+  ~MultiIndexHashingFeatureMatcher();
+
+ private:
+  bool MatchImagePair(
+      const KeypointsAndDescriptors& features1,
+      const KeypointsAndDescriptors& features2,
+      std::vector<IndexedFeatureMatch>* matches) override;
+
+  bool MatchesBinaryDescriptors() const override { return true; }
+
+  // Prefetches the hash tables in addition to the features of the image.
+  void PrefetchImage(const std::string& image_name) override;
+
+  // Builds the hash tables for the descriptors of the image. This function is
+  // utilized by the internal cache so that the hash tables are only kept in
+  // memory while they are needed.
+  std::shared_ptr<MultiIndexHashTables> BuildHashTables(
+      const std::string& image_name);
+
+  // An LRU cache that manages the hash tables. The cache has the same capacity
+  // as the cache of keypoints and descriptors.
+  typedef ConcurrentLRUCache<std::string,
+                             std::shared_ptr<MultiIndexHashTables> >
+      HashTablesCache;
+  std::unique_ptr<HashTablesCache> hash_tables_cache_;
+
+  DISALLOW_COPY_AND_ASSIGN(MultiIndexHashingFeatureMatcher);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_MULTI_INDEX_HASHING_FEATURE_MATCHER_H_
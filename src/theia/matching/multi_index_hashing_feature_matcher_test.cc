@@ -0,0 +1,103 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/matching/multi_index_hashing_feature_matcher.h"
+#include "theia/test/feature_matcher_test_utils.h"
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+namespace {
+
+static const int kNumDescriptors = 200;
+// The size of an AKAZE MLDB descriptor.
+static const int kNumBits = 486;
+static const int kNumFlippedBits = 40;
+
+void TestMatchCorrespondingDescriptors(const FeatureMatcherOptions& options) {
+  DescriptorMatrix descriptors1, descriptors2;
+  test::CreateCorrespondingBinaryDescriptors(kNumDescriptors,
+                                             kNumBits,
+                                             kNumFlippedBits,
+                                             &descriptors1,
+                                             &descriptors2);
+  test::ExpectCorrespondingDescriptorsMatch<MultiIndexHashingFeatureMatcher>(
+      options, "multi_index_hashing", descriptors1, descriptors2);
+}
+
+}  // namespace
+
+TEST(MultiIndexHashingFeatureMatcherTest, InCore) {
+  FeatureMatcherOptions options = test::BinaryMatcherOptions();
+  options.match_out_of_core = false;
+  TestMatchCorrespondingDescriptors(options);
+}
+
+TEST(MultiIndexHashingFeatureMatcherTest, OutOfCore) {
+  FeatureMatcherOptions options = test::BinaryMatcherOptions();
+  options.match_out_of_core = true;
+  options.keypoints_and_descriptors_output_dir = GTEST_TESTING_OUTPUT_DIRECTORY;
+  options.cache_capacity = 4;
+  TestMatchCorrespondingDescriptors(options);
+}
+
+TEST(MultiIndexHashingFeatureMatcherTest, NoDescriptors) {
+  DescriptorMatrix descriptors1(0, kNumBits);
+  DescriptorMatrix descriptors2 = DescriptorMatrix::Ones(2, kNumBits);
+
+  FeatureMatcherOptions options = test::BinaryMatcherOptions();
+  options.min_num_feature_matches = 30;
+
+  std::vector<Keypoint> keypoints1(descriptors1.rows());
+  std::vector<Keypoint> keypoints2(descriptors2.rows());
+  MultiIndexHashingFeatureMatcher matcher(options);
+  matcher.AddImage("1", keypoints1, descriptors1);
+  matcher.AddImage("2", keypoints2, descriptors2);
+
+  std::vector<ImagePairMatch> matches;
+  matcher.MatchImages(&matches);
+  EXPECT_EQ(matches.size(), 0);
+}
+
+}  // namespace theia
@@ -0,0 +1,311 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/matching/vocabulary_tree.h"
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <deque>
+#include <future>  // NOLINT
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/util/random.h"
+#include "theia/util/threadpool.h"
+
+namespace theia {
+
+namespace {
+
+// Nodes with fewer descriptors than this are clustered in a single thread.
+static const int kMinNumDescriptorsPerThread = 2048;
+
+// Returns the index of the row of centers that is closest to the descriptor.
+template <class Descriptor>
+int FindClosestCenter(const DescriptorMatrix& centers,
+                      const int first_center,
+                      const int num_centers,
+                      const Descriptor& descriptor) {
+  int closest_center = first_center;
+  float min_distance = std::numeric_limits<float>::max();
+  for (int i = first_center; i < first_center + num_centers; i++) {
+    const float distance = (centers.row(i) - descriptor).squaredNorm();
+    if (distance < min_distance) {
+      min_distance = distance;
+      closest_center = i;
+    }
+  }
+  return closest_center;
+}
+
+// Assigns the descriptors in [start, end) of the indices to their closest
+// center. Returns true if any assignment changed.
+bool AssignToClusters(const DescriptorMatrix& descriptors,
+                      const std::vector<int>& indices,
+                      const DescriptorMatrix& centers,
+                      const int start,
+                      const int end,
+                      std::vector<int>* assignments) {
+  bool changed = false;
+  for (int i = start; i < end; i++) {
+    const int cluster = FindClosestCenter(
+        centers, 0, centers.rows(), descriptors.row(indices[i]));
+    if (cluster != (*assignments)[i]) {
+      (*assignments)[i] = cluster;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+// Clusters the descriptors of the given indices into k clusters with Lloyd's
+// algorithm, using k random descriptors as the initial centers. Clusters may be
+// empty if there are duplicate descriptors.
+void KMeans(const DescriptorMatrix& descriptors,
+            const std::vector<int>& indices,
+            const int k,
+            const int max_num_iterations,
+            RandomNumberGenerator* rng,
+            ThreadPool* pool,
+            const int num_threads,
+            DescriptorMatrix* centers,
+            std::vector<int>* assignments) {
+  const int num_descriptors = indices.size();
+  CHECK_GE(num_descriptors, k);
+
+  // Choose k distinct descriptors as the initial centers with a partial
+  // Fisher-Yates shuffle.
+  std::vector<int> permutation(num_descriptors);
+  for (int i = 0; i < num_descriptors; i++) {
+    permutation[i] = i;
+  }
+  centers->resize(k, descriptors.cols());
+  for (int i = 0; i < k; i++) {
+    std::swap(permutation[i],
+              permutation[rng->RandInt(i, num_descriptors - 1)]);
+    centers->row(i) = descriptors.row(indices[permutation[i]]);
+  }
+
+  assignments->assign(num_descriptors, -1);
+  const int num_chunks =
+      pool == nullptr
+          ? 1
+          : std::max(1,
+                     std::min(num_threads,
+                              num_descriptors / kMinNumDescriptorsPerThread));
+  const int chunk_size = (num_descriptors + num_chunks - 1) / num_chunks;
+  for (int iteration = 0; iteration < max_num_iterations; iteration++) {
+    bool changed = false;
+    if (num_chunks == 1) {
+      changed = AssignToClusters(
+          descriptors, indices, *centers, 0, num_descriptors, assignments);
+    } else {
+      std::vector<std::future<bool> > chunks_changed;
+      for (int start = 0; start < num_descriptors; start += chunk_size) {
+        const int end = std::min(num_descriptors, start + chunk_size);
+        chunks_changed.emplace_back(pool->Add(AssignToClusters,
+                                              std::cref(descriptors),
+                                              std::cref(indices),
+                                              std::cref(*centers),
+                                              start,
+                                              end,
+                                              assignments));
+      }
+      for (std::future<bool>& chunk_changed : chunks_changed) {
+        changed |= chunk_changed.get();
+      }
+    }
+    if (!changed) {
+      break;
+    }
+
+    // Move the centers to the mean of their clusters. Empty clusters keep
+    // their center.
+    Eigen::MatrixXd sums = Eigen::MatrixXd::Zero(k, descriptors.cols());
+    Eigen::VectorXi counts = Eigen::VectorXi::Zero(k);
+    for (int i = 0; i < num_descriptors; i++) {
+      sums.row((*assignments)[i]) +=
+          descriptors.row(indices[i]).cast<double>();
+      ++counts((*assignments)[i]);
+    }
+    for (int i = 0; i < k; i++) {
+      if (counts(i) > 0) {
+        centers->row(i) = (sums.row(i) / counts(i)).cast<float>();
+      }
+    }
+  }
+}
+
+}  // namespace
+
+VocabularyTree::VocabularyTree() : num_words_(0) {}
+
+bool VocabularyTree::Train(const Options& options,
+                           const DescriptorMatrix& descriptors) {
+  CHECK_GT(options.branching_factor, 1);
+  CHECK_GT(options.depth, 0);
+  if (descriptors.rows() == 0) {
+    LOG(ERROR) << "Cannot train a vocabulary tree without descriptors.";
+    return false;
+  }
+
+  RandomNumberGenerator rng(options.seed);
+  std::unique_ptr<ThreadPool> pool;
+  if (options.num_threads > 1) {
+    pool.reset(new ThreadPool(options.num_threads));
+  }
+
+  // The centers are collected in a vector since the number of nodes is not
+  // known in advance.
+  std::vector<Eigen::VectorXf> centers(1, Eigen::VectorXf::Zero(
+                                              descriptors.cols()));
+  first_child_.assign(1, 0);
+  num_children_.assign(1, 0);
+  words_.assign(1, -1);
+  num_words_ = 0;
+
+  // The nodes are split in breadth-first order.
+  struct NodeToSplit {
+    int node;
+    int level;
+    std::vector<int> indices;
+  };
+  std::deque<NodeToSplit> nodes_to_split(1);
+  nodes_to_split.front().node = 0;
+  nodes_to_split.front().level = 0;
+  nodes_to_split.front().indices.resize(descriptors.rows());
+  for (int i = 0; i < descriptors.rows(); i++) {
+    nodes_to_split.front().indices[i] = i;
+  }
+
+  DescriptorMatrix cluster_centers;
+  std::vector<int> assignments;
+  while (!nodes_to_split.empty()) {
+    NodeToSplit node_to_split = std::move(nodes_to_split.front());
+    nodes_to_split.pop_front();
+    const int node = node_to_split.node;
+
+    // Nodes at the maximum depth and nodes with too few descriptors to be
+    // clustered become leaves.
+    const std::vector<int>& indices = node_to_split.indices;
+    if (node_to_split.level == options.depth ||
+        indices.size() <= options.branching_factor) {
+      words_[node] = num_words_++;
+      continue;
+    }
+
+    KMeans(descriptors,
+           indices,
+           options.branching_factor,
+           options.max_num_kmeans_iterations,
+           &rng,
+           pool.get(),
+           options.num_threads,
+           &cluster_centers,
+           &assignments);
+
+    // Split the descriptors into the non-empty clusters.
+    std::vector<std::vector<int> > clusters(options.branching_factor);
+    for (int i = 0; i < indices.size(); i++) {
+      clusters[assignments[i]].emplace_back(indices[i]);
+    }
+    int num_clusters = 0;
+    for (const std::vector<int>& cluster : clusters) {
+      if (!cluster.empty()) {
+        ++num_clusters;
+      }
+    }
+    // The descriptors are all identical and cannot be split.
+    if (num_clusters < 2) {
+      words_[node] = num_words_++;
+      continue;
+    }
+
+    first_child_[node] = centers.size();
+    num_children_[node] = num_clusters;
+    for (int i = 0; i < options.branching_factor; i++) {
+      if (clusters[i].empty()) {
+        continue;
+      }
+      NodeToSplit child;
+      child.node = centers.size();
+      child.level = node_to_split.level + 1;
+      child.indices.swap(clusters[i]);
+      nodes_to_split.emplace_back(std::move(child));
+
+      centers.emplace_back(cluster_centers.row(i).transpose());
+      first_child_.emplace_back(0);
+      num_children_.emplace_back(0);
+      words_.emplace_back(-1);
+    }
+  }
+
+  centers_.resize(centers.size(), descriptors.cols());
+  for (int i = 0; i < centers.size(); i++) {
+    centers_.row(i) = centers[i].transpose();
+  }
+
+  VLOG(1) << "Trained a vocabulary tree with " << num_words_
+          << " visual words from " << descriptors.rows() << " descriptors.";
+  return true;
+}
+
+int VocabularyTree::Quantize(
+    const Eigen::Ref<const Eigen::VectorXf>& descriptor) const {
+  CHECK_GT(num_words_, 0) << "The vocabulary tree has not been trained.";
+  CHECK_EQ(descriptor.size(), centers_.cols());
+  int node = 0;
+  while (num_children_[node] > 0) {
+    node = FindClosestCenter(centers_,
+                             first_child_[node],
+                             num_children_[node],
+                             descriptor.transpose());
+  }
+  return words_[node];
+}
+
+void VocabularyTree::Quantize(const DescriptorMatrix& descriptors,
+                              std::vector<int>* words) const {
+  CHECK_NOTNULL(words)->resize(descriptors.rows());
+  for (int i = 0; i < descriptors.rows(); i++) {
+    (*words)[i] = Quantize(descriptors.row(i).transpose());
+  }
+}
+
+}  // namespace theia
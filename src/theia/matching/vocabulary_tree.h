@@ -0,0 +1,118 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_MATCHING_VOCABULARY_TREE_H_
+#define THEIA_MATCHING_VOCABULARY_TREE_H_
+
+#include <cereal/access.hpp>
+#include <cereal/types/vector.hpp>
+#include <Eigen/Core>
+#include <stdint.h>
+
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/io/eigen_serializable.h"
+
+namespace theia {
+
+// A vocabulary tree as described in "Scalable Recognition with a Vocabulary
+// Tree" by Nister and Stewenius (CVPR 2006). The descriptor space is
+// partitioned with hierarchical k-means: the training descriptors are clustered
+// into branching_factor clusters, and each cluster is recursively clustered in
+// the same way until the tree has the desired depth. The leaves of the tree are
+// the visual words, and a descriptor is quantized to a visual word by
+// descending the tree to the closest child center at each level, which only
+// requires branching_factor * depth distance computations.
+class VocabularyTree {
+ public:
+  struct Options {
+    // The number of children of each node and the number of levels of the
+    // tree. The tree has at most branching_factor^depth visual words.
+    int branching_factor = 10;
+    int depth = 5;
+
+    // The maximum number of k-means iterations used to cluster each node.
+    int max_num_kmeans_iterations = 10;
+
+    // The number of threads used to assign the descriptors to the clusters.
+    int num_threads = 1;
+
+    // The seed used to choose the initial cluster centers.
+    unsigned int seed = 0;
+  };
+
+  VocabularyTree();
+
+  // Trains the vocabulary tree with hierarchical k-means on the given
+  // descriptors. Returns false if there are no training descriptors.
+  bool Train(const Options& options, const DescriptorMatrix& descriptors);
+
+  // Returns the visual word of the descriptor, in [0, NumWords()).
+  int Quantize(const Eigen::Ref<const Eigen::VectorXf>& descriptor) const;
+
+  // Quantizes each row of the descriptor matrix.
+  void Quantize(const DescriptorMatrix& descriptors,
+                std::vector<int>* words) const;
+
+  // The number of visual words (i.e., leaves) of the tree.
+  int NumWords() const { return num_words_; }
+
+  // The dimension of the descriptors that the tree was trained with.
+  int DescriptorDimension() const { return centers_.cols(); }
+
+ private:
+  // Templated method for disk I/O with cereal. This method tells cereal which
+  // data members should be used when reading/writing to/from disk.
+  friend class cereal::access;
+  template <class Archive>
+  void serialize(Archive& ar) {  // NOLINT
+    ar(centers_, first_child_, num_children_, words_, num_words_);
+  }
+
+  // The nodes of the tree are stored in breadth-first order, so the children
+  // of each node are contiguous. Node 0 is the root. Row i of centers_ holds
+  // the cluster center of node i (the row of the root is unused).
+  DescriptorMatrix centers_;
+  std::vector<int> first_child_;
+  std::vector<int> num_children_;
+
+  // The visual word of each leaf node, or -1 for inner nodes.
+  std::vector<int> words_;
+  int num_words_;
+};
+
+}  // namespace theia
+
+#endif  // THEIA_MATCHING_VOCABULARY_TREE_H_
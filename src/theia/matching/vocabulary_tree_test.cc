@@ -0,0 +1,166 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <Eigen/Core>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/io/read_vocabulary_tree.h"
+#include "theia/io/write_vocabulary_tree.h"
+#include "theia/matching/vocabulary_tree.h"
+#include "theia/util/filesystem.h"
+#include "theia/util/random.h"
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+namespace {
+
+static const int kNumDimensions = 16;
+static const int kNumDescriptorsPerCluster = 50;
+
+// Creates descriptors that are tightly clustered around the given centers.
+void CreateClusteredDescriptors(const std::vector<Eigen::VectorXf>& centers,
+                                RandomNumberGenerator* rng,
+                                DescriptorMatrix* descriptors) {
+  descriptors->resize(centers.size() * kNumDescriptorsPerCluster,
+                      kNumDimensions);
+  for (int i = 0; i < descriptors->rows(); i++) {
+    for (int j = 0; j < kNumDimensions; j++) {
+      (*descriptors)(i, j) =
+          centers[i / kNumDescriptorsPerCluster](j) + rng->RandFloat(-0.1, 0.1);
+    }
+  }
+}
+
+// Returns four centers that form two well separated groups of two centers.
+std::vector<Eigen::VectorXf> CreateHierarchicalCenters() {
+  std::vector<Eigen::VectorXf> centers(4, Eigen::VectorXf::Zero(
+                                              kNumDimensions));
+  centers[1](0) = 10.0;
+  centers[2](1) = 100.0;
+  centers[3](1) = 100.0;
+  centers[3](0) = 10.0;
+  return centers;
+}
+
+}  // namespace
+
+TEST(VocabularyTree, QuantizeClusters) {
+  RandomNumberGenerator rng(52);
+  const std::vector<Eigen::VectorXf> centers = CreateHierarchicalCenters();
+  DescriptorMatrix descriptors;
+  CreateClusteredDescriptors(centers, &rng, &descriptors);
+
+  VocabularyTree::Options options;
+  options.branching_factor = 2;
+  options.depth = 2;
+  VocabularyTree vocabulary_tree;
+  EXPECT_TRUE(vocabulary_tree.Train(options, descriptors));
+  EXPECT_EQ(vocabulary_tree.NumWords(), 4);
+  EXPECT_EQ(vocabulary_tree.DescriptorDimension(), kNumDimensions);
+
+  // All descriptors of a cluster are quantized to the same word and each
+  // cluster has a different word.
+  std::vector<int> words;
+  vocabulary_tree.Quantize(descriptors, &words);
+  std::vector<int> cluster_words;
+  for (int i = 0; i < centers.size(); i++) {
+    const int word = vocabulary_tree.Quantize(centers[i]);
+    EXPECT_GE(word, 0);
+    EXPECT_LT(word, vocabulary_tree.NumWords());
+    for (int j = 0; j < kNumDescriptorsPerCluster; j++) {
+      EXPECT_EQ(words[i * kNumDescriptorsPerCluster + j], word);
+    }
+    for (const int cluster_word : cluster_words) {
+      EXPECT_NE(cluster_word, word);
+    }
+    cluster_words.emplace_back(word);
+  }
+}
+
+TEST(VocabularyTree, FewDescriptors) {
+  // Nodes with no more descriptors than the branching factor are not split.
+  DescriptorMatrix descriptors = DescriptorMatrix::Identity(3, kNumDimensions);
+  VocabularyTree::Options options;
+  options.branching_factor = 4;
+  options.depth = 3;
+  VocabularyTree vocabulary_tree;
+  EXPECT_TRUE(vocabulary_tree.Train(options, descriptors));
+  EXPECT_EQ(vocabulary_tree.NumWords(), 1);
+  EXPECT_EQ(vocabulary_tree.Quantize(descriptors.row(0).transpose()), 0);
+
+  // Training fails without descriptors.
+  EXPECT_FALSE(vocabulary_tree.Train(options, DescriptorMatrix()));
+}
+
+TEST(VocabularyTree, ReadAndWrite) {
+  RandomNumberGenerator rng(52);
+  DescriptorMatrix descriptors(1000, kNumDimensions);
+  for (int i = 0; i < descriptors.rows(); i++) {
+    for (int j = 0; j < kNumDimensions; j++) {
+      descriptors(i, j) = rng.RandFloat(0.0, 1.0);
+    }
+  }
+
+  VocabularyTree::Options options;
+  options.branching_factor = 4;
+  options.depth = 3;
+  options.num_threads = 4;
+  VocabularyTree vocabulary_tree;
+  EXPECT_TRUE(vocabulary_tree.Train(options, descriptors));
+  EXPECT_GT(vocabulary_tree.NumWords(), 1);
+  EXPECT_LE(vocabulary_tree.NumWords(), 64);
+
+  const std::string vocabulary_tree_file =
+      std::string(GTEST_TESTING_OUTPUT_DIRECTORY) + "/vocabulary_tree.bin";
+  EXPECT_TRUE(WriteVocabularyTree(vocabulary_tree_file, vocabulary_tree));
+  // The temporary file that the tree is written to is renamed.
+  EXPECT_FALSE(FileExists(vocabulary_tree_file + ".tmp"));
+  VocabularyTree read_vocabulary_tree;
+  EXPECT_TRUE(ReadVocabularyTree(vocabulary_tree_file, &read_vocabulary_tree));
+  EXPECT_EQ(read_vocabulary_tree.NumWords(), vocabulary_tree.NumWords());
+
+  std::vector<int> words, read_words;
+  vocabulary_tree.Quantize(descriptors, &words);
+  read_vocabulary_tree.Quantize(descriptors, &read_words);
+  EXPECT_EQ(words, read_words);
+  remove(vocabulary_tree_file.c_str());
+}
+
+}  // namespace theia
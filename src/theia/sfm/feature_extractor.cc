@@ -42,6 +42,10 @@
 
 #include "theia/image/descriptor/create_descriptor_extractor.h"
 #include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/image_decoding_pipeline.h"
+#include "theia/io/packed_feature_store.h"
 #include "theia/io/write_keypoints_and_descriptors.h"
 #include "theia/image/image.h"
 #include "theia/image/keypoint_detector/keypoint.h"
@@ -49,42 +53,65 @@
 #include "theia/util/threadpool.h"
 
 namespace theia {
+namespace {
+
+void DescriptorMatricesToDescriptors(
+    const std::vector<DescriptorMatrix>& descriptor_matrices,
+    std::vector<std::vector<Eigen::VectorXf> >* descriptors) {
+  descriptors->resize(descriptor_matrices.size());
+  for (int i = 0; i < descriptor_matrices.size(); i++) {
+    MatrixToDescriptors(descriptor_matrices[i], &(*descriptors)[i]);
+  }
+}
+
+}  // namespace
 
 bool FeatureExtractor::Extract(
     const std::vector<std::string>& filenames,
     std::vector<std::vector<Keypoint> >* keypoints,
-    std::vector<std::vector<Eigen::VectorXf> >* descriptors) {
+    std::vector<DescriptorMatrix>* descriptors) {
   CHECK_GT(filenames.size(), 0) << "FeatureExtractor::Extract requires at "
                                    "least one image in order to extract "
                                    "features.";
   CHECK_NOTNULL(keypoints)->resize(filenames.size());
   CHECK_NOTNULL(descriptors)->resize(filenames.size());
 
-  // The thread pool will wait to finish all jobs when it goes out of scope.
-  const int num_threads =
-      std::min(options_.num_threads, static_cast<int>(filenames.size()));
-  ThreadPool feature_extractor_pool(num_threads);
+  std::vector<std::string> existing_filenames;
+  std::vector<int> image_indices;
   for (int i = 0; i < filenames.size(); i++) {
     if (!FileExists(filenames[i])) {
       LOG(ERROR) << "Could not extract features for " << filenames[i]
                  << " because the file cannot be found.";
       continue;
     }
-
-    feature_extractor_pool.Add(
-        &FeatureExtractor::ExtractFeatures,
-        this,
-        filenames[i],
-        &(*keypoints)[i],
-        &(*descriptors)[i]);
+    existing_filenames.emplace_back(filenames[i]);
+    image_indices.emplace_back(i);
   }
+
+  // The images are decoded by the pipeline, possibly in separate threads, and
+  // the features are extracted in the processing threads.
+  ImageDecodingPipeline pipeline(options_.image_decoding_options,
+                                 std::max(options_.num_threads, 1));
+  ImageDecodingStatistics statistics;
+  pipeline.Run(existing_filenames,
+               [&](const int index, const FloatImage& image,
+                   const double scale) {
+                 const int i = image_indices[index];
+                 ExtractFeatures(filenames[i],
+                                 image,
+                                 scale,
+                                 &(*keypoints)[i],
+                                 &(*descriptors)[i]);
+               },
+               &statistics);
+  LogImageDecodingStatistics(statistics);
   return true;
 }
 
 bool FeatureExtractor::Extract(
     const std::vector<FloatImage>& images,
     std::vector<std::vector<Keypoint> >* keypoints,
-    std::vector<std::vector<Eigen::VectorXf> >* descriptors) {
+    std::vector<DescriptorMatrix>* descriptors) {
   CHECK_GT(images.size(), 0) << "FeatureExtractor::Extract requires at "
             "least one image in order to extract "
             "features.";
@@ -106,36 +133,90 @@ bool FeatureExtractor::Extract(
   return true;
 }
 
+bool FeatureExtractor::Extract(
+    const std::vector<std::string>& filenames,
+    std::vector<std::vector<Keypoint> >* keypoints,
+    std::vector<std::vector<Eigen::VectorXf> >* descriptors) {
+  std::vector<DescriptorMatrix> descriptor_matrices;
+  if (!Extract(filenames, keypoints, &descriptor_matrices)) {
+    return false;
+  }
+  DescriptorMatricesToDescriptors(descriptor_matrices,
+                                  CHECK_NOTNULL(descriptors));
+  return true;
+}
+
+bool FeatureExtractor::Extract(
+    const std::vector<FloatImage>& images,
+    std::vector<std::vector<Keypoint> >* keypoints,
+    std::vector<std::vector<Eigen::VectorXf> >* descriptors) {
+  std::vector<DescriptorMatrix> descriptor_matrices;
+  if (!Extract(images, keypoints, &descriptor_matrices)) {
+    return false;
+  }
+  DescriptorMatricesToDescriptors(descriptor_matrices,
+                                  CHECK_NOTNULL(descriptors));
+  return true;
+}
+
 bool FeatureExtractor::ExtractToDisk(
     const std::vector<std::string>& filenames) {
   write_features_to_disk_ = true;
-  // Determine if the directory for writing out feature exists. If not, try to
-  // create it.
-  if (!DirectoryExists(options_.output_directory)) {
+  if (!options_.packed_features_file.empty()) {
+    packed_features_writer_.reset(new PackedFeatureStoreWriter);
+    if (!packed_features_writer_->Open(options_.packed_features_file)) {
+      return false;
+    }
+  } else if (!DirectoryExists(options_.output_directory)) {
+    // Determine if the directory for writing out feature exists. If not, try
+    // to create it.
     CHECK(CreateNewDirectory(options_.output_directory))
         << "Could not create the directory for storing features: "
         << options_.output_directory;
   }
 
   std::vector<std::vector<Keypoint> > keypoints;
-  std::vector<std::vector<Eigen::VectorXf> > descriptors;
-  return Extract(filenames, &keypoints, &descriptors);
+  std::vector<DescriptorMatrix> descriptors;
+  const bool success = Extract(filenames, &keypoints, &descriptors);
+  if (packed_features_writer_ != nullptr) {
+    const bool closed = packed_features_writer_->Close();
+    packed_features_writer_.reset();
+    return success && closed;
+  }
+  return success;
 }
 
 bool FeatureExtractor::ExtractFeatures(
     const std::string& filename,
+    const FloatImage& image,
+    const double scale,
     std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
-  std::unique_ptr<FloatImage> image(new FloatImage(filename));
-  if (!ExtractFeaturesFromImage(*image, keypoints, descriptors)) {
+    DescriptorMatrix* descriptors) {
+  if (!ExtractFeaturesFromImage(image, keypoints, descriptors)) {
     LOG(ERROR) << "Could not extract descriptors in image " << filename;
     return false;
   } else {
-    VLOG(1) << "Successfully extracted " << descriptors->size()
+    VLOG(1) << "Successfully extracted " << descriptors->rows()
             << " features from image " << filename;
   }
+  // Return the keypoints in the pixel coordinates of the full resolution
+  // image if the image was decoded at a reduced resolution.
+  RescaleKeypoints(scale, keypoints);
+
+  if (write_features_to_disk_ && packed_features_writer_ != nullptr) {
+    std::string image_filename;
+    CHECK(GetFilenameFromFilepath(filename, true, &image_filename));
+    CHECK(packed_features_writer_->AddImage(image_filename,
+                                            *keypoints,
+                                            *descriptors,
+                                            options_.descriptor_precision))
+        << "Could not write features for image " << image_filename
+        << " to the packed feature store " << options_.packed_features_file;
 
-  if (write_features_to_disk_) {
+    // Remove the features from memory.
+    keypoints->clear();
+    descriptors->resize(0, 0);
+  } else if (write_features_to_disk_) {
     std::string output_dir = options_.output_directory;
     // Add a trailing slash if one does not exist.
     if (output_dir.back() != '/') {
@@ -148,41 +229,36 @@ bool FeatureExtractor::ExtractFeatures(
     std::string features_file = output_dir + image_filename + ".features";
 
     // Write the features to disk.
-    CHECK(WriteKeypointsAndDescriptors(features_file, *keypoints, *descriptors))
+    CHECK(WriteKeypointsAndDescriptors(features_file,
+                                       *keypoints,
+                                       *descriptors,
+                                       options_.descriptor_precision))
       << "Could not write features for image " << image_filename
       << " from file " << features_file;
 
     // Remove the features from memory.
     keypoints->clear();
-    descriptors->clear();
+    descriptors->resize(0, 0);
   }
+  return true;
 }
 
 bool FeatureExtractor::ExtractFeaturesFromImage(
     const FloatImage& image,
     std::vector<Keypoint>* keypoints,
-    std::vector<Eigen::VectorXf>* descriptors) {
-  // We create these variable here instead of upon the construction of the
-  // object so that they can be thread-safe. We *should* be able to use the
-  // static thread_local keywords, but apparently Mac OS-X's version of clang
-  // does not actually support it!
-  //
-  // TODO(cmsweeney): Change this so that each thread in the threadpool receives
-  // exactly one object.
-  std::unique_ptr<DescriptorExtractor> descriptor_extractor =
-      CreateDescriptorExtractor(options_.descriptor_extractor_type,
-                                options_.feature_density);
-
-  // Exit if the descriptor extraction fails.
-  if (!descriptor_extractor->DetectAndExtractDescriptors(image,
-                                                         keypoints,
-                                                         descriptors)) {
+    DescriptorMatrix* descriptors) {
+  // The descriptor extractors are taken from the pool so that each thread
+  // reuses one extractor for all of its images.
+  if (!descriptor_extractor_pool_.DetectAndExtractDescriptors(image,
+                                                              keypoints,
+                                                              descriptors)) {
     return false;
   }
 
   if (keypoints->size() > options_.max_num_features) {
     keypoints->resize(options_.max_num_features);
-    descriptors->resize(options_.max_num_features);
+    descriptors->conservativeResize(options_.max_num_features,
+                                    descriptors->cols());
   }
 
   return true;
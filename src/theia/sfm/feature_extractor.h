@@ -36,10 +36,17 @@
 #define THEIA_SFM_FEATURE_EXTRACTOR_H_
 
 #include <Eigen/Core>
+#include <memory>
 #include <string>
 
 #include "theia/alignment/alignment.h"
 #include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/image/image_decoding_pipeline.h"
+#include "theia/io/packed_feature_store.h"
+#include "theia/util/threadpool.h"
 #include "theia/util/util.h"
 #include "theia/image/image.h"
 
@@ -67,41 +74,100 @@ class FeatureExtractor {
     // directory with the same name as the input image and a ".features"
     // appended.
     std::string output_directory = "";
+
+    // If set, the features of all images are written to this packed feature
+    // store (see PackedFeatureStore) instead of one file per image. The store
+    // is keyed by the image filenames (including the extension). This avoids
+    // creating a very large number of small files for large image
+    // collections.
+    std::string packed_features_file = "";
+
+    // The precision used to store the descriptors in the features files.
+    // FLOAT16 and UINT8 reduce the size of the features files by 2x and 4x.
+    // UINT8 is intended for SIFT descriptors.
+    DescriptorPrecision descriptor_precision = DescriptorPrecision::FLOAT32;
+
+    // Options for reading and decoding the images in separate threads from the
+    // num_threads feature extraction threads when extracting features from
+    // image files. See ImageDecodingPipeline. Set max_image_dimension to
+    // extract the features of large images at a reduced resolution; the
+    // keypoints are returned in the pixel coordinates of the full resolution
+    // images.
+    ImageDecodingOptions image_decoding_options;
+
+    // If true, the SIFT features of each large image are extracted with
+    // num_threads additional threads (see SiftDescriptorExtractor) so that a
+    // few very large images (e.g. orthomosaics or panoramas) use all threads.
+    // The features are the same as without this option.
+    bool parallelize_large_images = false;
   };
 
   explicit FeatureExtractor(const Options& options)
-      : options_(options), write_features_to_disk_(false) {}
+      : options_(options),
+        write_features_to_disk_(false),
+        large_image_thread_pool_(options.parallelize_large_images
+                                     ? new ThreadPool(options.num_threads)
+                                     : nullptr),
+        descriptor_extractor_pool_(options.descriptor_extractor_type,
+                                   options.feature_density,
+                                   large_image_thread_pool_.get()) {}
   ~FeatureExtractor() {}
 
-  // Method to extract descriptors.
+  // Method to extract descriptors. The descriptors of each image are returned
+  // as a matrix where the i-th row is the descriptor of the i-th keypoint.
   bool Extract(const std::vector<std::string>& filenames,
                std::vector<std::vector<Keypoint> >* keypoints,
-               std::vector<std::vector<Eigen::VectorXf> >* descriptors);
+               std::vector<DescriptorMatrix>* descriptors);
 
   // Method to extract descriptors from FloatImages
+  bool Extract(const std::vector<FloatImage>& images,
+               std::vector<std::vector<Keypoint> >* keypoints,
+               std::vector<DescriptorMatrix>* descriptors);
+
+  // Same as above, but the descriptors of each image are returned as a vector
+  // of descriptors.
+  bool Extract(const std::vector<std::string>& filenames,
+               std::vector<std::vector<Keypoint> >* keypoints,
+               std::vector<std::vector<Eigen::VectorXf> >* descriptors);
   bool Extract(const std::vector<FloatImage>& images,
                std::vector<std::vector<Keypoint> >* keypoints,
                std::vector<std::vector<Eigen::VectorXf> >* descriptors);
 
   // Extracts descriptors and writes them to disk. The features from each image
-  // are written to individual files in the directory specified in the options.
+  // are written to individual files in the directory specified in the options,
+  // or to the packed feature store if one is specified in the options.
   bool ExtractToDisk(const std::vector<std::string>& filenames);
 
  private:
-  // Extracts the features and metadata for a single image. This function is
-  // called by the threadpool and is thus thread safe.
+  // Extracts the features and metadata for a single decoded image and writes
+  // them to disk if desired. The image was reduced by the scale if it is
+  // larger than the max_image_dimension of the image decoding options. This
+  // function is called by the processing threads of the image decoding
+  // pipeline and is thus thread safe.
   bool ExtractFeatures(const std::string& filename,
+                       const FloatImage& image,
+                       const double scale,
                        std::vector<Keypoint>* keypoints,
-                       std::vector<Eigen::VectorXf>* descriptors);
+                       DescriptorMatrix* descriptors);
 
   // Extracts the features from a FloatImage
   bool ExtractFeaturesFromImage(const FloatImage& image,
                                 std::vector<Keypoint>* keypoints,
-                                std::vector<Eigen::VectorXf>* descriptors);
+                                DescriptorMatrix* descriptors);
 
   const Options options_;
   bool write_features_to_disk_;
 
+  // The threads that the descriptor extractors use to extract the features of
+  // large images in parallel, if enabled.
+  std::unique_ptr<ThreadPool> large_image_thread_pool_;
+
+  // The descriptor extractors, which are reused across images.
+  DescriptorExtractorPool descriptor_extractor_pool_;
+
+  // The packed feature store that features are written to, if any.
+  std::unique_ptr<PackedFeatureStoreWriter> packed_features_writer_;
+
   DISALLOW_COPY_AND_ASSIGN(FeatureExtractor);
 };
 
@@ -36,23 +36,31 @@
 
 #include <Eigen/Core>
 #include <algorithm>
+#include <cmath>
 #include <glog/logging.h>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <string>
 #include <thread>  // NOLINT
+#include <unordered_map>
 #include <vector>
 
 #include "theia/image/descriptor/create_descriptor_extractor.h"
 #include "theia/image/descriptor/descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
 #include "theia/image/image.h"
+#include "theia/image/image_decoding_pipeline.h"
 #include "theia/image/keypoint_detector/keypoint.h"
 #include "theia/matching/create_feature_matcher.h"
 #include "theia/matching/feature_correspondence.h"
 #include "theia/matching/feature_matcher_options.h"
 #include "theia/matching/image_pair_match.h"
+#include "theia/matching/image_pair_selection.h"
 #include "theia/sfm/camera_intrinsics_prior.h"
 #include "theia/sfm/estimate_twoview_info.h"
 #include "theia/sfm/exif_reader.h"
+#include "theia/sfm/gps_converter.h"
 #include "theia/sfm/two_view_match_geometric_verification.h"
 #include "theia/util/filesystem.h"
 #include "theia/util/string.h"
@@ -62,38 +70,34 @@ namespace theia {
 namespace {
 
 void ExtractFeatures(const FeatureExtractorAndMatcher::Options& options,
+                     DescriptorExtractorPool* descriptor_extractor_pool,
                      const std::string& image_filepath,
+                     const FloatImage& image,
+                     const double scale,
                      const std::string& imagemask_filepath,
                      std::vector<Keypoint>* keypoints,
-                     std::vector<Eigen::VectorXf>* descriptors) {
+                     DescriptorMatrix* descriptors) {
   static const float kMaskThreshold = 0.5;
-  std::unique_ptr<FloatImage> image(new FloatImage(image_filepath));
-  // We create these variable here instead of upon the construction of the
-  // object so that they can be thread-safe. We *should* be able to use the
-  // static thread_local keywords, but apparently Mac OS-X's version of clang
-  // does not actually support it!
-  //
-  // TODO(cmsweeney): Change this so that each thread in the threadpool receives
-  // exactly one object.
-  std::unique_ptr<DescriptorExtractor> descriptor_extractor =
-      CreateDescriptorExtractor(options.descriptor_extractor_type,
-                                options.feature_density);
 
   // Exit if the descriptor extraction fails.
-  if (!descriptor_extractor->DetectAndExtractDescriptors(
-          *image, keypoints, descriptors)) {
+  if (!descriptor_extractor_pool->DetectAndExtractDescriptors(
+          image, keypoints, descriptors)) {
     LOG(ERROR) << "Could not extract descriptors in image " << image_filepath;
     return;
   }
+  // Use the pixel coordinates of the full resolution image if the image was
+  // decoded at a reduced resolution.
+  RescaleKeypoints(scale, keypoints);
 
   if (imagemask_filepath.size() > 0) {
     std::unique_ptr<FloatImage> image_mask(new FloatImage(imagemask_filepath));
-    // Check the size of the image and its associated mask.
-    CHECK(image_mask->Width() == image->Width() &&
-          image_mask->Height() == image->Height())
+    // Check the size of the image and its associated mask. The size of a
+    // reduced image is only known up to one pixel of the reduced image.
+    CHECK(std::abs(image_mask->Width() - scale * image.Width()) < scale &&
+          std::abs(image_mask->Height() - scale * image.Height()) < scale)
         << "The image and the mask don't have the same size. \n"
-        << "- Image: " << image_filepath << "\t(" << image->Width() << " x "
-        << image->Height() << ")\n"
+        << "- Image: " << image_filepath << "\t(" << image.Width() << " x "
+        << image.Height() << ")\n"
         << "- Mask: " << imagemask_filepath << "\t(" << image_mask->Width()
         << " x " << image_mask->Height() << ")";
 
@@ -101,26 +105,32 @@ void ExtractFeatures(const FeatureExtractorAndMatcher::Options& options,
     image_mask->ConvertToGrayscaleImage();
     // Remove keypoints according to the associated mask (remove kp. in black
     // part).
-    for (int i = keypoints->size() - 1; i > -1; i--) {
-      if (image_mask->BilinearInterpolate(
-              keypoints->at(i).x(), keypoints->at(i).y(), 0) < kMaskThreshold) {
-        keypoints->erase(keypoints->begin() + i);
-        descriptors->erase(descriptors->begin() + i);
+    std::vector<Keypoint> masked_keypoints;
+    std::vector<int> masked_indices;
+    for (int i = 0; i < keypoints->size(); i++) {
+      const Keypoint& keypoint = keypoints->at(i);
+      if (image_mask->BilinearInterpolate(keypoint.x(), keypoint.y(), 0) >=
+          kMaskThreshold) {
+        masked_keypoints.emplace_back(keypoint);
+        masked_indices.emplace_back(i);
       }
     }
+    keypoints->swap(masked_keypoints);
+    SelectDescriptors(masked_indices, descriptors);
   }
 
   if (keypoints->size() > options.max_num_features) {
     keypoints->resize(options.max_num_features);
-    descriptors->resize(options.max_num_features);
+    descriptors->conservativeResize(options.max_num_features,
+                                    descriptors->cols());
   }
 
   if (imagemask_filepath.size() > 0) {
-    VLOG(1) << "Successfully extracted " << descriptors->size()
+    VLOG(1) << "Successfully extracted " << descriptors->rows()
             << " features from image " << image_filepath
             << " with an image mask.";
   } else {
-    VLOG(1) << "Successfully extracted " << descriptors->size()
+    VLOG(1) << "Successfully extracted " << descriptors->rows()
             << " features from image " << image_filepath;
   }
 }
@@ -129,7 +139,14 @@ void ExtractFeatures(const FeatureExtractorAndMatcher::Options& options,
 
 FeatureExtractorAndMatcher::FeatureExtractorAndMatcher(
     const FeatureExtractorAndMatcher::Options& options)
-    : options_(options) {
+    : options_(options),
+      extract_features_while_matching_(false),
+      large_image_thread_pool_(options.parallelize_large_images
+                                   ? new ThreadPool(options.num_threads)
+                                   : nullptr),
+      descriptor_extractor_pool_(options.descriptor_extractor_type,
+                                 options.feature_density,
+                                 large_image_thread_pool_.get()) {
   // Create the feature matcher.
   FeatureMatcherOptions matcher_options = options_.feature_matcher_options;
   matcher_options.num_threads = options_.num_threads;
@@ -165,18 +182,93 @@ bool FeatureExtractorAndMatcher::AddMaskForFeaturesExtraction(
 }
 void FeatureExtractorAndMatcher::SetPairsToMatch(
     const std::vector<std::pair<std::string, std::string> >& pairs_to_match) {
-  // Convert the image filepaths to image filenames.
-  std::vector<std::pair<std::string, std::string> > image_pairs;
-  image_pairs.reserve(pairs_to_match.size());
+  // Convert the image filepaths to image filenames. The pairs are given to the
+  // matcher once all images have been added.
+  pairs_to_match_.clear();
+  pairs_to_match_.reserve(pairs_to_match.size());
   for (const auto& pair_to_match : pairs_to_match) {
     std::string image1_filename;
     CHECK(GetFilenameFromFilepath(pair_to_match.first, true, &image1_filename));
     std::string image2_filename;
     CHECK(
         GetFilenameFromFilepath(pair_to_match.second, true, &image2_filename));
-    image_pairs.emplace_back(image1_filename, image2_filename);
+    pairs_to_match_.emplace_back(image1_filename, image2_filename);
+  }
+}
+
+void FeatureExtractorAndMatcher::SelectImagePairsToMatch() {
+  const ImagePairSelectionOptions& selection_options =
+      options_.image_pair_selection_options;
+  const bool select_by_position =
+      selection_options.num_nearest_neighbors_by_position > 0 ||
+      selection_options.max_distance_between_positions > 0.0;
+  const bool select_sequential = selection_options.sequential_window_size > 0 ||
+                                 selection_options.loop_closure_interval > 0;
+  if (!select_by_position && !select_sequential) {
+    if (!pairs_to_match_.empty()) {
+      matcher_->SetImagePairsToMatch(pairs_to_match_);
+    }
+    return;
   }
 
+  // Collect the images that were added to the matcher in capture order along
+  // with the ECEF positions of the images that have GPS coordinates.
+  std::vector<std::string> image_names;
+  std::vector<std::string> image_names_with_position;
+  std::vector<Eigen::Vector3d> positions;
+  for (int i = 0; i < image_filepaths_.size(); i++) {
+    if (!image_added_to_matcher_[i]) {
+      continue;
+    }
+    std::string image_filename;
+    CHECK(GetFilenameFromFilepath(image_filepaths_[i], true, &image_filename));
+    image_names.emplace_back(image_filename);
+
+    const CameraIntrinsicsPrior intrinsics = FindWithDefault(
+        intrinsics_, image_filepaths_[i], CameraIntrinsicsPrior());
+    if (intrinsics.latitude.is_set && intrinsics.longitude.is_set) {
+      const double altitude =
+          intrinsics.altitude.is_set ? intrinsics.altitude.value[0] : 0.0;
+      image_names_with_position.emplace_back(image_filename);
+      positions.emplace_back(GPSConverter::LLAToECEF(
+          Eigen::Vector3d(intrinsics.latitude.value[0],
+                          intrinsics.longitude.value[0],
+                          altitude)));
+    }
+  }
+
+  std::vector<std::vector<std::pair<std::string, std::string> > >
+      candidate_image_pairs(1, pairs_to_match_);
+  if (select_by_position) {
+    candidate_image_pairs.emplace_back();
+    SelectImagePairsByPosition(selection_options,
+                               image_names_with_position,
+                               positions,
+                               &candidate_image_pairs.back());
+    LOG(INFO) << "Selected " << candidate_image_pairs.back().size()
+              << " image pairs from the GPS positions of "
+              << image_names_with_position.size() << " images.";
+  }
+  if (select_sequential) {
+    candidate_image_pairs.emplace_back();
+    SelectSequentialImagePairs(
+        selection_options, image_names, &candidate_image_pairs.back());
+    LOG(INFO) << "Selected " << candidate_image_pairs.back().size()
+              << " image pairs from the capture order of the images.";
+  }
+  if (options_.feature_matcher_options.image_retrieval_num_neighbors > 0) {
+    candidate_image_pairs.emplace_back();
+    matcher_->RetrieveImagePairsToMatch(&candidate_image_pairs.back());
+  }
+
+  std::vector<std::pair<std::string, std::string> > image_pairs;
+  CombineImagePairs(candidate_image_pairs, &image_pairs);
+  if (image_pairs.empty()) {
+    LOG(WARNING) << "No image pairs were selected, so all image pairs will be "
+                    "matched.";
+    return;
+  }
+  LOG(INFO) << "Matching " << image_pairs.size() << " selected image pairs.";
   matcher_->SetImagePairsToMatch(image_pairs);
 }
 
@@ -188,11 +280,39 @@ void FeatureExtractorAndMatcher::SetPairsToMatch(
 void FeatureExtractorAndMatcher::ExtractAndMatchFeatures(
     std::vector<CameraIntrinsicsPrior>* intrinsics,
     std::vector<ImagePairMatch>* matches) {
-  CHECK_NOTNULL(intrinsics)->resize(image_filepaths_.size());
   CHECK_NOTNULL(matches);
+  ExtractFeaturesAndIntrinsics(intrinsics);
+  MatchFeatures([matches](const ImagePairMatch& match) {
+    matches->emplace_back(match);
+  });
+}
+
+void FeatureExtractorAndMatcher::ExtractFeaturesAndIntrinsics(
+    std::vector<CameraIntrinsicsPrior>* intrinsics) {
+  CHECK_NOTNULL(intrinsics)->resize(image_filepaths_.size());
   CHECK_NOTNULL(matcher_.get());
 
-  // For each image, process the features and add it to the matcher.
+  // Image retrieval needs the features of all images before any image pair can
+  // be selected, so the features are extracted first in that case.
+  extract_features_while_matching_ = options_.overlap_extraction_and_matching;
+  if (extract_features_while_matching_ &&
+      options_.feature_matcher_options.image_retrieval_num_neighbors > 0) {
+    LOG(WARNING) << "Features cannot be extracted while matching when image "
+                    "retrieval is used. Extracting all features first.";
+    extract_features_while_matching_ = false;
+  }
+  // Every shard process would write the same feature files at once, so the
+  // features of all images must have been extracted before matching a shard.
+  const bool is_matching_shard =
+      options_.feature_matcher_options.num_shards > 1;
+  if (extract_features_while_matching_ && is_matching_shard) {
+    LOG(WARNING) << "Features cannot be extracted while matching a shard. "
+                    "Reading the features that were extracted before.";
+    extract_features_while_matching_ = false;
+  }
+
+  // Extract the intrinsics of each image and determine whether it is used.
+  std::vector<char> image_is_used(image_filepaths_.size(), false);
   const int num_threads =
       std::min(options_.num_threads, static_cast<int>(image_filepaths_.size()));
   std::unique_ptr<ThreadPool> thread_pool(new ThreadPool(num_threads));
@@ -202,16 +322,58 @@ void FeatureExtractorAndMatcher::ExtractAndMatchFeatures(
                  << " because the file cannot be found.";
       continue;
     }
-    thread_pool->Add(&FeatureExtractorAndMatcher::ProcessImage, this, i);
+    thread_pool->Add([this, i, &image_is_used]() {
+      CameraIntrinsicsPrior intrinsics;
+      image_is_used[i] = ExtractIntrinsics(i, &intrinsics);
+    });
   }
   // This forces all tasks to complete before proceeding.
   thread_pool.reset(nullptr);
 
-  // After all threads complete feature extraction, perform matching.
+  // Extract the features of the images that are used and add them to the
+  // matcher, unless the features are extracted while matching. The intrinsics
+  // are not modified anymore, so they may be read without locking.
+  image_added_to_matcher_.assign(image_filepaths_.size(), false);
+  std::vector<std::string> image_filepaths_to_extract;
+  std::vector<int> image_indices_to_extract;
+  for (int i = 0; i < image_filepaths_.size(); i++) {
+    if (!image_is_used[i]) {
+      continue;
+    }
+    if (extract_features_while_matching_) {
+      image_added_to_matcher_[i] = true;
+    } else if (!AddFeaturesFromDiskToMatcher(
+                   i, FindOrDie(intrinsics_, image_filepaths_[i]))) {
+      image_filepaths_to_extract.emplace_back(image_filepaths_[i]);
+      image_indices_to_extract.emplace_back(i);
+    }
+  }
 
-  // Perform the matching.
-  LOG(INFO) << "Matching images...";
-  matcher_->MatchImages(matches);
+  CHECK(!is_matching_shard || image_filepaths_to_extract.empty())
+      << "The features of " << image_filepaths_to_extract.size()
+      << " images (e.g. " << image_filepaths_to_extract[0]
+      << ") were not found. The features must be extracted into the "
+         "keypoints and descriptors directory or the packed feature store "
+         "before a shard of the image pairs is matched.";
+
+  if (!image_filepaths_to_extract.empty()) {
+    ImageDecodingPipeline pipeline(options_.image_decoding_options,
+                                   std::max(options_.num_threads, 1));
+    ImageDecodingStatistics statistics;
+    pipeline.Run(image_filepaths_to_extract,
+                 [this, &image_indices_to_extract](const int index,
+                                                   const FloatImage& image,
+                                                   const double scale) {
+                   const int i = image_indices_to_extract[index];
+                   AddImageFeaturesToMatcher(
+                       i,
+                       FindOrDie(intrinsics_, image_filepaths_[i]),
+                       image,
+                       scale);
+                 },
+                 &statistics);
+    LogImageDecodingStatistics(statistics);
+  }
 
   // Add the intrinsics to the output.
   for (int i = 0; i < image_filepaths_.size(); i++) {
@@ -219,72 +381,166 @@ void FeatureExtractorAndMatcher::ExtractAndMatchFeatures(
   }
 }
 
-void FeatureExtractorAndMatcher::ProcessImage(const int i) {
+void FeatureExtractorAndMatcher::MatchFeatures(
+    const ImagePairMatchCallback& callback) {
+  CHECK_EQ(image_added_to_matcher_.size(), image_filepaths_.size())
+      << "ExtractFeaturesAndIntrinsics must be called before MatchFeatures.";
+
+  // After all threads complete feature extraction, perform matching.
+  SelectImagePairsToMatch();
+
+  // Perform the matching.
+  if (!extract_features_while_matching_) {
+    LOG(INFO) << "Matching images...";
+    matcher_->MatchImages(callback);
+    return;
+  }
+
+  // Extract the features of each image on the matching threads so that the
+  // image pairs are matched while the features of other images are extracted.
+  std::vector<std::string> image_names;
+  std::unordered_map<std::string, int> image_indices;
+  for (int i = 0; i < image_filepaths_.size(); i++) {
+    if (!image_added_to_matcher_[i]) {
+      continue;
+    }
+    std::string image_filename;
+    CHECK(GetFilenameFromFilepath(image_filepaths_[i], true, &image_filename));
+    image_indices.emplace(image_filename, i);
+    image_names.emplace_back(image_filename);
+  }
+
+  LOG(INFO) << "Extracting features and matching images...";
+  matcher_->AddAndMatchImages(
+      image_names,
+      [this, &image_indices](const std::string& image_name) {
+        const int i = FindOrDie(image_indices, image_name);
+        // The intrinsics are not modified anymore, so they may be read
+        // without locking.
+        return AddFeaturesToMatcher(
+            i, FindOrDie(intrinsics_, image_filepaths_[i]));
+      },
+      callback);
+}
+
+bool FeatureExtractorAndMatcher::ExtractIntrinsics(
+    const int i, CameraIntrinsicsPrior* intrinsics) {
   const std::string& image_filepath = image_filepaths_[i];
 
   // Get the camera intrinsics prior if it was provided.
-  CameraIntrinsicsPrior intrinsics =
-      FindWithDefault(intrinsics_, image_filepath, CameraIntrinsicsPrior());
-
-  // Get the associated mask if it was provided.
-  const std::string mask_filepath =
-      FindWithDefault(image_masks_, image_filepath, "");
+  {
+    std::lock_guard<std::mutex> lock(intrinsics_mutex_);
+    *intrinsics =
+        FindWithDefault(intrinsics_, image_filepath, CameraIntrinsicsPrior());
+  }
 
   // Extract an EXIF focal length if it was not provided.
-  if (!intrinsics.focal_length.is_set) {
-    CHECK(exif_reader_.ExtractEXIFMetadata(image_filepath, &intrinsics));
+  if (!intrinsics->focal_length.is_set) {
+    CHECK(exif_reader_.ExtractEXIFMetadata(image_filepath, intrinsics));
 
     // If the focal length still could not be extracted, set it to a reasonable
     // value based on a median viewing angle.
-    if (!options_.only_calibrated_views && !intrinsics.focal_length.is_set) {
+    if (!options_.only_calibrated_views && !intrinsics->focal_length.is_set) {
       VLOG(2) << "Exif was not detected. Setting it to a reasonable value.";
-      intrinsics.focal_length.is_set = true;
-      intrinsics.focal_length.value[0] =
-          1.2 * static_cast<double>(
-                    std::max(intrinsics.image_width, intrinsics.image_height));
+      intrinsics->focal_length.is_set = true;
+      intrinsics->focal_length.value[0] =
+          1.2 * static_cast<double>(std::max(intrinsics->image_width,
+                                             intrinsics->image_height));
     }
 
     std::lock_guard<std::mutex> lock(intrinsics_mutex_);
     // Insert or update the value of the intrinsics.
-    intrinsics_[image_filepath] = intrinsics;
+    intrinsics_[image_filepath] = *intrinsics;
   }
 
   // Early exit if no EXIF calibration exists and we are only processing
   // calibration views.
-  if (options_.only_calibrated_views && !intrinsics.focal_length.is_set) {
+  if (options_.only_calibrated_views && !intrinsics->focal_length.is_set) {
     LOG(INFO) << "Image " << image_filepath
               << " did not contain an EXIF focal length. Skipping this image.";
-    return;
+    return false;
   } else {
     LOG(INFO) << "Image " << image_filepath
               << " is initialized with the focal length: "
-              << intrinsics.focal_length.value[0];
+              << intrinsics->focal_length.value[0];
+  }
+  return true;
+}
+
+bool FeatureExtractorAndMatcher::AddFeaturesToMatcher(
+    const int i, const CameraIntrinsicsPrior& intrinsics) {
+  if (AddFeaturesFromDiskToMatcher(i, intrinsics)) {
+    return true;
   }
 
+  FloatImage image;
+  double scale;
+  if (!ReadGrayscaleImage(image_filepaths_[i],
+                          options_.image_decoding_options.max_image_dimension,
+                          &image,
+                          &scale)) {
+    return false;
+  }
+  AddImageFeaturesToMatcher(i, intrinsics, image, scale);
+  return true;
+}
+
+bool FeatureExtractorAndMatcher::AddFeaturesFromDiskToMatcher(
+    const int i, const CameraIntrinsicsPrior& intrinsics) {
   // Get the image filename without the directory.
   std::string image_filename;
-  CHECK(GetFilenameFromFilepath(image_filepath, true, &image_filename));
+  CHECK(GetFilenameFromFilepath(image_filepaths_[i], true, &image_filename));
+
+  // The features in the packed feature store are always read by the matcher.
+  // Otherwise, the features can only be reused if the matcher reads them from
+  // disk and the feature file already exists.
+  if (!matcher_->HasPackedFeatures(image_filename)) {
+    if (!options_.feature_matcher_options.match_out_of_core) {
+      return false;
+    }
 
-  // Get the feature filepath based on the image filename.
-  std::string output_dir =
-      options_.feature_matcher_options.keypoints_and_descriptors_output_dir;
-  AppendTrailingSlashIfNeeded(&output_dir);
-  const std::string feature_filepath =
-      output_dir + image_filename + ".features";
-
-  // If the feature file already exists, skip the feature extraction.
-  if (options_.feature_matcher_options.match_out_of_core &&
-      FileExists(feature_filepath)) {
-    std::lock_guard<std::mutex> lock(matcher_mutex_);
-    matcher_->AddImage(image_filename, intrinsics);
-    return;
+    // Get the feature filepath based on the image filename.
+    std::string output_dir =
+        options_.feature_matcher_options.keypoints_and_descriptors_output_dir;
+    AppendTrailingSlashIfNeeded(&output_dir);
+    const std::string feature_filepath =
+        output_dir + image_filename + ".features";
+    if (!FileExists(feature_filepath)) {
+      return false;
+    }
   }
+  std::lock_guard<std::mutex> lock(matcher_mutex_);
+  matcher_->AddImage(image_filename, intrinsics);
+  image_added_to_matcher_[i] = true;
+  return true;
+}
+
+void FeatureExtractorAndMatcher::AddImageFeaturesToMatcher(
+    const int i,
+    const CameraIntrinsicsPrior& intrinsics,
+    const FloatImage& image,
+    const double scale) {
+  const std::string& image_filepath = image_filepaths_[i];
+
+  // Get the associated mask if it was provided.
+  const std::string mask_filepath =
+      FindWithDefault(image_masks_, image_filepath, "");
+
+  // Get the image filename without the directory.
+  std::string image_filename;
+  CHECK(GetFilenameFromFilepath(image_filepath, true, &image_filename));
 
   // Extract Features.
   std::vector<Keypoint> keypoints;
-  std::vector<Eigen::VectorXf> descriptors;
-  ExtractFeatures(
-      options_, image_filepath, mask_filepath, &keypoints, &descriptors);
+  DescriptorMatrix descriptors;
+  ExtractFeatures(options_,
+                  &descriptor_extractor_pool_,
+                  image_filepath,
+                  image,
+                  scale,
+                  mask_filepath,
+                  &keypoints,
+                  &descriptors);
 
   // Add the relevant image and feature data to the feature matcher. This allows
   // the feature matcher to control fine-grained things like multi-threading and
@@ -292,6 +548,7 @@ void FeatureExtractorAndMatcher::ProcessImage(const int i) {
   // disk and read them back as needed.
   std::lock_guard<std::mutex> lock(matcher_mutex_);
   matcher_->AddImage(image_filename, keypoints, descriptors, intrinsics);
+  image_added_to_matcher_[i] = true;
 }
 
 }  // namespace theia
@@ -37,16 +37,22 @@
 
 #include <string>
 #include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
 #include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/descriptor/descriptor_extractor_pool.h"
+#include "theia/image/image_decoding_pipeline.h"
 #include "theia/matching/create_feature_matcher.h"
 #include "theia/matching/feature_matcher.h"
 #include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/image_pair_selection.h"
 #include "theia/sfm/exif_reader.h"
+#include "theia/util/threadpool.h"
 
 namespace theia {
 struct CameraIntrinsicsPrior;
+class FloatImage;
 struct ImagePairMatch;
 
 class FeatureExtractorAndMatcher {
@@ -80,6 +86,35 @@ class FeatureExtractorAndMatcher {
 
     // Matching options for determining which feature matches are good matches.
     FeatureMatcherOptions feature_matcher_options;
+
+    // Options for proposing the image pairs to match from the GPS positions
+    // (from EXIF or the intrinsics priors) and the capture order of the images,
+    // which is the order in which the images are added. If any of these are
+    // enabled, only the union of the proposed pairs, the pairs set with
+    // SetPairsToMatch, and the pairs found with image retrieval (if enabled in
+    // the feature matcher options) is matched.
+    ImagePairSelectionOptions image_pair_selection_options;
+
+    // If true, the features are extracted while the images are matched instead
+    // of before: ExtractFeaturesAndIntrinsics only reads the camera intrinsics
+    // and MatchFeatures extracts the features of each image on the matching
+    // threads, matching each image pair as soon as the features of both images
+    // are available. This is ignored if image retrieval is enabled, since it
+    // needs the features of all images, or if a shard of the image pairs is
+    // matched, since the features must have been extracted before.
+    bool overlap_extraction_and_matching = false;
+
+    // Options for reading and decoding the images in separate threads from the
+    // num_threads feature extraction threads. See ImageDecodingPipeline. Only
+    // max_image_dimension is used when the features are extracted while
+    // matching. The keypoints of images that are decoded at a reduced
+    // resolution are rescaled to the full resolution images.
+    ImageDecodingOptions image_decoding_options;
+
+    // If true, the SIFT features of each large image are extracted with
+    // num_threads additional threads so that a few very large images use all
+    // threads. See FeatureExtractor::Options.
+    bool parallelize_large_images = false;
   };
 
   explicit FeatureExtractorAndMatcher(const Options& options);
@@ -111,10 +146,47 @@ class FeatureExtractorAndMatcher {
   void ExtractAndMatchFeatures(std::vector<CameraIntrinsicsPrior>* intrinsics,
                                std::vector<ImagePairMatch>* matches);
 
+  // The two steps of ExtractAndMatchFeatures, which allow the matches to be
+  // processed as they are found instead of holding all of them in memory.
+  // ExtractFeaturesAndIntrinsics extracts the features and the camera
+  // intrinsics (from EXIF) of all images, and MatchFeatures then matches the
+  // images and passes each verified match to the callback. If
+  // overlap_extraction_and_matching is set, the features are extracted in
+  // MatchFeatures instead. If a shard of the image pairs is matched (see
+  // FeatureMatcherOptions::num_shards), no features are extracted and the
+  // features of all images must already be in the keypoints and descriptors
+  // directory or the packed feature store.
+  void ExtractFeaturesAndIntrinsics(
+      std::vector<CameraIntrinsicsPrior>* intrinsics);
+  void MatchFeatures(const ImagePairMatchCallback& callback);
+
  private:
-  // Processes a single image by extracting EXIF information, extracting
-  // features and descriptors, and adding the image to the matcher.
-  void ProcessImage(const int i);
+  // Extracts the intrinsics of the image (e.g. from EXIF) and returns false if
+  // the image should not be used.
+  bool ExtractIntrinsics(const int i, CameraIntrinsicsPrior* intrinsics);
+
+  // Reads the image, extracts its features (unless they are already on disk)
+  // and adds them to the matcher. Returns false if the image cannot be read.
+  bool AddFeaturesToMatcher(const int i,
+                            const CameraIntrinsicsPrior& intrinsics);
+
+  // Adds the image to the matcher without extracting its features if they are
+  // in the packed feature store of the matcher, or if it is matched out of core
+  // and its features file already exists. Returns false otherwise.
+  bool AddFeaturesFromDiskToMatcher(const int i,
+                                    const CameraIntrinsicsPrior& intrinsics);
+
+  // Extracts the features of the decoded image, which was reduced by the scale,
+  // and adds them to the matcher.
+  void AddImageFeaturesToMatcher(const int i,
+                                 const CameraIntrinsicsPrior& intrinsics,
+                                 const FloatImage& image,
+                                 const double scale);
+
+  // Sets the image pairs that the matcher should match, combining the pairs
+  // that were set explicitly with the pairs proposed from the GPS positions,
+  // the capture order, and image retrieval.
+  void SelectImagePairsToMatch();
 
   const Options options_;
 
@@ -124,11 +196,28 @@ class FeatureExtractorAndMatcher {
   std::unordered_map<std::string, CameraIntrinsicsPrior> intrinsics_;
   std::unordered_map<std::string, std::string> image_masks_;
 
+  // The image pairs (by image filename) that were set explicitly, and whether
+  // each image was added to the matcher.
+  std::vector<std::pair<std::string, std::string> > pairs_to_match_;
+  std::vector<bool> image_added_to_matcher_;
+
+  // True if the features are extracted in MatchFeatures, in which case
+  // image_added_to_matcher_ holds whether each image is used.
+  bool extract_features_while_matching_;
+
   // Exif reader for loading exif information. This object is created once so
   // that the EXIF focal length database does not have to be loaded multiple
   // times.
   ExifReader exif_reader_;
 
+  // The threads that the descriptor extractors use to extract the features of
+  // large images in parallel, if enabled.
+  std::unique_ptr<ThreadPool> large_image_thread_pool_;
+
+  // The descriptor extractors, which are reused across images by the threads
+  // that extract features.
+  DescriptorExtractorPool descriptor_extractor_pool_;
+
   // Feature matcher and mutex for thread-safe access.
   std::unique_ptr<FeatureMatcher> matcher_;
   std::mutex intrinsics_mutex_, matcher_mutex_;
@@ -35,11 +35,14 @@
 #include "theia/sfm/reconstruction_builder.h"
 
 #include <glog/logging.h>
+#include <cstdio>
 #include <memory>
 #include <string>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
-#include "theia/io/write_matches.h"
+#include "theia/io/matches_file.h"
 #include "theia/matching/image_pair_match.h"
 #include "theia/sfm/camera_intrinsics_prior.h"
 #include "theia/sfm/feature_extractor_and_matcher.h"
@@ -50,11 +53,18 @@
 #include "theia/sfm/view.h"
 #include "theia/sfm/view_graph/view_graph.h"
 #include "theia/util/filesystem.h"
+#include "theia/util/hash.h"
+#include "theia/util/map_util.h"
 
 namespace theia {
 
 namespace {
 
+// Returns the filepath of the matching journal that is used to resume matching.
+std::string MatchingJournalFilename(const std::string& matches_file) {
+  return matches_file + ".journal";
+}
+
 // Add the view to the reconstruction. If the camera intrinsics group id is set
 // to an invalid group id then simply add the view to the reconstruction without
 // shared camera intrinsics.
@@ -169,10 +179,25 @@ ReconstructionBuilder::ReconstructionBuilder(
   feam_options.min_num_inlier_matches = options_.min_num_inlier_matches;
   feam_options.matching_strategy = options_.matching_strategy;
   feam_options.feature_matcher_options = options_.matching_options;
+  feam_options.image_pair_selection_options =
+      options_.image_pair_selection_options;
+  feam_options.overlap_extraction_and_matching =
+      options_.overlap_extraction_and_matching;
+  feam_options.parallelize_large_images = options_.parallelize_large_images;
+  feam_options.image_decoding_options = options_.image_decoding_options;
   feam_options.feature_matcher_options.geometric_verification_options
       .min_num_inlier_matches = options_.min_num_inlier_matches;
   feam_options.feature_matcher_options.geometric_verification_options
       .estimate_twoview_info_options.rng = options_.rng;
+  if (options_.resume_matching) {
+    if (options_.output_matches_file.empty()) {
+      LOG(WARNING) << "Matching can only be resumed if the matches are written "
+                      "to an output matches file.";
+    } else {
+      feam_options.feature_matcher_options.matching_journal_file =
+          MatchingJournalFilename(options_.output_matches_file);
+    }
+  }
 
   feature_extractor_and_matcher_.reset(
       new FeatureExtractorAndMatcher(feam_options));
@@ -242,11 +267,10 @@ bool ReconstructionBuilder::ExtractAndMatchFeatures() {
                                           "after TwoViewMatches has been "
                                           "called.";
 
-  // Extract features and obtain the feature matches.
-  std::vector<ImagePairMatch> matches;
+  // Extract the features and the camera intrinsics priors of all images.
   std::vector<CameraIntrinsicsPrior> camera_intrinsics_priors;
-  feature_extractor_and_matcher_->ExtractAndMatchFeatures(
-      &camera_intrinsics_priors, &matches);
+  feature_extractor_and_matcher_->ExtractFeaturesAndIntrinsics(
+      &camera_intrinsics_priors);
 
   // If we only want calibrated views remove them from the reconstruction so
   // that they no features are detected and matched between them.
@@ -261,12 +285,6 @@ bool ReconstructionBuilder::ExtractAndMatchFeatures() {
     }
   }
 
-  // Log how many view pairs were geometrically verified.
-  const int num_total_view_pairs =
-      image_filepaths_.size() * (image_filepaths_.size() - 1) / 2;
-  LOG(INFO) << matches.size() << " of " << num_total_view_pairs
-            << " view pairs were matched and geometrically verified.";
-
   // Add the EXIF data to each view.
   std::vector<std::string> image_filenames(image_filepaths_.size());
   for (int i = 0; i < image_filepaths_.size(); i++) {
@@ -279,21 +297,97 @@ bool ReconstructionBuilder::ExtractAndMatchFeatures() {
     *view->MutableCameraIntrinsicsPrior() = camera_intrinsics_priors[i];
   }
 
-  // Write the matches to a file if it exists.
+  // Match the features. The matches are never held in memory all at once:
+  // they are either appended to the matches file as they are found and then
+  // read back chunk by chunk, or added to the view graph directly.
+  int num_matches = 0;
   if (options_.output_matches_file.length() > 0) {
     LOG(INFO) << "Writing matches to file: " << options_.output_matches_file;
-    CHECK(WriteMatchesAndGeometry(options_.output_matches_file,
-                                  image_filenames,
-                                  camera_intrinsics_priors,
-                                  matches))
+    MatchesWriter matches_writer;
+
+    // When resuming, the matches are appended to the matches file of the
+    // previous run if it holds the same views. Pairs that are already in the
+    // file are not added again in case the matching journal was started over.
+    std::unordered_set<std::pair<std::string, std::string> > existing_pairs;
+    bool resume_matching = false;
+    if (options_.resume_matching &&
+        FileExists(options_.output_matches_file)) {
+      MatchesReader existing_matches_reader;
+      std::vector<ImagePairMatch> existing_matches;
+      resume_matching =
+          existing_matches_reader.Open(options_.output_matches_file) &&
+          existing_matches_reader.view_names() == image_filenames &&
+          existing_matches_reader.ReadMatchesWithoutCorrespondences(
+              &existing_matches) &&
+          matches_writer.Reopen(options_.output_matches_file);
+      if (resume_matching) {
+        for (const ImagePairMatch& match : existing_matches) {
+          existing_pairs.emplace(match.image1, match.image2);
+        }
+        LOG(INFO) << "Resuming matching with the " << existing_pairs.size()
+                  << " matches in " << options_.output_matches_file;
+      } else {
+        LOG(WARNING) << "The matches file " << options_.output_matches_file
+                     << " cannot be resumed because it was written for other "
+                        "images. Matching starts over.";
+      }
+    }
+    if (!resume_matching) {
+      // Any journal belongs to the matches that are overwritten now.
+      if (options_.resume_matching) {
+        std::remove(
+            MatchingJournalFilename(options_.output_matches_file).c_str());
+      }
+      CHECK(matches_writer.Open(options_.output_matches_file,
+                                image_filenames,
+                                camera_intrinsics_priors))
+          << "Could not write the matches to " << options_.output_matches_file;
+    }
+
+    // The journal records pairs as matched once the callback returns, so each
+    // match is flushed to the file right away when matching can be resumed.
+    const bool flush_each_match = options_.resume_matching;
+    feature_extractor_and_matcher_->MatchFeatures(
+        [&](const ImagePairMatch& match) {
+          if (ContainsKey(existing_pairs,
+                          std::make_pair(match.image1, match.image2))) {
+            return;
+          }
+          CHECK(matches_writer.AddMatch(match));
+          if (flush_each_match) {
+            CHECK(matches_writer.Flush());
+          }
+        });
+    CHECK(matches_writer.Close())
         << "Could not write the matches to " << options_.output_matches_file;
-  }
 
-  // Add the matches to the view graph and reconstruction.
-  for (const auto& match : matches) {
-    AddTwoViewMatch(match.image1, match.image2, match);
+    // Add the matches to the view graph and reconstruction.
+    MatchesReader matches_reader;
+    CHECK(matches_reader.Open(options_.output_matches_file));
+    std::vector<ImagePairMatch> matches;
+    while (matches_reader.ReadNextChunk(&matches)) {
+      for (const auto& match : matches) {
+        AddTwoViewMatch(match.image1, match.image2, match);
+      }
+      num_matches += matches.size();
+    }
+    CHECK(matches_reader.is_complete())
+        << "Could not read the matches from " << options_.output_matches_file;
+  } else {
+    // The matcher never invokes the callback from two threads at once.
+    feature_extractor_and_matcher_->MatchFeatures(
+        [this, &num_matches](const ImagePairMatch& match) {
+          AddTwoViewMatch(match.image1, match.image2, match);
+          ++num_matches;
+        });
   }
 
+  // Log how many view pairs were geometrically verified.
+  const int num_total_view_pairs =
+      image_filepaths_.size() * (image_filepaths_.size() - 1) / 2;
+  LOG(INFO) << num_matches << " of " << num_total_view_pairs
+            << " view pairs were matched and geometrically verified.";
+
   return true;
 }
 
@@ -40,8 +40,10 @@
 #include <vector>
 
 #include "theia/image/descriptor/create_descriptor_extractor.h"
+#include "theia/image/image_decoding_pipeline.h"
 #include "theia/matching/create_feature_matcher.h"
 #include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/image_pair_selection.h"
 #include "theia/sfm/reconstruction_estimator_options.h"
 #include "theia/sfm/types.h"
 #include "theia/util/util.h"
@@ -101,10 +103,36 @@ struct ReconstructionBuilderOptions {
   MatchingStrategy matching_strategy = MatchingStrategy::BRUTE_FORCE;
 
   // Options for computing matches between images. Two view geometric
-  // verification options are also part of these options.
+  // verification options are also part of these options. Set
+  // matching_options.image_retrieval_num_neighbors to only match the most
+  // similar images (found with a vocabulary tree) instead of all image pairs.
+  // Set matching_options.packed_features_file to read the features of the
+  // images from a packed feature store instead of extracting them.
   // See //theia/matching/feature_matcher_options.h
   FeatureMatcherOptions matching_options;
 
+  // Options for only matching the image pairs that are close according to the
+  // GPS positions of the images or that are close in capture order (i.e. the
+  // order in which the images are added). This greatly reduces the number of
+  // image pairs that are matched for aerial surveys and video sequences.
+  // See //theia/matching/image_pair_selection.h
+  ImagePairSelectionOptions image_pair_selection_options;
+
+  // If true, the features of the images are extracted while other images are
+  // matched instead of extracting all features before matching. This is
+  // ignored if image retrieval is used.
+  bool overlap_extraction_and_matching = false;
+
+  // If true, the SIFT features of each large image are extracted with
+  // additional threads so that a few very large images use all threads. The
+  // features are the same as without this option.
+  bool parallelize_large_images = false;
+
+  // Options for reading and decoding the images in separate threads from the
+  // feature extraction threads.
+  // See //theia/image/image_decoding_pipeline.h
+  ImageDecodingOptions image_decoding_options;
+
   // Options for estimating the reconstruction.
   // See //theia/sfm/reconstruction_estimator_options.h
   ReconstructionEstimatorOptions reconstruction_estimator_options;
@@ -112,8 +140,17 @@ struct ReconstructionBuilderOptions {
   // If you want the matches to be saved, set this variable to the filename that
   // you want the matches to be written to. Image names, inlier matches, and
   // view metadata so that the view graph and tracks may be exactly
-  // recreated.
+  // recreated. The matches are appended to the file as they are found and the
+  // view graph is then built from the file, so if matching is interrupted the
+  // file holds all matches that were found before.
   std::string output_matches_file;
+
+  // If true (and output_matches_file is set), the image pairs that have been
+  // matched are recorded in a journal next to the matches file (see
+  // MatchingJournal). If matching is interrupted, running it again with the
+  // same images and matching options skips the pairs that were matched before
+  // and appends the new matches to the matches file.
+  bool resume_matching = false;
 };
 
 // Base class for building SfM reconstructions. This class will manage the
@@ -0,0 +1,167 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/sfm/view_graph/guided_match_view_graph.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "theia/matching/guided_epipolar_matcher.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/sfm/camera/camera.h"
+#include "theia/sfm/camera_intrinsics_prior.h"
+#include "theia/sfm/reconstruction.h"
+#include "theia/sfm/twoview_info.h"
+#include "theia/sfm/types.h"
+#include "theia/sfm/view.h"
+#include "theia/sfm/view_graph/view_graph.h"
+#include "theia/util/hash.h"
+#include "theia/util/map_util.h"
+#include "theia/util/random.h"
+#include "theia/util/threadpool.h"
+
+namespace theia {
+namespace {
+
+// Sets up the cameras of the view pair such that camera 1 is at the origin and
+// camera 2 is at the relative pose of the two view info.
+void SetupCameras(const CameraIntrinsicsPrior& intrinsics1,
+                  const CameraIntrinsicsPrior& intrinsics2,
+                  const TwoViewInfo& info,
+                  Camera* camera1,
+                  Camera* camera2) {
+  camera1->SetFromCameraIntrinsicsPriors(intrinsics1);
+  camera1->SetFocalLength(info.focal_length_1);
+
+  camera2->SetOrientationFromAngleAxis(info.rotation_2);
+  camera2->SetPosition(info.position_2);
+  camera2->SetFromCameraIntrinsicsPriors(intrinsics2);
+  camera2->SetFocalLength(info.focal_length_2);
+}
+
+// Matches the view pair with a random number generator that is seeded with the
+// given seed. The generator draws from a state that is local to the thread (see
+// RandomNumberGenerator), so it is created by the thread that matches the view
+// pair.
+void GuidedMatchViewPair(const GuidedEpipolarMatcher::Options& options,
+                         const unsigned seed,
+                         const CameraIntrinsicsPrior& intrinsics1,
+                         const CameraIntrinsicsPrior& intrinsics2,
+                         const TwoViewInfo& info,
+                         const KeypointsAndDescriptors& features1,
+                         const KeypointsAndDescriptors& features2,
+                         std::vector<IndexedFeatureMatch>* matches) {
+  Camera camera1, camera2;
+  SetupCameras(intrinsics1, intrinsics2, info, &camera1, &camera2);
+
+  GuidedEpipolarMatcher::Options view_pair_options = options;
+  view_pair_options.rng = std::make_shared<RandomNumberGenerator>(seed);
+  GuidedEpipolarMatcher guided_matcher(view_pair_options, camera1, camera2,
+                                       features1, features2);
+  guided_matcher.GetMatches(matches);
+}
+
+}  // namespace
+
+void GuidedMatchViewGraph(
+    const GuidedEpipolarMatcher::Options& options,
+    const Reconstruction& reconstruction,
+    const ViewGraph& view_graph,
+    const std::unordered_map<ViewId, KeypointsAndDescriptors>& features,
+    std::unordered_map<ViewIdPair, std::vector<IndexedFeatureMatch> >*
+        matches) {
+  CHECK_NOTNULL(matches);
+
+  // The view pairs are matched in parallel, so each view pair is matched with
+  // a single thread.
+  GuidedEpipolarMatcher::Options view_pair_options = options;
+  view_pair_options.num_threads = 1;
+
+  // Create the matches of all view pairs before matching so that the container
+  // is not modified while it is accessed by the threads.
+  const auto& view_pairs = view_graph.GetAllEdges();
+  std::vector<std::pair<ViewIdPair, std::vector<IndexedFeatureMatch>*> >
+      view_pair_matches;
+  view_pair_matches.reserve(view_pairs.size());
+  for (const auto& view_pair : view_pairs) {
+    const ViewIdPair& view_id_pair = view_pair.first;
+    if (!ContainsKey(features, view_id_pair.first) ||
+        !ContainsKey(features, view_id_pair.second)) {
+      VLOG(2) << "Skipping guided matching of view pair (" << view_id_pair.first
+              << ", " << view_id_pair.second
+              << ") because the features of a view are missing.";
+      continue;
+    }
+    view_pair_matches.emplace_back(view_id_pair, &(*matches)[view_id_pair]);
+  }
+
+  // The generator of the options must not be shared by the threads, so each
+  // view pair gets its own generator. Its seed is derived from a seed that is
+  // drawn up front and from the view ids, so the matches do not depend on the
+  // order in which the view pairs are matched or on the number of threads.
+  std::shared_ptr<RandomNumberGenerator> rng = options.rng;
+  if (rng == nullptr) {
+    rng = std::make_shared<RandomNumberGenerator>();
+  }
+  const unsigned base_seed = rng->RandInt(0, std::numeric_limits<int>::max());
+
+  const int num_threads = std::max(
+      1, std::min(options.num_threads,
+                  static_cast<int>(view_pair_matches.size())));
+  ThreadPool pool(num_threads);
+  for (const auto& view_pair_match : view_pair_matches) {
+    const ViewIdPair& view_id_pair = view_pair_match.first;
+    const View* view1 = CHECK_NOTNULL(reconstruction.View(view_id_pair.first));
+    const View* view2 = CHECK_NOTNULL(reconstruction.View(view_id_pair.second));
+    const unsigned seed = base_seed ^ std::hash<ViewIdPair>()(view_id_pair);
+    pool.Add(GuidedMatchViewPair,
+             std::cref(view_pair_options),
+             seed,
+             std::cref(view1->CameraIntrinsicsPrior()),
+             std::cref(view2->CameraIntrinsicsPrior()),
+             std::cref(*view_graph.GetEdge(view_id_pair.first,
+                                           view_id_pair.second)),
+             std::cref(FindOrDie(features, view_id_pair.first)),
+             std::cref(FindOrDie(features, view_id_pair.second)),
+             view_pair_match.second);
+  }
+}
+
+}  // namespace theia
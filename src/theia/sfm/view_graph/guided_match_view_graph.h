@@ -0,0 +1,70 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_SFM_VIEW_GRAPH_GUIDED_MATCH_VIEW_GRAPH_H_
+#define THEIA_SFM_VIEW_GRAPH_GUIDED_MATCH_VIEW_GRAPH_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "theia/matching/guided_epipolar_matcher.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/sfm/types.h"
+#include "theia/util/hash.h"
+
+namespace theia {
+
+class Reconstruction;
+class ViewGraph;
+
+// Performs guided matching over all edges of the view graph. The epipolar
+// geometry of each view pair is obtained from the relative pose and focal
+// lengths of the TwoViewInfo that was estimated during geometric verification
+// together with the camera intrinsics priors of the views in the
+// reconstruction. The matches of each view pair, keyed by the ViewIdPair of the
+// edge, are used as the initial matches and the guided matches are appended to
+// them. View pairs are matched in parallel with options.num_threads threads and
+// edges whose views do not have features are skipped.
+void GuidedMatchViewGraph(
+    const GuidedEpipolarMatcher::Options& options,
+    const Reconstruction& reconstruction,
+    const ViewGraph& view_graph,
+    const std::unordered_map<ViewId, KeypointsAndDescriptors>& features,
+    std::unordered_map<ViewIdPair, std::vector<IndexedFeatureMatch> >*
+        matches);
+
+}  // namespace theia
+
+#endif  // THEIA_SFM_VIEW_GRAPH_GUIDED_MATCH_VIEW_GRAPH_H_
@@ -0,0 +1,259 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include <glog/logging.h>
+#include <Eigen/Core>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/matching/guided_epipolar_matcher.h"
+#include "theia/matching/indexed_feature_match.h"
+#include "theia/matching/keypoints_and_descriptors.h"
+#include "theia/sfm/camera/camera.h"
+#include "theia/sfm/pose/test_util.h"
+#include "theia/sfm/reconstruction.h"
+#include "theia/sfm/twoview_info.h"
+#include "theia/sfm/types.h"
+#include "theia/sfm/view.h"
+#include "theia/sfm/view_graph/guided_match_view_graph.h"
+#include "theia/sfm/view_graph/view_graph.h"
+#include "theia/util/map_util.h"
+#include "theia/util/random.h"
+
+namespace theia {
+
+namespace {
+
+static const int kNumDescriptorDimensions = 128;
+static const double kFocalLength = 800.0;
+static const double kPrincipalPoint = 1000.0;
+
+// Creates views that observe the same 3D points. Feature i of each view is the
+// projection of point i and has the same descriptor in all views, followed by
+// features that have no matches.
+void CreateViewsAndFeatures(
+    const int num_views,
+    const int num_valid_matches,
+    const int num_invalid_matches,
+    RandomNumberGenerator* rng,
+    Reconstruction* reconstruction,
+    std::vector<Camera>* cameras,
+    std::unordered_map<ViewId, KeypointsAndDescriptors>* features) {
+  cameras->resize(num_views);
+  for (int i = 0; i < num_views; i++) {
+    Camera& camera = (*cameras)[i];
+    camera.SetFocalLength(kFocalLength);
+    camera.SetPrincipalPoint(kPrincipalPoint, kPrincipalPoint);
+    camera.SetImageSize(2.0 * kPrincipalPoint, 2.0 * kPrincipalPoint);
+    if (i > 0) {
+      camera.SetOrientationFromRotationMatrix(RandomRotation(5.0, rng));
+      camera.SetPosition(rng->RandVector3d());
+    }
+
+    const ViewId view_id = reconstruction->AddView(std::to_string(i));
+    *reconstruction->MutableView(view_id)->MutableCameraIntrinsicsPrior() =
+        camera.CameraIntrinsicsPriorFromIntrinsics();
+    (*features)[view_id].descriptors.resize(
+        num_valid_matches + num_invalid_matches, kNumDescriptorDimensions);
+  }
+
+  for (int i = 0; i < num_valid_matches; i++) {
+    const Eigen::Vector4d point(rng->RandDouble(-2.0, 2.0),
+                                rng->RandDouble(-2.0, 2.0),
+                                rng->RandDouble(5.0, 10.0),
+                                1.0);
+    Eigen::VectorXf descriptor(kNumDescriptorDimensions);
+    rng->SetRandom(&descriptor);
+    descriptor.normalize();
+    for (int j = 0; j < num_views; j++) {
+      Eigen::Vector2d feature;
+      CHECK_GT((*cameras)[j].ProjectPoint(point, &feature), 0);
+      KeypointsAndDescriptors& view_features = (*features)[j];
+      view_features.keypoints.emplace_back(feature.x(), feature.y(),
+                                           Keypoint::OTHER);
+      view_features.descriptors.row(i) = descriptor.transpose();
+    }
+  }
+
+  const double max_image_bound = 2.0 * kPrincipalPoint;
+  for (int i = 0; i < num_invalid_matches; i++) {
+    for (int j = 0; j < num_views; j++) {
+      KeypointsAndDescriptors& view_features = (*features)[j];
+      view_features.keypoints.emplace_back(rng->RandDouble(0, max_image_bound),
+                                           rng->RandDouble(0, max_image_bound),
+                                           Keypoint::OTHER);
+      Eigen::VectorXf descriptor(kNumDescriptorDimensions);
+      rng->SetRandom(&descriptor);
+      view_features.descriptors.row(num_valid_matches + i) =
+          descriptor.normalized().transpose();
+    }
+  }
+}
+
+void TestGuidedMatchViewGraph(const int num_threads) {
+  static const int kNumViews = 4;
+  static const int kNumValidMatches = 500;
+  static const int kNumInvalidMatches = 100;
+  static const int kNumProvidedMatches = 20;
+
+  RandomNumberGenerator rng(59);
+  Reconstruction reconstruction;
+  std::vector<Camera> cameras;
+  std::unordered_map<ViewId, KeypointsAndDescriptors> features;
+  CreateViewsAndFeatures(kNumViews, kNumValidMatches, kNumInvalidMatches, &rng,
+                         &reconstruction, &cameras, &features);
+
+  // Connect all views and provide matches for some of the view pairs.
+  ViewGraph view_graph;
+  std::unordered_map<ViewIdPair, std::vector<IndexedFeatureMatch> > matches;
+  for (ViewId i = 0; i < kNumViews; i++) {
+    for (ViewId j = i + 1; j < kNumViews; j++) {
+      TwoViewInfo info;
+      TwoViewInfoFromTwoCameras(cameras[i], cameras[j], &info);
+      view_graph.AddEdge(i, j, info);
+      if (j == i + 1) {
+        for (int k = 0; k < kNumProvidedMatches; k++) {
+          IndexedFeatureMatch match;
+          match.feature1_ind = k;
+          match.feature2_ind = k;
+          matches[ViewIdPair(i, j)].emplace_back(match);
+        }
+      }
+    }
+  }
+
+  GuidedEpipolarMatcher::Options options;
+  options.num_threads = num_threads;
+  GuidedMatchViewGraph(options, reconstruction, view_graph, features,
+                       &matches);
+
+  // Ensure that all view pairs have been matched and that the matches are
+  // valid.
+  EXPECT_EQ(matches.size(), view_graph.NumEdges());
+  for (const auto& view_pair_matches : matches) {
+    EXPECT_GT(view_pair_matches.second.size(), kNumProvidedMatches);
+    for (const IndexedFeatureMatch& match : view_pair_matches.second) {
+      if (match.feature1_ind < kNumValidMatches) {
+        EXPECT_EQ(match.feature1_ind, match.feature2_ind);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+TEST(GuidedMatchViewGraph, SingleThreaded) {
+  TestGuidedMatchViewGraph(1);
+}
+
+TEST(GuidedMatchViewGraph, Multithreaded) {
+  static const int kNumThreads = 4;
+  TestGuidedMatchViewGraph(kNumThreads);
+}
+
+TEST(GuidedMatchViewGraph, SeededMatchesDoNotDependOnNumThreads) {
+  static const int kNumViews = 4;
+  RandomNumberGenerator rng(67);
+  Reconstruction reconstruction;
+  std::vector<Camera> cameras;
+  std::unordered_map<ViewId, KeypointsAndDescriptors> features;
+  CreateViewsAndFeatures(kNumViews, 200, 50, &rng, &reconstruction, &cameras,
+                         &features);
+
+  ViewGraph view_graph;
+  for (ViewId i = 0; i < kNumViews; i++) {
+    for (ViewId j = i + 1; j < kNumViews; j++) {
+      TwoViewInfo info;
+      TwoViewInfoFromTwoCameras(cameras[i], cameras[j], &info);
+      view_graph.AddEdge(i, j, info);
+    }
+  }
+
+  // Each view pair draws from its own generator, so the matches only depend on
+  // the seed and not on how the view pairs are distributed over the threads.
+  std::unordered_map<ViewIdPair, std::vector<IndexedFeatureMatch> >
+      single_threaded_matches, multithreaded_matches;
+  GuidedEpipolarMatcher::Options options;
+  options.rng = std::make_shared<RandomNumberGenerator>(71);
+  options.num_threads = 1;
+  GuidedMatchViewGraph(options, reconstruction, view_graph, features,
+                       &single_threaded_matches);
+  options.rng = std::make_shared<RandomNumberGenerator>(71);
+  options.num_threads = 4;
+  GuidedMatchViewGraph(options, reconstruction, view_graph, features,
+                       &multithreaded_matches);
+
+  ASSERT_EQ(single_threaded_matches.size(), view_graph.NumEdges());
+  ASSERT_EQ(multithreaded_matches.size(), view_graph.NumEdges());
+  for (const auto& view_pair_matches : single_threaded_matches) {
+    const std::vector<IndexedFeatureMatch>& expected_matches =
+        view_pair_matches.second;
+    const std::vector<IndexedFeatureMatch>& matches =
+        FindOrDieNoPrint(multithreaded_matches, view_pair_matches.first);
+    ASSERT_EQ(matches.size(), expected_matches.size());
+    for (int i = 0; i < matches.size(); i++) {
+      EXPECT_EQ(matches[i].feature1_ind, expected_matches[i].feature1_ind);
+      EXPECT_EQ(matches[i].feature2_ind, expected_matches[i].feature2_ind);
+    }
+  }
+}
+
+TEST(GuidedMatchViewGraph, SkipsViewPairsWithoutFeatures) {
+  RandomNumberGenerator rng(61);
+  Reconstruction reconstruction;
+  std::vector<Camera> cameras;
+  std::unordered_map<ViewId, KeypointsAndDescriptors> features;
+  CreateViewsAndFeatures(3, 100, 10, &rng, &reconstruction, &cameras,
+                         &features);
+  features.erase(2);
+
+  ViewGraph view_graph;
+  TwoViewInfo info;
+  TwoViewInfoFromTwoCameras(cameras[0], cameras[1], &info);
+  view_graph.AddEdge(0, 1, info);
+  TwoViewInfoFromTwoCameras(cameras[1], cameras[2], &info);
+  view_graph.AddEdge(1, 2, info);
+
+  std::unordered_map<ViewIdPair, std::vector<IndexedFeatureMatch> > matches;
+  GuidedMatchViewGraph(GuidedEpipolarMatcher::Options(), reconstruction,
+                       view_graph, features, &matches);
+  EXPECT_EQ(matches.size(), 1);
+  EXPECT_GT(matches[ViewIdPair(0, 1)].size(), 0);
+}
+
+}  // namespace theia
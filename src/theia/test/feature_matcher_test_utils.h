@@ -0,0 +1,142 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_TEST_FEATURE_MATCHER_TEST_UTILS_H_
+#define THEIA_TEST_FEATURE_MATCHER_TEST_UTILS_H_
+
+#include <Eigen/Core>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "theia/image/descriptor/descriptor_matrix.h"
+#include "theia/image/descriptor/quantized_descriptor_matrix.h"
+#include "theia/image/keypoint_detector/keypoint.h"
+#include "theia/matching/feature_correspondence.h"
+#include "theia/matching/feature_matcher_options.h"
+#include "theia/matching/image_pair_match.h"
+#include "theia/util/random.h"
+
+namespace theia {
+namespace test {
+
+// Creates random binary descriptors for the first image and copies of them
+// with num_flipped_bits flipped bits in reverse order for the second image, so
+// that descriptor i of the first image corresponds to descriptor
+// num_descriptors - 1 - i of the second.
+inline void CreateCorrespondingBinaryDescriptors(
+    const int num_descriptors,
+    const int num_bits,
+    const int num_flipped_bits,
+    DescriptorMatrix* descriptors1,
+    DescriptorMatrix* descriptors2) {
+  RandomNumberGenerator rng(61);
+  descriptors1->resize(num_descriptors, num_bits);
+  descriptors2->resize(num_descriptors, num_bits);
+  for (int i = 0; i < num_descriptors; i++) {
+    for (int j = 0; j < num_bits; j++) {
+      (*descriptors1)(i, j) = rng.RandInt(0, 1);
+    }
+    const int row2 = num_descriptors - 1 - i;
+    descriptors2->row(row2) = descriptors1->row(i);
+    for (int j = 0; j < num_flipped_bits; j++) {
+      float& bit = (*descriptors2)(row2, rng.RandInt(0, num_bits - 1));
+      bit = 1.0f - bit;
+    }
+  }
+}
+
+// Options that match binary descriptors symmetrically with the ratio test and
+// keep all matches without geometric verification.
+inline FeatureMatcherOptions BinaryMatcherOptions() {
+  FeatureMatcherOptions options;
+  options.descriptor_precision = DescriptorPrecision::BINARY;
+  options.min_num_feature_matches = 0;
+  options.keep_only_symmetric_matches = true;
+  options.use_lowes_ratio = true;
+  options.perform_geometric_verification = false;
+  return options;
+}
+
+inline int NumDescriptors(const DescriptorMatrix& descriptors) {
+  return descriptors.rows();
+}
+
+inline int NumDescriptors(const std::vector<Eigen::VectorXf>& descriptors) {
+  return descriptors.size();
+}
+
+// Matches two images with a matcher of type MatcherType and expects that each
+// descriptor i of the first image is matched to descriptor n - 1 - i of the
+// second image, where n is the number of descriptors. The images are named
+// after image_name_prefix, which must differ between tests since the features
+// of out-of-core matchers are written to a directory shared by all tests.
+template <class MatcherType, class DescriptorsType>
+void ExpectCorrespondingDescriptorsMatch(const FeatureMatcherOptions& options,
+                                         const std::string& image_name_prefix,
+                                         const DescriptorsType& descriptors1,
+                                         const DescriptorsType& descriptors2) {
+  const int num_descriptors = NumDescriptors(descriptors1);
+  ASSERT_EQ(NumDescriptors(descriptors2), num_descriptors);
+
+  // Add features. The x coordinate of each keypoint is the feature index so
+  // that the matched features can be identified from the correspondences.
+  std::vector<Keypoint> keypoints1, keypoints2;
+  for (int i = 0; i < num_descriptors; i++) {
+    keypoints1.emplace_back(i, 0, Keypoint::OTHER);
+    keypoints2.emplace_back(i, 0, Keypoint::OTHER);
+  }
+  MatcherType matcher(options);
+  matcher.AddImage(image_name_prefix + "1", keypoints1, descriptors1);
+  matcher.AddImage(image_name_prefix + "2", keypoints2, descriptors2);
+
+  // Match features.
+  std::vector<ImagePairMatch> matches;
+  matcher.MatchImages(&matches);
+
+  // Check that all features are matched to their corresponding feature.
+  ASSERT_EQ(matches.size(), 1);
+  EXPECT_EQ(matches[0].correspondences.size(), num_descriptors);
+  for (const FeatureCorrespondence& correspondence :
+       matches[0].correspondences) {
+    const int index1 = correspondence.feature1.x();
+    const int index2 = correspondence.feature2.x();
+    EXPECT_EQ(index2, num_descriptors - 1 - index1);
+  }
+}
+
+}  // namespace test
+}  // namespace theia
+
+#endif  // THEIA_TEST_FEATURE_MATCHER_TEST_UTILS_H_
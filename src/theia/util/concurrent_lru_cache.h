@@ -0,0 +1,396 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_UTIL_CONCURRENT_LRU_CACHE_H_
+#define THEIA_UTIL_CONCURRENT_LRU_CACHE_H_
+
+#include <glog/logging.h>
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>  // NOLINT
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "theia/util/util.h"
+
+namespace theia {
+
+// The capacity of a ConcurrentLRUCache.
+struct ConcurrentLRUCacheOptions {
+  // The maximum number of entries in the cache.
+  int max_cache_entries = std::numeric_limits<int>::max();
+
+  // The maximum total size of the entries in the cache. The size of the entries
+  // is computed with the entry size function of the cache.
+  size_t max_cache_size = std::numeric_limits<size_t>::max();
+
+  // The number of shards that the cache is split into.
+  int num_shards = 1;
+};
+
+// An LRU cache that may be used by many threads at once. Unlike LRUCache, the
+// function that fetches an entry on a cache miss (e.g., a read from disk) is
+// run without holding any lock, so threads only wait for each other while the
+// cache bookkeeping is updated. If several threads miss on the same key at the
+// same time, the entry is fetched only once and all threads wait for it.
+//
+// To reduce lock contention further the cache is split into shards which each
+// hold a part of the keys and have their own lock and LRU order. The capacity
+// is split evenly between the shards, so the eviction order is only
+// approximately LRU when more than one shard is used.
+//
+// The capacity of the cache may be limited both by the number of entries and
+// by the total size (e.g. in bytes) of the entries, where the size of each
+// entry is determined by a user-provided function.
+template <class KeyType, class ValueType>
+class ConcurrentLRUCache {
+ public:
+  typedef ConcurrentLRUCacheOptions Options;
+
+  // Pass a function that performs the cache miss lookup (e.g., a read from
+  // disk) that takes a key and returns a value, and a function that returns the
+  // size of a value (e.g. in bytes). See LRUCache for how to bind a member
+  // function to an object. The fetch function may be called by several threads
+  // at once (for different keys) and must therefore be thread safe.
+  ConcurrentLRUCache(
+      const std::function<ValueType(const KeyType&)>& fetch_entry,
+      const std::function<size_t(const ValueType&)>& entry_size,
+      const Options& options)
+      : fetch_entry_(fetch_entry),
+        entry_size_(entry_size),
+        options_(options),
+        shards_(options.num_shards) {
+    CHECK_GT(options_.max_cache_entries, 0)
+        << "The maximum number of cache entries must be greater than 0.";
+    CHECK_GT(options_.max_cache_size, 0)
+        << "The maximum cache size must be greater than 0.";
+    CHECK_GT(options_.num_shards, 0)
+        << "The number of cache shards must be greater than 0.";
+
+    // Round up so that the shards can hold at least max_cache_entries entries.
+    max_shard_entries_ =
+        options_.max_cache_entries / options_.num_shards +
+        (options_.max_cache_entries % options_.num_shards != 0 ? 1 : 0);
+    max_shard_size_ = options_.max_cache_size / options_.num_shards;
+    cache_misses_ = 0;
+    cache_hits_ = 0;
+    num_prefetches_ = 0;
+    prefetch_hits_ = 0;
+  }
+
+  // Same as above, but the capacity is only limited by the number of entries.
+  ConcurrentLRUCache(
+      const std::function<ValueType(const KeyType&)>& fetch_entry,
+      const int max_cache_entries,
+      const int num_shards = 1)
+      : ConcurrentLRUCache(fetch_entry,
+                           [](const ValueType&) { return size_t(1); },
+                           MakeOptions(max_cache_entries, num_shards)) {}
+
+  // Fetch the entry and return the value. If the entry is in the cache then it
+  // will be returned efficiently. If the entry is currently being fetched by
+  // another thread, this waits until it is available.
+  ValueType Fetch(const KeyType& key) {
+    Shard& shard = GetShard(key);
+    std::shared_future<ValueType> cached_value;
+    std::shared_ptr<std::promise<ValueType> > promise;
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      const auto it = shard.entries.find(key);
+      if (it != shard.entries.end()) {
+        ++cache_hits_;
+        if (it->second.is_prefetched) {
+          ++prefetch_hits_;
+          it->second.is_prefetched = false;
+        }
+
+        // If the entry was in the cache, we need to update the access record by
+        // moving it to the back of the list.
+        shard.lru_order.splice(
+            shard.lru_order.end(), shard.lru_order, it->second.position);
+        cached_value = it->second.value;
+      } else {
+        ++cache_misses_;
+        promise = AddLoadingEntry(key, &shard);
+      }
+    }
+
+    // Wait for the value outside of the lock in case it is still being fetched
+    // by another thread.
+    if (cached_value.valid()) {
+      return cached_value.get();
+    }
+    return FetchEntry(key, promise, &shard);
+  }
+
+  // Fetches the entry into the cache if it is not in the cache yet so that a
+  // later call to Fetch is a cache hit. If the entry is in the cache it is
+  // marked as the most recently used entry. Prefetches are not counted as
+  // cache hits or misses. Returns false if the entry could not be fetched, in
+  // which case the error is reported by the next call to Fetch.
+  bool Prefetch(const KeyType& key) {
+    Shard& shard = GetShard(key);
+    std::shared_ptr<std::promise<ValueType> > promise;
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      const auto it = shard.entries.find(key);
+      if (it != shard.entries.end()) {
+        shard.lru_order.splice(
+            shard.lru_order.end(), shard.lru_order, it->second.position);
+        return true;
+      }
+
+      ++num_prefetches_;
+      promise = AddLoadingEntry(key, &shard);
+      shard.entries[key].is_prefetched = true;
+    }
+
+    try {
+      FetchEntry(key, promise, &shard);
+    } catch (...) {
+      return false;
+    }
+    return true;
+  }
+
+  // Inserts a key-value pair into the cache, evicting the oldest entries if the
+  // cache is at the maximum capacity. This method assumes that the key is not
+  // already in the cache, and will CHECK-fail if the key already exists.
+  void Insert(const KeyType& key, const ValueType& value) {
+    const size_t value_size = entry_size_(value);
+    std::promise<ValueType> promise;
+    promise.set_value(value);
+
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry& entry = AddEntry(key, &shard);
+    entry.value = promise.get_future().share();
+    entry.size = value_size;
+    shard.size += value_size;
+    EvictEntries(key, &shard);
+  }
+
+  // Return if the key exists in the cache (or is currently being fetched).
+  bool ExistsInCache(const KeyType& key) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.entries.find(key) != shard.entries.end();
+  }
+
+  // Various statistics for the cache.
+  int CacheCapacity() const { return options_.max_cache_entries; }
+  size_t MaxCacheSize() const { return options_.max_cache_size; }
+  int NumShards() const { return options_.num_shards; }
+  int NumCacheMisses() const { return cache_misses_; }
+  int NumCacheHits() const { return cache_hits_; }
+  // The number of entries fetched by Prefetch and the number of those entries
+  // that were later requested with Fetch.
+  int NumPrefetches() const { return num_prefetches_; }
+  int NumPrefetchHits() const { return prefetch_hits_; }
+  int Size() {
+    int num_entries = 0;
+    for (Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      num_entries += shard.entries.size();
+    }
+    return num_entries;
+  }
+  // The total size of the entries in the cache.
+  size_t SizeOfEntries() {
+    size_t size = 0;
+    for (Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      size += shard.size;
+    }
+    return size;
+  }
+
+ private:
+  typedef std::list<KeyType> CacheList;
+  typedef typename CacheList::iterator CacheListIterator;
+
+  struct Entry {
+    Entry() : size(0), is_loading(false), is_prefetched(false) {}
+
+    std::shared_future<ValueType> value;
+    // The position of the entry in the LRU order of the shard.
+    CacheListIterator position;
+    // The size of the value. This is 0 while the value is being fetched.
+    size_t size;
+    bool is_loading;
+    // True if the entry was prefetched and has not been fetched since.
+    bool is_prefetched;
+  };
+
+  struct Shard {
+    Shard() : size(0) {}
+
+    std::mutex mutex;
+    // The keys ordered from the least to the most recently used.
+    CacheList lru_order;
+    std::unordered_map<KeyType, Entry> entries;
+    // The total size of the entries in the shard.
+    size_t size;
+  };
+
+  static Options MakeOptions(const int max_cache_entries,
+                             const int num_shards) {
+    Options options;
+    options.max_cache_entries = max_cache_entries;
+    options.num_shards = num_shards;
+    return options;
+  }
+
+  Shard& GetShard(const KeyType& key) {
+    return shards_[std::hash<KeyType>()(key) % shards_.size()];
+  }
+
+  // Adds a new entry as the most recently used entry of the shard.
+  //
+  // NOTE: The shard must be locked when calling this method.
+  Entry& AddEntry(const KeyType& key, Shard* shard) {
+    // Ensure this method is only called on a cache miss.
+    CHECK(shard->entries.find(key) == shard->entries.end());
+    Entry& entry = shard->entries[key];
+    entry.position = shard->lru_order.insert(shard->lru_order.end(), key);
+    return entry;
+  }
+
+  // Adds an entry for a value that is about to be fetched. The entry is added
+  // before the value is available so that other threads which need the same
+  // entry wait for this fetch instead of repeating it.
+  //
+  // NOTE: The shard must be locked when calling this method.
+  std::shared_ptr<std::promise<ValueType> > AddLoadingEntry(const KeyType& key,
+                                                            Shard* shard) {
+    std::shared_ptr<std::promise<ValueType> > promise =
+        std::make_shared<std::promise<ValueType> >();
+    Entry& entry = AddEntry(key, shard);
+    entry.value = promise->get_future().share();
+    entry.is_loading = true;
+    return promise;
+  }
+
+  // Fetches the value of an entry added with AddLoadingEntry. The value is
+  // fetched without holding the lock of the shard. If the fetch fails, the
+  // entry is removed and the exception is rethrown.
+  ValueType FetchEntry(const KeyType& key,
+                       const std::shared_ptr<std::promise<ValueType> >& promise,
+                       Shard* shard) {
+    ValueType value;
+    try {
+      value = fetch_entry_(key);
+    } catch (...) {
+      promise->set_exception(std::current_exception());
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      RemoveLoadingEntry(key, shard);
+      throw;
+    }
+    promise->set_value(value);
+
+    const size_t value_size = entry_size_(value);
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    const auto it = shard->entries.find(key);
+    if (it != shard->entries.end() && it->second.is_loading) {
+      it->second.is_loading = false;
+      it->second.size = value_size;
+      shard->size += value_size;
+      EvictEntries(key, shard);
+    }
+    return value;
+  }
+
+  // Removes an entry whose value could not be fetched.
+  //
+  // NOTE: The shard must be locked when calling this method.
+  void RemoveLoadingEntry(const KeyType& key, Shard* shard) {
+    const auto it = shard->entries.find(key);
+    if (it != shard->entries.end() && it->second.is_loading) {
+      shard->lru_order.erase(it->second.position);
+      shard->entries.erase(it);
+    }
+  }
+
+  // Evicts the least recently used entries until the shard is within its
+  // capacity. The entry with the given key was just added and is not evicted,
+  // and neither are entries that are still being fetched.
+  //
+  // NOTE: The shard must be locked when calling this method.
+  void EvictEntries(const KeyType& key, Shard* shard) {
+    auto it = shard->lru_order.begin();
+    while ((shard->entries.size() > max_shard_entries_ ||
+            shard->size > max_shard_size_) &&
+           it != shard->lru_order.end()) {
+      const auto entry = shard->entries.find(*it);
+      if (*it == key || entry->second.is_loading) {
+        ++it;
+        continue;
+      }
+      shard->size -= entry->second.size;
+      shard->entries.erase(entry);
+      it = shard->lru_order.erase(it);
+    }
+  }
+
+  // A function that takes in a KeyType as input and returns the ValueType. This
+  // is utilized for cache misses and e.g., can implement a read from disk.
+  const std::function<ValueType(const KeyType&)> fetch_entry_;
+
+  // A function that returns the size of a value.
+  const std::function<size_t(const ValueType&)> entry_size_;
+
+  const Options options_;
+  std::vector<Shard> shards_;
+
+  // The capacity of each shard.
+  size_t max_shard_entries_;
+  size_t max_shard_size_;
+
+  // Some cache statistics.
+  std::atomic<int> cache_misses_, cache_hits_;
+  std::atomic<int> num_prefetches_, prefetch_hits_;
+
+  DISALLOW_COPY_AND_ASSIGN(ConcurrentLRUCache);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_UTIL_CONCURRENT_LRU_CACHE_H_
@@ -0,0 +1,219 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/util/concurrent_lru_cache.h"
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <memory>
+#include <stdexcept>
+#include <thread>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "theia/util/map_util.h"
+
+namespace theia {
+
+namespace {
+
+const std::unordered_map<int, int> kCacheLookup = {
+    {0, 1}, {1, 47}, {2, 14}, {3, 101}, {4, 7}, {5, 29}};
+
+int CacheMissLookup(const int& input) {
+  return FindOrDie(kCacheLookup, input);
+}
+
+}  // namespace
+
+TEST(ConcurrentLRUCache, FetchWorksWithManyEntries) {
+  const int kMaxCacheSize = 6;
+  ConcurrentLRUCache<int, int> cache(CacheMissLookup, kMaxCacheSize);
+  EXPECT_EQ(cache.CacheCapacity(), kMaxCacheSize);
+  EXPECT_EQ(cache.Size(), 0);
+
+  int num_elements_inserted = 0;
+  for (const auto& entry : kCacheLookup) {
+    EXPECT_EQ(cache.Fetch(entry.first), entry.second);
+    EXPECT_TRUE(cache.ExistsInCache(entry.first));
+    ++num_elements_inserted;
+    EXPECT_EQ(cache.Size(), num_elements_inserted);
+    EXPECT_EQ(cache.NumCacheMisses(), num_elements_inserted);
+    EXPECT_EQ(cache.NumCacheHits(), 0);
+  }
+
+  // All elements fit in the cache so these are all cache hits.
+  for (const auto& entry : kCacheLookup) {
+    EXPECT_EQ(cache.Fetch(entry.first), entry.second);
+  }
+  EXPECT_EQ(cache.NumCacheMisses(), kCacheLookup.size());
+  EXPECT_EQ(cache.NumCacheHits(), kCacheLookup.size());
+}
+
+TEST(ConcurrentLRUCache, EvictsLeastRecentlyUsedEntry) {
+  const int kMaxCacheSize = 2;
+  ConcurrentLRUCache<int, int> cache(CacheMissLookup, kMaxCacheSize);
+  cache.Fetch(0);
+  cache.Fetch(1);
+  // Touch 0 so that 1 becomes the least recently used entry.
+  cache.Fetch(0);
+  cache.Fetch(2);
+  EXPECT_TRUE(cache.ExistsInCache(0));
+  EXPECT_FALSE(cache.ExistsInCache(1));
+  EXPECT_TRUE(cache.ExistsInCache(2));
+  EXPECT_EQ(cache.Size(), kMaxCacheSize);
+
+  cache.Insert(3, 5);
+  EXPECT_FALSE(cache.ExistsInCache(0));
+  EXPECT_EQ(cache.Fetch(3), 5);
+  EXPECT_EQ(cache.Size(), kMaxCacheSize);
+}
+
+TEST(ConcurrentLRUCache, EvictsEntriesToStayWithinSizeLimit) {
+  // The size of an entry is its value, so the cache can hold entries 0, 2 and
+  // 4 (with sizes 1, 14 and 7) but not 3 together with any other entry.
+  ConcurrentLRUCache<int, int>::Options options;
+  options.max_cache_size = 110;
+  ConcurrentLRUCache<int, int> cache(
+      CacheMissLookup, [](const int& value) { return size_t(value); },
+      options);
+
+  cache.Fetch(0);
+  cache.Fetch(2);
+  cache.Fetch(4);
+  EXPECT_EQ(cache.Size(), 3);
+  EXPECT_EQ(cache.SizeOfEntries(), 1 + 14 + 7);
+
+  cache.Fetch(3);
+  EXPECT_EQ(cache.Size(), 2);
+  EXPECT_TRUE(cache.ExistsInCache(3));
+  EXPECT_TRUE(cache.ExistsInCache(4));
+  EXPECT_EQ(cache.SizeOfEntries(), 101 + 7);
+}
+
+TEST(ConcurrentLRUCache, EntriesAreSplitBetweenShards) {
+  const int kMaxCacheSize = 64;
+  const int kNumShards = 4;
+  ConcurrentLRUCache<int, int> cache(
+      [](const int& key) { return 2 * key; }, kMaxCacheSize, kNumShards);
+  EXPECT_EQ(cache.NumShards(), kNumShards);
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(cache.Fetch(i), 2 * i);
+  }
+  EXPECT_LE(cache.Size(), kMaxCacheSize);
+  EXPECT_EQ(cache.NumCacheMisses(), 1000);
+}
+
+TEST(ConcurrentLRUCache, ConcurrentMissesFetchTheEntryOnce) {
+  const int kNumThreads = 8;
+  std::atomic<int> num_fetches(0);
+  ConcurrentLRUCache<int, int> cache(
+      [&num_fetches](const int& key) {
+        ++num_fetches;
+        // Make the fetch slow so that all threads request the key while it is
+        // being fetched.
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return key + 1;
+      },
+      10);
+
+  std::vector<int> values(kNumThreads, 0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back(
+        [&cache, &values, i]() { values[i] = cache.Fetch(7); });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(num_fetches, 1);
+  EXPECT_EQ(cache.NumCacheMisses(), 1);
+  EXPECT_EQ(cache.NumCacheHits(), kNumThreads - 1);
+  for (const int value : values) {
+    EXPECT_EQ(value, 8);
+  }
+}
+
+TEST(ConcurrentLRUCache, PrefetchedEntriesAreCacheHits) {
+  ConcurrentLRUCache<int, int> cache(CacheMissLookup, 2);
+  EXPECT_TRUE(cache.Prefetch(0));
+  EXPECT_TRUE(cache.Prefetch(1));
+  // Prefetching an entry that is in the cache does not fetch it again.
+  EXPECT_TRUE(cache.Prefetch(0));
+  EXPECT_EQ(cache.NumPrefetches(), 2);
+  EXPECT_EQ(cache.NumCacheMisses(), 0);
+  EXPECT_EQ(cache.NumCacheHits(), 0);
+
+  // 0 was prefetched most recently so 1 is evicted.
+  EXPECT_TRUE(cache.Prefetch(2));
+  EXPECT_FALSE(cache.ExistsInCache(1));
+
+  EXPECT_EQ(cache.Fetch(0), FindOrDie(kCacheLookup, 0));
+  EXPECT_EQ(cache.Fetch(0), FindOrDie(kCacheLookup, 0));
+  EXPECT_EQ(cache.Fetch(1), FindOrDie(kCacheLookup, 1));
+  EXPECT_EQ(cache.NumCacheHits(), 2);
+  EXPECT_EQ(cache.NumCacheMisses(), 1);
+  EXPECT_EQ(cache.NumPrefetches(), 3);
+  EXPECT_EQ(cache.NumPrefetchHits(), 1);
+}
+
+TEST(ConcurrentLRUCache, FailedFetchIsNotCached) {
+  int num_fetches = 0;
+  ConcurrentLRUCache<int, int> cache(
+      [&num_fetches](const int& key) {
+        ++num_fetches;
+        if (num_fetches == 1) {
+          throw std::runtime_error("Fetch failed.");
+        }
+        return key;
+      },
+      10);
+
+  EXPECT_THROW(cache.Fetch(1), std::runtime_error);
+  EXPECT_FALSE(cache.ExistsInCache(1));
+  EXPECT_EQ(cache.Fetch(1), 1);
+  EXPECT_EQ(num_fetches, 2);
+
+  // The same holds for prefetches.
+  num_fetches = 0;
+  EXPECT_FALSE(cache.Prefetch(2));
+  EXPECT_FALSE(cache.ExistsInCache(2));
+  EXPECT_TRUE(cache.Prefetch(2));
+  EXPECT_TRUE(cache.ExistsInCache(2));
+}
+
+}  // namespace theia
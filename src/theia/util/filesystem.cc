@@ -97,6 +97,10 @@ bool FileExists(const std::string& filename) {
   return stlplus::file_exists(filename);
 }
 
+size_t FileSize(const std::string& filename) {
+  return stlplus::file_size(filename);
+}
+
 // Returns true if the directory exists, false otherwise.
 bool DirectoryExists(const std::string& directory) {
     return stlplus::folder_exists(directory);
@@ -107,4 +111,9 @@ bool CreateNewDirectory(const std::string& directory) {
   return stlplus::folder_create(directory);
 }
 
+bool RenameFile(const std::string& old_filename,
+                const std::string& new_filename) {
+  return stlplus::file_rename(old_filename, new_filename);
+}
+
 }  // namespace theia
@@ -35,6 +35,7 @@
 #ifndef THEIA_UTIL_FILESYSTEM_H_
 #define THEIA_UTIL_FILESYSTEM_H_
 
+#include <cstddef>
 #include <string>
 #include <vector>
 
@@ -60,12 +61,21 @@ bool GetDirectoryFromFilepath(const std::string& filepath,
 // Returns true if the file exists, false otherwise.
 bool FileExists(const std::string& filename);
 
+// Returns the size of the file in bytes, or 0 if the file does not exist.
+size_t FileSize(const std::string& filename);
+
 // Returns true if the directory exists, false otherwise.
 bool DirectoryExists(const std::string& directory);
 
 // Creates the given directory.
 bool CreateNewDirectory(const std::string& directory);
 
+// Renames the file. An existing file with the new name is replaced, and on
+// POSIX systems the rename is atomic, so a file that is written under a
+// temporary name and then renamed is never seen partially written.
+bool RenameFile(const std::string& old_filename,
+                const std::string& new_filename);
+
 }  // namespace theia
 
 #endif  // THEIA_UTIL_FILESYSTEM_H_
@@ -36,6 +36,7 @@
 #define THEIA_UTIL_HASH_H_
 
 #include <Eigen/Core>
+#include <stdint.h>
 #include <utility>
 
 // This file defines hash functions for stl containers.
@@ -78,4 +79,22 @@ struct hash<Eigen::Matrix<T, N, M> > {
 
 }  // namespace std
 
+namespace theia {
+
+// The 64-bit FNV-1a hash of the data. Unlike std::hash, the hash is the same on
+// all platforms so it may be stored in files, e.g. to detect corrupted data.
+// Data may be hashed in pieces by passing the hash of the previous pieces.
+inline uint64_t Fnv1aHash(const void* data,
+                          const size_t size,
+                          uint64_t hash = 0xcbf29ce484222325ULL) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+}  // namespace theia
+
 #endif  // THEIA_UTIL_HASH_H_
@@ -115,6 +115,7 @@ class LRUCache {
 
   // Return if the key exists in the cache.
   virtual bool ExistsInCache(const KeyType& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
     return ContainsKey(cache_entries_map_, key);
   }
 
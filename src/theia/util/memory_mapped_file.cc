@@ -0,0 +1,118 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/util/memory_mapped_file.h"
+
+#include <glog/logging.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <fstream>  // NOLINT
+#include <string>
+#include <vector>
+
+namespace theia {
+
+MemoryMappedFile::MemoryMappedFile()
+    : data_(nullptr), size_(0), is_mapped_(false) {}
+
+MemoryMappedFile::~MemoryMappedFile() {
+#ifndef _WIN32
+  if (is_mapped_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+#endif
+}
+
+bool MemoryMappedFile::Open(const std::string& filename) {
+  CHECK(data_ == nullptr && size_ == 0) << "The file is already open.";
+
+#ifndef _WIN32
+  const int file_descriptor = open(filename.c_str(), O_RDONLY);
+  if (file_descriptor < 0) {
+    LOG(ERROR) << "Could not open the file: " << filename << " for reading.";
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(file_descriptor, &file_stat) != 0) {
+    LOG(ERROR) << "Could not determine the size of the file: " << filename;
+    close(file_descriptor);
+    return false;
+  }
+  size_ = file_stat.st_size;
+
+  // Empty files cannot be mapped.
+  if (size_ == 0) {
+    close(file_descriptor);
+    return true;
+  }
+
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, file_descriptor, 0);
+  // The mapping remains valid after the file is closed.
+  close(file_descriptor);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Could not memory map the file: " << filename;
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<const char*>(data);
+  is_mapped_ = true;
+  return true;
+#else
+  std::ifstream reader(filename, std::ios::in | std::ios::binary);
+  if (!reader.is_open()) {
+    LOG(ERROR) << "Could not open the file: " << filename << " for reading.";
+    return false;
+  }
+  reader.seekg(0, std::ios::end);
+  buffer_.resize(reader.tellg());
+  reader.seekg(0, std::ios::beg);
+  if (!reader.read(buffer_.data(), buffer_.size())) {
+    LOG(ERROR) << "Could not read the file: " << filename;
+    buffer_.clear();
+    return false;
+  }
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+  return true;
+#endif
+}
+
+}  // namespace theia
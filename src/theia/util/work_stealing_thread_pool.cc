@@ -0,0 +1,196 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/util/work_stealing_thread_pool.h"
+
+#include <glog/logging.h>
+
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
+
+namespace theia {
+
+WorkStealingThreadPool::WorkStealingThreadPool(const int num_threads)
+    : num_queued_tasks_(0), num_unfinished_tasks_(0), stop_(false) {
+  CHECK_GE(num_threads, 1) << "The number of threads specified to the "
+                              "WorkStealingThreadPool is insufficient.";
+  // All workers are created before any of them is started since the workers
+  // look at the queues of each other.
+  for (int i = 0; i < num_threads; i++) {
+    workers_.emplace_back(new Worker);
+  }
+  for (int i = 0; i < num_threads; i++) {
+    workers_[i]->thread =
+        std::thread(&WorkStealingThreadPool::RunWorker, this, i);
+  }
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  task_queued_.notify_all();
+  for (const std::unique_ptr<Worker>& worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+void WorkStealingThreadPool::Add(std::function<void()> task) {
+  ++num_unfinished_tasks_;
+  const int worker_index = WorkerIndexOfThisThread();
+  if (worker_index >= 0) {
+    Worker* worker = workers_[worker_index].get();
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->tasks.emplace_back(std::move(task));
+  } else {
+    std::lock_guard<std::mutex> lock(shared_tasks_mutex_);
+    shared_tasks_.emplace_back(std::move(task));
+  }
+
+  // The counter is incremented while holding the mutex so that a worker cannot
+  // miss the notification between checking the counter and waiting.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++num_queued_tasks_;
+  }
+  task_queued_.notify_one();
+}
+
+void WorkStealingThreadPool::Wait() {
+  CHECK_LT(WorkerIndexOfThisThread(), 0)
+      << "WorkStealingThreadPool::Wait must not be called from a task.";
+  std::unique_lock<std::mutex> lock(mutex_);
+  tasks_finished_.wait(lock, [this] { return num_unfinished_tasks_ == 0; });
+}
+
+std::vector<WorkStealingThreadPool::WorkerStatistics>
+WorkStealingThreadPool::GetWorkerStatistics() const {
+  std::vector<WorkerStatistics> statistics;
+  statistics.reserve(workers_.size());
+  for (const std::unique_ptr<Worker>& worker : workers_) {
+    statistics.emplace_back(worker->statistics);
+  }
+  return statistics;
+}
+
+void WorkStealingThreadPool::RunWorker(const int worker_index) {
+  Worker* worker = workers_[worker_index].get();
+  std::function<void()> task;
+  bool is_stolen;
+  while (true) {
+    if (!TakeTask(worker_index, &task, &is_stolen)) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_queued_.wait(
+          lock, [this] { return stop_ || num_queued_tasks_ > 0; });
+      if (stop_ && num_queued_tasks_ == 0) {
+        return;
+      }
+      continue;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    task();
+    task = nullptr;
+    const std::chrono::duration<double> busy_time =
+        std::chrono::steady_clock::now() - start;
+    worker->statistics.busy_time_in_seconds += busy_time.count();
+    ++worker->statistics.num_tasks;
+    if (is_stolen) {
+      ++worker->statistics.num_stolen_tasks;
+    }
+
+    if (--num_unfinished_tasks_ == 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_finished_.notify_all();
+    }
+  }
+}
+
+bool WorkStealingThreadPool::TakeTask(const int worker_index,
+                                      std::function<void()>* task,
+                                      bool* is_stolen) {
+  *is_stolen = false;
+  {
+    Worker* worker = workers_[worker_index].get();
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (!worker->tasks.empty()) {
+      *task = std::move(worker->tasks.back());
+      worker->tasks.pop_back();
+      --num_queued_tasks_;
+      return true;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(shared_tasks_mutex_);
+    if (!shared_tasks_.empty()) {
+      *task = std::move(shared_tasks_.front());
+      shared_tasks_.pop_front();
+      --num_queued_tasks_;
+      return true;
+    }
+  }
+
+  // Steal the oldest task of the next worker that has one.
+  for (int i = 1; i < workers_.size(); i++) {
+    Worker* victim = workers_[(worker_index + i) % workers_.size()].get();
+    std::lock_guard<std::mutex> lock(victim->mutex);
+    if (!victim->tasks.empty()) {
+      *task = std::move(victim->tasks.front());
+      victim->tasks.pop_front();
+      --num_queued_tasks_;
+      *is_stolen = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+int WorkStealingThreadPool::WorkerIndexOfThisThread() const {
+  const std::thread::id thread_id = std::this_thread::get_id();
+  for (int i = 0; i < workers_.size(); i++) {
+    if (workers_[i]->thread.get_id() == thread_id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+}  // namespace theia
@@ -0,0 +1,134 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#ifndef THEIA_UTIL_WORK_STEALING_THREAD_POOL_H_
+#define THEIA_UTIL_WORK_STEALING_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "theia/util/util.h"
+
+namespace theia {
+
+// A thread pool for many small tasks of varying cost that may add further tasks
+// (e.g. the next stage of processing the same item). Each worker thread has its
+// own queue of tasks. Tasks that are added from outside of the pool go to a
+// shared queue and are started in the order they were added. Tasks that are
+// added by a task go to the queue of the worker thread that runs it, and the
+// worker runs the most recently added of them first so that the data of the
+// task is still in its cache. Workers whose queue and the shared queue are
+// empty steal the oldest task from the queue of another worker, so no worker
+// is idle while tasks are waiting.
+class WorkStealingThreadPool {
+ public:
+  // The time each worker thread spent running tasks and the number of tasks it
+  // ran, of which num_stolen_tasks were stolen from other workers.
+  struct WorkerStatistics {
+    double busy_time_in_seconds = 0.0;
+    int num_tasks = 0;
+    int num_stolen_tasks = 0;
+  };
+
+  // All the threads are created upon construction.
+  explicit WorkStealingThreadPool(const int num_threads);
+  // Waits for all tasks to finish and joins the threads.
+  ~WorkStealingThreadPool();
+
+  // Adds a task to the pool. This may be called from within a task.
+  void Add(std::function<void()> task);
+
+  // Blocks until all tasks, including the tasks added by other tasks, have
+  // finished. This must not be called from within a task.
+  void Wait();
+
+  int NumThreads() const { return workers_.size(); }
+
+  // Returns the statistics of each worker thread. This must only be called
+  // while no tasks are running, e.g. after Wait.
+  std::vector<WorkerStatistics> GetWorkerStatistics() const;
+
+  // Returns the index (in [0, NumThreads())) of the worker running on the
+  // calling thread, or -1 if the calling thread is not a worker of the pool.
+  // Tasks may use it to keep per-worker state without locking.
+  int WorkerIndexOfThisThread() const;
+
+ private:
+  struct Worker {
+    std::thread thread;
+    std::mutex mutex;
+    std::deque<std::function<void()> > tasks;
+    WorkerStatistics statistics;
+  };
+
+  // Runs tasks on the worker thread with the given index until the pool stops.
+  void RunWorker(const int worker_index);
+
+  // Takes the next task for the worker from its own queue, the shared queue,
+  // or the queue of another worker (in this order). Returns false if all queues
+  // are empty.
+  bool TakeTask(const int worker_index,
+                std::function<void()>* task,
+                bool* is_stolen);
+
+  std::vector<std::unique_ptr<Worker> > workers_;
+
+  // Tasks that were added from outside of the pool.
+  std::mutex shared_tasks_mutex_;
+  std::deque<std::function<void()> > shared_tasks_;
+
+  // The number of tasks waiting in any queue, and the number of tasks that
+  // have been added but have not finished yet.
+  std::atomic<int> num_queued_tasks_;
+  std::atomic<int> num_unfinished_tasks_;
+
+  // Idle workers wait for tasks to be queued, and Wait waits for all tasks to
+  // finish.
+  std::mutex mutex_;
+  std::condition_variable task_queued_;
+  std::condition_variable tasks_finished_;
+  bool stop_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkStealingThreadPool);
+};
+
+}  // namespace theia
+
+#endif  // THEIA_UTIL_WORK_STEALING_THREAD_POOL_H_
@@ -0,0 +1,127 @@
+// Copyright (C) 2016 The Regents of the University of California (Regents).
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above
+//       copyright notice, this list of conditions and the following
+//       disclaimer in the documentation and/or other materials provided
+//       with the distribution.
+//
+//     * Neither the name of The Regents or University of California nor the
+//       names of its contributors may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Please contact the author of this library if you have any questions.
+// Author: Chris Sweeney (cmsweeney@cs.ucsb.edu)
+
+#include "theia/util/work_stealing_thread_pool.h"
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace theia {
+
+TEST(WorkStealingThreadPool, RunsTasksAddedByTasks) {
+  static const int kNumThreads = 4;
+  static const int kNumTasks = 1000;
+  WorkStealingThreadPool pool(kNumThreads);
+  EXPECT_EQ(pool.NumThreads(), kNumThreads);
+
+  // Each task adds a second stage that is run after it.
+  std::vector<std::atomic<int> > stages(kNumTasks);
+  for (int i = 0; i < kNumTasks; i++) {
+    stages[i] = 0;
+    pool.Add([&pool, &stages, i]() {
+      EXPECT_EQ(stages[i]++, 0);
+      pool.Add([&stages, i]() { EXPECT_EQ(stages[i]++, 1); });
+    });
+  }
+  pool.Wait();
+  for (int i = 0; i < kNumTasks; i++) {
+    EXPECT_EQ(stages[i], 2);
+  }
+
+  int num_tasks = 0;
+  for (const auto& statistics : pool.GetWorkerStatistics()) {
+    num_tasks += statistics.num_tasks;
+    EXPECT_GE(statistics.busy_time_in_seconds, 0.0);
+  }
+  EXPECT_EQ(num_tasks, 2 * kNumTasks);
+
+  // The pool may be reused after waiting.
+  std::atomic<int> num_finished_tasks(0);
+  for (int i = 0; i < kNumTasks; i++) {
+    pool.Add([&num_finished_tasks]() { ++num_finished_tasks; });
+  }
+  pool.Wait();
+  EXPECT_EQ(num_finished_tasks, kNumTasks);
+}
+
+TEST(WorkStealingThreadPool, WorkerIndexOfThisThread) {
+  static const int kNumThreads = 4;
+  static const int kNumTasks = 100;
+  WorkStealingThreadPool pool(kNumThreads);
+  EXPECT_EQ(pool.WorkerIndexOfThisThread(), -1);
+
+  std::vector<int> worker_indices(kNumTasks, -1);
+  for (int i = 0; i < kNumTasks; i++) {
+    pool.Add([&pool, &worker_indices, i]() {
+      worker_indices[i] = pool.WorkerIndexOfThisThread();
+    });
+  }
+  pool.Wait();
+  for (const int worker_index : worker_indices) {
+    EXPECT_GE(worker_index, 0);
+    EXPECT_LT(worker_index, kNumThreads);
+  }
+}
+
+TEST(WorkStealingThreadPool, IdleWorkersStealTasks) {
+  static const int kNumThreads = 4;
+  static const int kNumTasks = 40;
+  std::atomic<int> num_finished_tasks(0);
+  {
+    WorkStealingThreadPool pool(kNumThreads);
+    // A single task adds all tasks to the queue of its worker, so the other
+    // workers can only run them by stealing.
+    pool.Add([&pool, &num_finished_tasks]() {
+      for (int i = 0; i < kNumTasks; i++) {
+        pool.Add([&num_finished_tasks]() {
+          std::this_thread::sleep_for(std::chrono::milliseconds(2));
+          ++num_finished_tasks;
+        });
+      }
+    });
+    pool.Wait();
+    int num_stolen_tasks = 0;
+    for (const auto& statistics : pool.GetWorkerStatistics()) {
+      num_stolen_tasks += statistics.num_stolen_tasks;
+    }
+    EXPECT_GT(num_stolen_tasks, 0);
+  }
+  EXPECT_EQ(num_finished_tasks, kNumTasks);
+}
+
+}  // namespace theia